@@ -0,0 +1,221 @@
+// bench/bench-decoder.cc
+// wujian@2018
+
+#include <thread>
+
+#include "bench/bench.h"
+#include "decoder/decode-server.h"
+#include "decoder/decoder.h"
+#include "decoder/lockstep-decoder.h"
+
+// 10ms per frame
+const Float64 kFrameSeconds = 0.01;
+
+// Each frame: Clear() the list of last frame, Find() then Insert() successors
+// of num_active random states, Delete() the old ones, as ProcessEmitting()
+template <template <class, class> class HashListT>
+void BenchHashList(const std::string &name, Int32 num_active,
+                   BenchReporter *reporter, Float64 min_seconds) {
+  typedef typename HashListT<Int32, Int32>::Elem Elem;
+  HashListT<Int32, Int32> toks;
+  toks.SetSize(num_active * 2);
+  std::mt19937 generator(num_active);
+  std::uniform_int_distribution<Int32> state(0, 4000000);
+  std::vector<Int32> keys(num_active * 4);
+  for (Int32 &key : keys) key = state(generator);
+  Int64 num_iters;
+  Float64 cost = TimeIt(
+      [&] {
+        Elem *last = toks.Clear();
+        for (Int32 key : keys) {
+          Elem *found = toks.Find(key);
+          if (found)
+            found->val++;
+          else
+            toks.Insert(key, 0);
+        }
+        for (Elem *e = last, *e_tail; e != NULL; e = e_tail) {
+          e_tail = e->tail;
+          toks.Delete(e);
+        }
+      },
+      min_seconds, &num_iters);
+  for (Elem *e = toks.Clear(), *e_tail; e != NULL; e = e_tail) {
+    e_tail = e->tail;
+    toks.Delete(e);
+  }
+  reporter->Report(name, {{"num_finds", keys.size()}}, num_iters, cost);
+}
+
+// RTF of FasterDecoder::Decode() over a sweep of max_active/beam, with exact
+// (nth_element) or histogram cutoff
+void BenchDecode(const DecodeGraph &graph, const std::vector<Float32> &loglikes,
+                 Int32 num_frames, BenchReporter *reporter) {
+  const Int32 max_actives[] = {500, 2000, 7000};
+  const Float32 beams[] = {10.0, 13.0, 16.0};
+  const Int32 histogram_bins[] = {0, 64};
+  Int32 num_pdfs = graph.NumPdfs();
+  for (Int32 bins : histogram_bins) {
+    for (Int32 i = 0; i < 3; i++) {
+      DecodeOpts opts(200, max_actives[i], beams[i]);
+      opts.histogram_bins = bins;
+      FasterDecoder decoder(graph, opts);
+      // counters are recorded only if built with DECODER_PROFILE
+      Profiler profiler;
+      decoder.SetProfiler(&profiler);
+      Timer timer;
+      decoder.Reset();
+      decoder.Decode(const_cast<Float32 *>(loglikes.data()), num_frames,
+                     num_pdfs, num_pdfs);
+      std::vector<Int32> words;
+      decoder.GetBestPath(&words);
+      Float64 cost = timer.Elapsed();
+      std::map<std::string, Float64> metrics = {
+          {"rtf", cost / (num_frames * kFrameSeconds)},
+          {"num_words", words.size()}};
+      if (kProfiling) {
+        metrics["mean_active_tokens"] = profiler.ActiveTokens().Mean();
+        metrics["mean_arcs"] = profiler.Arcs().Mean();
+      }
+      reporter->Report("decode",
+                       {{"max_active", max_actives[i]},
+                        {"beam", beams[i]},
+                        {"histogram_bins", bins},
+                        {"num_frames", num_frames}},
+                       1, cost, metrics);
+    }
+  }
+}
+
+// RTF of one FasterDecoder expanding emitting arcs with 1 to 8 threads, on a
+// wide beam where the arc loop dominates. num_threads is the number of
+// threads used (requested ones are limited to the cores)
+void BenchParallelDecode(const DecodeGraph &graph,
+                         const std::vector<Float32> &loglikes,
+                         Int32 num_frames, BenchReporter *reporter) {
+  Int32 num_pdfs = graph.NumPdfs();
+  std::vector<Int32> ref_words;
+  for (Int32 num_threads = 1; num_threads <= 8; num_threads *= 2) {
+    DecodeOpts opts(200, 20000, 18.0);
+    opts.num_threads = num_threads;
+    FasterDecoder decoder(graph, opts);
+    Timer timer;
+    decoder.Reset();
+    decoder.Decode(const_cast<Float32 *>(loglikes.data()), num_frames,
+                   num_pdfs, num_pdfs);
+    std::vector<Int32> words;
+    decoder.GetBestPath(&words);
+    Float64 cost = timer.Elapsed();
+    if (num_threads == 1) ref_words = words;
+    reporter->Report("decode_parallel",
+                     {{"num_threads", decoder.NumThreads()},
+                      {"requested_threads", num_threads},
+                      {"max_active", opts.max_active},
+                      {"beam", opts.beam},
+                      {"num_frames", num_frames}},
+                     1, cost,
+                     {{"rtf", cost / (num_frames * kFrameSeconds)},
+                      {"same_words", words == ref_words}});
+  }
+}
+
+// Overall RTF of DecodeServer with num_utts utterances, wall time / audio
+void BenchServer(const DecodeGraph &graph, const std::vector<Float32> &loglikes,
+                 Int32 num_frames, Int32 num_utts, BenchReporter *reporter) {
+  Int32 num_pdfs = graph.NumPdfs(),
+        max_workers = std::max(1u, std::thread::hardware_concurrency());
+  DecodeOpts decode_opts(200, 2000, 13.0);
+  for (Int32 num_workers = 1; num_workers <= std::min(max_workers, 8);
+       num_workers *= 2) {
+    DecodeServerOpts server_opts(num_workers);
+    Timer timer;
+    DecodeServer server(graph, decode_opts, server_opts);
+    std::thread producer([&] {
+      for (Int32 u = 0; u < num_utts; u++)
+        server.Submit(std::to_string(u), loglikes.data(), num_frames,
+                      num_pdfs, num_pdfs);
+      server.Close();
+    });
+    DecodeResult result;
+    Int32 num_results = 0;
+    while (server.GetResult(&result)) num_results += result.succeed;
+    producer.join();
+    ASSERT(num_results == num_utts);
+    Float64 cost = timer.Elapsed();
+    reporter->Report(
+        "decode_server",
+        {{"num_workers", num_workers},
+         {"num_utts", num_utts},
+         {"num_frames", num_frames}},
+        1, cost, {{"rtf", cost / (num_utts * num_frames * kFrameSeconds)}});
+  }
+}
+
+// RTF of LockstepDecoder on num_streams streams (sharing the same loglikes),
+// wall time / audio, with 1 to 8 threads
+void BenchLockstep(const DecodeGraph &graph,
+                   const std::vector<Float32> &loglikes, Int32 num_frames,
+                   Int32 num_streams, BenchReporter *reporter) {
+  Int32 num_pdfs = graph.NumPdfs();
+  std::vector<Float32> batch;
+  for (Int32 s = 0; s < num_streams; s++)
+    batch.insert(batch.end(), loglikes.begin(),
+                 loglikes.begin() + num_frames * num_pdfs);
+  for (Int32 num_threads = 1; num_threads <= 8; num_threads *= 2) {
+    DecodeOpts opts(200, 2000, 13.0);
+    opts.num_threads = num_threads;
+    Timer timer;
+    LockstepDecoder decoder(graph, opts);
+    std::vector<Int32> streams(num_streams);
+    for (Int32 &stream : streams) stream = decoder.NewStream();
+    decoder.DecodeFrames(batch.data(), streams.data(), num_streams, num_frames,
+                         num_pdfs, num_pdfs);
+    std::vector<Int32> words;
+    decoder.GetBestPath(streams[0], &words);
+    Float64 cost = timer.Elapsed();
+    reporter->Report(
+        "decode_lockstep",
+        {{"num_threads", num_threads},
+         {"num_streams", num_streams},
+         {"num_frames", num_frames}},
+        1, cost, {{"rtf", cost / (num_streams * num_frames * kFrameSeconds)}});
+  }
+}
+
+int main(int argc, char const *argv[]) {
+  const char *usage =
+      "Benchmark token containers and decoding on synthetic graph and "
+      "loglikes, one JSON record per line on stdout\n"
+      "\n"
+      "Usage: bench-decoder [--quick] [--tag=<tag>]\n";
+  Bool quick;
+  std::string tag;
+  ParseBenchArgs(argc, argv, usage, &quick, &tag);
+  BenchReporter reporter(tag);
+  Float64 min_seconds = quick ? 0.1 : 1.0;
+
+  const Int32 active_sizes[] = {1000, 10000, 50000};
+  for (Int32 num_active : active_sizes) {
+    BenchHashList<HashList>("hash_list", num_active, &reporter, min_seconds);
+    BenchHashList<FlatHashList>("flat_hash_list", num_active, &reporter,
+                                min_seconds);
+  }
+
+  SyntheticGraphOpts graph_opts(quick ? 50000 : 500000);
+  SimpleFst fst;
+  TransitionTable table;
+  Timer timer;
+  GenerateGraph(graph_opts, &fst, &table);
+  DecodeGraph graph(fst, table);
+  LOG_INFO << "Generate graph of " << graph_opts.num_states << " states, cost "
+           << timer.Elapsed() << "s";
+
+  Int32 num_frames = quick ? 300 : 3000;
+  std::vector<Float32> loglikes;
+  GenerateLoglikes(num_frames, graph.NumPdfs(), 1, &loglikes);
+  BenchDecode(graph, loglikes, num_frames, &reporter);
+  BenchParallelDecode(graph, loglikes, num_frames, &reporter);
+  BenchServer(graph, loglikes, num_frames, quick ? 4 : 16, &reporter);
+  BenchLockstep(graph, loglikes, num_frames, quick ? 4 : 16, &reporter);
+  return 0;
+}
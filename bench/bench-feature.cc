@@ -0,0 +1,126 @@
+// bench/bench-feature.cc
+// wujian@2018
+
+#include "bench/bench.h"
+#include "decoder/batch-feature.h"
+#include "decoder/fft-computer.h"
+#include "decoder/signal.h"
+
+void BenchFFT(BenchReporter *reporter, Float64 min_seconds) {
+  const Int32 sizes[] = {256, 512, 1024};
+  const FFTEngine engines[] = {kRadix2FFT, kRadix4FFT};
+  for (Int32 size : sizes) {
+    std::vector<Float32> signal, frame(size);
+    GenerateSignal(size, size, &signal);
+    for (FFTEngine engine : engines) {
+      FFTComputer computer(size, engine);
+      Int64 num_iters;
+      // restore input each time, RealFFT() is in place
+      Float64 cost = TimeIt(
+          [&] {
+            memcpy(frame.data(), signal.data(), sizeof(Float32) * size);
+            computer.RealFFT(frame.data(), size);
+          },
+          min_seconds, &num_iters);
+      reporter->Report(
+          "fft", {{"size", size}, {"radix", engine == kRadix4FFT ? 4 : 2}},
+          num_iters, cost);
+    }
+  }
+}
+
+// Features of num_seconds audio, rtf is cost / num_seconds
+void BenchComputer(const std::string &name, Computer *computer,
+                   Float64 num_seconds, BenchReporter *reporter,
+                   Float64 min_seconds) {
+  Int32 num_samps = num_seconds * 16000;
+  std::vector<Float32> signal, feats;
+  GenerateSignal(num_samps, 7, &signal);
+  Int32 num_frames = computer->NumFrames(num_samps),
+        dim = computer->FeatureDim();
+  feats.resize(num_frames * dim);
+  Int64 num_iters;
+  Float64 cost = TimeIt(
+      [&] {
+        computer->Reset();
+        ComputeFeature(computer, signal.data(), num_samps, feats.data(), dim);
+      },
+      min_seconds, &num_iters);
+  reporter->Report(name, {{"seconds", num_seconds}, {"dim", dim}}, num_iters,
+                   cost,
+                   {{"rtf", cost / num_seconds},
+                    {"per_frame_us", cost / num_frames * 1e6}});
+}
+
+// Same as above, but num_streams signals are computed together by
+// BatchFeatureComputer, rtf is cost / (num_streams * num_seconds)
+void BenchBatchComputer(const std::string &name, const FeatureTables &tables,
+                        Int32 num_streams, Float64 num_seconds,
+                        BenchReporter *reporter, Float64 min_seconds) {
+  Int32 num_samps = num_seconds * 16000;
+  std::vector<std::vector<Float32> > signals(num_streams);
+  std::vector<const Float32 *> signal_ptrs(num_streams);
+  std::vector<Int32> num_samps_vec(num_streams, num_samps),
+      num_frames(num_streams);
+  Int32 frames_per_stream = tables.NumFrames(num_samps),
+        dim = tables.FeatureDim();
+  std::vector<Float32> feats(num_streams * frames_per_stream * dim);
+  std::vector<Float32 *> addrs(num_streams);
+  for (Int32 s = 0; s < num_streams; s++) {
+    GenerateSignal(num_samps, 7 + s, &signals[s]);
+    signal_ptrs[s] = signals[s].data();
+    addrs[s] = feats.data() + s * frames_per_stream * dim;
+  }
+  BatchFeatureComputer computer(tables);
+  Int64 num_iters;
+  Float64 cost = TimeIt(
+      [&] {
+        computer.Compute(signal_ptrs.data(), num_samps_vec.data(),
+                         num_streams, addrs.data(), dim, num_frames.data());
+      },
+      min_seconds, &num_iters);
+  Float64 total_seconds = num_seconds * num_streams;
+  reporter->Report(name,
+                   {{"seconds", num_seconds},
+                    {"dim", dim},
+                    {"streams", num_streams}},
+                   num_iters, cost,
+                   {{"rtf", cost / total_seconds},
+                    {"per_frame_us",
+                     cost / (frames_per_stream * num_streams) * 1e6}});
+}
+
+int main(int argc, char const *argv[]) {
+  const char *usage =
+      "Benchmark FFT and feature computers on synthetic signal, one JSON "
+      "record per line on stdout\n"
+      "\n"
+      "Usage: bench-feature [--quick] [--tag=<tag>]\n";
+  Bool quick;
+  std::string tag;
+  ParseBenchArgs(argc, argv, usage, &quick, &tag);
+  BenchReporter reporter(tag);
+  Float64 min_seconds = quick ? 0.1 : 1.0, num_seconds = quick ? 2 : 10;
+
+  BenchFFT(&reporter, min_seconds);
+
+  SpectrogramOpts spectrogram_opts;
+  SpectrogramComputer spectrogram(spectrogram_opts);
+  BenchComputer("spectrogram", &spectrogram, num_seconds, &reporter,
+                min_seconds);
+  FbankOpts fbank_opts;
+  FbankComputer fbank(fbank_opts);
+  BenchComputer("fbank", &fbank, num_seconds, &reporter, min_seconds);
+  MfccOpts mfcc_opts;
+  MfccComputer mfcc(mfcc_opts);
+  BenchComputer("mfcc", &mfcc, num_seconds, &reporter, min_seconds);
+
+  FeatureTables fbank_tables(fbank_opts), mfcc_tables(mfcc_opts);
+  for (Int32 num_streams : {1, 4, 16}) {
+    BenchBatchComputer("fbank_batch", fbank_tables, num_streams, num_seconds,
+                       &reporter, min_seconds);
+    BenchBatchComputer("mfcc_batch", mfcc_tables, num_streams, num_seconds,
+                       &reporter, min_seconds);
+  }
+  return 0;
+}
@@ -0,0 +1,114 @@
+// bench/bench.cc
+// wujian@2018
+
+#include "bench/bench.h"
+
+void GenerateGraph(const SyntheticGraphOpts &opts, SimpleFst *fst,
+                   TransitionTable *table) {
+  ASSERT(opts.num_states > 1 && opts.num_arcs >= 1 && opts.num_pdfs > 0);
+  ASSERT(fst && table && fst->NumStates() == 0);
+  std::mt19937 generator(opts.seed);
+  std::uniform_real_distribution<Float32> uniform(0, 1), weight(0, 5);
+  Int32 num_tids = opts.num_pdfs * opts.num_tids_per_pdf;
+  std::uniform_int_distribution<Int32> tid(1, num_tids),
+      state(0, opts.num_states - 1), local(1, opts.local_range),
+      word(1, 10000);
+
+  for (Int32 s = 0; s < opts.num_states; s++) fst->AddState();
+  fst->SetStart(0);
+  for (StateId s = 0; s < opts.num_states; s++) {
+    fst->ReserveArcs(s, opts.num_arcs + 1);
+    if (uniform(generator) < opts.epsilon_prob)
+      fst->AddArc(s, Arc(0, uniform(generator) < opts.word_prob
+                                ? word(generator)
+                                : 0,
+                         weight(generator), state(generator)));
+    fst->AddArc(s, Arc(tid(generator), 0, weight(generator) * 0.2, s));
+    for (Int32 a = 1; a < opts.num_arcs; a++) {
+      StateId next = uniform(generator) < opts.local_prob
+                         ? (s + local(generator)) % opts.num_states
+                         : state(generator);
+      Label olabel = uniform(generator) < opts.word_prob ? word(generator) : 0;
+      fst->AddArc(s, Arc(tid(generator), olabel, weight(generator), next));
+    }
+    if (uniform(generator) < 0.01) fst->SetFinal(s, weight(generator));
+  }
+  // table is built by Read(), same as loaded from trans.tab
+  std::vector<Int32> pdfs(num_tids);
+  for (Int32 t = 0; t < num_tids; t++) pdfs[t] = t % opts.num_pdfs;
+  std::shuffle(pdfs.begin(), pdfs.end(), generator);
+  std::stringstream ss;
+  WriteBinaryBasicType(ss, num_tids);
+  WriteBinaryBasicType(ss, opts.num_pdfs);
+  WriteBinary(ss, reinterpret_cast<const char *>(pdfs.data()),
+              sizeof(Int32) * num_tids);
+  table->Read(ss);
+}
+
+void GenerateLoglikes(Int32 num_frames, Int32 num_pdfs, UInt32 seed,
+                      std::vector<Float32> *loglikes, Float32 sharpness) {
+  ASSERT(loglikes && num_frames > 0 && num_pdfs > 0);
+  std::mt19937 generator(seed);
+  std::normal_distribution<Float32> score(0, sharpness);
+  loglikes->resize(static_cast<UInt64>(num_frames) * num_pdfs);
+  for (Int32 t = 0; t < num_frames; t++) {
+    Float32 *row = loglikes->data() + static_cast<UInt64>(t) * num_pdfs;
+    Float32 max_score = -FLOAT32_INF;
+    for (Int32 p = 0; p < num_pdfs; p++) {
+      row[p] = score(generator);
+      max_score = std::max(max_score, row[p]);
+    }
+    Float64 sum = 0;
+    for (Int32 p = 0; p < num_pdfs; p++) sum += std::exp(row[p] - max_score);
+    Float32 log_sum = max_score + std::log(sum);
+    for (Int32 p = 0; p < num_pdfs; p++) row[p] -= log_sum;
+  }
+}
+
+void GenerateSignal(Int32 num_samps, UInt32 seed,
+                    std::vector<Float32> *signal) {
+  ASSERT(signal && num_samps > 0);
+  std::mt19937 generator(seed);
+  std::normal_distribution<Float32> noise(0, 300);
+  signal->resize(num_samps);
+  for (Int32 n = 0; n < num_samps; n++)
+    (*signal)[n] = noise(generator) + 3000 * std::sin(0.05 * n) +
+                   1000 * std::sin(0.37 * n);
+}
+
+void BenchReporter::Report(const std::string &bench,
+                           const std::map<std::string, Float64> &params,
+                           Int64 num_iters, Float64 seconds_per_iter,
+                           const std::map<std::string, Float64> &metrics) {
+  std::ostringstream oss;
+  oss.precision(6);
+  oss << "{\"tag\": \"" << tag_ << "\", \"bench\": \"" << bench
+      << "\", \"params\": {";
+  for (auto iter = params.begin(); iter != params.end(); iter++)
+    oss << (iter == params.begin() ? "" : ", ") << "\"" << iter->first
+        << "\": " << iter->second;
+  oss << "}, \"iters\": " << num_iters << ", \"seconds\": "
+      << seconds_per_iter * num_iters
+      << ", \"per_iter_us\": " << seconds_per_iter * 1e6;
+  for (auto &metric : metrics)
+    oss << ", \"" << metric.first << "\": " << metric.second;
+  oss << "}";
+  os_ << oss.str() << std::endl;
+}
+
+void ParseBenchArgs(int argc, char const *argv[], const char *usage,
+                    Bool *quick, std::string *tag) {
+  *quick = false;
+  tag->clear();
+  for (Int32 i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg == "--quick") {
+      *quick = true;
+    } else if (arg.compare(0, 6, "--tag=") == 0) {
+      *tag = arg.substr(6);
+    } else {
+      std::cerr << usage;
+      LOG_FAIL << "Unknown argument: " << arg;
+    }
+  }
+}
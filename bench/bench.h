@@ -0,0 +1,100 @@
+// bench/bench.h
+// wujian@2018
+
+// Shared by benchmarks: synthetic inputs (fixed seeds, so runs are
+// reproducible without data files) and a reporter of JSON lines, one record
+// per measurement on stdout, egs:
+// {"tag": "3fa1c2e", "bench": "decode", "params": {"max_active": 7000,
+// "beam": 15}, "iters": 1, "seconds": 0.81, "per_iter_us": 810000,
+// "rtf": 0.081}
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <map>
+#include <random>
+
+#include "decoder/common.h"
+#include "decoder/simple-fst.h"
+#include "decoder/transition-table.h"
+
+// Shape of a synthetic graph
+struct SyntheticGraphOpts {
+  Int32 num_states;
+  // Emitting arcs per state, including one self-loop
+  Int32 num_arcs;
+  Int32 num_pdfs;
+  // Each pdf has num_tids_per_pdf transition-ids
+  Int32 num_tids_per_pdf;
+  // Probability of a state having an input epsilon arc, and of an arc having
+  // a word (olabel)
+  Float32 epsilon_prob, word_prob;
+  // Most arcs go to one of the next local_range states (like HMM topologies
+  // in HCLG), others anywhere
+  Int32 local_range;
+  Float32 local_prob;
+  UInt32 seed;
+
+  SyntheticGraphOpts(Int32 num_states = 200000, Int32 num_arcs = 4,
+                     Int32 num_pdfs = 3000)
+      : num_states(num_states),
+        num_arcs(num_arcs),
+        num_pdfs(num_pdfs),
+        num_tids_per_pdf(2),
+        epsilon_prob(0.2),
+        word_prob(0.05),
+        local_range(64),
+        local_prob(0.8),
+        seed(777) {}
+};
+
+// Graph labeled by transition-ids and its table
+void GenerateGraph(const SyntheticGraphOpts &opts, SimpleFst *fst,
+                   TransitionTable *table);
+
+// num_frames x num_pdfs log-posteriors (log softmax of gaussian scores with
+// standard deviation sharpness), row major
+void GenerateLoglikes(Int32 num_frames, Int32 num_pdfs, UInt32 seed,
+                      std::vector<Float32> *loglikes,
+                      Float32 sharpness = 3.0);
+
+// Samples of white noise plus a few tones, in Int16 range
+void GenerateSignal(Int32 num_samps, UInt32 seed, std::vector<Float32> *signal);
+
+// Run func (at least once) until min_seconds passed, return seconds per call
+template <class Func>
+Float64 TimeIt(Func func, Float64 min_seconds, Int64 *num_iters) {
+  Int64 iters = 0;
+  Timer timer;
+  Float64 elapsed = 0;
+  do {
+    func();
+    iters++;
+    elapsed = timer.Elapsed();
+  } while (elapsed < min_seconds);
+  if (num_iters) *num_iters = iters;
+  return elapsed / iters;
+}
+
+class BenchReporter {
+ public:
+  // tag is written in each record, egs: commit id
+  BenchReporter(const std::string &tag, std::ostream &os = std::cout)
+      : tag_(tag), os_(os) {}
+
+  // params and metrics are written as they are (numbers)
+  void Report(const std::string &bench,
+              const std::map<std::string, Float64> &params, Int64 num_iters,
+              Float64 seconds_per_iter,
+              const std::map<std::string, Float64> &metrics = {});
+
+ private:
+  std::string tag_;
+  std::ostream &os_;
+};
+
+// Parse "--quick" and "--tag=<tag>" of argv, LOG_FAIL on others
+void ParseBenchArgs(int argc, char const *argv[], const char *usage,
+                    Bool *quick, std::string *tag);
+
+#endif
@@ -0,0 +1,24 @@
+# Run by "make bench" (cmake -P): tag records by the commit id resolved now,
+# not when cmake was configured, and append them to OUTPUT
+#   SOURCE_DIR: source tree, tag is "unknown" if it is not a git checkout
+#   BENCHES: benchmark executables, separated by ";"
+#   OUTPUT: JSON lines file to append to
+
+execute_process(COMMAND git describe --always --dirty
+                WORKING_DIRECTORY ${SOURCE_DIR}
+                OUTPUT_VARIABLE BENCH_TAG
+                OUTPUT_STRIP_TRAILING_WHITESPACE
+                ERROR_QUIET)
+if(NOT BENCH_TAG)
+  set(BENCH_TAG unknown)
+endif()
+
+foreach(BENCH ${BENCHES})
+  execute_process(COMMAND ${BENCH} --quick --tag=${BENCH_TAG}
+                  OUTPUT_VARIABLE RECORDS
+                  RESULT_VARIABLE RESULT)
+  if(NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "${BENCH} failed: ${RESULT}")
+  endif()
+  file(APPEND ${OUTPUT} "${RECORDS}")
+endforeach()
@@ -0,0 +1,34 @@
+// wujian@2018
+
+#include "decoder/batch-decoder.h"
+
+Int32 BatchDecoder::NewStream() {
+  Int32 stream;
+  if (free_streams_.empty()) {
+    stream = decoders_.size();
+    decoders_.push_back(new FasterDecoder(graph_, opts_));
+    active_.push_back(true);
+  } else {
+    stream = free_streams_.back();
+    free_streams_.pop_back();
+    active_[stream] = true;
+  }
+  decoders_[stream]->Reset();
+  return stream;
+}
+
+void BatchDecoder::FreeStream(Int32 stream) {
+  Decoder(stream);
+  active_[stream] = false;
+  free_streams_.push_back(stream);
+}
+
+void BatchDecoder::DecodeFrames(Float32 *loglikes, const Int32 *streams,
+                                Int32 num_streams, Int32 num_frames,
+                                Int32 stride, Int32 num_pdfs) {
+  ASSERT(num_pdfs <= stride);
+  for (Int32 i = 0; i < num_streams; i++)
+    Decoder(streams[i])
+        ->Decode(loglikes + i * num_frames * stride, num_frames, stride,
+                 num_pdfs);
+}
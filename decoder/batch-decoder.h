@@ -0,0 +1,79 @@
+// wujian@2018
+
+// Decode many streams on one shared graph
+
+#ifndef BATCH_DECODER_H
+#define BATCH_DECODER_H
+
+#include "decoder/common.h"
+#include "decoder/decode-graph.h"
+#include "decoder/decoder.h"
+
+// Each stream is a FasterDecoder on the shared DecodeGraph, which only holds
+// its tokens and hash list. Frames of many streams are fed in one call, which
+// fits acoustic models that compute a batch of streams at once.
+// egs:
+// DecodeGraph graph("graph.fst", "trans.tab");
+// BatchDecoder decoder(graph, DecodeOpts("decode.conf"));
+// Int32 s0 = decoder.NewStream(), s1 = decoder.NewStream();
+// Int32 streams[2] = {s0, s1};
+// // loglikes: 2 x num_frames x num_pdfs
+// decoder.DecodeFrames(loglikes, streams, 2, num_frames, num_pdfs, num_pdfs);
+// decoder.GetBestPath(s0, &word_ids);
+// decoder.FreeStream(s0);
+class BatchDecoder {
+ public:
+  // graph should outlive the decoder
+  BatchDecoder(const DecodeGraph &graph, const DecodeOpts &opts)
+      : graph_(graph), opts_(opts) {}
+
+  ~BatchDecoder() {
+    for (FasterDecoder *decoder : decoders_) delete decoder;
+  }
+
+  // Start a new stream and return its id. Ids (and decoders, with their
+  // token pools) of freed streams are reused
+  Int32 NewStream();
+
+  // Finish stream, do not use its id after this
+  void FreeStream(Int32 stream);
+
+  // Decode num_frames frames for each stream in streams[0: num_streams].
+  // Frames of streams[i] are loglikes[i * num_frames * stride:], one frame per
+  // stride floats
+  void DecodeFrames(Float32 *loglikes, const Int32 *streams, Int32 num_streams,
+                    Int32 num_frames, Int32 stride, Int32 num_pdfs);
+
+  Int32 NumDecodedFrames(Int32 stream) {
+    return Decoder(stream)->NumDecodedFrames();
+  }
+
+  Bool ReachedFinal(Int32 stream) { return Decoder(stream)->ReachedFinal(); }
+
+  Bool GetBestPath(Int32 stream, std::vector<Int32> *word_sequence) {
+    return Decoder(stream)->GetBestPath(word_sequence);
+  }
+
+  Int32 NumActiveStreams() const {
+    return decoders_.size() - free_streams_.size();
+  }
+
+ private:
+  BatchDecoder(const BatchDecoder &) = delete;
+  BatchDecoder &operator=(const BatchDecoder &) = delete;
+
+  FasterDecoder *Decoder(Int32 stream) {
+    if (stream < 0 || stream >= decoders_.size() || !active_[stream])
+      LOG_FAIL << "Stream " << stream << " is not active";
+    return decoders_[stream];
+  }
+
+  const DecodeGraph &graph_;
+  DecodeOpts opts_;
+  // Indexed by stream id
+  std::vector<FasterDecoder *> decoders_;
+  std::vector<Bool> active_;
+  std::vector<Int32> free_streams_;
+};
+
+#endif
@@ -0,0 +1,372 @@
+// wujian@2018
+
+#include "decoder/batch-feature.h"
+#include "decoder/simd.h"
+
+FeatureTables::FeatureTables(const ConfigureTable &conf,
+                             const std::string &type) {
+  ConfigureParser parser(conf);
+  switch (StringToFeatureType(type)) {
+    case kSpectrogram: {
+      SpectrogramOpts spectrogram_opts;
+      spectrogram_opts.ParseConfigure(&parser);
+      Init(spectrogram_opts, NULL, NULL);
+      break;
+    }
+    case kFbank: {
+      FbankOpts fbank_opts;
+      fbank_opts.ParseConfigure(&parser);
+      Init(fbank_opts.spectrogram_opts, &fbank_opts, NULL);
+      break;
+    }
+    case kMfcc: {
+      MfccOpts mfcc_opts;
+      mfcc_opts.ParseConfigure(&parser);
+      Init(mfcc_opts.fbank_opts.spectrogram_opts, &mfcc_opts.fbank_opts,
+           &mfcc_opts);
+      break;
+    }
+    case kUnkown:
+      LOG_FAIL << "Unknown feature type: " << type;
+      break;
+  }
+}
+
+void FeatureTables::Init(const SpectrogramOpts &spectrogram_opts,
+                         const FbankOpts *fbank_opts,
+                         const MfccOpts *mfcc_opts) {
+  if (mfcc_opts) {
+    mfcc_opts->Check();
+    ASSERT(spectrogram_opts.apply_pow && fbank_opts->apply_log);
+  } else if (fbank_opts) {
+    fbank_opts->Check();
+  } else {
+    spectrogram_opts.Check();
+  }
+  type_ = mfcc_opts ? kMfcc : (fbank_opts ? kFbank : kSpectrogram);
+  frame_opts_ = spectrogram_opts.frame_opts;
+  apply_pow_ = spectrogram_opts.apply_pow;
+  apply_log_ = spectrogram_opts.apply_log;
+  use_log_raw_energy_ = spectrogram_opts.use_log_raw_energy;
+  if (fbank_opts) ASSERT(!apply_log_ && !use_log_raw_energy_);
+
+  Int32 frame_length = frame_opts_.frame_length;
+  padding_length_ = RoundUpToNearestPowerOfTwo(frame_length);
+  if (frame_opts_.window_type != kNone) {
+    window_.resize(frame_length);
+    ComputeWindow(frame_length, window_.data(), frame_opts_.window_type);
+  }
+  // same tables as FFTComputer(padding_length_)
+  Int32 n = padding_length_ >> 1;
+  ASSERT(n >= 2);
+  for (Int32 j = 0, i = 0; i < n - 1; i++) {
+    if (i < j) swaps_.push_back(i), swaps_.push_back(j);
+    Int32 m = n >> 1;
+    while (j >= m) {
+      j = j - m;
+      m = m >> 1;
+    }
+    j = j + m;
+  }
+  for (Int32 m = 1; m < n; m <<= 1) {
+    for (Int32 t = 0; t < m; t++) {
+      Int32 k = t * (n / m);
+      twiddles_.push_back(cos(PI * k / n));
+      twiddles_.push_back(sin(PI * k / n));
+    }
+  }
+  cos_table_.resize(n);
+  sin_table_.resize(n);
+  for (Int32 r = 0; r < n; r++) {
+    cos_table_[r] = cos(PI * r / n);
+    sin_table_[r] = sin(PI * r / n);
+  }
+  feature_dim_ = n + 1;
+  fbank_apply_log_ = use_energy_ = false;
+  num_ceps_ = 0;
+  if (!fbank_opts) return;
+
+  Int32 center_freq = frame_opts_.sample_rate >> 1;
+  Int32 upper_bound = fbank_opts->upper_bound > 0
+                          ? fbank_opts->upper_bound
+                          : center_freq + fbank_opts->upper_bound;
+  ComputeMelFilters(n + 1, fbank_opts->num_mel_bins, center_freq,
+                    fbank_opts->lower_bound, upper_bound, &mel_filters_);
+  fbank_apply_log_ = fbank_opts->apply_log;
+  feature_dim_ = fbank_opts->num_mel_bins;
+  if (!mfcc_opts) return;
+
+  num_ceps_ = mfcc_opts->num_ceps;
+  dct_matrix_.resize(num_ceps_ * feature_dim_);
+  ComputeDctMatrix(dct_matrix_.data(), num_ceps_, feature_dim_);
+  Float32 cepstral_lifter = mfcc_opts->cepstral_lifter;
+  if (cepstral_lifter != 0.0) {
+    lifter_coeffs_.resize(num_ceps_);
+    for (Int32 i = 0; i < num_ceps_; i++)
+      lifter_coeffs_[i] =
+          0.5 * cepstral_lifter * sin(PI * i / cepstral_lifter) + 1.0;
+  }
+  use_energy_ = mfcc_opts->use_energy;
+  feature_dim_ = num_ceps_;
+}
+
+BatchFeatureComputer::BatchFeatureComputer(const FeatureTables &tables)
+    : tables_(tables) {
+  frames_.resize(tables_.padding_length_ * kFeatureLanes);
+  spectrum_.resize((tables_.padding_length_ / 2 + 1) * kFeatureLanes);
+  mel_energy_.resize(tables_.mel_filters_.size() * kFeatureLanes);
+}
+
+void BatchFeatureComputer::FrameLanes(const Float32 *const *frames,
+                                      Int32 num_lanes, Float32 *energy) {
+  const FrameOpts &opts = tables_.frame_opts_;
+  Int32 frame_length = opts.frame_length;
+  Float32 *x = frames_.data();
+  for (Int32 n = 0; n < frame_length; n++) {
+    for (Int32 l = 0; l < num_lanes; l++)
+      x[n * kFeatureLanes + l] = frames[l][n];
+    for (Int32 l = num_lanes; l < kFeatureLanes; l++)
+      x[n * kFeatureLanes + l] = 0;
+  }
+  memset(x + frame_length * kFeatureLanes, 0,
+         sizeof(Float32) * (tables_.padding_length_ - frame_length) *
+             kFeatureLanes);
+  if (opts.remove_dc) {
+    Float32x4 sum = Set4(0);
+    for (Int32 n = 0; n < frame_length; n++)
+      sum = Add4(sum, Load4(x + n * kFeatureLanes));
+    Float32 dc[kFeatureLanes];
+    Store4(dc, sum);
+    for (Int32 l = 0; l < kFeatureLanes; l++) dc[l] /= frame_length;
+    Float32x4 dc4 = Load4(dc);
+    for (Int32 n = 0; n < frame_length; n++)
+      Store4(x + n * kFeatureLanes, Sub4(Load4(x + n * kFeatureLanes), dc4));
+  }
+  // raw energy after removing DC
+  Float32x4 sum = Set4(0);
+  for (Int32 n = 0; n < frame_length; n++) {
+    Float32x4 v = Load4(x + n * kFeatureLanes);
+    sum = Add4(sum, Mul4(v, v));
+  }
+  Store4(energy, sum);
+  if (opts.preemph_coeff != 0.0) {
+    Float32x4 coeff = Set4(opts.preemph_coeff);
+    for (Int32 n = frame_length - 1; n > 0; n--)
+      Store4(x + n * kFeatureLanes,
+             Sub4(Load4(x + n * kFeatureLanes),
+                  Mul4(coeff, Load4(x + (n - 1) * kFeatureLanes))));
+    Store4(x, Sub4(Load4(x), Mul4(coeff, Load4(x))));
+  }
+  if (!tables_.window_.empty()) {
+    const Float32 *window = tables_.window_.data();
+    for (Int32 n = 0; n < frame_length; n++)
+      Store4(x + n * kFeatureLanes,
+             Mul4(Load4(x + n * kFeatureLanes), Set4(window[n])));
+  }
+}
+
+// Complex point k of all lanes: real parts at x + k * 8, imaginary parts at
+// x + k * 8 + 4
+void BatchFeatureComputer::ComplexFFTLanes() {
+  const Int32 cplx_stride = 2 * kFeatureLanes;
+  Int32 n = tables_.padding_length_ >> 1;
+  Float32 *x = frames_.data();
+  const std::vector<Int32> &swaps = tables_.swaps_;
+  for (UInt64 k = 0; k < swaps.size(); k += 2) {
+    Float32 *a = x + swaps[k] * cplx_stride,
+            *b = x + swaps[k + 1] * cplx_stride;
+    Float32x4 ar = Load4(a), ai = Load4(a + kFeatureLanes);
+    Store4(a, Load4(b));
+    Store4(a + kFeatureLanes, Load4(b + kFeatureLanes));
+    Store4(b, ar);
+    Store4(b + kFeatureLanes, ai);
+  }
+  const Float32 *twiddles = tables_.twiddles_.data();
+  for (Int32 m = 1; m < n; m <<= 1) {
+    for (Int32 base = 0; base < n; base += 2 * m) {
+      for (Int32 t = 0; t < m; t++) {
+        Float32 *xi = x + (base + t) * cplx_stride, *xj = xi + m * cplx_stride;
+        Float32x4 wr = Set4(twiddles[2 * t]), wi = Set4(twiddles[2 * t + 1]);
+        Float32x4 ri = Load4(xi), ii = Load4(xi + kFeatureLanes),
+                  rj = Load4(xj), ij = Load4(xj + kFeatureLanes);
+        Float32x4 tr = Sub4(Mul4(wr, rj), Mul4(wi, ij)),
+                  ti = Add4(Mul4(wr, ij), Mul4(wi, rj));
+        Store4(xi, Add4(ri, tr));
+        Store4(xi + kFeatureLanes, Add4(ii, ti));
+        Store4(xj, Sub4(ri, tr));
+        Store4(xj + kFeatureLanes, Sub4(ii, ti));
+      }
+    }
+    twiddles += 2 * m;
+  }
+}
+
+void BatchFeatureComputer::SpectrumLanes() {
+  const Int32 cplx_stride = 2 * kFeatureLanes;
+  Int32 n = tables_.padding_length_ >> 1;
+  const Float32 *x = frames_.data();
+  Float32 *spectrum = spectrum_.data();
+  Float32x4 half = Set4(0.5);
+  for (Int32 r = 1; r < n; r++) {
+    const Float32 *y = x + r * cplx_stride, *cy = x + (n - r) * cplx_stride;
+    Float32x4 yr = Load4(y), yi = Load4(y + kFeatureLanes), cyr = Load4(cy),
+              cyi = Load4(cy + kFeatureLanes);
+    // conjugate of point n - r
+    Float32x4 fr = Mul4(Add4(yr, cyr), half), fi = Mul4(Sub4(yi, cyi), half),
+              gr = Mul4(Add4(yi, cyi), half), gi = Mul4(Sub4(cyr, yr), half);
+    Float32x4 cosr = Set4(tables_.cos_table_[r]),
+              sinr = Set4(tables_.sin_table_[r]);
+    Float32x4 xr = Sub4(Add4(fr, Mul4(cosr, gr)), Mul4(sinr, gi)),
+              xi = Add4(Add4(fi, Mul4(cosr, gi)), Mul4(sinr, gr));
+    Store4(spectrum + r * kFeatureLanes, Add4(Mul4(xr, xr), Mul4(xi, xi)));
+  }
+  Float32x4 fr = Load4(x), gr = Load4(x + kFeatureLanes),
+            r0 = Add4(fr, gr), rn = Sub4(fr, gr);
+  Store4(spectrum, Mul4(r0, r0));
+  Store4(spectrum + n * kFeatureLanes, Mul4(rn, rn));
+  if (!tables_.apply_pow_ || tables_.apply_log_) {
+    for (Int32 i = 0; i < (n + 1) * kFeatureLanes; i++) {
+      if (!tables_.apply_pow_) spectrum[i] = sqrtf(spectrum[i]);
+      if (tables_.apply_log_) spectrum[i] = LogFloat32(spectrum[i]);
+    }
+  }
+}
+
+void BatchFeatureComputer::ComputeFrames(const Float32 *const *frames,
+                                         Int32 num_frames,
+                                         Float32 *const *addrs,
+                                         Float32 *raw_energy) {
+  Int32 num_bins = tables_.padding_length_ / 2 + 1,
+        num_mel_bins = tables_.mel_filters_.size(),
+        num_ceps = tables_.num_ceps_;
+  Float32 energy[kFeatureLanes], values[kFeatureLanes];
+  for (Int32 g = 0; g < num_frames; g += kFeatureLanes) {
+    Int32 num_lanes = std::min(kFeatureLanes, num_frames - g);
+    Float32 *const *lane_addrs = addrs + g;
+    FrameLanes(frames + g, num_lanes, energy);
+    if (raw_energy)
+      memcpy(raw_energy + g, energy, sizeof(Float32) * num_lanes);
+    ComplexFFTLanes();
+    SpectrumLanes();
+    const Float32 *spectrum = spectrum_.data();
+    if (tables_.type_ == kSpectrogram) {
+      for (Int32 l = 0; l < num_lanes; l++) {
+        for (Int32 d = 0; d < num_bins; d++)
+          lane_addrs[l][d] = spectrum[d * kFeatureLanes + l];
+        if (tables_.use_log_raw_energy_)
+          lane_addrs[l][0] = LogFloat32(energy[l]);
+      }
+      continue;
+    }
+    // mel-filters, only over nonzero weights
+    Float32 *mel_energy = mel_energy_.data();
+    for (Int32 f = 0; f < num_mel_bins; f++) {
+      const MelFilter &filter = tables_.mel_filters_[f];
+      const Float32 *weights = filter.weights.data(),
+                    *bins = spectrum + filter.offset * kFeatureLanes;
+      Float32x4 sum = Set4(0);
+      for (Int32 k = 0; k < filter.weights.size(); k++)
+        sum = Add4(sum,
+                   Mul4(Load4(bins + k * kFeatureLanes), Set4(weights[k])));
+      Store4(mel_energy + f * kFeatureLanes, sum);
+    }
+    if (tables_.fbank_apply_log_)
+      for (Int32 i = 0; i < num_mel_bins * kFeatureLanes; i++)
+        mel_energy[i] = LogFloat32(mel_energy[i]);
+    if (tables_.type_ == kFbank) {
+      for (Int32 l = 0; l < num_lanes; l++)
+        for (Int32 f = 0; f < num_mel_bins; f++)
+          lane_addrs[l][f] = mel_energy[f * kFeatureLanes + l];
+      continue;
+    }
+    // mfcc = mel_energy * dct_matrix_^T, liftered
+    const Float32 *dct = tables_.dct_matrix_.data();
+    for (Int32 c = 0; c < num_ceps; c++) {
+      Float32x4 sum = Set4(0);
+      for (Int32 j = 0; j < num_mel_bins; j++)
+        sum = Add4(sum, Mul4(Load4(mel_energy + j * kFeatureLanes),
+                             Set4(dct[c * num_mel_bins + j])));
+      if (!tables_.lifter_coeffs_.empty())
+        sum = Mul4(sum, Set4(tables_.lifter_coeffs_[c]));
+      Store4(values, sum);
+      for (Int32 l = 0; l < num_lanes; l++) lane_addrs[l][c] = values[l];
+    }
+    if (tables_.use_energy_)
+      for (Int32 l = 0; l < num_lanes; l++)
+        lane_addrs[l][0] = LogFloat32(energy[l]);
+  }
+}
+
+void BatchFeatureComputer::Compute(const Float32 *const *signals,
+                                   const Int32 *num_samps, Int32 num_signals,
+                                   Float32 *const *addrs, Int32 stride,
+                                   Int32 *num_frames) {
+  ASSERT(FeatureDim() <= stride);
+  Int32 frame_shift = tables_.FrameShift();
+  frame_ptrs_.clear();
+  addr_ptrs_.clear();
+  for (Int32 s = 0; s < num_signals; s++) {
+    num_frames[s] = tables_.NumFrames(num_samps[s]);
+    for (Int32 t = 0; t < num_frames[s]; t++) {
+      frame_ptrs_.push_back(signals[s] + t * frame_shift);
+      addr_ptrs_.push_back(addrs[s] + t * stride);
+    }
+  }
+  ComputeFrames(frame_ptrs_.data(), frame_ptrs_.size(), addr_ptrs_.data(),
+                NULL);
+}
+
+Int32 BatchFeatureComputer::NewStream() {
+  Int32 id;
+  if (free_streams_.empty()) {
+    id = streams_.size();
+    streams_.push_back(new Stream());
+  } else {
+    id = free_streams_.back();
+    free_streams_.pop_back();
+  }
+  Stream *stream = streams_[id];
+  stream->samples.clear();
+  stream->begin = 0;
+  stream->active = true;
+  return id;
+}
+
+void BatchFeatureComputer::FreeStream(Int32 stream) {
+  GetStream(stream)->active = false;
+  free_streams_.push_back(stream);
+}
+
+void BatchFeatureComputer::AcceptWaveform(Int32 stream,
+                                          const Float32 *samples,
+                                          Int32 num_samps) {
+  Stream *s = GetStream(stream);
+  // drop framed samples once they are the most
+  if (s->begin && s->begin >= s->NumSamples()) {
+    s->samples.erase(s->samples.begin(), s->samples.begin() + s->begin);
+    s->begin = 0;
+  }
+  s->samples.insert(s->samples.end(), samples, samples + num_samps);
+}
+
+void BatchFeatureComputer::GetFrames(const Int32 *streams, Int32 num_streams,
+                                     Float32 *const *addrs, Int32 stride,
+                                     Int32 max_frames, Int32 *num_frames) {
+  ASSERT(FeatureDim() <= stride);
+  Int32 frame_shift = tables_.FrameShift();
+  frame_ptrs_.clear();
+  addr_ptrs_.clear();
+  for (Int32 i = 0; i < num_streams; i++) {
+    Stream *s = GetStream(streams[i]);
+    num_frames[i] = std::min(ReadyFrames(streams[i]), max_frames);
+    const Float32 *signal = s->samples.data() + s->begin;
+    for (Int32 t = 0; t < num_frames[i]; t++) {
+      frame_ptrs_.push_back(signal + t * frame_shift);
+      addr_ptrs_.push_back(addrs[i] + t * stride);
+    }
+  }
+  ComputeFrames(frame_ptrs_.data(), frame_ptrs_.size(), addr_ptrs_.data(),
+                NULL);
+  for (Int32 i = 0; i < num_streams; i++)
+    GetStream(streams[i])->begin += num_frames[i] * frame_shift;
+}
@@ -0,0 +1,185 @@
+// wujian@2018
+
+// Compute spectrogram/fbank/mfcc of many streams (egs: channels of a call,
+// concurrent connections) together, with frames of different streams in
+// SIMD lanes
+
+#ifndef BATCH_FEATURE_H
+#define BATCH_FEATURE_H
+
+#include "decoder/common.h"
+#include "decoder/config.h"
+#include "decoder/online.h"
+#include "decoder/signal.h"
+
+// Number of frames computed together, one in each lane of Float32x4
+const Int32 kFeatureLanes = 4;
+
+// Immutable tables of a feature type: window, FFT swaps and twiddles, mel
+// filters, DCT matrix and lifter. Built once from options, shared read-only
+// (among threads too) by any number of BatchFeatureComputer, egs:
+// FeatureTables tables(ConfigureTable("mfcc.conf"), "mfcc");
+// // per thread
+// BatchFeatureComputer computer(tables);
+class FeatureTables {
+ public:
+  FeatureTables(const SpectrogramOpts &opts) { Init(opts, NULL, NULL); }
+
+  FeatureTables(const FbankOpts &opts) {
+    Init(opts.spectrogram_opts, &opts, NULL);
+  }
+
+  FeatureTables(const MfccOpts &opts) {
+    Init(opts.fbank_opts.spectrogram_opts, &opts.fbank_opts, &opts);
+  }
+
+  // Options of type (spectrogram/fbank/mfcc) parsed from conf
+  FeatureTables(const ConfigureTable &conf, const std::string &type);
+
+  FeatureType Type() const { return type_; }
+
+  Int32 FeatureDim() const { return feature_dim_; }
+
+  Int32 FrameLength() const { return frame_opts_.frame_length; }
+
+  Int32 FrameShift() const { return frame_opts_.frame_shift; }
+
+  Int32 SampleRate() const { return frame_opts_.sample_rate; }
+
+  // Number of frames of a whole signal
+  Int32 NumFrames(Int32 num_samps) const {
+    if (num_samps < frame_opts_.frame_length) return 0;
+    return (num_samps - frame_opts_.frame_length) / frame_opts_.frame_shift +
+           1;
+  }
+
+ private:
+  friend class BatchFeatureComputer;
+
+  // fbank_opts and mfcc_opts are NULL if not computed
+  void Init(const SpectrogramOpts &spectrogram_opts,
+            const FbankOpts *fbank_opts, const MfccOpts *mfcc_opts);
+
+  FeatureType type_;
+  FrameOpts frame_opts_;
+  Bool apply_pow_, apply_log_, use_log_raw_energy_;
+  Bool fbank_apply_log_, use_energy_;
+  Int32 padding_length_, feature_dim_;
+  // Empty if window is none
+  std::vector<Float32> window_;
+  // Pairs (i, j), i < j, to swap for bit-reverse permutation of
+  // padding_length_ / 2 complex points
+  std::vector<Int32> swaps_;
+  // Radix-2 stages with half size m = 1, 2, 4 ..., twiddles of stage m are
+  // [cos(0), sin(0), cos(PI / m), sin(PI / m), ...] from m - 1
+  std::vector<Float32> twiddles_;
+  // cos/sin(PI * r / (padding_length_ / 2)) to split RealFFT
+  std::vector<Float32> cos_table_, sin_table_;
+  std::vector<MelFilter> mel_filters_;
+  // num_ceps x num_mel_bins, and liftering coefficients (empty if no lifter)
+  Int32 num_ceps_;
+  std::vector<Float32> dct_matrix_, lifter_coeffs_;
+};
+
+// Features of frames from any streams, kFeatureLanes frames at a time: one
+// frame per lane for every stage (framing, FFT, mel, DCT), so each vector
+// instruction works on kFeatureLanes streams, and tables are loaded once for
+// all of them. Same result as the computers in signal.h (snip edges, no
+// dithering) within float rounding error. Resampling and stages in
+// feature-stage.h are not applied.
+// egs:
+// BatchFeatureComputer computer(tables);
+// Int32 s = computer.NewStream();
+// computer.AcceptWaveform(s, packet, num_samps);
+// computer.GetFrames(streams, num_streams, addrs, stride, max_frames, counts);
+class BatchFeatureComputer {
+ public:
+  // tables should outlive the computer
+  BatchFeatureComputer(const FeatureTables &tables);
+
+  Int32 FeatureDim() const { return tables_.FeatureDim(); }
+
+  // Compute features of num_frames frames, frames[i] points to the raw
+  // samples (FrameLength()) of frame i and its features go to addrs[i]. Raw
+  // energy of each frame goes to raw_energy[i] if not NULL
+  void ComputeFrames(const Float32 *const *frames, Int32 num_frames,
+                     Float32 *const *addrs, Float32 *raw_energy);
+
+  // Whole signals (egs: channels of a wave), frames of signal s are written
+  // to addrs[s] (row stride stride) and counted in num_frames[s]
+  void Compute(const Float32 *const *signals, const Int32 *num_samps,
+               Int32 num_signals, Float32 *const *addrs, Int32 stride,
+               Int32 *num_frames);
+
+  // Start a new stream and return its id, ids of freed streams are reused
+  Int32 NewStream();
+
+  // Finish stream, do not use its id after this
+  void FreeStream(Int32 stream);
+
+  // Append samples of stream
+  void AcceptWaveform(Int32 stream, const Float32 *samples, Int32 num_samps);
+
+  // Number of frames of samples accepted and not taken by GetFrames()
+  Int32 ReadyFrames(Int32 stream) {
+    return tables_.NumFrames(GetStream(stream)->NumSamples());
+  }
+
+  // Compute at most max_frames ready frames of each stream in
+  // streams[0: num_streams] (distinct) together, frames of streams[i] are
+  // written to addrs[i] (row stride stride) and counted in num_frames[i]
+  void GetFrames(const Int32 *streams, Int32 num_streams,
+                 Float32 *const *addrs, Int32 stride, Int32 max_frames,
+                 Int32 *num_frames);
+
+  Int32 NumActiveStreams() const {
+    return streams_.size() - free_streams_.size();
+  }
+
+  ~BatchFeatureComputer() {
+    for (Stream *stream : streams_) delete stream;
+  }
+
+ private:
+  BatchFeatureComputer(const BatchFeatureComputer &) = delete;
+  BatchFeatureComputer &operator=(const BatchFeatureComputer &) = delete;
+
+  struct Stream {
+    // samples[begin:] are not framed yet
+    std::vector<Float32> samples;
+    Int32 begin;
+    Bool active;
+
+    Int32 NumSamples() const { return samples.size() - begin; }
+  };
+
+  Stream *GetStream(Int32 stream) {
+    if (stream < 0 || stream >= streams_.size() || !streams_[stream]->active)
+      LOG_FAIL << "Stream " << stream << " is not active";
+    return streams_[stream];
+  }
+
+  // Frames of all lanes into frames_ (value n of lane l at n * lanes + l),
+  // with DC removed, preemphasized and windowed, raw energy into energy
+  void FrameLanes(const Float32 *const *frames, Int32 num_lanes,
+                  Float32 *energy);
+
+  // In place forward ComplexFFT of frames_, padding_length_ / 2 complex
+  // points in each lane (radix-2, same twiddles as FFTComputer)
+  void ComplexFFTLanes();
+
+  // Split ComplexFFT of frames_ into RealFFT (as FFTComputer::RealFFT()) and
+  // compute spectrum of each lane into spectrum_
+  void SpectrumLanes();
+
+  const FeatureTables &tables_;
+  // Scratch of kFeatureLanes frames, interleaved by lanes
+  std::vector<Float32> frames_, spectrum_, mel_energy_;
+  std::vector<Stream *> streams_;
+  std::vector<Int32> free_streams_;
+  // Frames gathered by Compute() and GetFrames()
+  std::vector<const Float32 *> frame_ptrs_;
+  std::vector<Float32 *> addr_ptrs_;
+};
+
+#endif
@@ -0,0 +1,210 @@
+// wujian@2018
+
+#include "decoder/compact-fst.h"
+
+// ReadBinary()/WriteBinary() accept Int32 bytes, do it in pieces
+template <class T>
+static void WriteArray(std::ostream &os, const std::vector<T> &array) {
+  const UInt64 piece = 1 << 30, num_bytes = array.size() * sizeof(T);
+  const char *ptr = reinterpret_cast<const char *>(array.data());
+  for (UInt64 done = 0; done < num_bytes; done += piece)
+    WriteBinary(os, ptr + done, std::min(piece, num_bytes - done));
+}
+
+template <class T>
+static void ReadArray(std::istream &is, UInt64 size, std::vector<T> *array) {
+  array->resize(size);
+  const UInt64 piece = 1 << 30, num_bytes = size * sizeof(T);
+  char *ptr = reinterpret_cast<char *>(array->data());
+  for (UInt64 done = 0; done < num_bytes; done += piece)
+    ReadBinary(is, ptr + done, std::min(piece, num_bytes - done));
+}
+
+// Number of bits to hold [0, value]
+static UInt32 NumBits(UInt64 value) {
+  UInt32 bits = 1;
+  while (bits < 64 && (value >> bits)) bits++;
+  return bits;
+}
+
+void CompactFst::Reset() {
+  start_ = NoStateId;
+  num_pdfs_ = -1;
+  state_bits_ = label_bits_ = 1;
+  weight_base_ = 0, weight_step_ = 1;
+  num_arcs_ = 0;
+  CompactState sentinel = {0, 0, kWeightInf};
+  states_.assign(1, sentinel);
+  words_.assign(1, 0);
+  olabel_bits_.clear();
+  olabel_rank_.clear();
+  olabels_.clear();
+}
+
+UInt16 CompactFst::EncodeWeight(Weight weight) const {
+  if (std::isinf(weight)) return kWeightInf;
+  Float64 code = std::round((weight - weight_base_) / weight_step_);
+  return static_cast<UInt16>(
+      std::max(0.0, std::min(code, static_cast<Float64>(kWeightInf - 1))));
+}
+
+void CompactFst::Init(const ConstFst &fst) {
+  Reset();
+  UInt64 num_states = fst.NumStates();
+  num_arcs_ = fst.NumArcs();
+  if (num_arcs_ > std::numeric_limits<UInt32>::max())
+    LOG_FAIL << "Too many arcs for CompactFst: " << num_arcs_;
+  start_ = fst.Start();
+  num_pdfs_ = fst.NumPdfs();
+
+  Label max_label = 0;
+  Float32 min_weight = FLOAT32_INF, max_weight = -FLOAT32_INF;
+  for (StateId s = 0; s < static_cast<StateId>(num_states); s++) {
+    Weight final = fst.Final(s);
+    if (!std::isinf(final)) {
+      min_weight = std::min(min_weight, final);
+      max_weight = std::max(max_weight, final);
+    }
+    for (ArcIterator aiter(fst, s); !aiter.Done(); aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      if (arc.ilabel < 0 || arc.nextstate < 0)
+        LOG_FAIL << "Negative ilabel/nextstate in state " << s << ": "
+                 << arc.ToString();
+      max_label = std::max(max_label, arc.ilabel);
+      if (!std::isinf(arc.weight)) {
+        min_weight = std::min(min_weight, arc.weight);
+        max_weight = std::max(max_weight, arc.weight);
+      }
+    }
+  }
+  state_bits_ = NumBits(num_states ? num_states - 1 : 0);
+  label_bits_ = NumBits(max_label);
+  UInt64 arc_bits = state_bits_ + label_bits_ + kWeightBits;
+  if (arc_bits > 64)
+    LOG_FAIL << "Can not pack arcs into 64 bits, " << state_bits_ << " bits "
+             << "for states and " << label_bits_ << " bits for labels";
+  if (min_weight <= max_weight) {
+    weight_base_ = min_weight;
+    weight_step_ = (max_weight - min_weight) / (kWeightInf - 1);
+    if (weight_step_ == 0) weight_step_ = 1;
+  }
+
+  states_.resize(num_states + 1);
+  for (StateId s = 0; s < static_cast<StateId>(num_states); s++) {
+    if (fst.NumInputEpsilons(s) > std::numeric_limits<UInt16>::max())
+      LOG_FAIL << "Too many input epsilon arcs for CompactFst in state " << s
+               << ": " << fst.NumInputEpsilons(s);
+    states_[s].offset = fst.Arcs(s) - fst.Arcs(0);
+    states_[s].niepsilons = fst.NumInputEpsilons(s);
+    states_[s].final = EncodeWeight(fst.Final(s));
+  }
+  states_[num_states].offset = num_arcs_;
+
+  words_.assign((num_arcs_ * arc_bits + 63) / 64 + 1, 0);
+  olabel_bits_.assign((num_arcs_ + 63) / 64, 0);
+  olabel_rank_.assign(olabel_bits_.size(), 0);
+  const Arc *arcs = num_states ? fst.Arcs(0) : NULL;
+  for (UInt64 i = 0; i < num_arcs_; i++) {
+    const Arc &arc = arcs[i];
+    UInt64 code = static_cast<UInt64>(EncodeWeight(arc.weight));
+    code = (code << label_bits_) | arc.ilabel;
+    code = (code << state_bits_) | arc.nextstate;
+    UInt64 bit = i * arc_bits, word = bit >> 6, shift = bit & 63;
+    words_[word] |= code << shift;
+    if (shift + arc_bits > 64) words_[word + 1] |= code >> (64 - shift);
+    if (i % 64 == 0) olabel_rank_[i / 64] = olabels_.size();
+    if (arc.olabel) {
+      olabel_bits_[i / 64] |= 1ULL << (i % 64);
+      olabels_.push_back(arc.olabel);
+    }
+  }
+  LOG_INFO << "Encode decoder graph(CompactFst), " << state_bits_ << " + "
+           << label_bits_ << " + " << kWeightBits << " bits per arc, "
+           << olabels_.size() << " arcs with olabels, weight error <= "
+           << WeightError();
+}
+
+void CompactFst::Write(std::ostream &os) const {
+  CompactFstHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kCompactFstMagic, sizeof(header.magic));
+  header.version = kCompactFstVersion;
+  header.start = start_;
+  header.num_pdfs = num_pdfs_;
+  header.state_bits = state_bits_;
+  header.label_bits = label_bits_;
+  header.weight_base = weight_base_;
+  header.weight_step = weight_step_;
+  header.num_states = NumStates();
+  header.num_arcs = num_arcs_;
+  header.num_words = words_.size();
+  header.num_olabels = olabels_.size();
+  WriteBinary(os, reinterpret_cast<const char *>(&header), sizeof(header));
+  WriteArray(os, states_);
+  WriteArray(os, words_);
+  WriteArray(os, olabel_bits_);
+  WriteArray(os, olabel_rank_);
+  WriteArray(os, olabels_);
+  LOG_INFO << "Write decoder graph(CompactFst), contains " << NumStates()
+           << " states and " << num_arcs_ << " arcs with start index "
+           << start_ << ", " << MemoryUsage() << " bytes";
+}
+
+void CompactFst::Read(std::istream &is) {
+  CompactFstHeader header;
+  ReadBinary(is, reinterpret_cast<char *>(&header), sizeof(header));
+  if (memcmp(header.magic, kCompactFstMagic, sizeof(header.magic)) != 0)
+    LOG_FAIL << "Stream is not in CompactFst format";
+  if (header.version != kCompactFstVersion)
+    LOG_FAIL << "Unsupported CompactFst version " << header.version
+             << ", expect " << kCompactFstVersion;
+  UInt64 arc_bits = header.state_bits + header.label_bits + kWeightBits;
+  if (arc_bits > 64 || header.num_words * 64 < header.num_arcs * arc_bits)
+    LOG_FAIL << "Bad layout of CompactFst, file corrupted?";
+  start_ = header.start;
+  num_pdfs_ = header.num_pdfs;
+  state_bits_ = header.state_bits;
+  label_bits_ = header.label_bits;
+  weight_base_ = header.weight_base;
+  weight_step_ = header.weight_step;
+  num_arcs_ = header.num_arcs;
+  ReadArray(is, header.num_states + 1, &states_);
+  ReadArray(is, header.num_words, &words_);
+  ReadArray(is, (num_arcs_ + 63) / 64, &olabel_bits_);
+  ReadArray(is, (num_arcs_ + 63) / 64, &olabel_rank_);
+  ReadArray(is, header.num_olabels, &olabels_);
+  if (states_[header.num_states].offset != num_arcs_)
+    LOG_FAIL << "Check number of arcs failed, "
+             << states_[header.num_states].offset << " vs " << num_arcs_;
+  LOG_INFO << "Read decoder graph(CompactFst), contains " << NumStates()
+           << " states and " << num_arcs_ << " arcs with start index "
+           << start_;
+}
+
+void CompactFst::Load(const std::string &fname) {
+  Bool is_compact = false;
+  {
+    BinaryInput bi(fname);
+    char magic[sizeof(kCompactFstMagic)];
+    bi.Stream().read(magic, sizeof(magic));
+    is_compact = bi.Stream().gcount() == sizeof(magic) &&
+                 memcmp(magic, kCompactFstMagic, sizeof(magic)) == 0;
+  }
+  if (is_compact) {
+    BinaryInput bi(fname);
+    Read(bi.Stream());
+  } else {
+    ConstFst fst(fname);
+    Init(fst);
+  }
+}
+
+void ReadCompactFst(const std::string &filename, CompactFst *fst) {
+  ASSERT(fst);
+  fst->Load(filename);
+}
+
+void WriteCompactFst(const std::string &filename, const CompactFst &fst) {
+  BinaryOutput bo(filename);
+  fst.Write(bo.Stream());
+}
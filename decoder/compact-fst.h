@@ -0,0 +1,209 @@
+// wujian@2018
+
+// Bit-packed read-only FST for memory limited devices
+
+#ifndef COMPACT_FST_H
+#define COMPACT_FST_H
+
+#include "decoder/common.h"
+#include "decoder/const-fst.h"
+#include "decoder/simple-fst.h"
+
+// Per-state record of CompactFst, arcs of state s are
+// [states[s].offset, states[s + 1].offset), input epsilon arcs first
+struct CompactState {
+  UInt32 offset;
+  UInt16 niepsilons;
+  UInt16 final;  // quantized, see CompactFst
+};
+
+// On-disk layout of CompactFst (native endian):
+// CompactFstHeader | CompactState x (num_states + 1) | UInt64 x num_words |
+// UInt64 x num_olabel_words | UInt32 x num_olabel_words | Label x num_olabels
+const char kCompactFstMagic[8] = {'C', 'O', 'M', 'P', 'A', 'C', 'T', 'F'};
+const UInt32 kCompactFstVersion = 1;
+
+struct CompactFstHeader {
+  char magic[8];
+  UInt32 version;
+  Int32 start;
+  Int32 num_pdfs;
+  UInt32 state_bits, label_bits;
+  Float32 weight_base, weight_step;
+  UInt64 num_states, num_arcs, num_words, num_olabels;
+};
+
+class CompactFst;
+
+// Decodes arcs one by one, used as [begin, end) of ArcRange
+class CompactArcIterator {
+ public:
+  CompactArcIterator(const CompactFst *fst, UInt64 index)
+      : fst_(fst), index_(index) {}
+
+  inline Arc operator*() const;
+
+  CompactArcIterator &operator++() {
+    index_++;
+    return *this;
+  }
+
+  Bool operator!=(const CompactArcIterator &other) const {
+    return index_ != other.index_;
+  }
+
+ private:
+  const CompactFst *fst_;
+  UInt64 index_;
+};
+
+// Lossy but much smaller version of ConstFst. Each arc is packed into
+// state_bits + label_bits + 16 bits (usually 6~7 bytes instead of 16):
+//  nextstate: fixed width, enough for NumStates()
+//  ilabel:    fixed width, enough for the largest transition-id (or pdf-id + 1)
+//  weight:    16 bits, linearly quantized over [min, max] of all arc/final
+//             weights, error no more than weight_step / 2. Infinity is kept
+// Most arcs have no output label, so olabels are kept in a side table: one bit
+// per arc marks the labeled arcs, and the olabel of a marked arc is found by
+// the rank of its bit (a block count every 64 arcs plus a popcount).
+class CompactFst {
+ public:
+  typedef ArcRange<CompactArcIterator> Range;
+
+  CompactFst() { Reset(); }
+
+  CompactFst(const ConstFst &fst) { Init(fst); }
+
+  CompactFst(const SimpleFst &fst) {
+    ConstFst const_fst(fst);
+    Init(const_fst);
+  }
+
+  // Load graph from file, see Load()
+  CompactFst(const std::string &fname) { Load(fname); }
+
+  // Encode from ConstFst
+  void Init(const ConstFst &fst);
+
+  void Write(std::ostream &os) const;
+
+  void Read(std::istream &is);
+
+  // Read if fname is in CompactFst format, otherwise load it as ConstFst
+  // (ConstFst or SimpleFst format) and encode
+  void Load(const std::string &fname);
+
+  Bool IsPdfLabeled() const { return num_pdfs_ >= 0; }
+
+  Int32 NumPdfs() const { return num_pdfs_; }
+
+  StateId Start() const { return start_; }
+
+  Weight Final(StateId state) const {
+    return DecodeWeight(states_[state].final);
+  }
+
+  UInt64 NumStates() const { return states_.size() - 1; }
+
+  UInt64 NumArcs(StateId state) const {
+    return states_[state + 1].offset - states_[state].offset;
+  }
+
+  UInt64 NumArcs() const { return num_arcs_; }
+
+  UInt64 NumInputEpsilons(StateId state) const {
+    return states_[state].niepsilons;
+  }
+
+  // Leading input epsilon arcs of the state
+  Range EpsilonArcs(StateId state) const {
+    UInt64 offset = states_[state].offset;
+    return Range(CompactArcIterator(this, offset),
+                 CompactArcIterator(this, offset + states_[state].niepsilons));
+  }
+
+  // Arcs which consume a frame
+  Range EmittingArcs(StateId state) const {
+    return Range(
+        CompactArcIterator(this, states_[state].offset +
+                                     states_[state].niepsilons),
+        CompactArcIterator(this, states_[state + 1].offset));
+  }
+
+  Range Arcs(StateId state) const {
+    return Range(CompactArcIterator(this, states_[state].offset),
+                 CompactArcIterator(this, states_[state + 1].offset));
+  }
+
+  // Decode index-th arc of the whole graph
+  inline Arc GetArc(UInt64 index) const {
+    UInt64 arc_bits = state_bits_ + label_bits_ + kWeightBits;
+    UInt64 bit = index * arc_bits, word = bit >> 6, shift = bit & 63;
+    UInt64 code = words_[word] >> shift;
+    if (shift + arc_bits > 64) code |= words_[word + 1] << (64 - shift);
+    Arc arc;
+    arc.nextstate = code & ((1ULL << state_bits_) - 1);
+    code >>= state_bits_;
+    arc.ilabel = code & ((1ULL << label_bits_) - 1);
+    code >>= label_bits_;
+    arc.weight = DecodeWeight(code & kWeightMask);
+    UInt64 olabel_word = olabel_bits_[index >> 6], mask = 1ULL << (index & 63);
+    arc.olabel = (olabel_word & mask)
+                     ? olabels_[olabel_rank_[index >> 6] +
+                                __builtin_popcountll(olabel_word & (mask - 1))]
+                     : 0;
+    return arc;
+  }
+
+  // Upper bound of quantization error of weights
+  Float32 WeightError() const { return weight_step_ / 2; }
+
+  // Bytes hold by states, arcs and olabels
+  UInt64 MemoryUsage() const {
+    return states_.size() * sizeof(CompactState) +
+           words_.size() * sizeof(UInt64) +
+           olabel_bits_.size() * (sizeof(UInt64) + sizeof(UInt32)) +
+           olabels_.size() * sizeof(Label);
+  }
+
+ private:
+  CompactFst(const CompactFst &) = delete;
+  CompactFst &operator=(const CompactFst &) = delete;
+
+  static const UInt32 kWeightBits = 16, kWeightMask = 0xffff,
+                      kWeightInf = 0xffff;
+
+  void Reset();
+
+  inline Weight DecodeWeight(UInt32 code) const {
+    return code == kWeightInf ? TROPICAL_ZERO32
+                              : weight_base_ + code * weight_step_;
+  }
+
+  UInt16 EncodeWeight(Weight weight) const;
+
+  StateId start_;
+  Int32 num_pdfs_;
+  UInt32 state_bits_, label_bits_;
+  Float32 weight_base_, weight_step_;
+  UInt64 num_arcs_;
+  // NumStates() + 1 items, the last one is a sentinel
+  std::vector<CompactState> states_;
+  // Packed arcs, one more word as padding
+  std::vector<UInt64> words_;
+  // One bit per arc, set if it has olabel, and number of set bits before
+  // each word
+  std::vector<UInt64> olabel_bits_;
+  std::vector<UInt32> olabel_rank_;
+  std::vector<Label> olabels_;
+};
+
+inline Arc CompactArcIterator::operator*() const {
+  return fst_->GetArc(index_);
+}
+
+void ReadCompactFst(const std::string &filename, CompactFst *fst);
+
+void WriteCompactFst(const std::string &filename, const CompactFst &fst);
+
+#endif
@@ -0,0 +1,92 @@
+// wujian@2018
+
+#include "decoder/compose-fst.h"
+
+ComposeFst::ComposeFst(const DecodeGraph &hcl, const ConstFst &g,
+                       UInt64 max_cached_arcs, UInt64 max_states)
+    : hcl_(hcl.Fst()),
+      g_(g),
+      max_cached_arcs_(max_cached_arcs),
+      max_states_(max_states),
+      num_cached_arcs_(0) {
+  if (hcl_.Start() == NoStateId || g_.Start() == NoStateId)
+    LOG_FAIL << "Compose with empty HCL or G";
+  for (StateId s = 0; s < static_cast<StateId>(g_.NumStates()); s++) {
+    const Arc *arcs = g_.Arcs(s);
+    for (UInt64 i = g_.NumInputEpsilons(s) + 1; i < g_.NumArcs(s); i++)
+      if (arcs[i - 1].ilabel > arcs[i].ilabel)
+        LOG_FAIL << "Arcs of G are not sorted by ilabel in state " << s;
+  }
+  start_ = FindOrAddState(hcl_.Start(), g_.Start());
+}
+
+StateId ComposeFst::FindOrAddState(StateId hcl_state, StateId g_state) const {
+  UInt64 key = (static_cast<UInt64>(hcl_state) << 32) |
+               static_cast<UInt32>(g_state);
+  auto iter = state_ids_.find(key);
+  if (iter != state_ids_.end()) return iter->second;
+  StateId state = states_.size();
+  states_.push_back(ComposeState());
+  ComposeState &cur = states_.back();
+  cur.hcl_state = hcl_state, cur.g_state = g_state;
+  cur.expanded = false;
+  cur.niepsilons = 0;
+  state_ids_[key] = state;
+  return state;
+}
+
+Bool ComposeFst::Shrink() const {
+  if (states_.size() <= max_states_) return false;
+  std::vector<ComposeState>().swap(states_);
+  std::unordered_map<UInt64, StateId>().swap(state_ids_);
+  num_cached_arcs_ = 0;
+  // start state gets the same id (0) again
+  FindOrAddState(hcl_.Start(), g_.Start());
+  return true;
+}
+
+void ComposeFst::ExpandState(StateId state) const {
+  if (num_cached_arcs_ > max_cached_arcs_) {
+    for (ComposeState &cur : states_) {
+      std::vector<Arc>().swap(cur.arcs);
+      cur.expanded = false;
+    }
+    num_cached_arcs_ = 0;
+  }
+  // states_ may grow below, do not keep reference
+  StateId hcl_state = states_[state].hcl_state,
+          g_state = states_[state].g_state;
+  epsilon_arcs_.clear();
+  emitting_arcs_.clear();
+  const Arc *g_begin = g_.Arcs(g_state) + g_.NumInputEpsilons(g_state),
+            *g_end = g_.Arcs(g_state) + g_.NumArcs(g_state);
+  const Arc *hcl_arcs = hcl_.Arcs(hcl_state);
+  for (UInt64 i = 0; i < hcl_.NumArcs(hcl_state); i++) {
+    const Arc &arc = hcl_arcs[i];
+    std::vector<Arc> &arcs = arc.ilabel ? emitting_arcs_ : epsilon_arcs_;
+    if (arc.olabel == 0) {
+      arcs.push_back(Arc(arc.ilabel, 0, arc.weight,
+                         FindOrAddState(arc.nextstate, g_state)));
+      continue;
+    }
+    // G arcs with same word
+    const Arc *match = std::lower_bound(
+        g_begin, g_end, arc.olabel,
+        [](const Arc &g_arc, Label word) { return g_arc.ilabel < word; });
+    for (; match != g_end && match->ilabel == arc.olabel; match++)
+      arcs.push_back(
+          Arc(arc.ilabel, arc.olabel, arc.weight + match->weight,
+              FindOrAddState(arc.nextstate, match->nextstate)));
+  }
+  for (const Arc &g_arc : g_.EpsilonArcs(g_state))
+    epsilon_arcs_.push_back(Arc(0, g_arc.olabel, g_arc.weight,
+                                FindOrAddState(hcl_state, g_arc.nextstate)));
+
+  ComposeState &cur = states_[state];
+  cur.niepsilons = epsilon_arcs_.size();
+  cur.arcs.reserve(epsilon_arcs_.size() + emitting_arcs_.size());
+  cur.arcs.assign(epsilon_arcs_.begin(), epsilon_arcs_.end());
+  cur.arcs.insert(cur.arcs.end(), emitting_arcs_.begin(), emitting_arcs_.end());
+  cur.expanded = true;
+  num_cached_arcs_ += cur.arcs.size();
+}
@@ -0,0 +1,117 @@
+// wujian@2018
+
+// On-the-fly composition of HCL and G
+
+#ifndef COMPOSE_FST_H
+#define COMPOSE_FST_H
+
+#include <unordered_map>
+
+#include "decoder/common.h"
+#include "decoder/const-fst.h"
+#include "decoder/decode-graph.h"
+
+// Lazy HCL o G, so the huge static HCLG is not needed. States of the result
+// are pairs of (HCL state, G state), numbered in the order they are reached,
+// and arcs of a state are expanded when the decoder first walks them:
+//  1) HCL arcs without olabel move in HCL only
+//  2) HCL arcs with word olabel are matched with arcs of the same ilabel in G,
+//     weights are added
+//  3) input epsilon arcs of G (backoff) move in G only
+// Arcs are still kept epsilon first, so it could be used by FasterDecoderTpl
+// as ConstFst. The expanded arcs are cached, and dropped all at once if there
+// are more than max_cached_arcs of them (state ids are kept, the arcs would
+// be expanded again). The states reached are kept across utterances, until
+// there are more than max_states of them: then Shrink(), called by the
+// decoder on Reset(), drops them all with the arcs.
+//
+// HCL is a checked DecodeGraph, shared by any number of ComposeFst, so is G.
+// Arcs of G must be sorted by ilabel (fstarcsort --sort_type=ilabel), and
+// backoff arcs should be epsilon (#0 replaced by 0). The cache is not thread
+// safe, use one ComposeFst per decoder.
+// No label lookahead here: word costs of G are applied where HCL emits the
+// word label.
+class ComposeFst {
+ public:
+  typedef ArcRange<const Arc *> Range;
+
+  ComposeFst(const DecodeGraph &hcl, const ConstFst &g,
+             UInt64 max_cached_arcs = 1 << 22, UInt64 max_states = 1 << 20);
+
+  Bool IsPdfLabeled() const { return hcl_.IsPdfLabeled(); }
+
+  Int32 NumPdfs() const { return hcl_.NumPdfs(); }
+
+  StateId Start() const { return start_; }
+
+  Weight Final(StateId state) const {
+    const ComposeState &cur = states_[state];
+    return hcl_.Final(cur.hcl_state) + g_.Final(cur.g_state);
+  }
+
+  // Number of states reached so far
+  UInt64 NumStates() const { return states_.size(); }
+
+  UInt64 NumInputEpsilons(StateId state) const {
+    Expand(state);
+    return states_[state].niepsilons;
+  }
+
+  Range EpsilonArcs(StateId state) const {
+    Expand(state);
+    const ComposeState &cur = states_[state];
+    return Range(cur.arcs.data(), cur.arcs.data() + cur.niepsilons);
+  }
+
+  Range EmittingArcs(StateId state) const {
+    Expand(state);
+    const ComposeState &cur = states_[state];
+    return Range(cur.arcs.data() + cur.niepsilons,
+                 cur.arcs.data() + cur.arcs.size());
+  }
+
+  // Number of arcs in cache
+  UInt64 NumCachedArcs() const { return num_cached_arcs_; }
+
+  // Drop all the states and arcs if more than max_states states are reached,
+  // return true if so. State ids given before are invalid then (except the
+  // start state), so call it only between utterances
+  Bool Shrink() const;
+
+  // Bytes hold by states and cached arcs (not including HCL and G)
+  UInt64 MemoryUsage() const {
+    return states_.size() * (sizeof(ComposeState) + 2 * sizeof(UInt64)) +
+           num_cached_arcs_ * sizeof(Arc);
+  }
+
+ private:
+  ComposeFst(const ComposeFst &) = delete;
+  ComposeFst &operator=(const ComposeFst &) = delete;
+
+  struct ComposeState {
+    StateId hcl_state, g_state;
+    Bool expanded;
+    UInt32 niepsilons;
+    std::vector<Arc> arcs;
+  };
+
+  // State id of (hcl_state, g_state), add one if not reached before
+  StateId FindOrAddState(StateId hcl_state, StateId g_state) const;
+
+  inline void Expand(StateId state) const {
+    if (!states_[state].expanded) ExpandState(state);
+  }
+
+  void ExpandState(StateId state) const;
+
+  const ConstFst &hcl_, &g_;
+  StateId start_;
+  UInt64 max_cached_arcs_, max_states_;
+  // Cache, modified by const methods
+  mutable std::vector<ComposeState> states_;
+  mutable std::unordered_map<UInt64, StateId> state_ids_;
+  mutable UInt64 num_cached_arcs_;
+  mutable std::vector<Arc> epsilon_arcs_, emitting_arcs_;
+};
+
+#endif
@@ -2,34 +2,12 @@
 
 #include "decoder/config.h"
 
-void ConfigureParser::LoadConfigure() {
-  while (!conf_stream_.eof()) {
-    std::string line;
-    std::getline(conf_stream_, line);
-    StripString(&line);
-    // comment or space line
-    if (line[0] == '#' || !line.size()) continue;
-    std::string::iterator space_iter = std::find(line.begin(), line.end(), ' ');
-    std::string::iterator equal_iter = std::find(line.begin(), line.end(), '=');
-    if (space_iter != line.end() || equal_iter == line.end() ||
-        line.substr(0, 2) != "--")
-      LOG_FAIL << "Wrong configure line: \'" << line << "\'";
-    if (std::count(line.begin(), line.end(), '=') != 1)
-      LOG_FAIL << "Wrong configure line: \'" << line << "\'";
-    Int32 point_pos = line.find_first_of("."),
-          equal_pos = line.find_first_of("=");
-    std::string conf_name = line.substr(2, point_pos - 2),
-                arg_name =
-                    line.substr(point_pos + 1, equal_pos - point_pos - 1),
-                arg_value = line.substr(equal_pos + 1, line.size() - equal_pos);
-    table_[conf_name].push_back(std::make_pair(arg_name, arg_value));
-    std::string key = "--" + conf_name + "." + arg_name;
-    if (status_.count(key)) LOG_FAIL << "Duplicated key " << key << " existed";
-    status_[key] = false;
-  }
-}
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
 
-void ConfigureParser::StripString(std::string *str) {
+// Like python's strip()
+static void StripString(std::string *str) {
   ASSERT(str && "String point is NULL!");
   const char *white_chars = " \t\n\r\f";
   Int32 last = str->find_last_not_of(white_chars);
@@ -43,74 +21,115 @@ void ConfigureParser::StripString(std::string *str) {
   }
 }
 
-std::string ConfigureParser::Configure() {
-  std::ostringstream oss;
-  for (ConfigureMap::iterator it = table_.begin(); it != table_.end(); it++) {
-    const std::string &opt = it->first;
-    const std::vector<std::pair<std::string, std::string> > &vec = it->second;
-    for (std::pair<std::string, std::string> p : vec) {
-      oss << "--" << opt << "." << p.first << "=" << p.second << std::endl;
-    }
+static Bool ConvertValue(const std::string &str, Float32 *value) {
+  const char *begin = str.c_str();
+  char *end = NULL;
+  errno = 0;
+  Float32 v = strtof(begin, &end);
+  if (str.empty() || end != begin + str.size() || errno == ERANGE)
+    return false;
+  *value = v;
+  return true;
+}
+
+static Bool ConvertValue(const std::string &str, Int32 *value) {
+  const char *begin = str.c_str();
+  char *end = NULL;
+  errno = 0;
+  long v = strtol(begin, &end, 10);
+  if (str.empty() || end != begin + str.size() || errno == ERANGE ||
+      v != static_cast<Int32>(v))
+    return false;
+  *value = v;
+  return true;
+}
+
+static Bool ConvertValue(const std::string &str, Bool *value) {
+  if (str != "true" && str != "false") return false;
+  *value = str == "true";
+  return true;
+}
+
+ConfigureTable::ConfigureTable(const std::string &conf) {
+  std::ifstream is(conf);
+  if (!is.is_open()) LOG_FAIL << "Open configure file " << conf << " failed";
+  LoadConfigure(is, conf);
+}
+
+ConfigureTable::ConfigureTable(std::istream &is, const std::string &name) {
+  LoadConfigure(is, name);
+}
+
+void ConfigureTable::LoadConfigure(std::istream &is, const std::string &name) {
+  std::string line;
+  while (std::getline(is, line)) {
+    StripString(&line);
+    // comment or space line
+    if (!line.size() || line[0] == '#') continue;
+    if (std::find(line.begin(), line.end(), ' ') != line.end() ||
+        std::count(line.begin(), line.end(), '=') != 1 ||
+        line.substr(0, 2) != "--")
+      LOG_FAIL << "Wrong configure line in " << name << ": \'" << line << "\'";
+    Int32 equal_pos = line.find_first_of("=");
+    std::string key = line.substr(2, equal_pos - 2);
+    if (key.find('.') == std::string::npos)
+      LOG_FAIL << "Wrong configure line in " << name << ": \'" << line << "\'";
+    if (!index_.insert(std::make_pair(key, options_.size())).second)
+      LOG_FAIL << "Duplicated key --" << key << " existed";
+    options_.push_back(std::make_pair(key, line.substr(equal_pos + 1)));
   }
+}
+
+Int32 ConfigureTable::Find(const std::string &opt,
+                           const std::string &name) const {
+  std::unordered_map<std::string, Int32>::const_iterator it =
+      index_.find(opt + "." + name);
+  return it == index_.end() ? -1 : it->second;
+}
+
+std::string ConfigureTable::Configure() const {
+  std::ostringstream oss;
+  for (const std::pair<std::string, std::string> &p : options_)
+    oss << "--" << p.first << "=" << p.second << std::endl;
   return oss.str();
 }
 
+Int32 ConfigureParser::Lookup(const std::string &opt,
+                              const std::string &name) {
+  Int32 index = table_->Find(opt, name);
+  if (index >= 0) used_[index] = true;
+  return index;
+}
+
 void ConfigureParser::AddOptions(const std::string &opt,
                                  const std::string &name, Float32 *value) {
-  if (!table_.count(opt)) return;
-  const std::vector<std::pair<std::string, std::string> > &vec = table_[opt];
-  for (std::pair<std::string, std::string> p : vec) {
-    if (p.first == name) {
-      *value = std::stof(p.second);
-      std::string key = "--" + opt + "." + name;
-      status_[key] = true;
-      break;
-    }
-  }
+  Int32 index = Lookup(opt, name);
+  if (index < 0) return;
+  if (!ConvertValue(table_->Value(index), value))
+    LOG_FAIL << "Invalid value for Float32 type: " << table_->Key(index) << "="
+             << table_->Value(index);
 }
 
 void ConfigureParser::AddOptions(const std::string &opt,
                                  const std::string &name, Int32 *value) {
-  if (!table_.count(opt)) return;
-  const std::vector<std::pair<std::string, std::string> > &vec = table_[opt];
-  for (std::pair<std::string, std::string> p : vec) {
-    if (p.first == name) {
-      *value = std::stoi(p.second);
-      std::string key = "--" + opt + "." + name;
-      status_[key] = true;
-      break;
-    }
-  }
+  Int32 index = Lookup(opt, name);
+  if (index < 0) return;
+  if (!ConvertValue(table_->Value(index), value))
+    LOG_FAIL << "Invalid value for Int32 type: " << table_->Key(index) << "="
+             << table_->Value(index);
 }
 
 void ConfigureParser::AddOptions(const std::string &opt,
                                  const std::string &name, Bool *value) {
-  if (!table_.count(opt)) return;
-  const std::vector<std::pair<std::string, std::string> > &vec = table_[opt];
-  for (std::pair<std::string, std::string> p : vec) {
-    if (p.first == name) {
-      if (p.second != "true" && p.second != "false")
-        LOG_FAIL << "Invalid value for Bool type: " << p.second;
-      if (p.second == "true") *value = true;
-      if (p.second == "false") *value = false;
-      std::string key = "--" + opt + "." + name;
-      status_[key] = true;
-      break;
-    }
-  }
+  Int32 index = Lookup(opt, name);
+  if (index < 0) return;
+  if (!ConvertValue(table_->Value(index), value))
+    LOG_FAIL << "Invalid value for Bool type: " << table_->Key(index) << "="
+             << table_->Value(index);
 }
 
 void ConfigureParser::AddOptions(const std::string &opt,
                                  const std::string &name, std::string *value) {
-  if (!table_.count(opt)) return;
-  const std::vector<std::pair<std::string, std::string> > &vec = table_[opt];
-  for (std::pair<std::string, std::string> p : vec) {
-    if (p.first == name) {
-      value->clear();
-      value->assign(p.second);
-      std::string key = "--" + opt + "." + name;
-      status_[key] = true;
-      break;
-    }
-  }
-}
\ No newline at end of file
+  Int32 index = Lookup(opt, name);
+  if (index >= 0) value->assign(table_->Value(index));
+}
@@ -3,32 +3,74 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
-#include <map>
+#include <unordered_map>
 #include "decoder/common.h"
 
 // Parse configure for acoustic feature because there are too many parameters
 
+// Lines of a configure file ("--Opts.name=value"), parsed once and kept in
+// memory. It is read-only after construction, so one table could be shared
+// (even among threads) by any number of ConfigureParser, egs:
+// ConfigureTable table("decode.conf");
+// // per request, no file access
+// DecodeOpts opts(table);
+class ConfigureTable {
+ public:
+  explicit ConfigureTable(const std::string &conf);
+
+  // Configure lines from a stream, name is used in error messages
+  ConfigureTable(std::istream &is, const std::string &name);
+
+  Int32 NumOptions() const { return options_.size(); }
+
+  // Index of option --opt.name, -1 if not present
+  Int32 Find(const std::string &opt, const std::string &name) const;
+
+  // "--opt.name" of option index
+  std::string Key(Int32 index) const { return "--" + options_[index].first; }
+
+  const std::string &Value(Int32 index) const {
+    return options_[index].second;
+  }
+
+  // Configure lines in file order
+  std::string Configure() const;
+
+ private:
+  // Load configure from stream
+  void LoadConfigure(std::istream &is, const std::string &name);
+
+  // "opt.name" and value of each line
+  std::vector<std::pair<std::string, std::string> > options_;
+  // "opt.name" => index in options_
+  std::unordered_map<std::string, Int32> index_;
+};
+
+// Fill options from a ConfigureTable, each value is checked against the type
+// of the option it is registered to, and LOG_FAIL if it does not convert
+// exactly (egs: "15abc" for Float32, "1" for Bool)
 class ConfigureParser {
  public:
+  // Parse file conf, for objects created once
   ConfigureParser(const std::string &conf)
-      : conf_path_(conf), conf_stream_(conf, std::ios::in) {
-    if (!conf_stream_.is_open())
-      LOG_FAIL << "Open configure file " << conf_path_ << " failed";
-    LoadConfigure();
-  }
+      : own_table_(new ConfigureTable(conf)),
+        table_(own_table_),
+        used_(table_->NumOptions(), false) {}
+
+  // Use a parsed table, which should outlive the parser
+  ConfigureParser(const ConfigureTable &table)
+      : own_table_(NULL), table_(&table), used_(table_->NumOptions(), false) {}
 
   // TODO: handle unprocessed values --DONE
   ~ConfigureParser() {
-    if (conf_stream_.is_open()) conf_stream_.close();
-    for (std::map<std::string, bool>::iterator p = status_.begin();
-         p != status_.end(); p++) {
-      if (!p->second)
-        LOG_WARN << "Options \"" << p->first << "\" haven't been used, seems "
-                 << "using incorrect feature type";
+    for (Int32 i = 0; i < used_.size(); i++) {
+      if (!used_[i])
+        LOG_WARN << "Options \"" << table_->Key(i) << "\" haven't been used, "
+                 << "seems using incorrect feature type";
     }
+    if (own_table_) delete own_table_;
   }
 
-  // Could be optimized
   void AddOptions(const std::string &opt, const std::string &name,
                   Float32 *value);
 
@@ -41,25 +83,19 @@ class ConfigureParser {
                   std::string *value);
 
   // Generate configures
-  std::string Configure();
+  std::string Configure() { return table_->Configure(); }
 
  private:
-  typedef std::map<std::string,
-                   std::vector<std::pair<std::string, std::string> > >
-      ConfigureMap;
-
-  // Load configure from file stream
-  void LoadConfigure();
-
-  // Like python's strip()
-  void StripString(std::string *str);
+  ConfigureParser(const ConfigureParser &) = delete;
+  ConfigureParser &operator=(const ConfigureParser &) = delete;
 
-  std::string conf_path_;
-  std::fstream conf_stream_;
+  // Index of option --opt.name marked as used, -1 if not present
+  Int32 Lookup(const std::string &opt, const std::string &name);
 
-  ConfigureMap table_;
+  ConfigureTable *own_table_;
+  const ConfigureTable *table_;
   // To track unregisted values
-  std::map<std::string, bool> status_;
+  std::vector<Bool> used_;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,221 @@
+// wujian@2018
+
+#include "decoder/const-fst.h"
+
+static UInt64 AlignOffset(UInt64 offset) {
+  return (offset + kConstFstAlign - 1) / kConstFstAlign * kConstFstAlign;
+}
+
+static void WritePadding(std::ostream &os, UInt64 cur, UInt64 target) {
+  const char zeros[kConstFstAlign] = {0};
+  ASSERT(target >= cur && target - cur < kConstFstAlign);
+  if (target > cur) WriteBinary(os, zeros, target - cur);
+}
+
+void ConstFst::SetPointers() {
+  if (mapped_) {
+    delete mapped_;
+    mapped_ = NULL;
+  }
+  if (own_states_.empty()) {
+    ConstState sentinel = {TROPICAL_ZERO32, 0, 0};
+    own_states_.push_back(sentinel);
+    start_ = NoStateId;
+  }
+  num_states_ = own_states_.size() - 1;
+  num_arcs_ = own_arcs_.size();
+  states_ = own_states_.data();
+  arcs_ = own_arcs_.data();
+}
+
+void ConstFst::PartitionArcs() {
+  std::vector<Arc> emitting;
+  for (UInt64 s = 0; s + 1 < own_states_.size(); s++) {
+    Arc *begin = own_arcs_.data() + own_states_[s].offset,
+        *end = own_arcs_.data() + own_states_[s + 1].offset, *eps = begin;
+    emitting.clear();
+    for (Arc *arc = begin; arc != end; arc++) {
+      if (arc->ilabel == 0)
+        *eps++ = *arc;
+      else
+        emitting.push_back(*arc);
+    }
+    own_states_[s].niepsilons = eps - begin;
+    std::copy(emitting.begin(), emitting.end(), eps);
+  }
+}
+
+void ConstFst::Init(const SimpleFst &fst) {
+  start_ = fst.Start();
+  num_pdfs_ = -1;
+  UInt64 num_states = fst.NumStates(), num_arcs = 0;
+  for (StateIterator siter(fst); !siter.Done(); siter.Next())
+    num_arcs += fst.NumArcs(siter.Value());
+  own_states_.clear();
+  own_arcs_.clear();
+  own_states_.resize(num_states + 1);
+  own_arcs_.reserve(num_arcs);
+  for (StateIterator siter(fst); !siter.Done(); siter.Next()) {
+    StateId state = siter.Value();
+    ConstState &cur = own_states_[state];
+    cur.final = fst.Final(state);
+    cur.offset = own_arcs_.size();
+    for (ArcIterator aiter(fst, state); !aiter.Done(); aiter.Next())
+      own_arcs_.push_back(aiter.Value());
+  }
+  own_states_[num_states].final = TROPICAL_ZERO32;
+  own_states_[num_states].niepsilons = 0;
+  own_states_[num_states].offset = own_arcs_.size();
+  PartitionArcs();
+  SetPointers();
+}
+
+void ConstFst::Read(std::istream &is) {
+  ReadBinaryBasicType(is, &start_);
+  num_pdfs_ = -1;
+  Int64 num_states = 0, num_arcs = 0;
+  ReadBinaryBasicType(is, &num_states);
+  ReadBinaryBasicType(is, &num_arcs);
+  LOG_INFO << "Read decoder graph, contains " << num_states << " states and "
+           << num_arcs << " arcs with start index " << start_;
+  own_states_.resize(num_states + 1);
+  own_arcs_.resize(num_arcs);
+  Int64 state_num_arcs, check_num_arcs = 0;
+  for (Int32 state_id = 0; state_id < num_states; state_id++) {
+    ConstState &cur = own_states_[state_id];
+    ReadBinaryBasicType(is, &cur.final);
+    ReadBinaryBasicType(is, &state_num_arcs);
+    if (check_num_arcs + state_num_arcs > num_arcs)
+      LOG_FAIL << "Number of arcs exceed " << num_arcs << " in state "
+               << state_id;
+    cur.offset = check_num_arcs;
+    for (Int32 i = 0; i < state_num_arcs; i++)
+      ReadBinaryArc(is, &own_arcs_[check_num_arcs + i]);
+    check_num_arcs += state_num_arcs;
+  }
+  if (check_num_arcs != num_arcs)
+    LOG_FAIL << "Check number of arcs failed, " << check_num_arcs << " vs "
+             << num_arcs;
+  own_states_[num_states].final = TROPICAL_ZERO32;
+  own_states_[num_states].niepsilons = 0;
+  own_states_[num_states].offset = num_arcs;
+  PartitionArcs();
+  SetPointers();
+}
+
+void ConstFst::RelabelToPdfs(const TransitionTable &table) {
+  if (IsPdfLabeled()) LOG_FAIL << "ConstFst is already labeled by pdf-ids";
+  if (IsMapped()) {
+    // mapped memory is read-only, copy it out first
+    own_states_.assign(states_, states_ + num_states_ + 1);
+    own_arcs_.assign(arcs_, arcs_ + num_arcs_);
+    SetPointers();
+  }
+  Int32 num_tids = table.NumTransitionIds();
+  const Int32 *pdfs = table.Table();
+  for (Arc &arc : own_arcs_) {
+    if (arc.ilabel == 0) continue;
+    if (arc.ilabel < 0 || arc.ilabel > num_tids)
+      LOG_FAIL << "Index out of total number of transition ids, " << arc.ilabel
+               << "/" << num_tids;
+    arc.ilabel = pdfs[arc.ilabel - 1] + 1;
+  }
+  num_pdfs_ = table.NumPdfs();
+}
+
+void ConstFst::Write(std::ostream &os) const {
+  ConstFstHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kConstFstMagic, sizeof(header.magic));
+  header.version = kConstFstVersion;
+  header.flags = kConstFstEpsilonFirst;
+  if (IsPdfLabeled()) header.flags |= kConstFstPdfLabels;
+  header.start = start_;
+  header.num_pdfs = IsPdfLabeled() ? num_pdfs_ : -1;
+  header.num_states = num_states_;
+  header.num_arcs = num_arcs_;
+  header.states_offset = AlignOffset(sizeof(header));
+  UInt64 states_bytes = (num_states_ + 1) * sizeof(ConstState),
+         arcs_bytes = num_arcs_ * sizeof(Arc);
+  header.arcs_offset = AlignOffset(header.states_offset + states_bytes);
+
+  WriteBinary(os, reinterpret_cast<const char *>(&header), sizeof(header));
+  WritePadding(os, sizeof(header), header.states_offset);
+  // WriteBinary() accepts Int32 bytes, write in pieces
+  const UInt64 piece = 1 << 30;
+  const char *states_ptr = reinterpret_cast<const char *>(states_);
+  for (UInt64 done = 0; done < states_bytes; done += piece)
+    WriteBinary(os, states_ptr + done, std::min(piece, states_bytes - done));
+  WritePadding(os, header.states_offset + states_bytes, header.arcs_offset);
+  const char *arcs_ptr = reinterpret_cast<const char *>(arcs_);
+  for (UInt64 done = 0; done < arcs_bytes; done += piece)
+    WriteBinary(os, arcs_ptr + done, std::min(piece, arcs_bytes - done));
+  LOG_INFO << "Write decoder graph(ConstFst), contains " << num_states_
+           << " states and " << num_arcs_ << " arcs with start index "
+           << start_;
+}
+
+void ConstFst::Map(const std::string &fname) {
+  MappedFile *mapped = new MappedFile(fname);
+  if (mapped->Size() < sizeof(ConstFstHeader))
+    LOG_FAIL << "File " << fname << " is too small to be a ConstFst";
+  const char *base = mapped->Data();
+  const ConstFstHeader *header = reinterpret_cast<const ConstFstHeader *>(base);
+  if (memcmp(header->magic, kConstFstMagic, sizeof(header->magic)) != 0)
+    LOG_FAIL << "File " << fname << " is not in ConstFst format";
+  if (header->version != kConstFstVersion)
+    LOG_FAIL << "Unsupported ConstFst version " << header->version
+             << ", expect " << kConstFstVersion;
+  if (header->states_offset % kConstFstAlign ||
+      header->arcs_offset % kConstFstAlign ||
+      header->states_offset + (header->num_states + 1) * sizeof(ConstState) >
+          header->arcs_offset ||
+      header->arcs_offset + header->num_arcs * sizeof(Arc) > mapped->Size())
+    LOG_FAIL << "Bad layout of ConstFst " << fname << ", file truncated?";
+  if (!(header->flags & kConstFstEpsilonFirst))
+    LOG_FAIL << "Arcs of ConstFst " << fname << " are not sorted, "
+             << "convert it again using convert-decode-graph";
+  if (mapped_) delete mapped_;
+  mapped_ = mapped;
+  own_states_.clear();
+  own_arcs_.clear();
+  start_ = header->start;
+  num_pdfs_ = (header->flags & kConstFstPdfLabels) ? header->num_pdfs : -1;
+  num_states_ = header->num_states;
+  num_arcs_ = header->num_arcs;
+  states_ = reinterpret_cast<const ConstState *>(base + header->states_offset);
+  arcs_ = reinterpret_cast<const Arc *>(base + header->arcs_offset);
+  if (states_[num_states_].offset != num_arcs_)
+    LOG_FAIL << "Check number of arcs failed, " << states_[num_states_].offset
+             << " vs " << num_arcs_;
+  LOG_INFO << "Map decoder graph(ConstFst), contains " << num_states_
+           << " states and " << num_arcs_ << " arcs with start index "
+           << start_ << (IsPdfLabeled() ? ", labeled by pdf-ids" : "");
+}
+
+void ConstFst::Load(const std::string &fname) {
+  if (IsConstFst(fname)) {
+    Map(fname);
+  } else {
+    BinaryInput bi(fname);
+    Read(bi.Stream());
+  }
+}
+
+Bool IsConstFst(const std::string &filename) {
+  BinaryInput bi(filename);
+  char magic[sizeof(kConstFstMagic)];
+  bi.Stream().read(magic, sizeof(magic));
+  if (bi.Stream().gcount() != sizeof(magic)) return false;
+  return memcmp(magic, kConstFstMagic, sizeof(magic)) == 0;
+}
+
+void ReadConstFst(const std::string &filename, ConstFst *fst) {
+  ASSERT(fst);
+  fst->Load(filename);
+}
+
+void WriteConstFst(const std::string &filename, const ConstFst &fst) {
+  BinaryOutput bo(filename);
+  fst.Write(bo.Stream());
+}
@@ -0,0 +1,177 @@
+// wujian@2018
+
+// Frozen FST used by decoder
+
+#ifndef CONST_FST_H
+#define CONST_FST_H
+
+#include "decoder/common.h"
+#include "decoder/simple-fst.h"
+#include "decoder/transition-table.h"
+
+// [begin, end) of arcs, so graphs could be walked by range-based for
+// without knowing how arcs are stored, egs:
+// for (const Arc &arc : fst.EmittingArcs(state)) ...
+template <class Iter>
+class ArcRange {
+ public:
+  ArcRange(Iter begin, Iter end) : begin_(begin), end_(end) {}
+
+  Iter begin() const { return begin_; }
+
+  Iter end() const { return end_; }
+
+ private:
+  Iter begin_, end_;
+};
+
+// Per-state record of ConstFst. Arcs of state s are
+// arcs[states[s].offset: states[s + 1].offset], input epsilon arcs come first,
+// so the first niepsilons arcs are non-emitting and the rest are emitting
+struct ConstState {
+  Weight final;
+  UInt32 niepsilons;
+  UInt64 offset;
+};
+
+// On-disk layout of ConstFst (native endian):
+// ConstFstHeader | pad | ConstState x (num_states + 1) | pad | Arc x num_arcs
+// Both arrays are aligned to kConstFstAlign bytes, so the whole file could
+// be mmaped and used in place.
+const char kConstFstMagic[8] = {'C', 'O', 'N', 'S', 'T', 'F', 'S', 'T'};
+const UInt32 kConstFstVersion = 1;
+const UInt64 kConstFstAlign = 64;
+
+// Bits of ConstFstHeader::flags
+// arcs of each state are partitioned, input epsilon arcs first
+const UInt32 kConstFstEpsilonFirst = 0x1;
+// ilabels are pdf-id + 1 instead of transition-id
+const UInt32 kConstFstPdfLabels = 0x2;
+
+struct ConstFstHeader {
+  char magic[8];
+  UInt32 version;
+  UInt32 flags;
+  Int32 start;
+  Int32 num_pdfs;  // valid with kConstFstPdfLabels
+  UInt64 num_states, num_arcs;
+  // byte offset from beginning of the file
+  UInt64 states_offset, arcs_offset;
+};
+
+// Read-only graph in CSR layout: all arcs are kept in one contiguous array
+// and each state only records its final weight and offset of its first arc.
+// SimpleFst is still used as the mutable builder, freeze it into ConstFst
+// before decoding. Arcs are always stored epsilon first, so decoder could
+// walk emitting and non-emitting arcs separately without checking ilabels.
+class ConstFst {
+ public:
+  ConstFst() : num_pdfs_(-1), mapped_(NULL) { SetPointers(); }
+
+  ConstFst(const SimpleFst &fst) : num_pdfs_(-1), mapped_(NULL) { Init(fst); }
+
+  // Load graph from file, see ReadConstFst()
+  ConstFst(const std::string &fname) : num_pdfs_(-1), mapped_(NULL) {
+    Load(fname);
+  }
+
+  ~ConstFst() {
+    if (mapped_) delete mapped_;
+  }
+
+  // Freeze from SimpleFst
+  void Init(const SimpleFst &fst);
+
+  // Same format as SimpleFst::Read, but without per-state allocation
+  void Read(std::istream &is);
+
+  // Write in ConstFst format
+  void Write(std::ostream &os) const;
+
+  // Map file in ConstFst format, no parsing and no copy
+  void Map(const std::string &fname);
+
+  // Map if fname is in ConstFst format, otherwise read as SimpleFst format
+  void Load(const std::string &fname);
+
+  // Rewrite ilabels from transition-id to pdf-id + 1, then decoder could
+  // index loglikes directly and TransitionTable is not needed any more.
+  // A mapped graph is copied into memory first
+  void RelabelToPdfs(const TransitionTable &table);
+
+  Bool IsMapped() const { return mapped_ != NULL; }
+
+  Bool IsPdfLabeled() const { return num_pdfs_ >= 0; }
+
+  // Number of pdfs if IsPdfLabeled(), otherwise -1
+  Int32 NumPdfs() const { return num_pdfs_; }
+
+  StateId Start() const { return start_; }
+
+  Weight Final(StateId state) const { return states_[state].final; }
+
+  UInt64 NumStates() const { return num_states_; }
+
+  UInt64 NumArcs(StateId state) const {
+    return states_[state + 1].offset - states_[state].offset;
+  }
+
+  UInt64 NumArcs() const { return num_arcs_; }
+
+  UInt64 NumInputEpsilons(StateId state) const {
+    return states_[state].niepsilons;
+  }
+
+  const Arc *Arcs(StateId state) const {
+    return arcs_ + states_[state].offset;
+  }
+
+  // Leading input epsilon arcs of the state
+  ArcRange<const Arc *> EpsilonArcs(StateId state) const {
+    const Arc *begin = Arcs(state);
+    return ArcRange<const Arc *>(begin, begin + NumInputEpsilons(state));
+  }
+
+  // Arcs which consume a frame
+  ArcRange<const Arc *> EmittingArcs(StateId state) const {
+    const Arc *begin = Arcs(state);
+    return ArcRange<const Arc *>(begin + NumInputEpsilons(state),
+                                 begin + NumArcs(state));
+  }
+
+  // Bytes hold by states and arcs
+  UInt64 MemoryUsage() const {
+    return (num_states_ + 1) * sizeof(ConstState) + num_arcs_ * sizeof(Arc);
+  }
+
+ private:
+  ConstFst(const ConstFst &) = delete;
+  ConstFst &operator=(const ConstFst &) = delete;
+
+  // Point states_/arcs_ to owned buffers
+  void SetPointers();
+
+  // Move input epsilon arcs of each state ahead (keep relative order) and
+  // count them
+  void PartitionArcs();
+
+  StateId start_;
+  Int32 num_pdfs_;
+  UInt64 num_states_, num_arcs_;
+  // Point to own_* or mapped memory
+  const ConstState *states_;
+  const Arc *arcs_;
+  // NumStates() + 1 items, the last one is a sentinel
+  std::vector<ConstState> own_states_;
+  std::vector<Arc> own_arcs_;
+  MappedFile *mapped_;
+};
+
+// Check magic of the file
+Bool IsConstFst(const std::string &filename);
+
+void ReadConstFst(const std::string &filename, ConstFst *fst);
+
+void WriteConstFst(const std::string &filename, const ConstFst &fst);
+
+#endif
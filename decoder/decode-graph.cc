@@ -0,0 +1,26 @@
+// wujian@2018
+
+#include "decoder/decode-graph.h"
+
+template <class FST>
+void DecodeGraphTpl<FST>::Check() {
+  if (!fst_.IsPdfLabeled()) {
+    const Int32 *table = table_.Table();
+    for (Int32 i = 0; i < table_.NumTransitionIds(); i++) {
+      if (table[i] < 0 || table[i] >= table_.NumPdfs())
+        LOG_FAIL << "Bad pdf-id " << table[i] << " for transition-id "
+                 << i + 1;
+    }
+  }
+  Int32 max_label = MaxLabel();
+  for (StateIterator siter(fst_); !siter.Done(); siter.Next()) {
+    for (const Arc &arc : fst_.EmittingArcs(siter.Value())) {
+      if (arc.ilabel <= 0 || arc.ilabel > max_label)
+        LOG_FAIL << "Input label of graph out of range, " << arc.ilabel << "/"
+                 << max_label;
+    }
+  }
+}
+
+template class DecodeGraphTpl<ConstFst>;
+template class DecodeGraphTpl<CompactFst>;
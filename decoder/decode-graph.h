@@ -0,0 +1,60 @@
+// wujian@2018
+
+// Immutable decoding graph shared by decoders
+
+#ifndef DECODE_GRAPH_H
+#define DECODE_GRAPH_H
+
+#include "decoder/common.h"
+#include "decoder/compact-fst.h"
+#include "decoder/const-fst.h"
+#include "decoder/simple-fst.h"
+#include "decoder/transition-table.h"
+
+// Frozen graph (ConstFst or CompactFst) and the TransitionTable it depends on,
+// checked once when loaded. Decoders keep a const reference of it, so one
+// graph could be shared by any number of decoding streams (and threads)
+// without copy. The table is empty if the graph is labeled by pdf-ids.
+template <class FST>
+class DecodeGraphTpl {
+ public:
+  DecodeGraphTpl(const SimpleFst &fst, const TransitionTable &table)
+      : fst_(fst), table_(table) {
+    Check();
+  }
+
+  // str_table is not used if graph is labeled by pdf-ids
+  DecodeGraphTpl(const std::string &str_fst, const std::string &str_table)
+      : fst_(str_fst) {
+    if (!fst_.IsPdfLabeled()) ReadTransitionTable(str_table, &table_);
+    Check();
+  }
+
+  const FST &Fst() const { return fst_; }
+
+  const TransitionTable &Table() const { return table_; }
+
+  Int32 NumPdfs() const {
+    return fst_.IsPdfLabeled() ? fst_.NumPdfs() : table_.NumPdfs();
+  }
+
+  // Upper bound of ilabels, number of pdfs or transition-ids
+  Int32 MaxLabel() const {
+    return fst_.IsPdfLabeled() ? fst_.NumPdfs() : table_.NumTransitionIds();
+  }
+
+ private:
+  DecodeGraphTpl(const DecodeGraphTpl &) = delete;
+  DecodeGraphTpl &operator=(const DecodeGraphTpl &) = delete;
+
+  // Check ilabels and the table, then no check is needed when decoding
+  void Check();
+
+  FST fst_;
+  TransitionTable table_;
+};
+
+typedef DecodeGraphTpl<ConstFst> DecodeGraph;
+typedef DecodeGraphTpl<CompactFst> CompactDecodeGraph;
+
+#endif
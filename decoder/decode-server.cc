@@ -0,0 +1,124 @@
+// wujian@2018
+
+#include "decoder/decode-server.h"
+
+DecodeServer::DecodeServer(const DecodeGraph &graph,
+                           const DecodeOpts &decode_opts,
+                           const DecodeServerOpts &server_opts)
+    : graph_(graph),
+      decode_opts_(decode_opts),
+      server_opts_(server_opts),
+      num_submitted_(0),
+      num_fetched_(0),
+      closed_(false),
+      stopped_(false) {
+  ASSERT(server_opts_.num_workers > 0 && server_opts_.max_pending > 0);
+  for (Int32 i = 0; i < server_opts_.num_workers; i++)
+    workers_.push_back(std::thread(&DecodeServer::Work, this));
+}
+
+DecodeServer::~DecodeServer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true, stopped_ = true;
+  }
+  task_cond_.notify_all();
+  space_cond_.notify_all();
+  for (std::thread &worker : workers_) worker.join();
+}
+
+void DecodeServer::Submit(const std::string &key,
+                          std::vector<Float32> &&loglikes, Int32 num_frames,
+                          Int32 num_pdfs) {
+  if (loglikes.size() != static_cast<UInt64>(num_frames) * num_pdfs)
+    LOG_FAIL << "Size of loglikes mismatch with " << num_frames << " x "
+             << num_pdfs << " for utterance " << key;
+  Task task;
+  task.key = key;
+  task.loglikes = std::move(loglikes);
+  task.data = NULL;
+  task.num_frames = num_frames, task.stride = task.num_pdfs = num_pdfs;
+  Push(std::move(task));
+}
+
+void DecodeServer::Submit(const std::string &key, const Float32 *loglikes,
+                          Int32 num_frames, Int32 stride, Int32 num_pdfs) {
+  ASSERT(loglikes && num_pdfs <= stride);
+  Task task;
+  task.key = key;
+  task.data = loglikes;
+  task.num_frames = num_frames, task.stride = stride, task.num_pdfs = num_pdfs;
+  Push(std::move(task));
+}
+
+void DecodeServer::Push(Task &&task) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (closed_) LOG_FAIL << "Submit utterance " << task.key << " after Close()";
+  // backpressure: submitted but not fetched
+  space_cond_.wait(lock, [this] {
+    return stopped_ ||
+           num_submitted_ - num_fetched_ < server_opts_.max_pending;
+  });
+  if (stopped_) return;
+  task.index = num_submitted_++;
+  tasks_.push_back(std::move(task));
+  lock.unlock();
+  task_cond_.notify_one();
+}
+
+void DecodeServer::Close() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+  }
+  task_cond_.notify_all();
+  result_cond_.notify_all();
+}
+
+Bool DecodeServer::GetResult(DecodeResult *result) {
+  ASSERT(result);
+  std::unique_lock<std::mutex> lock(mutex_);
+  std::map<Int64, DecodeResult>::iterator iter;
+  result_cond_.wait(lock, [this, &iter] {
+    if (closed_ && num_fetched_ == num_submitted_) return true;
+    iter = server_opts_.ordered ? results_.find(num_fetched_)
+                                : results_.begin();
+    return iter != results_.end();
+  });
+  if (num_fetched_ == num_submitted_) return false;
+  *result = std::move(iter->second);
+  results_.erase(iter);
+  num_fetched_++;
+  lock.unlock();
+  space_cond_.notify_one();
+  return true;
+}
+
+void DecodeServer::Work() {
+  // per-worker decoder, reused across utterances
+  FasterDecoder decoder(graph_, decode_opts_);
+  while (true) {
+    Task task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      task_cond_.wait(
+          lock, [this] { return stopped_ || closed_ || !tasks_.empty(); });
+      if (stopped_ || tasks_.empty()) return;
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+    DecodeResult result;
+    result.key = task.key;
+    result.index = task.index;
+    decoder.Reset();
+    decoder.Decode(const_cast<Float32 *>(task.data ? task.data
+                                                   : task.loglikes.data()),
+                   task.num_frames, task.stride, task.num_pdfs);
+    result.succeed = decoder.GetBestPath(&result.word_ids);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      results_[task.index] = std::move(result);
+    }
+    result_cond_.notify_all();
+  }
+}
@@ -0,0 +1,142 @@
+// wujian@2018
+
+// Decode utterances on a pool of worker threads
+
+#ifndef DECODE_SERVER_H
+#define DECODE_SERVER_H
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "decoder/common.h"
+#include "decoder/config.h"
+#include "decoder/decode-graph.h"
+#include "decoder/decoder.h"
+
+struct DecodeServerOpts {
+  Int32 num_workers;
+  // Max number of utterances submitted but not fetched yet, Submit() blocks
+  // when reached
+  Int32 max_pending;
+  // Deliver results in order of submission or in order of completion
+  Bool ordered;
+
+  DecodeServerOpts(Int32 num_workers = 4, Int32 max_pending = 64,
+                   Bool ordered = true)
+      : num_workers(num_workers), max_pending(max_pending), ordered(ordered) {}
+
+  DecodeServerOpts(const std::string &conf)
+      : DecodeServerOpts(ConfigureTable(conf)) {}
+
+  // From a configure parsed once, without file access
+  DecodeServerOpts(const ConfigureTable &conf) : DecodeServerOpts() {
+    ConfigureParser parser(conf);
+    ParseConfigure(&parser);
+  }
+
+  void ParseConfigure(ConfigureParser *parser) {
+    parser->AddOptions("DecodeServerOpts", "num_workers", &num_workers);
+    parser->AddOptions("DecodeServerOpts", "max_pending", &max_pending);
+    parser->AddOptions("DecodeServerOpts", "ordered", &ordered);
+  }
+
+  std::string Configure() {
+    std::ostringstream oss;
+    oss << "--DecodeServerOpts.num_workers=" << num_workers << std::endl;
+    oss << "--DecodeServerOpts.max_pending=" << max_pending << std::endl;
+    oss << "--DecodeServerOpts.ordered=" << (ordered ? "true" : "false")
+        << std::endl;
+    return oss.str();
+  }
+};
+
+struct DecodeResult {
+  std::string key;
+  // Submission order, starts from 0
+  Int64 index;
+  // Return value of FasterDecoder::GetBestPath()
+  Bool succeed;
+  std::vector<Int32> word_ids;
+};
+
+// All workers share one read-only DecodeGraph, each of them keeps its own
+// FasterDecoder. Producers call Submit(), and one consumer calls GetResult()
+// until it returns false, after Close() is called.
+// egs:
+// DecodeServer server(graph, decode_opts, server_opts);
+// // producer thread
+// server.Submit(utt, std::move(loglikes), num_frames, num_pdfs);
+// server.Close();
+// // consumer thread
+// DecodeResult result;
+// while (server.GetResult(&result)) { ... }
+class DecodeServer {
+ public:
+  // graph should outlive the server
+  DecodeServer(const DecodeGraph &graph, const DecodeOpts &decode_opts,
+               const DecodeServerOpts &server_opts);
+
+  // Wait for all submitted utterances and stop workers. Results not fetched
+  // are dropped
+  ~DecodeServer();
+
+  // Queue utterance with num_frames x num_pdfs loglikes, blocks if max_pending
+  // utterances have not been fetched yet
+  void Submit(const std::string &key, std::vector<Float32> &&loglikes,
+              Int32 num_frames, Int32 num_pdfs);
+
+  // Same as above, but loglikes (one frame per stride floats) are not
+  // copied, they should be kept until the result is fetched
+  void Submit(const std::string &key, const Float32 *loglikes,
+              Int32 num_frames, Int32 stride, Int32 num_pdfs);
+
+  // No more Submit() after this
+  void Close();
+
+  // Blocks until a result is available. Return false if closed and all
+  // results have been fetched
+  Bool GetResult(DecodeResult *result);
+
+ private:
+  DecodeServer(const DecodeServer &) = delete;
+  DecodeServer &operator=(const DecodeServer &) = delete;
+
+  struct Task {
+    std::string key;
+    Int64 index;
+    // Owned loglikes, or borrowed ones if data is not NULL
+    std::vector<Float32> loglikes;
+    const Float32 *data;
+    Int32 num_frames, stride, num_pdfs;
+  };
+
+  // Queue task, blocks if max_pending reached
+  void Push(Task &&task);
+
+  void Work();
+
+  const DecodeGraph &graph_;
+  DecodeOpts decode_opts_;
+  DecodeServerOpts server_opts_;
+  std::vector<std::thread> workers_;
+
+  // All below are guarded by mutex_
+  std::mutex mutex_;
+  // Notify workers: new task or closed
+  std::condition_variable task_cond_;
+  // Notify consumer: new result or all done
+  std::condition_variable result_cond_;
+  // Notify producers: result fetched
+  std::condition_variable space_cond_;
+  std::deque<Task> tasks_;
+  // Finished results, keyed by index
+  std::map<Int64, DecodeResult> results_;
+  // Index of next submitted/delivered result
+  Int64 num_submitted_, num_fetched_;
+  Bool closed_, stopped_;
+};
+
+#endif
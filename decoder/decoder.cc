@@ -4,104 +4,340 @@
 
 #include "decoder/decoder.h"
 
-Bool debug_decoder = false;
+// Whether EmittingArcs() of FST could be called by threads concurrently.
+// ComposeFst caches the states it has expanded, so it could not
+template <class FST>
+struct ConcurrentArcs {
+  static const Bool value = true;
+};
 
-void FasterDecoder::Reset() {
+template <>
+struct ConcurrentArcs<ComposeFst> {
+  static const Bool value = false;
+};
+
+// Let ComposeFst drop the states reached if there are too many, return true
+// if state ids are changed
+template <class FST>
+struct ShrinkStates {
+  static Bool Run(const FST &fst) { return false; }
+};
+
+template <>
+struct ShrinkStates<ComposeFst> {
+  static Bool Run(const ComposeFst &fst) { return fst.Shrink(); }
+};
+
+template <template <class, class> class HashListT, class FST>
+void FasterDecoderTpl<HashListT, FST>::Init(const DecodeOpts &opts) {
+  min_active_ = opts.min_active, max_active_ = opts.max_active;
+  beam_ = opts.beam, acoustic_scale_ = opts.acwt;
+  word_penalty_ = opts.penalty;
+  precompute_cost_ = opts.precompute_cost;
+  histogram_bins_ = opts.histogram_bins;
+  histogram_.resize(histogram_bins_);
+  if (max_active_ == std::numeric_limits<Int32>::max() && min_active_ == 0)
+    cutoff_type_ = kBeamCutoff;
+  else
+    cutoff_type_ = histogram_bins_ ? kHistogramCutoff : kExactCutoff;
+  frame_subsampling_factor_ = opts.frame_subsampling_factor;
+  blank_id_ = opts.blank_id;
+  log_blank_threshold_ = std::log(opts.blank_threshold);
+  endpoint_opts_ = opts.endpoint_opts;
+  parallel_min_tokens_ = opts.parallel_min_tokens;
+  toks_.SetSize(1000);
+  immortal_tok_ = NULL;
+  // labels are checked by DecodeGraph
+  num_pdfs_ = fst_.IsPdfLabeled() ? fst_.NumPdfs() : table_.NumPdfs();
+  Check();
+  Int32 max_label = fst_.IsPdfLabeled() ? num_pdfs_ : table_.NumTransitionIds();
+  if (!endpoint_opts_.silence_pdfs.empty())
+    endpoint_opts_.SilenceMask(num_pdfs_, &silence_mask_);
+  use_silence_mask_ = !silence_mask_.empty();
+  if (precompute_cost_) {
+    if (!fst_.IsPdfLabeled()) pdf_cost_.resize(num_pdfs_);
+    cost_table_.resize(max_label + 1, 0);
+  }
+  num_frames_received_ = num_frames_skipped_ = 0;
+  reset_ = false;
+  start_hash_size_ = 0;
+  profiler_ = NULL;
+  worker_group_ = NULL;
+  Int32 num_threads = opts.num_threads;
+  ASSERT(num_threads >= 1);
+  if (num_threads > 1 && !ConcurrentArcs<FST>::value) {
+    LOG_WARN << "Arcs of ComposeFst are expanded on demand, could not decode "
+                "with num_threads = "
+             << num_threads << ", use 1 thread instead";
+    num_threads = 1;
+  }
+  // workers beyond the cores only wait for each other at every frame (about
+  // 2x slower than serial when oversubscribed), 0 means unknown
+  Int32 num_cores = std::thread::hardware_concurrency();
+  if (num_cores > 0 && num_threads > num_cores) {
+    LOG_WARN << "DecodeOpts.num_threads = " << num_threads << ", but only "
+             << num_cores << " core(s) available, use " << num_cores
+             << " instead";
+    num_threads = num_cores;
+  }
+  if (num_threads > 1) {
+    worker_group_ = new WorkerGroup(num_threads);
+    for (Int32 w = 0; w < num_threads; w++) {
+      ExpandWorker *worker = new ExpandWorker;
+      worker->shards.resize(num_threads);
+      expand_workers_.push_back(worker);
+    }
+  }
+}
+
+template <template <class, class> class HashListT, class FST>
+void FasterDecoderTpl<HashListT, FST>::Reset() {
+  num_frames_received_ = num_frames_skipped_ = 0;
+  // states in start_records_ and toks_ are not valid any more
+  if (ShrinkStates<FST>::Run(fst_)) {
+    start_records_.clear();
+    reset_ = false;
+  }
+  // still at the start state, nothing to do
+  if (reset_ && num_frames_decoded_ == 0) return;
   num_frames_decoded_ = 0;
-  if (reset_) return;
   ClearToks(toks_.Clear());
-  StateId start_state = fst_.Start();
-  ASSERT(start_state != NoStateId);
-  Arc dummy_arc(0, 0, 0, start_state);
-  toks_.Insert(start_state, new Token(dummy_arc, NULL));
-  ProcessNonemitting(std::numeric_limits<Float64>::max());
+  // released with all the others
+  immortal_tok_ = NULL;
+  new_stable_words_.clear();
+  if (!start_records_.empty() && start_hash_size_ == toks_.Size()) {
+    RestoreToks(start_records_, start_active_, -1);
+  } else {
+    StateId start_state = fst_.Start();
+    ASSERT(start_state != NoStateId);
+    Arc dummy_arc(0, 0, 0, start_state);
+    toks_.Insert(start_state, NewToken(dummy_arc, NULL));
+    ProcessNonemitting(std::numeric_limits<Float64>::max());
+    Int32 immortal;
+    SaveToks(false, &start_records_, &start_active_, &immortal);
+    start_hash_size_ = toks_.Size();
+  }
   reset_ = true;
 }
 
-void FasterDecoder::DecodeFrame(Float32 *loglikes, Int32 num_pdfs) {
-  if (num_pdfs != table_.NumPdfs()) {
+template <template <class, class> class HashListT, class FST>
+template <class Loglikes>
+void FasterDecoderTpl<HashListT, FST>::DecodeRow(const Loglikes &loglikes,
+                                                 Int32 num_pdfs) {
+  if (num_pdfs != num_pdfs_) {
     LOG_FAIL << "It seems that dimention of loglikes do not equal to number of "
                 "pdfs, "
-             << num_pdfs << " vs " << table_.NumPdfs();
+             << num_pdfs << " vs " << num_pdfs_;
   }
   if (!reset_) LOG_FAIL << "Need call Reset() first to initialize decoder";
-  Float64 weight_cutoff = ProcessEmitting(loglikes, num_pdfs);
+  if (blank_id_ >= 0 && loglikes[blank_id_] > log_blank_threshold_) {
+    num_frames_skipped_++;
+    return;
+  }
+  Int64 begin = kProfiling && profiler_ ? NowNanoseconds() : 0;
+  if (kProfiling) frame_stats_.Reset();
+  Float64 weight_cutoff;
+  if (precompute_cost_) {
+    ComputeCostTable(loglikes, num_pdfs);
+    TableCost cost = {cost_table_.data()};
+    weight_cutoff = ProcessEmitting(cost);
+  } else if (fst_.IsPdfLabeled()) {
+    PdfCost<Loglikes> cost = {loglikes, acoustic_scale_, word_penalty_};
+    weight_cutoff = ProcessEmitting(cost);
+  } else {
+    TransitionCost<Loglikes> cost = {loglikes, table_.Table(),
+                                     acoustic_scale_, word_penalty_};
+    weight_cutoff = ProcessEmitting(cost);
+  }
   ProcessNonemitting(weight_cutoff);
+  if (kProfiling && profiler_) {
+    Int64 end = NowNanoseconds();
+    profiler_->AddStage(kDecodeStage, begin, end);
+    profiler_->AddFrame(frame_stats_, end);
+  }
 }
 
-void FasterDecoder::Decode(Float32 *loglikes, Int32 num_frames, Int32 stride,
-                           Int32 num_pdfs) {
+template <template <class, class> class HashListT, class FST>
+void FasterDecoderTpl<HashListT, FST>::DecodeFrame(Float32 *loglikes,
+                                                   Int32 num_pdfs) {
+  Float32Loglikes row = {loglikes};
+  DecodeRow(row, num_pdfs);
+}
+
+template <template <class, class> class HashListT, class FST>
+void FasterDecoderTpl<HashListT, FST>::DecodeFrame(const UInt16 *loglikes,
+                                                   Int32 num_pdfs) {
+  Float16Loglikes row = {loglikes};
+  DecodeRow(row, num_pdfs);
+}
+
+template <template <class, class> class HashListT, class FST>
+void FasterDecoderTpl<HashListT, FST>::DecodeFrame(const Int08 *loglikes,
+                                                   Float32 scale,
+                                                   Int32 num_pdfs) {
+  Int8Loglikes row = {loglikes, scale};
+  DecodeRow(row, num_pdfs);
+}
+
+template <template <class, class> class HashListT, class FST>
+Int32 FasterDecoderTpl<HashListT, FST>::FirstSubsampledRow(Int32 num_frames,
+                                                           Int32 stride,
+                                                           Int32 num_pdfs) {
   // check memory
   ASSERT(num_pdfs <= stride);
-  for (Int32 t = 0; t < num_frames; t++) {
+  // continue the phase of last call
+  Int32 t = (frame_subsampling_factor_ -
+             num_frames_received_ % frame_subsampling_factor_) %
+            frame_subsampling_factor_;
+  num_frames_received_ += num_frames;
+  return t;
+}
+
+template <template <class, class> class HashListT, class FST>
+void FasterDecoderTpl<HashListT, FST>::Decode(Float32 *loglikes,
+                                              Int32 num_frames, Int32 stride,
+                                              Int32 num_pdfs) {
+  for (Int32 t = FirstSubsampledRow(num_frames, stride, num_pdfs);
+       t < num_frames; t += frame_subsampling_factor_) {
     // LOG_INFO << "Decode frame " << t;
     DecodeFrame(loglikes + t * stride, num_pdfs);
   }
 }
 
+template <template <class, class> class HashListT, class FST>
+void FasterDecoderTpl<HashListT, FST>::Decode(const UInt16 *loglikes,
+                                              Int32 num_frames, Int32 stride,
+                                              Int32 num_pdfs) {
+  for (Int32 t = FirstSubsampledRow(num_frames, stride, num_pdfs);
+       t < num_frames; t += frame_subsampling_factor_)
+    DecodeFrame(loglikes + t * stride, num_pdfs);
+}
+
+template <template <class, class> class HashListT, class FST>
+void FasterDecoderTpl<HashListT, FST>::Decode(const Int08 *loglikes,
+                                              const Float32 *scales,
+                                              Int32 num_frames, Int32 stride,
+                                              Int32 num_pdfs) {
+  for (Int32 t = FirstSubsampledRow(num_frames, stride, num_pdfs);
+       t < num_frames; t += frame_subsampling_factor_)
+    DecodeFrame(loglikes + t * stride, scales[t], num_pdfs);
+}
+
 // Gets the weight cutoff.  Also counts the active tokens.
-Float64 FasterDecoder::GetCutoff(Elem *list_head, UInt64 *tok_count,
-                                 Float32 *adaptive_beam, Elem **best_elem) {
+template <template <class, class> class HashListT, class FST>
+Float64 FasterDecoderTpl<HashListT, FST>::GetCutoff(Elem *list_head,
+                                                    UInt64 *tok_count,
+                                                    Float32 *adaptive_beam,
+                                                    Elem **best_elem) {
   Float64 best_cost = FLOAT64_INF;
   UInt64 count = 0;
-  if (max_active_ == std::numeric_limits<Int32>::max() && min_active_ == 0) {
-    for (Elem *e = list_head; e != NULL; e = e->tail, count++) {
-      Float64 w = e->val->cost_;
-      if (w < best_cost) {
-        best_cost = w;
-        if (best_elem) *best_elem = e;
-      }
+  for (Elem *e = list_head; e != NULL; e = e->tail, count++) {
+    Float64 w = e->val->cost_;
+    if (w < best_cost) {
+      best_cost = w;
+      if (best_elem) *best_elem = e;
     }
-    if (tok_count != NULL) *tok_count = count;
-    if (adaptive_beam != NULL) *adaptive_beam = beam_;
-    return best_cost + beam_;
-  } else {
-    cost_active_.clear();
-    for (Elem *e = list_head; e != NULL; e = e->tail, count++) {
-      Float64 w = e->val->cost_;
-      cost_active_.push_back(w);
-      if (w < best_cost) {
-        best_cost = w;
-        if (best_elem) *best_elem = e;
-      }
-    }
-    if (tok_count != NULL) *tok_count = count;
+  }
+  if (tok_count != NULL) *tok_count = count;
+  switch (cutoff_type_) {
+    case kHistogramCutoff:
+      return GetHistogramCutoff(list_head, best_cost, adaptive_beam);
+    case kExactCutoff:
+      return GetExactCutoff(list_head, best_cost, adaptive_beam);
+    default:
+      if (adaptive_beam != NULL) *adaptive_beam = beam_;
+      return best_cost + beam_;
+  }
+}
 
-    Float64 beam_cutoff = best_cost + beam_, min_active_cutoff = FLOAT64_INF,
-            max_active_cutoff = FLOAT64_INF;
+Float64 ExactActiveCutoff(std::vector<Float32> *costs, Float64 best_cost,
+                          Float32 beam, Int32 min_active, Int32 max_active,
+                          Float32 *adaptive_beam) {
+  std::vector<Float32> &cost_active = *costs;
+  Float64 beam_cutoff = best_cost + beam, min_active_cutoff = FLOAT64_INF,
+          max_active_cutoff = FLOAT64_INF;
 
-    if (cost_active_.size() > static_cast<UInt64>(max_active_)) {
-      std::nth_element(cost_active_.begin(), cost_active_.begin() + max_active_,
-                       cost_active_.end());
-      max_active_cutoff = cost_active_[max_active_];
-    }
-    if (max_active_cutoff < beam_cutoff) {  // max_active is tighter than beam.
-      if (adaptive_beam) *adaptive_beam = max_active_cutoff - best_cost + 0.5;
-      return max_active_cutoff;
+  if (cost_active.size() > static_cast<UInt64>(max_active)) {
+    std::nth_element(cost_active.begin(), cost_active.begin() + max_active,
+                     cost_active.end());
+    max_active_cutoff = cost_active[max_active];
+  }
+  if (max_active_cutoff < beam_cutoff) {  // max_active is tighter than beam.
+    if (adaptive_beam) *adaptive_beam = max_active_cutoff - best_cost + 0.5;
+    return max_active_cutoff;
+  }
+  if (cost_active.size() > static_cast<UInt64>(min_active)) {
+    if (min_active == 0)
+      min_active_cutoff = best_cost;
+    else {
+      std::nth_element(cost_active.begin(), cost_active.begin() + min_active,
+                       cost_active.size() > static_cast<UInt64>(max_active)
+                           ? cost_active.begin() + max_active
+                           : cost_active.end());
+      min_active_cutoff = cost_active[min_active];
     }
-    if (cost_active_.size() > static_cast<UInt64>(min_active_)) {
-      if (min_active_ == 0)
-        min_active_cutoff = best_cost;
-      else {
-        std::nth_element(cost_active_.begin(),
-                         cost_active_.begin() + min_active_,
-                         cost_active_.size() > static_cast<UInt64>(max_active_)
-                             ? cost_active_.begin() + max_active_
-                             : cost_active_.end());
-        min_active_cutoff = cost_active_[min_active_];
-      }
+  }
+  if (min_active_cutoff > beam_cutoff) {  // min_active is looser than beam.
+    if (adaptive_beam) *adaptive_beam = min_active_cutoff - best_cost + 0.5;
+    return min_active_cutoff;
+  } else {
+    if (adaptive_beam) *adaptive_beam = beam;
+    return beam_cutoff;
+  }
+}
+
+template <template <class, class> class HashListT, class FST>
+Float64 FasterDecoderTpl<HashListT, FST>::GetExactCutoff(
+    Elem *list_head, Float64 best_cost, Float32 *adaptive_beam) {
+  cost_active_.clear();
+  for (Elem *e = list_head; e != NULL; e = e->tail)
+    cost_active_.push_back(e->val->cost_);
+  return ExactActiveCutoff(&cost_active_, best_cost, beam_, min_active_,
+                           max_active_, adaptive_beam);
+}
+
+// Kept tokens satisfy cost < cutoff. With bins of width beam / histogram_bins
+// over [best, best + beam), the max-active cutoff is the lower edge of the bin
+// where the cumulative count exceeds max_active, so at most max_active tokens
+// survive (one bin more if the first bin already exceeds it). Tokens out of
+// beam are not binned, if min_active is not exceeded inside the beam, fall
+// back to the exact version.
+template <template <class, class> class HashListT, class FST>
+Float64 FasterDecoderTpl<HashListT, FST>::GetHistogramCutoff(
+    Elem *list_head, Float64 best_cost, Float32 *adaptive_beam) {
+  UInt32 *histogram = histogram_.data();
+  std::fill(histogram, histogram + histogram_bins_, 0);
+  Float64 bin_width = beam_ / histogram_bins_, scale = 1.0 / bin_width;
+  UInt64 num_in_beam = 0;
+  for (Elem *e = list_head; e != NULL; e = e->tail) {
+    Float64 offset = (e->val->cost_ - best_cost) * scale;
+    if (offset < histogram_bins_) {
+      histogram[static_cast<Int32>(offset)]++;
+      num_in_beam++;
     }
-    if (min_active_cutoff > beam_cutoff) {  // min_active is looser than beam.
-      if (adaptive_beam) *adaptive_beam = min_active_cutoff - best_cost + 0.5;
-      return min_active_cutoff;
-    } else {
-      *adaptive_beam = beam_;
-      return beam_cutoff;
+  }
+  if (num_in_beam <= static_cast<UInt64>(min_active_))
+    return GetExactCutoff(list_head, best_cost, adaptive_beam);
+
+  if (num_in_beam > static_cast<UInt64>(max_active_)) {
+    UInt64 acc = 0;
+    Int32 bin = 0;
+    for (; bin < histogram_bins_; bin++) {
+      if (acc + histogram[bin] > static_cast<UInt64>(max_active_)) break;
+      acc += histogram[bin];
     }
+    // keep the best bin at least
+    Float64 max_active_cutoff = best_cost + std::max(bin, 1) * bin_width;
+    if (adaptive_beam) *adaptive_beam = max_active_cutoff - best_cost + 0.5;
+    return max_active_cutoff;
   }
+  if (adaptive_beam) *adaptive_beam = beam_;
+  return best_cost + beam_;
 }
 
-Float64 FasterDecoder::ProcessEmitting(Float32 *loglikes, Int32 num_pdfs) {
+template <template <class, class> class HashListT, class FST>
+template <class Cost>
+Float64 FasterDecoderTpl<HashListT, FST>::ProcessEmitting(const Cost &cost) {
   Elem *last_toks = toks_.Clear();
   UInt64 tok_cnt;
   Float32 adaptive_beam;
@@ -109,6 +345,11 @@ Float64 FasterDecoder::ProcessEmitting(Float32 *loglikes, Int32 num_pdfs) {
   Float64 weight_cutoff =
       GetCutoff(last_toks, &tok_cnt, &adaptive_beam, &best_elem);
 
+  if (kProfiling) {
+    frame_stats_.num_active_tokens = tok_cnt;
+    frame_stats_.beam = adaptive_beam;
+  }
+
   UInt64 new_sz = static_cast<UInt64>(static_cast<Float32>(tok_cnt) * 2);
   if (new_sz > toks_.Size()) toks_.SetSize(new_sz);
 
@@ -117,52 +358,47 @@ Float64 FasterDecoder::ProcessEmitting(Float32 *loglikes, Int32 num_pdfs) {
   if (best_elem) {
     StateId state = best_elem->key;
     Token *tok = best_elem->val;
-    for (ArcIterator aiter(fst_, state); !aiter.Done(); aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      if (arc.ilabel != 0) {
-        // -loglikes[table_.TransitionIdToPdf(arc.ilabel)] * acoustic_scale_;
-        Float32 ac_cost = NegativeLoglikelihood(loglikes, arc.ilabel);
-        Float64 new_weight = arc.weight + tok->cost_ + ac_cost;
-        if (new_weight + adaptive_beam < next_weight_cutoff)
-          next_weight_cutoff = new_weight + adaptive_beam;
-      }
+    // emitting arcs follow the input epsilon arcs
+    for (const Arc &arc : fst_.EmittingArcs(state)) {
+      Float32 ac_cost = cost(arc.ilabel);
+      Float64 new_weight = arc.weight + tok->cost_ + ac_cost;
+      if (new_weight + adaptive_beam < next_weight_cutoff)
+        next_weight_cutoff = new_weight + adaptive_beam;
     }
   }
 
-  for (Elem *e = last_toks, *e_tail; e != NULL; e = e_tail) {
-    StateId state = e->key;
-    Token *tok = e->val;
-    if (tok->cost_ < weight_cutoff) {
-      ASSERT(state == tok->arc_.nextstate);
-      for (ArcIterator aiter(fst_, state); !aiter.Done(); aiter.Next()) {
-        const Arc &arc = aiter.Value();
-        if (arc.ilabel != 0) {
-          // minimum
-          // -loglikes[table_.TransitionIdToPdf(arc.ilabel)] * acoustic_scale_;
-          Float32 ac_cost = NegativeLoglikelihood(loglikes, arc.ilabel);
+  if (worker_group_ && tok_cnt >= static_cast<UInt64>(parallel_min_tokens_)) {
+    next_weight_cutoff = ExpandParallel(cost, last_toks, weight_cutoff,
+                                        adaptive_beam, next_weight_cutoff);
+  } else {
+    for (Elem *e = last_toks, *e_tail; e != NULL; e = e_tail) {
+      StateId state = e->key;
+      Token *tok = e->val;
+      if (tok->cost_ < weight_cutoff) {
+        ASSERT(state == tok->arc_.nextstate);
+        for (const Arc &arc : fst_.EmittingArcs(state)) {
+          if (kProfiling) frame_stats_.num_arcs++;
+          Float32 ac_cost = cost(arc.ilabel);
           Float64 new_weight = arc.weight + tok->cost_ + ac_cost;
           if (new_weight < next_weight_cutoff) {  // not pruned..
-            Token *new_tok = new Token(arc, tok, ac_cost);
+            Token *new_tok = NewToken(arc, tok, ac_cost);
             Elem *e_found = toks_.Find(arc.nextstate);
             if (new_weight + adaptive_beam < next_weight_cutoff)
               next_weight_cutoff = new_weight + adaptive_beam;
             if (e_found == NULL) {
               toks_.Insert(arc.nextstate, new_tok);
-              if (debug_decoder)
-                std::cerr << "insert token(" << arc.nextstate << ", "
-                          << new_tok->cost_ << "=" << arc.weight << "+"
-                          << tok->cost_ << "+" << ac_cost << "[" << arc.ilabel
-                          << "->" << table_.TransitionIdToPdf(arc.ilabel)
-                          << "])\n";
+              LOG_DEBUG << "insert token(" << arc.nextstate << ", "
+                        << new_tok->cost_ << "=" << arc.weight << "+"
+                        << tok->cost_ << "+" << ac_cost << "[" << arc.ilabel
+                        << "->" << LabelToPdf(arc.ilabel) << "])";
             } else {
               if (e_found->val->cost_ > new_tok->cost_) {
                 FreeToken(e_found->val);
                 e_found->val = new_tok;
-                if (debug_decoder)
-                  std::cerr << "replace token(" << e_found->key << ", "
-                            << e_found->val->cost_ << ") with "
-                            << "token(" << e_found->key << ", "
-                            << new_tok->cost_ << ")\n";
+                LOG_DEBUG << "replace token(" << e_found->key << ", "
+                          << e_found->val->cost_ << ") with "
+                          << "token(" << e_found->key << ", " << new_tok->cost_
+                          << ")";
               } else {
                 FreeToken(new_tok);
               }
@@ -170,22 +406,131 @@ Float64 FasterDecoder::ProcessEmitting(Float32 *loglikes, Int32 num_pdfs) {
           }
         }
       }
+      e_tail = e->tail;
+      FreeToken(e->val);
+      toks_.Delete(e);
     }
-    e_tail = e->tail;
-    FreeToken(e->val);
-    toks_.Delete(e);
   }
   num_frames_decoded_++;
 
-  if (debug_decoder)
-    LOG_INFO << "NumFrames/ActiveTokens: " << num_frames_decoded_ << "/"
-             << tok_cnt << "(" << weight_cutoff << "|" << next_weight_cutoff
-             << ")";
+  LOG_DEBUG << "NumFrames/ActiveTokens: " << num_frames_decoded_ << "/"
+            << tok_cnt << "(" << weight_cutoff << "|" << next_weight_cutoff
+            << ")";
+
+  return next_weight_cutoff;
+}
+
+template <template <class, class> class HashListT, class FST>
+template <class Cost>
+Float64 FasterDecoderTpl<HashListT, FST>::ExpandParallel(
+    const Cost &cost, Elem *last_toks, Float64 weight_cutoff,
+    Float32 adaptive_beam, Float64 next_weight_cutoff) {
+  last_elems_.clear();
+  for (Elem *e = last_toks; e != NULL; e = e->tail) last_elems_.push_back(e);
+  UInt64 num_elems = last_elems_.size();
+  Int32 num_workers = expand_workers_.size();
+
+  // arcs are visited twice, only the first pass is free of hashing
+  worker_group_->Run([&](Int32 w) {
+    Float64 cutoff = FLOAT64_INF;
+    for (UInt64 i = num_elems * w / num_workers,
+                end = num_elems * (w + 1) / num_workers;
+         i < end; i++) {
+      Token *tok = last_elems_[i]->val;
+      if (tok->cost_ >= weight_cutoff) continue;
+      for (const Arc &arc : fst_.EmittingArcs(last_elems_[i]->key)) {
+        Float64 new_weight = arc.weight + tok->cost_ + cost(arc.ilabel);
+        cutoff = std::min(cutoff, new_weight + adaptive_beam);
+      }
+    }
+    expand_workers_[w]->next_weight_cutoff = cutoff;
+  });
+  for (ExpandWorker *worker : expand_workers_) {
+    Float64 part_cutoff = worker->next_weight_cutoff;
+    worker->next_weight_cutoff = next_weight_cutoff;
+    next_weight_cutoff = std::min(next_weight_cutoff, part_cutoff);
+  }
+
+  worker_group_->Run([&](Int32 w) {
+    ExpandWorker *worker = expand_workers_[w];
+    // tokens are allocated from the shared pool in batches
+    HolderCache<Token> cache(&token_pool_);
+    worker->toks.Clear();
+    for (std::vector<WorkerElem *> &shard : worker->shards) shard.clear();
+    worker->num_arcs = worker->num_new_tokens = 0;
+    Float64 cutoff = worker->next_weight_cutoff;
+    for (UInt64 i = num_elems * w / num_workers,
+                end = num_elems * (w + 1) / num_workers;
+         i < end; i++) {
+      Token *tok = last_elems_[i]->val;
+      if (tok->cost_ >= weight_cutoff) continue;
+      for (const Arc &arc : fst_.EmittingArcs(last_elems_[i]->key)) {
+        if (kProfiling) worker->num_arcs++;
+        Float32 ac_cost = cost(arc.ilabel);
+        Float64 new_weight = arc.weight + tok->cost_ + ac_cost;
+        if (new_weight >= cutoff) continue;
+        if (new_weight + adaptive_beam < cutoff)
+          cutoff = new_weight + adaptive_beam;
+        WorkerElem *e_found = worker->toks.Find(arc.nextstate);
+        if (e_found == NULL) {
+          worker->toks.Insert(
+              arc.nextstate,
+              cache.New(arc, tok, ac_cost, SilenceFrames(arc, tok)));
+        } else if (e_found->val->cost_ > new_weight) {
+          // new_weight equals cost_ of the new token, no need to construct it
+          FreeNewToken(e_found->val, &cache);
+          e_found->val = cache.New(arc, tok, ac_cost, SilenceFrames(arc, tok));
+        } else {
+          continue;
+        }
+        if (kProfiling) worker->num_new_tokens++;
+      }
+    }
+    worker->next_weight_cutoff = cutoff;
+    for (WorkerElem *e = worker->toks.GetList(); e != NULL; e = e->tail)
+      worker->shards[StateShard(e->key)].push_back(e);
+  });
+
+  worker_group_->Run([&](Int32 w) {
+    ExpandWorker *worker = expand_workers_[w];
+    worker->owners.Clear();
+    worker->losers.clear();
+    for (ExpandWorker *from : expand_workers_) {
+      for (WorkerElem *e : from->shards[w]) {
+        typename FlatHashList<StateId, WorkerElem *>::Elem *e_found =
+            worker->owners.Find(e->key);
+        if (e_found == NULL) {
+          worker->owners.Insert(e->key, e);
+          continue;
+        }
+        WorkerElem *owner = e_found->val;
+        if (owner->val->cost_ > e->val->cost_) std::swap(owner->val, e->val);
+        worker->losers.push_back(e->val);
+        e->val = NULL;
+      }
+    }
+  });
 
+  for (ExpandWorker *worker : expand_workers_) {
+    for (WorkerElem *e = worker->toks.GetList(); e != NULL; e = e->tail)
+      if (e->val) toks_.Insert(e->key, e->val);
+    for (Token *tok : worker->losers) FreeToken(tok);
+    next_weight_cutoff =
+        std::min(next_weight_cutoff, worker->next_weight_cutoff);
+    if (kProfiling) {
+      frame_stats_.num_arcs += worker->num_arcs;
+      frame_stats_.num_new_tokens += worker->num_new_tokens;
+    }
+  }
+  for (Elem *e : last_elems_) {
+    FreeToken(e->val);
+    toks_.Delete(e);
+  }
   return next_weight_cutoff;
 }
 
-void FasterDecoder::ProcessNonemitting(Float64 cutoff) {
+template <template <class, class> class HashListT, class FST>
+void FasterDecoderTpl<HashListT, FST>::ProcessNonemitting(Float64 cutoff) {
   // Processes nonemitting arcs for one frame.
   ASSERT(queue_.empty());
   for (const Elem *e = toks_.GetList(); e != NULL; e = e->tail)
@@ -200,26 +545,25 @@ void FasterDecoder::ProcessNonemitting(Float64 cutoff) {
 
     ASSERT(tok != NULL && state == tok->arc_.nextstate);
     // std::cerr << "Go: pop state(" << state << "), push state(";
-    for (ArcIterator aiter(fst_, state); !aiter.Done(); aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      if (arc.ilabel == 0) {
-        Token *new_tok = new Token(arc, tok);
-        if (new_tok->cost_ > cutoff) {
-          FreeToken(new_tok);
+    // only the leading input epsilon arcs
+    for (const Arc &arc : fst_.EpsilonArcs(state)) {
+      if (kProfiling) frame_stats_.num_arcs++;
+      Token *new_tok = NewToken(arc, tok);
+      if (new_tok->cost_ > cutoff) {
+        FreeToken(new_tok);
+      } else {
+        Elem *e_found = toks_.Find(arc.nextstate);
+        if (e_found == NULL) {
+          toks_.Insert(arc.nextstate, new_tok);
+          queue_.push_back(arc.nextstate);
         } else {
-          Elem *e_found = toks_.Find(arc.nextstate);
-          if (e_found == NULL) {
-            toks_.Insert(arc.nextstate, new_tok);
+          if (e_found->val->cost_ > new_tok->cost_) {
+            FreeToken(e_found->val);
+            e_found->val = new_tok;
             queue_.push_back(arc.nextstate);
+            // std::cerr << arc.nextstate << " ";
           } else {
-            if (e_found->val->cost_ > new_tok->cost_) {
-              FreeToken(e_found->val);
-              e_found->val = new_tok;
-              queue_.push_back(arc.nextstate);
-              // std::cerr << arc.nextstate << " ";
-            } else {
-              FreeToken(new_tok);
-            }
+            FreeToken(new_tok);
           }
         }
       }
@@ -227,23 +571,39 @@ void FasterDecoder::ProcessNonemitting(Float64 cutoff) {
     // std::cerr << ")" << std::endl;
     num_iter++;
   }
-  if (debug_decoder) LOG_INFO << "Go " << num_iter << " iterations";
+  if (kProfiling) frame_stats_.num_epsilon_iters = num_iter;
+  LOG_DEBUG << "Go " << num_iter << " iterations";
 }
 
-inline Float32 FasterDecoder::NegativeLoglikelihood(Float32 *loglikes,
-                                                    Label tid) {
-  Int32 pdf_id = table_.TransitionIdToPdf(tid);
-  return -loglikes[pdf_id] * acoustic_scale_ + word_penalty_;
+template <template <class, class> class HashListT, class FST>
+template <class Loglikes>
+void FasterDecoderTpl<HashListT, FST>::ComputeCostTable(
+    const Loglikes &loglikes, Int32 num_pdfs) {
+  // Scale first (could be vectorized), then gather by transition-id. If graph
+  // is labeled by pdf-ids, ilabel is pdf-id + 1 and no gather is needed
+  Float32 *cost_table = cost_table_.data(),
+          *pdf_cost = fst_.IsPdfLabeled() ? cost_table + 1 : pdf_cost_.data();
+  for (Int32 p = 0; p < num_pdfs; p++)
+    pdf_cost[p] = -loglikes[p] * acoustic_scale_ + word_penalty_;
+  if (fst_.IsPdfLabeled()) return;
+  const Int32 *table = table_.Table();
+  Int32 num_tids = table_.NumTransitionIds();
+  // transition-id starts from 1
+  for (Int32 tid = 1; tid <= num_tids; tid++)
+    cost_table[tid] = pdf_cost[table[tid - 1]];
 }
 
-Bool FasterDecoder::ReachedFinal() {
+template <template <class, class> class HashListT, class FST>
+Bool FasterDecoderTpl<HashListT, FST>::ReachedFinal() {
   for (const Elem *e = toks_.GetList(); e != NULL; e = e->tail) {
     if (e->val->cost_ != FLOAT64_INF && fst_.Final(e->key) != 0) return true;
   }
   return false;
 }
 
-Bool FasterDecoder::GetBestPath(std::vector<Int32> *word_sequence) {
+template <template <class, class> class HashListT, class FST>
+Bool FasterDecoderTpl<HashListT, FST>::GetBestPath(
+    std::vector<Int32> *word_sequence) {
   // do not clear
   // word_sequence->clear();
   // std::vector<Int32>::iterator end_iter = word_sequence->end();
@@ -255,10 +615,9 @@ Bool FasterDecoder::GetBestPath(std::vector<Int32> *word_sequence) {
     for (const Elem *e = toks_.GetList(); e != NULL; e = e->tail)
       if (best_tok == NULL || best_tok->cost_ > e->val->cost_)
         best_tok = e->val;
-    if (debug_decoder)
-      LOG_INFO << "Log-like per frame is "
-               << -best_tok->cost_ / num_frames_decoded_ << " over "
-               << num_frames_decoded_ << " frames[PARTIAL]";
+    LOG_DEBUG << "Log-like per frame is "
+              << -best_tok->cost_ / num_frames_decoded_ << " over "
+              << num_frames_decoded_ << " frames[PARTIAL]";
   } else {
     Float64 best_cost = FLOAT64_INF;
     for (const Elem *e = toks_.GetList(); e != NULL; e = e->tail) {
@@ -268,9 +627,8 @@ Bool FasterDecoder::GetBestPath(std::vector<Int32> *word_sequence) {
         best_tok = e->val;
       }
     }
-    if (debug_decoder)
-      LOG_INFO << "Log-like per frame is " << -best_cost / num_frames_decoded_
-               << " over " << num_frames_decoded_ << " frames";
+    LOG_DEBUG << "Log-like per frame is " << -best_cost / num_frames_decoded_
+              << " over " << num_frames_decoded_ << " frames";
   }
   if (best_tok == NULL) return false;
 
@@ -285,23 +643,360 @@ Bool FasterDecoder::GetBestPath(std::vector<Int32> *word_sequence) {
   return true;
 }
 
-void FasterDecoder::ClearToks(Elem *list) {
+// Following Kaldi's OnlineFasterDecoder::UpdateImmortalToken(), trace back from
+// all active tokens frame by frame until they meet. It stops at the old
+// immortal token at latest, which is an ancestor of all of them.
+template <template <class, class> class HashListT, class FST>
+void FasterDecoderTpl<HashListT, FST>::UpdateImmortalToken() {
+  emitting_.clear();
+  for (const Elem *e = toks_.GetList(); e != NULL; e = e->tail) {
+    Token *tok = e->val;
+    while (tok != NULL && tok->arc_.ilabel == 0) tok = tok->prev_;
+    if (tok != NULL) emitting_.push_back(tok);
+  }
+  while (true) {
+    std::sort(emitting_.begin(), emitting_.end());
+    emitting_.erase(std::unique(emitting_.begin(), emitting_.end()),
+                    emitting_.end());
+    if (emitting_.size() <= 1) break;
+    prev_emitting_.clear();
+    for (Token *tok : emitting_) {
+      Token *prev_tok = tok->prev_;
+      while (prev_tok != NULL && prev_tok->arc_.ilabel == 0)
+        prev_tok = prev_tok->prev_;
+      if (prev_tok != NULL) prev_emitting_.push_back(prev_tok);
+    }
+    std::swap(emitting_, prev_emitting_);
+  }
+  if (emitting_.size() != 1 || emitting_[0] == immortal_tok_) return;
+  Token *the_one = emitting_[0];
+  Int32 num_labels = 0;
+  for (Token *tok = the_one; tok != immortal_tok_; tok = tok->prev_) {
+    ASSERT(tok != NULL);
+    if (tok->arc_.olabel) {
+      new_stable_words_.push_back(tok->arc_.olabel);
+      num_labels++;
+    }
+  }
+  if (num_labels)
+    std::reverse(new_stable_words_.end() - num_labels, new_stable_words_.end());
+  the_one->ref_count_++;
+  if (immortal_tok_) FreeToken(immortal_tok_);
+  immortal_tok_ = the_one;
+}
+
+template <template <class, class> class HashListT, class FST>
+void FasterDecoderTpl<HashListT, FST>::GetPartialPath(
+    std::vector<Int32> *stable_words, std::vector<Int32> *partial_words) {
+  ASSERT(stable_words && partial_words);
+  if (!reset_) LOG_FAIL << "Need call Reset() first to initialize decoder";
+  UpdateImmortalToken();
+  stable_words->insert(stable_words->end(), new_stable_words_.begin(),
+                       new_stable_words_.end());
+  new_stable_words_.clear();
+
+  partial_words->clear();
+  Token *best_tok = NULL;
+  for (const Elem *e = toks_.GetList(); e != NULL; e = e->tail)
+    if (best_tok == NULL || best_tok->cost_ > e->val->cost_)
+      best_tok = e->val;
+  for (Token *tok = best_tok; tok != NULL && tok != immortal_tok_;
+       tok = tok->prev_)
+    if (tok->arc_.olabel) partial_words->push_back(tok->arc_.olabel);
+  std::reverse(partial_words->begin(), partial_words->end());
+}
+
+template <template <class, class> class HashListT, class FST>
+typename FasterDecoderTpl<HashListT, FST>::Token *
+FasterDecoderTpl<HashListT, FST>::BestToken(Float32 *final_relative_cost) {
+  Token *best_tok = NULL;
+  Float64 best_cost_with_final = FLOAT64_INF;
+  for (const Elem *e = toks_.GetList(); e != NULL; e = e->tail) {
+    if (best_tok == NULL || best_tok->cost_ > e->val->cost_) best_tok = e->val;
+    if (final_relative_cost)
+      best_cost_with_final =
+          std::min(best_cost_with_final, e->val->cost_ + fst_.Final(e->key));
+  }
+  if (final_relative_cost) {
+    if (best_tok == NULL || best_tok->cost_ == FLOAT64_INF ||
+        best_cost_with_final == FLOAT64_INF)
+      *final_relative_cost = FLOAT32_INF;
+    else
+      *final_relative_cost = best_cost_with_final - best_tok->cost_;
+  }
+  return best_tok;
+}
+
+template <template <class, class> class HashListT, class FST>
+Float32 FasterDecoderTpl<HashListT, FST>::FinalRelativeCost() {
+  Float32 final_relative_cost;
+  BestToken(&final_relative_cost);
+  return final_relative_cost;
+}
+
+template <template <class, class> class HashListT, class FST>
+Int32 FasterDecoderTpl<HashListT, FST>::TrailingSilenceFrames() {
+  Token *best_tok = BestToken(NULL);
+  return best_tok ? best_tok->silence_frames_ : 0;
+}
+
+template <template <class, class> class HashListT, class FST>
+Bool FasterDecoderTpl<HashListT, FST>::EndpointDetected() {
+  Float32 final_relative_cost;
+  Token *best_tok = BestToken(&final_relative_cost);
+  return endpoint_opts_.Detected(num_frames_decoded_,
+                                 best_tok ? best_tok->silence_frames_ : 0,
+                                 final_relative_cost);
+}
+
+template <template <class, class> class HashListT, class FST>
+void FasterDecoderTpl<HashListT, FST>::AccumulateActiveStates(
+    std::vector<UInt64> *counts) {
+  ASSERT(counts);
+  if (counts->size() < fst_.NumStates()) counts->resize(fst_.NumStates(), 0);
+  for (const Elem *e = toks_.GetList(); e != NULL; e = e->tail)
+    (*counts)[e->key]++;
+}
+
+template <template <class, class> class HashListT, class FST>
+void FasterDecoderTpl<HashListT, FST>::SaveState(std::ostream &os) {
+  std::vector<TokenRecord> records;
+  std::vector<Int32> active;
+  Int32 immortal;
+  SaveToks(true, &records, &active, &immortal);
+  WriteToken(os, "<DecoderState>");
+  WriteBinaryBasicType(os, static_cast<UInt64>(fst_.NumStates()));
+  WriteBinaryBasicType(os, num_frames_decoded_);
+  WriteBinaryBasicType(os, num_frames_received_);
+  WriteBinaryBasicType(os, num_frames_skipped_);
+  WriteBinaryBasicType(os, static_cast<Int32>(reset_));
+  // decides the list order of toks_ (HashList), so the search continues the
+  // same way
+  WriteBinaryBasicType(os, static_cast<UInt64>(toks_.Size()));
+  WriteBinaryBasicType(os, static_cast<Int32>(new_stable_words_.size()));
+  for (Int32 word : new_stable_words_) WriteBinaryBasicType(os, word);
+  // field by field, no struct padding or layout in the bytes
+  WriteBinaryBasicType(os, static_cast<Int32>(records.size()));
+  for (const TokenRecord &record : records) {
+    WriteBinaryArc(os, record.arc);
+    WriteBinaryBasicType(os, record.prev);
+    WriteBinaryBasicType(os, record.cost);
+  }
+  WriteBinaryBasicType(os, static_cast<Int32>(active.size()));
+  for (Int32 i : active) WriteBinaryBasicType(os, i);
+  WriteBinaryBasicType(os, immortal);
+}
+
+template <template <class, class> class HashListT, class FST>
+void FasterDecoderTpl<HashListT, FST>::RestoreState(std::istream &is) {
+  ExpectToken(is, "<DecoderState>");
+  UInt64 num_states, hash_size;
+  ReadBinaryBasicType(is, &num_states);
+  if (num_states != fst_.NumStates())
+    LOG_FAIL << "State is saved on a graph of " << num_states
+             << " states, but this one has " << fst_.NumStates();
+  // read into locals, members are not touched until all of them are checked
+  Int32 num_frames_decoded, num_frames_received, num_frames_skipped;
+  Int32 reset, num_words, num_records, num_active, immortal;
+  ReadBinaryBasicType(is, &num_frames_decoded);
+  ReadBinaryBasicType(is, &num_frames_received);
+  ReadBinaryBasicType(is, &num_frames_skipped);
+  if (num_frames_decoded < 0 || num_frames_received < 0 ||
+      num_frames_skipped < 0)
+    LOG_FAIL << "Bad frame counts in saved state: " << num_frames_decoded
+             << "/" << num_frames_received << "/" << num_frames_skipped;
+  ReadBinaryBasicType(is, &reset);
+  ReadBinaryBasicType(is, &hash_size);
+  if (hash_size == 0) LOG_FAIL << "Bad hash size 0 in saved state";
+  ReadBinaryBasicType(is, &num_words);
+  if (num_words < 0) LOG_FAIL << "Bad number of words " << num_words;
+  std::vector<Int32> stable_words(num_words);
+  for (Int32 &word : stable_words) ReadBinaryBasicType(is, &word);
+  ReadBinaryBasicType(is, &num_records);
+  if (num_records < 0) LOG_FAIL << "Bad number of tokens " << num_records;
+  std::vector<TokenRecord> records(num_records);
+  for (TokenRecord &record : records) {
+    ReadBinaryArc(is, &record.arc);
+    ReadBinaryBasicType(is, &record.prev);
+    ReadBinaryBasicType(is, &record.cost);
+  }
+  ReadBinaryBasicType(is, &num_active);
+  if (num_active < 0) LOG_FAIL << "Bad number of active tokens " << num_active;
+  std::vector<Int32> active(num_active);
+  for (Int32 &i : active) ReadBinaryBasicType(is, &i);
+  ReadBinaryBasicType(is, &immortal);
+  for (Int32 i = 0; i < num_records; i++) {
+    const TokenRecord &record = records[i];
+    if (record.prev < -1 || record.prev >= i || record.arc.nextstate < 0 ||
+        record.arc.nextstate >= static_cast<StateId>(num_states))
+      LOG_FAIL << "Bad token " << i << " in saved state";
+  }
+  for (Int32 i : active)
+    if (i < 0 || i >= num_records) LOG_FAIL << "Bad active token " << i;
+  if (immortal < -1 || immortal >= num_records)
+    LOG_FAIL << "Bad immortal token " << immortal;
+  num_frames_decoded_ = num_frames_decoded;
+  num_frames_received_ = num_frames_received;
+  num_frames_skipped_ = num_frames_skipped;
+  new_stable_words_.swap(stable_words);
+  reset_ = reset;
+  ClearToks(toks_.Clear());
+  toks_.SetSize(hash_size);
+  RestoreToks(records, active, immortal);
+}
+
+template <template <class, class> class HashListT, class FST>
+void FasterDecoderTpl<HashListT, FST>::SaveState(std::string *buffer) {
+  ASSERT(buffer);
+  std::ostringstream oss;
+  SaveState(oss);
+  *buffer = oss.str();
+}
+
+template <template <class, class> class HashListT, class FST>
+void FasterDecoderTpl<HashListT, FST>::RestoreState(const std::string &buffer) {
+  std::istringstream iss(buffer);
+  RestoreState(iss);
+}
+
+template <template <class, class> class HashListT, class FST>
+void FasterDecoderTpl<HashListT, FST>::SaveToks(
+    Bool prune, std::vector<TokenRecord> *records, std::vector<Int32> *active,
+    Int32 *immortal) {
+  ASSERT(records && active && immortal);
+  // number tokens parents first, walking back from each one until a
+  // numbered ancestor
+  std::unordered_map<Token *, Int32> index;
+  std::vector<Token *> order, path;
+  auto visit = [&](Token *tok) {
+    path.clear();
+    for (; tok != NULL && !index.count(tok); tok = tok->prev_)
+      path.push_back(tok);
+    for (auto iter = path.rbegin(); iter != path.rend(); iter++) {
+      index[*iter] = order.size();
+      order.push_back(*iter);
+    }
+  };
+  if (immortal_tok_) visit(immortal_tok_);
+  for (const Elem *e = toks_.GetList(); e != NULL; e = e->tail) visit(e->val);
+  Int32 num_toks = order.size();
+  std::vector<Int32> prev(num_toks);
+  for (Int32 i = 0; i < num_toks; i++)
+    prev[i] = order[i]->prev_ ? index[order[i]->prev_] : -1;
+  active->clear();
+  for (const Elem *e = toks_.GetList(); e != NULL; e = e->tail)
+    active->push_back(index[e->val]);
+  *immortal = immortal_tok_ ? index[immortal_tok_] : -1;
+
+  // ancestors of the common ancestor form a chain, keep only words on it
+  std::vector<Bool> keep(num_toks, true), chain(num_toks, false);
+  if (prune && !active->empty()) {
+    std::vector<UInt64> below(num_toks, 0);
+    for (Int32 i : *active) below[i]++;
+    for (Int32 i = num_toks - 1; i >= 0; i--)
+      if (prev[i] >= 0) below[prev[i]] += below[i];
+    // the deepest one covering all active tokens
+    Int32 ancestor = 0;
+    for (Int32 i = 0; i < num_toks; i++)
+      if (below[i] == active->size()) ancestor = i;
+    for (Int32 i = prev[ancestor]; i >= 0; i = prev[i]) {
+      chain[i] = true;
+      keep[i] = order[i]->arc_.olabel != 0 || i == *immortal;
+    }
+  }
+  std::vector<Int32> new_index(num_toks, -1), kept_prev(num_toks, -1);
+  records->clear();
+  for (Int32 i = 0; i < num_toks; i++) {
+    Int32 p = prev[i];
+    kept_prev[i] = (p < 0 || keep[p]) ? p : kept_prev[p];
+    if (!keep[i]) continue;
+    new_index[i] = records->size();
+    TokenRecord record;
+    record.arc = order[i]->arc_;
+    if (chain[i]) record.arc.ilabel = 0;
+    record.prev = kept_prev[i] >= 0 ? new_index[kept_prev[i]] : -1;
+    record.cost = order[i]->cost_;
+    records->push_back(record);
+  }
+  for (Int32 &i : *active) i = new_index[i];
+  if (*immortal >= 0) *immortal = new_index[*immortal];
+}
+
+template <template <class, class> class HashListT, class FST>
+void FasterDecoderTpl<HashListT, FST>::RestoreToks(
+    const std::vector<TokenRecord> &records, const std::vector<Int32> &active,
+    Int32 immortal) {
+  std::vector<Token *> toks(records.size());
+  for (UInt64 i = 0; i < records.size(); i++) {
+    const TokenRecord &record = records[i];
+    Token *prev = record.prev >= 0 ? toks[record.prev] : NULL;
+    Token *tok = token_pool_.New(record.arc, prev, 0.0,
+                                 SilenceFrames(record.arc, prev));
+    tok->cost_ = record.cost;
+    // only references of children so far
+    tok->ref_count_--;
+    toks[i] = tok;
+  }
+  for (Int32 i : active) {
+    toks[i]->ref_count_++;
+    toks_.Insert(toks[i]->arc_.nextstate, toks[i]);
+  }
+  immortal_tok_ = immortal >= 0 ? toks[immortal] : NULL;
+  if (immortal_tok_) immortal_tok_->ref_count_++;
+}
+
+template <template <class, class> class HashListT, class FST>
+void FasterDecoderTpl<HashListT, FST>::ClearToks(Elem *list) {
   for (Elem *e = list, *e_tail; e != NULL; e = e_tail) {
-    FreeToken(e->val);
     e_tail = e->tail;
     // delete Elem
     toks_.Delete(e);
   }
+  // All live tokens are reachable from the list, no need to traceback
+  token_pool_.Release();
 }
 
-void FasterDecoder::FreeToken(Token *tok) {
+template <template <class, class> class HashListT, class FST>
+void FasterDecoderTpl<HashListT, FST>::FreeToken(Token *tok) {
   // traceback
   while (--tok->ref_count_ == 0) {
     Token *prev = tok->prev_;
-    delete tok;  // delete or other free function
+    token_pool_.Free(tok);
     if (prev == NULL)
       return;
     else
       tok = prev;
   }
-}
\ No newline at end of file
+}
+
+template class FasterDecoderTpl<HashList, ConstFst>;
+template class FasterDecoderTpl<FlatHashList, ConstFst>;
+template class FasterDecoderTpl<HashList, CompactFst>;
+
+// ComposeFst is not held by DecodeGraph, so not all the constructors are
+// valid, instantiate the members one by one
+typedef FasterDecoderTpl<HashList, ComposeFst> ComposeDecoder;
+template void ComposeDecoder::Init(const DecodeOpts &opts);
+template void ComposeDecoder::Reset();
+template void ComposeDecoder::DecodeFrame(Float32 *loglikes, Int32 num_pdfs);
+template void ComposeDecoder::DecodeFrame(const UInt16 *loglikes,
+                                          Int32 num_pdfs);
+template void ComposeDecoder::DecodeFrame(const Int08 *loglikes,
+                                          Float32 scale, Int32 num_pdfs);
+template void ComposeDecoder::Decode(Float32 *loglikes, Int32 num_frames,
+                                     Int32 stride, Int32 num_pdfs);
+template void ComposeDecoder::Decode(const UInt16 *loglikes, Int32 num_frames,
+                                     Int32 stride, Int32 num_pdfs);
+template void ComposeDecoder::Decode(const Int08 *loglikes,
+                                     const Float32 *scales, Int32 num_frames,
+                                     Int32 stride, Int32 num_pdfs);
+template Bool ComposeDecoder::ReachedFinal();
+template Bool ComposeDecoder::GetBestPath(std::vector<Int32> *word_sequence);
+template void ComposeDecoder::GetPartialPath(std::vector<Int32> *stable_words,
+                                             std::vector<Int32> *partial_words);
+template Float32 ComposeDecoder::FinalRelativeCost();
+template Int32 ComposeDecoder::TrailingSilenceFrames();
+template Bool ComposeDecoder::EndpointDetected();
+template void ComposeDecoder::AccumulateActiveStates(
+    std::vector<UInt64> *counts);
+template void ComposeDecoder::ClearToks(Elem *list);
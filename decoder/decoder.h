@@ -5,25 +5,74 @@
 #ifndef DECODER_H
 #define DECODER_H
 
+#include <unordered_map>
+
 #include "decoder/common.h"
+#include "decoder/compose-fst.h"
 #include "decoder/config.h"
+#include "decoder/const-fst.h"
+#include "decoder/decode-graph.h"
+#include "decoder/endpoint.h"
+#include "decoder/flat-hash-list.h"
 #include "decoder/hash-list.h"
+#include "decoder/holder.h"
+#include "decoder/loglikes.h"
+#include "decoder/profiler.h"
 #include "decoder/simple-fst.h"
+#include "decoder/symbol-table.h"
 #include "decoder/transition-table.h"
+#include "decoder/worker-group.h"
 
 struct DecodeOpts {
   Int32 min_active, max_active;
   Float32 beam, acwt, penalty;
+  // Convert loglikes into a cost table indexed by transition-id once per
+  // frame, instead of looking up TransitionTable for each arc
+  Bool precompute_cost;
+  // If > 0, estimate max/min-active cutoff using a histogram of token costs
+  // with this number of bins over [best, best + beam), instead of exact
+  // nth_element. The error is bounded by the bin width (beam / bins)
+  Int32 histogram_bins;
+  // Decode() takes one of every frame_subsampling_factor rows of loglikes
+  // (rows 0, n, 2n ... counted from Reset()), for models trained on
+  // subsampled frames (egs: 3 for chain models). DecodeFrame() is not affected
+  Int32 frame_subsampling_factor;
+  // If blank_id >= 0, frames with loglikes[blank_id] > log(blank_threshold)
+  // are skipped without advancing tokens (blank skipping of CTC-style models,
+  // loglikes should be log-posteriors)
+  Int32 blank_id;
+  Float32 blank_threshold;
+  // If num_threads > 1, emitting arcs of a frame with at least
+  // parallel_min_tokens active tokens are expanded by num_threads threads
+  // (the caller included), see FasterDecoderTpl::ExpandParallel(). Results
+  // are same as num_threads = 1. Limited to the number of cores (serial on a
+  // single core). Not supported on ComposeFst
+  Int32 num_threads, parallel_min_tokens;
+  // Used by EndpointDetected(), frames are counted in decoded frames
+  EndpointOpts endpoint_opts;
 
   DecodeOpts(Int32 min_active = 200, Int32 max_active = 7000,
-             Float32 beam = 15.0, Float32 acwt = 0.1, Float32 penalty = 0.0)
+             Float32 beam = 15.0, Float32 acwt = 0.1, Float32 penalty = 0.0,
+             Bool precompute_cost = false, Int32 histogram_bins = 0,
+             Int32 frame_subsampling_factor = 1, Int32 blank_id = -1,
+             Float32 blank_threshold = 0.95)
       : min_active(min_active),
         max_active(max_active),
         beam(beam),
         acwt(acwt),
-        penalty(penalty) {}
-
-  DecodeOpts(const std::string &conf) {
+        penalty(penalty),
+        precompute_cost(precompute_cost),
+        histogram_bins(histogram_bins),
+        frame_subsampling_factor(frame_subsampling_factor),
+        blank_id(blank_id),
+        blank_threshold(blank_threshold),
+        num_threads(1),
+        parallel_min_tokens(5000) {}
+
+  DecodeOpts(const std::string &conf) : DecodeOpts(ConfigureTable(conf)) {}
+
+  // From a configure parsed once, without file access
+  DecodeOpts(const ConfigureTable &conf) : DecodeOpts() {
     ConfigureParser parser(conf);
     ParseConfigure(&parser);
   }
@@ -34,6 +83,16 @@ struct DecodeOpts {
     parser->AddOptions("DecodeOpts", "beam", &beam);
     parser->AddOptions("DecodeOpts", "acwt", &acwt);
     parser->AddOptions("DecodeOpts", "penalty", &penalty);
+    parser->AddOptions("DecodeOpts", "precompute_cost", &precompute_cost);
+    parser->AddOptions("DecodeOpts", "histogram_bins", &histogram_bins);
+    parser->AddOptions("DecodeOpts", "frame_subsampling_factor",
+                       &frame_subsampling_factor);
+    parser->AddOptions("DecodeOpts", "blank_id", &blank_id);
+    parser->AddOptions("DecodeOpts", "blank_threshold", &blank_threshold);
+    parser->AddOptions("DecodeOpts", "num_threads", &num_threads);
+    parser->AddOptions("DecodeOpts", "parallel_min_tokens",
+                       &parallel_min_tokens);
+    endpoint_opts.ParseConfigure(parser);
   }
 
   std::string Configure() {
@@ -43,73 +102,192 @@ struct DecodeOpts {
     oss << "--DecodeOpts.beam=" << beam << std::endl;
     oss << "--DecodeOpts.acwt=" << acwt << std::endl;
     oss << "--DecodeOpts.penalty=" << penalty << std::endl;
+    oss << "--DecodeOpts.precompute_cost="
+        << (precompute_cost ? "true" : "false") << std::endl;
+    oss << "--DecodeOpts.histogram_bins=" << histogram_bins << std::endl;
+    oss << "--DecodeOpts.frame_subsampling_factor=" << frame_subsampling_factor
+        << std::endl;
+    oss << "--DecodeOpts.blank_id=" << blank_id << std::endl;
+    oss << "--DecodeOpts.blank_threshold=" << blank_threshold << std::endl;
+    oss << "--DecodeOpts.num_threads=" << num_threads << std::endl;
+    oss << "--DecodeOpts.parallel_min_tokens=" << parallel_min_tokens
+        << std::endl;
+    oss << endpoint_opts.Configure();
     return oss.str();
   }
 };
 
-class FasterDecoder {
+// Exact max/min-active cutoff of token costs (reordered by nth_element),
+// adaptive_beam (if not NULL) is set to the beam it implies. Shared by
+// FasterDecoderTpl and LatticeDecoder
+Float64 ExactActiveCutoff(std::vector<Float32> *costs, Float64 best_cost,
+                          Float32 beam, Int32 min_active, Int32 max_active,
+                          Float32 *adaptive_beam);
+
+// HashListT is the container of active tokens, HashList or FlatHashList, and
+// FST is the frozen graph, ConstFst (in memory or mapped), CompactFst or
+// ComposeFst. Use typedefs below. The arc loop is also instantiated for each
+// acoustic cost in loglikes.h and each loglikes type, the one matching the
+// options and graph labels is picked once per frame.
+template <template <class, class> class HashListT, class FST = ConstFst>
+class FasterDecoderTpl {
  public:
-  FasterDecoder(const SimpleFst &fst, const TransitionTable &table,
-                Int32 min_active = 200, Int32 max_active = 7000,
-                Float32 beam = 15.0, Float32 acwt = 0.1, Float32 penalty = 0.0)
-      : fst_(fst),
-        table_(table),
-        min_active_(min_active),
-        max_active_(max_active),
-        beam_(beam),
-        acoustic_scale_(acwt),
-        word_penalty_(penalty) {
-    toks_.SetSize(1000);
-    Check();
-    reset_ = false;
-  }
-
-  FasterDecoder(const SimpleFst &fst, const TransitionTable &table,
-                const DecodeOpts &opts)
-      : fst_(fst),
-        table_(table),
-        min_active_(opts.min_active),
-        max_active_(opts.max_active),
-        beam_(opts.beam),
-        acoustic_scale_(opts.acwt),
-        word_penalty_(opts.penalty) {
-    toks_.SetSize(1000);
-    Check();
-    reset_ = false;
-  }
-
-  FasterDecoder(const std::string &str_fst, const std::string &str_table,
-                const std::string &conf)
-      : fst_(str_fst), table_(str_table) {
-    DecodeOpts opts(conf);
-    min_active_ = opts.min_active, max_active_ = opts.max_active;
-    beam_ = opts.beam, acoustic_scale_ = opts.acwt,
-    word_penalty_ = opts.penalty;
-    toks_.SetSize(1000);
-    Check();
-    reset_ = false;
-  }
-
-  ~FasterDecoder() { ClearToks(toks_.Clear()); }
+  // Decode on a shared graph, which should outlive the decoder
+  FasterDecoderTpl(const DecodeGraphTpl<FST> &graph, const DecodeOpts &opts)
+      : own_graph_(NULL), fst_(graph.Fst()), table_(graph.Table()) {
+    Init(opts);
+  }
+
+  // Decode on a graph not held by DecodeGraph (egs: ComposeFst), its labels
+  // should have been checked. Both fst and table should outlive the decoder
+  FasterDecoderTpl(const FST &fst, const TransitionTable &table,
+                   const DecodeOpts &opts)
+      : own_graph_(NULL), fst_(fst), table_(table) {
+    Init(opts);
+  }
+
+  FasterDecoderTpl(const SimpleFst &fst, const TransitionTable &table,
+                   Int32 min_active = 200, Int32 max_active = 7000,
+                   Float32 beam = 15.0, Float32 acwt = 0.1,
+                   Float32 penalty = 0.0)
+      : own_graph_(new DecodeGraphTpl<FST>(fst, table)),
+        fst_(own_graph_->Fst()),
+        table_(own_graph_->Table()) {
+    Init(DecodeOpts(min_active, max_active, beam, acwt, penalty));
+  }
+
+  FasterDecoderTpl(const SimpleFst &fst, const TransitionTable &table,
+                   const DecodeOpts &opts)
+      : own_graph_(new DecodeGraphTpl<FST>(fst, table)),
+        fst_(own_graph_->Fst()),
+        table_(own_graph_->Table()) {
+    Init(opts);
+  }
+
+  // str_table is not used if graph is labeled by pdf-ids
+  FasterDecoderTpl(const std::string &str_fst, const std::string &str_table,
+                   const std::string &conf)
+      : own_graph_(new DecodeGraphTpl<FST>(str_fst, str_table)),
+        fst_(own_graph_->Fst()),
+        table_(own_graph_->Table()) {
+    Init(DecodeOpts(conf));
+  }
+
+  ~FasterDecoderTpl() {
+    ClearToks(toks_.Clear());
+    if (own_graph_) delete own_graph_;
+    if (worker_group_) delete worker_group_;
+    for (ExpandWorker *worker : expand_workers_) delete worker;
+  }
 
   void Reset();
 
   void DecodeFrame(Float32 *loglikes, Int32 num_pdfs);
 
+  // Half precision loglikes (IEEE 754 bits in UInt16), or int8 ones of
+  // loglikes[p] * scale. Values are converted only for the pdfs looked up,
+  // unless DecodeOpts.precompute_cost is true
+  void DecodeFrame(const UInt16 *loglikes, Int32 num_pdfs);
+
+  void DecodeFrame(const Int08 *loglikes, Float32 scale, Int32 num_pdfs);
+
   void Decode(Float32 *loglikes, Int32 num_frames, Int32 stride,
               Int32 num_pdfs);
 
+  void Decode(const UInt16 *loglikes, Int32 num_frames, Int32 stride,
+              Int32 num_pdfs);
+
+  // One scale per frame
+  void Decode(const Int08 *loglikes, const Float32 *scales, Int32 num_frames,
+              Int32 stride, Int32 num_pdfs);
+
+  // Number of frames tokens advanced on, not counting subsampled or skipped
   Int32 NumDecodedFrames() { return num_frames_decoded_; }
 
+  // Number of blank frames skipped since Reset()
+  Int32 NumSkippedFrames() { return num_frames_skipped_; }
+
+  Int32 FrameSubsamplingFactor() const { return frame_subsampling_factor_; }
+
+  // Threads expanding emitting arcs: DecodeOpts.num_threads limited to the
+  // cores, 1 for ComposeFst
+  Int32 NumThreads() const {
+    return worker_group_ ? static_cast<Int32>(expand_workers_.size()) : 1;
+  }
+
   Bool ReachedFinal();
 
   Bool GetBestPath(std::vector<Int32> *word_sequence);
 
+  // Same as above, but words are mapped by symbols and appended to text,
+  // separated by spaces
+  Bool GetBestPath(const SymbolTable &symbols, std::string *text) {
+    std::vector<Int32> word_sequence;
+    Bool ret = GetBestPath(&word_sequence);
+    symbols.Join(word_sequence, text);
+    return ret;
+  }
+
+  // Partial result which does not disturb decoding (no Reset() needed).
+  // Words before the immortal token (common ancestor of all active tokens)
+  // will not change, those stabilized since last call are appended to
+  // stable_words. partial_words is set to the rest of current best path.
+  // Both cost O(words since last immortal token), not O(T).
+  void GetPartialPath(std::vector<Int32> *stable_words,
+                      std::vector<Int32> *partial_words);
+
+  // Best cost with final weights minus best cost, infinity if no final state
+  // reached. Small value means that current best path ends well
+  Float32 FinalRelativeCost();
+
+  // Number of silence frames at the end of current best path. Counted on each
+  // token as it is created, so it costs one pass over active tokens, not a
+  // traceback
+  Int32 TrailingSilenceFrames();
+
+  // Check endpoint rules of DecodeOpts.endpoint_opts
+  Bool EndpointDetected();
+
+  // Add one to counts[s] for each active state s. Accumulated over a dev set,
+  // it gives the visit frequency used by FrequencyStateOrder()
+  void AccumulateActiveStates(std::vector<UInt64> *counts);
+
+  // Statistics of token allocator, accumulated since construction
+  const AllocatorStats &TokenStats() const { return token_pool_.Stats(); }
+
+  // Save the search state (active tokens, their traceback and frame counts),
+  // which could be restored by another decoder on the same graph (egs: when a
+  // stream migrates to another process), then decoding continues as if not
+  // interrupted. The traceback before the common ancestor of active tokens is
+  // pruned to the tokens with words, TrailingSilenceFrames() does not count
+  // frames before it after restored. Not supported on ComposeFst
+  void SaveState(std::ostream &os);
+
+  void RestoreState(std::istream &is);
+
+  // Same as above, on a byte buffer
+  void SaveState(std::string *buffer);
+
+  void RestoreState(const std::string &buffer);
+
+  // Record time and search statistics of each decoded frame into profiler
+  // (if built with DECODER_PROFILE), NULL to disable
+  void SetProfiler(Profiler *profiler) { profiler_ = profiler; }
+
  private:
+  FasterDecoderTpl(const FasterDecoderTpl &) = delete;
+  FasterDecoderTpl &operator=(const FasterDecoderTpl &) = delete;
+
+  void Init(const DecodeOpts &opts);
+
   void Check() {
     ASSERT(min_active_ < max_active_);
     ASSERT(min_active_ > 0 && max_active_ > 1);
     ASSERT(word_penalty_ >= 0 && word_penalty_ <= 1);
+    ASSERT(histogram_bins_ >= 0);
+    ASSERT(frame_subsampling_factor_ >= 1);
+    ASSERT(blank_id_ < num_pdfs_);
+    ASSERT(parallel_min_tokens_ >= 0);
   }
 
   class Token {
@@ -117,10 +295,17 @@ class FasterDecoder {
     Arc arc_;
     Token *prev_;
     Int32 ref_count_;
+    // TrailingSilenceFrames() of the path ending here, set on creation (fits
+    // in the padding before cost_)
+    Int32 silence_frames_;
     Float64 cost_;  // negative-log
 
-    inline Token(const Arc &arc, Token *prev, Float32 ac_cost = 0.0)
-        : arc_(arc), prev_(prev), ref_count_(1) {
+    inline Token(const Arc &arc, Token *prev, Float32 ac_cost = 0.0,
+                 Int32 silence_frames = 0)
+        : arc_(arc),
+          prev_(prev),
+          ref_count_(1),
+          silence_frames_(silence_frames) {
       if (prev) {
         prev->ref_count_++;
         cost_ = prev->cost_ + arc.weight + ac_cost;
@@ -130,35 +315,217 @@ class FasterDecoder {
     }
   };
 
-  typedef HashList<StateId, Token *>::Elem Elem;
+  typedef typename HashListT<StateId, Token *>::Elem Elem;
+
+  // Token in saved state, parents first. Written field by field by
+  // SaveState(), not as raw bytes of the struct
+  struct TokenRecord {
+    Arc arc;
+    // Index of prev record, -1 if none
+    Int32 prev;
+    Float64 cost;
+  };
+
+  // Collect tokens reachable from toks_ (and immortal_tok_) into records,
+  // active are indices of tokens in toks_ (in list order), immortal is the
+  // index of immortal_tok_ (-1 if NULL). If prune, ancestors of the common
+  // ancestor of active tokens are removed except those with words and the
+  // immortal one, they are kept as non-emitting tokens
+  void SaveToks(Bool prune, std::vector<TokenRecord> *records,
+                std::vector<Int32> *active, Int32 *immortal);
+
+  // Inverse of SaveToks(), toks_ should be empty
+  void RestoreToks(const std::vector<TokenRecord> &records,
+                   const std::vector<Int32> &active, Int32 immortal);
+
+  // Decided by options once in Init(), not per frame
+  enum CutoffType { kBeamCutoff, kExactCutoff, kHistogramCutoff };
 
   Float64 GetCutoff(Elem *list_head, UInt64 *tok_count, Float32 *adaptive_beam,
                     Elem **best_elem);
 
-  Float64 ProcessEmitting(Float32 *loglikes, Int32 num_pdfs);
+  // Exact min/max-active cutoff using nth_element
+  Float64 GetExactCutoff(Elem *list_head, Float64 best_cost,
+                         Float32 *adaptive_beam);
+
+  // Approximate min/max-active cutoff using histogram of token costs
+  Float64 GetHistogramCutoff(Elem *list_head, Float64 best_cost,
+                             Float32 *adaptive_beam);
+
+  // Decode one frame, Loglikes is one of the rows in loglikes.h
+  template <class Loglikes>
+  void DecodeRow(const Loglikes &loglikes, Int32 num_pdfs);
+
+  // Row of the first frame decoded by Decode() on num_frames rows
+  Int32 FirstSubsampledRow(Int32 num_frames, Int32 stride, Int32 num_pdfs);
+
+  // Cost is one of the acoustic costs in loglikes.h
+  template <class Cost>
+  Float64 ProcessEmitting(const Cost &cost);
+
+  // Parallel version of the arc loop in ProcessEmitting(), tokens of last_toks
+  // are split into contiguous parts, one per worker. The serial loop is
+  // reproduced exactly, whatever the number of workers:
+  //  0) each worker computes the cutoff its part alone tightens to, so part w
+  //     starts from the cutoff the serial loop has on reaching it (that of
+  //     the best token tightened by parts before w)
+  //  1) each worker expands its part from that cutoff, recombines new tokens
+  //     in a local map (in order of first insertion), then splits them into
+  //     shards by nextstate
+  //  2) worker w merges shard w of all the workers in order: the best token
+  //     of each state (the earlier on ties) is moved to its first entry, the
+  //     others are cleared
+  //  3) the caller inserts the first entries into toks_ in worker order, i.e.
+  //     the order the serial loop inserts states, then frees the losers and
+  //     last_toks (token ref counts are shared across parts)
+  // Returns next_weight_cutoff, the min of all workers
+  template <class Cost>
+  Float64 ExpandParallel(const Cost &cost, Elem *last_toks,
+                         Float64 weight_cutoff, Float32 adaptive_beam,
+                         Float64 next_weight_cutoff);
+
+  inline Int32 LabelToPdf(Label ilabel) const {
+    return fst_.IsPdfLabeled() ? ilabel - 1 : table_.TransitionIdToPdf(ilabel);
+  }
 
-  inline Float32 NegativeLoglikelihood(Float32 *loglikes, Label tid);
+  // Fill cost_table_ using loglikes of current frame
+  template <class Loglikes>
+  void ComputeCostTable(const Loglikes &loglikes, Int32 num_pdfs);
 
   void ProcessNonemitting(Float64 cutoff);
 
-  HashList<StateId, Token *> toks_;
+  HashListT<StateId, Token *> toks_;
 
+  // Delete all elements and release all tokens
   void ClearToks(Elem *list);
 
+  // Move immortal_tok_ forward and collect words it passes
+  void UpdateImmortalToken();
+
+  inline Token *NewToken(const Arc &arc, Token *prev, Float32 ac_cost = 0.0) {
+    if (kProfiling) frame_stats_.num_new_tokens++;
+    return token_pool_.New(arc, prev, ac_cost, SilenceFrames(arc, prev));
+  }
+
+  // Token::silence_frames_ of a token on arc from prev, in O(1): frames since
+  // the last word, or with silence pdfs, the trailing frames on silence pdfs
+  inline Int32 SilenceFrames(const Arc &arc, const Token *prev) const {
+    Int32 prev_frames = prev ? prev->silence_frames_ : 0;
+    if (!use_silence_mask_)
+      return (arc.olabel == 0) * (prev_frames + (arc.ilabel != 0));
+    if (arc.ilabel == 0) return prev_frames;
+    return silence_mask_[LabelToPdf(arc.ilabel)] ? prev_frames + 1 : 0;
+  }
+
+  // Best active token (NULL if none) in one pass over toks_, and
+  // FinalRelativeCost() if final_relative_cost is not NULL
+  Token *BestToken(Float32 *final_relative_cost);
+
   inline void FreeToken(Token *tok);
 
+  // Used by ExpandParallel() for tokens expanded in this frame, whose prev is
+  // still referenced by last_toks, so no traceback
+  inline void FreeNewToken(Token *tok, HolderCache<Token> *cache) {
+    tok->prev_->ref_count_--;
+    cache->Free(tok);
+  }
+
+  // Per-worker state of ExpandParallel(), reused across frames
+  typedef typename FlatHashList<StateId, Token *>::Elem WorkerElem;
+
+  struct ExpandWorker {
+    // Local recombination (phase 1), val cleared if lost in phase 2
+    FlatHashList<StateId, Token *> toks;
+    // Entries of toks by shard
+    std::vector<std::vector<WorkerElem *>> shards;
+    // First entry of each state of its shard over all the workers (phase 2)
+    FlatHashList<StateId, WorkerElem *> owners;
+    // Tokens lost in phase 2, freed by the caller
+    std::vector<Token *> losers;
+    // Cutoff of its part alone (phase 0), then the one it starts from and
+    // ends with (phase 1)
+    Float64 next_weight_cutoff;
+    // Counted only if kProfiling
+    UInt64 num_arcs, num_new_tokens;
+  };
+
+  // Shard of a state in ExpandParallel()
+  inline Int32 StateShard(StateId state) const {
+    // fibonacci hashing to [0, 2^32), then scaled to [0, num_workers)
+    UInt64 h = (static_cast<UInt32>(state) * 0x9E3779B97F4A7C15ULL) >> 32;
+    return static_cast<Int32>((h * expand_workers_.size()) >> 32);
+  }
+
+  // Tokens are allocated from here, reused across utterances
+  Holder<Token> token_pool_;
+
+  // Epsilon closure of the start state saved by the first Reset(), restored
+  // by later ones while the hash size of toks_ (which decides list order) is
+  // the same
+  std::vector<TokenRecord> start_records_;
+  std::vector<Int32> start_active_;
+  UInt64 start_hash_size_;
+
   std::vector<StateId> queue_;
   std::vector<Float32> cost_active_;
-
-  SimpleFst fst_;
-  TransitionTable table_;
+  // Common ancestor of all active tokens, hold one reference of it
+  Token *immortal_tok_;
+  // Words stabilized but not returned by GetPartialPath()
+  std::vector<Int32> new_stable_words_;
+  // Used by UpdateImmortalToken()
+  std::vector<Token *> emitting_, prev_emitting_;
+
+  EndpointOpts endpoint_opts_;
+  // Indexed by pdf-id, empty if silence is not given
+  std::vector<Bool> silence_mask_;
+  Bool use_silence_mask_;
+  // Counts of token costs, used by GetHistogramCutoff()
+  std::vector<UInt32> histogram_;
+  // Scaled negative loglikes, indexed by pdf-id and transition-id
+  std::vector<Float32> pdf_cost_, cost_table_;
+
+  // Not NULL if the graph is not shared
+  DecodeGraphTpl<FST> *own_graph_;
+  // Frozen graph, input epsilon arcs first
+  const FST &fst_;
+  // Empty if fst_ is labeled by pdf-ids
+  const TransitionTable &table_;
+  Int32 num_pdfs_;
 
   Int32 min_active_, max_active_;
   Float32 beam_;
   Float32 acoustic_scale_, word_penalty_;  // acwt and word penalty
+  Bool precompute_cost_;
+  Int32 histogram_bins_;
+  CutoffType cutoff_type_;
+  Int32 frame_subsampling_factor_, blank_id_;
+  Float32 log_blank_threshold_;
 
   Int32 num_frames_decoded_;
+  // Rows passed to Decode() and blank frames skipped since Reset()
+  Int32 num_frames_received_, num_frames_skipped_;
   Bool reset_;
+
+  Profiler *profiler_;
+  // Counted only if kProfiling
+  DecodeFrameStats frame_stats_;
+
+  // NULL if DecodeOpts.num_threads == 1
+  WorkerGroup *worker_group_;
+  std::vector<ExpandWorker *> expand_workers_;
+  Int32 parallel_min_tokens_;
+  // Elems of last frame, indexed for partitioning
+  std::vector<Elem *> last_elems_;
 };
 
+// Chained hash buckets, same as Kaldi
+typedef FasterDecoderTpl<HashList> FasterDecoder;
+// Open addressing, elems stored contiguously
+typedef FasterDecoderTpl<FlatHashList> FlatFasterDecoder;
+// Decode on bit-packed graph, to save memory
+typedef FasterDecoderTpl<HashList, CompactFst> CompactFasterDecoder;
+// Decode on HCL o G composed on the fly, construct it with ComposeFst. Reset()
+// calls ComposeFst::Shrink(), so states reached are bounded across utterances
+typedef FasterDecoderTpl<HashList, ComposeFst> ComposeFasterDecoder;
+
 #endif
\ No newline at end of file
@@ -0,0 +1,133 @@
+// wujian@2018
+
+// Endpoint rules, from Kaldi's online-endpoint.{h,cc}
+
+#ifndef ENDPOINT_H
+#define ENDPOINT_H
+
+#include "decoder/common.h"
+#include "decoder/config.h"
+
+// A rule is activated if all of its conditions are met, lengths are in seconds
+struct EndpointRule {
+  Bool must_contain_nonsilence;
+  Float32 min_trailing_silence;
+  Float32 max_relative_cost;
+  Float32 min_utterance_length;
+
+  EndpointRule(Bool must_contain_nonsilence = true,
+               Float32 min_trailing_silence = 1.0,
+               Float32 max_relative_cost = FLOAT32_INF,
+               Float32 min_utterance_length = 0.0)
+      : must_contain_nonsilence(must_contain_nonsilence),
+        min_trailing_silence(min_trailing_silence),
+        max_relative_cost(max_relative_cost),
+        min_utterance_length(min_utterance_length) {}
+
+  // Options are --EndpointOpts.<name>_<field>=...
+  void ParseConfigure(ConfigureParser *parser, const std::string &name) {
+    parser->AddOptions("EndpointOpts", name + "_must_contain_nonsilence",
+                       &must_contain_nonsilence);
+    parser->AddOptions("EndpointOpts", name + "_min_trailing_silence",
+                       &min_trailing_silence);
+    parser->AddOptions("EndpointOpts", name + "_max_relative_cost",
+                       &max_relative_cost);
+    parser->AddOptions("EndpointOpts", name + "_min_utterance_length",
+                       &min_utterance_length);
+  }
+
+  std::string Configure(const std::string &name) {
+    std::ostringstream oss;
+    oss << "--EndpointOpts." << name << "_must_contain_nonsilence="
+        << (must_contain_nonsilence ? "true" : "false") << std::endl;
+    oss << "--EndpointOpts." << name
+        << "_min_trailing_silence=" << min_trailing_silence << std::endl;
+    oss << "--EndpointOpts." << name
+        << "_max_relative_cost=" << max_relative_cost << std::endl;
+    oss << "--EndpointOpts." << name
+        << "_min_utterance_length=" << min_utterance_length << std::endl;
+    return oss.str();
+  }
+
+  Bool Activated(Float32 trailing_silence, Float32 relative_cost,
+                 Float32 utterance_length) const {
+    Bool contains_nonsilence = utterance_length > trailing_silence;
+    return (contains_nonsilence || !must_contain_nonsilence) &&
+           trailing_silence >= min_trailing_silence &&
+           relative_cost <= max_relative_cost &&
+           utterance_length >= min_utterance_length;
+  }
+};
+
+// Same default rules as Kaldi: end if
+// 1) 5s silence even if nothing decoded
+// 2) 0.5s silence after something decoded and final cost is good
+// 3) 1s silence after something decoded and final cost is not bad
+// 4) 2s silence after something decoded
+// 5) utterance reaches 20s
+// Silence is given by silence_pdfs (colon separated pdf-ids, egs: 0:1:2).
+// If it's empty, frames after the last word on best path are treated as
+// silence.
+struct EndpointOpts {
+  std::string silence_pdfs;
+  // Seconds per decoded frame
+  Float32 frame_shift;
+  EndpointRule rule1, rule2, rule3, rule4, rule5;
+
+  EndpointOpts()
+      : frame_shift(0.01),
+        rule1(false, 5.0, FLOAT32_INF, 0.0),
+        rule2(true, 0.5, 2.0, 0.0),
+        rule3(true, 1.0, 8.0, 0.0),
+        rule4(true, 2.0, FLOAT32_INF, 0.0),
+        rule5(false, 0.0, FLOAT32_INF, 20.0) {}
+
+  void ParseConfigure(ConfigureParser *parser) {
+    parser->AddOptions("EndpointOpts", "silence_pdfs", &silence_pdfs);
+    parser->AddOptions("EndpointOpts", "frame_shift", &frame_shift);
+    rule1.ParseConfigure(parser, "rule1");
+    rule2.ParseConfigure(parser, "rule2");
+    rule3.ParseConfigure(parser, "rule3");
+    rule4.ParseConfigure(parser, "rule4");
+    rule5.ParseConfigure(parser, "rule5");
+  }
+
+  std::string Configure() {
+    std::ostringstream oss;
+    oss << "--EndpointOpts.silence_pdfs=" << silence_pdfs << std::endl;
+    oss << "--EndpointOpts.frame_shift=" << frame_shift << std::endl;
+    oss << rule1.Configure("rule1") << rule2.Configure("rule2")
+        << rule3.Configure("rule3") << rule4.Configure("rule4")
+        << rule5.Configure("rule5");
+    return oss.str();
+  }
+
+  // Parse silence_pdfs into a mask of num_pdfs
+  void SilenceMask(Int32 num_pdfs, std::vector<Bool> *mask) const {
+    ASSERT(mask);
+    mask->assign(num_pdfs, false);
+    std::istringstream iss(silence_pdfs);
+    std::string token;
+    while (std::getline(iss, token, ':')) {
+      if (token.empty()) continue;
+      Int32 pdf_id = std::stoi(token);
+      if (pdf_id < 0 || pdf_id >= num_pdfs)
+        LOG_FAIL << "Bad silence pdf-id " << pdf_id << ", expect in [0, "
+                 << num_pdfs << ")";
+      (*mask)[pdf_id] = true;
+    }
+  }
+
+  Bool Detected(Int32 num_frames, Int32 trailing_silence_frames,
+                Float32 relative_cost) const {
+    Float32 utterance_length = num_frames * frame_shift,
+            trailing_silence = trailing_silence_frames * frame_shift;
+    return rule1.Activated(trailing_silence, relative_cost, utterance_length) ||
+           rule2.Activated(trailing_silence, relative_cost, utterance_length) ||
+           rule3.Activated(trailing_silence, relative_cost, utterance_length) ||
+           rule4.Activated(trailing_silence, relative_cost, utterance_length) ||
+           rule5.Activated(trailing_silence, relative_cost, utterance_length);
+  }
+};
+
+#endif
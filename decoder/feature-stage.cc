@@ -0,0 +1,193 @@
+// decoder/feature-stage.cc
+// wujian@2018
+
+#include "feature-stage.h"
+
+// Read Kaldi CMVN stats: 2 x (dim + 1) matrix, binary ("\0B" + "DM"/"FM") or
+// text ("[ ... ]"), row 0 is sum and count, row 1 sum of squares
+static void ReadCmvnStats(const std::string &filename,
+                          std::vector<Float64> *stats, Int32 *num_cols) {
+  BinaryInput bi(filename);
+  std::istream &is = bi.Stream();
+  if (is.peek() == '\0') {
+    char header[2];
+    ReadBinary(is, header, 2);
+    if (header[1] != 'B') LOG_FAIL << "Bad binary header in " << filename;
+    std::string token;
+    ReadToken(is, &token);
+    if (token != "DM" && token != "FM")
+      LOG_FAIL << "Expect DM or FM in " << filename << ", but got " << token;
+    Int32 num_rows;
+    ReadBinaryBasicType(is, &num_rows);
+    ReadBinaryBasicType(is, num_cols);
+    stats->resize(num_rows * *num_cols);
+    for (Float64 &value : *stats) {
+      if (token == "DM") {
+        ReadBinary(is, reinterpret_cast<char *>(&value), sizeof(value));
+      } else {
+        Float32 value32;
+        ReadBinary(is, reinterpret_cast<char *>(&value32), sizeof(value32));
+        value = value32;
+      }
+    }
+  } else {
+    ExpectToken(is, "[");
+    std::string line;
+    *num_cols = 0;
+    stats->clear();
+    while (std::getline(is, line)) {
+      std::istringstream iss(line);
+      std::string word;
+      Int32 num_words = 0;
+      while (iss >> word) {
+        if (word == "]") break;
+        stats->push_back(atof(word.c_str()));
+        num_words++;
+      }
+      if (num_words) *num_cols = num_words;
+      if (word == "]") break;
+    }
+  }
+  if (*num_cols < 2 || stats->size() != 2 * *num_cols)
+    LOG_FAIL << "Expect 2 x (dim + 1) CMVN stats in " << filename;
+}
+
+CmvnStage::CmvnStage(Int32 dim, const CmvnOpts &opts)
+    : opts_(opts), dim_(dim), global_count_(0) {
+  opts_.Check();
+  window_.resize(opts_.cmn_window * dim_);
+  sum_.resize(dim_);
+  sum_square_.resize(dim_);
+  if (!opts_.global_stats.empty()) {
+    std::vector<Float64> stats;
+    Int32 num_cols;
+    ReadCmvnStats(opts_.global_stats, &stats, &num_cols);
+    if (num_cols != dim_ + 1)
+      LOG_FAIL << "Dimension of global CMVN stats mismatch: " << num_cols - 1
+               << " vs " << dim_;
+    global_sum_.assign(stats.begin(), stats.begin() + dim_);
+    global_sum_square_.assign(stats.begin() + num_cols,
+                              stats.begin() + num_cols + dim_);
+    global_count_ = stats[dim_];
+    ASSERT(global_count_ > 0);
+  }
+  Reset();
+}
+
+void CmvnStage::Reset() {
+  std::fill(sum_.begin(), sum_.end(), 0);
+  std::fill(sum_square_.begin(), sum_square_.end(), 0);
+  num_frames_ = 0;
+}
+
+Int32 CmvnStage::Process(Float32 *addr, Int32 stride, Int32 num_frames) {
+  Int32 window = opts_.cmn_window;
+  for (Int32 i = 0; i < num_frames; i++) {
+    Float32 *frame = addr + i * stride,
+            *slot = window_.data() + (num_frames_ % window) * dim_;
+    // frame out of the window
+    if (num_frames_ >= window) {
+      for (Int32 d = 0; d < dim_; d++) {
+        sum_[d] -= slot[d];
+        sum_square_[d] -= slot[d] * slot[d];
+      }
+    }
+    for (Int32 d = 0; d < dim_; d++) {
+      sum_[d] += frame[d];
+      sum_square_[d] += frame[d] * frame[d];
+    }
+    memcpy(slot, frame, sizeof(Float32) * dim_);
+    num_frames_++;
+    Float64 count = std::min(num_frames_, static_cast<Int64>(window)),
+            prior = 0;
+    if (global_count_ > 0 && count < opts_.global_frames)
+      prior = (opts_.global_frames - count) / global_count_;
+    count += prior * global_count_;
+    for (Int32 d = 0; d < dim_; d++) {
+      Float64 sum = sum_[d] + (prior ? prior * global_sum_[d] : 0),
+              mean = sum / count;
+      if (!opts_.norm_vars) {
+        frame[d] -= mean;
+        continue;
+      }
+      Float64 square =
+          sum_square_[d] + (prior ? prior * global_sum_square_[d] : 0);
+      Float64 var = std::max(square / count - mean * mean, 1e-10);
+      frame[d] = (frame[d] - mean) / sqrt(var);
+    }
+  }
+  return num_frames;
+}
+
+ContextStage::ContextStage(Int32 dim, Int32 left, Int32 right)
+    : dim_(dim), left_(left), right_(right) {
+  num_history_ = left_ + right_ + 1;
+  history_.resize(num_history_ * dim_);
+  Reset();
+}
+
+Int32 ContextStage::Process(Float32 *addr, Int32 stride, Int32 num_frames) {
+  Int32 num_output = 0;
+  for (Int32 i = 0; i < num_frames; i++) {
+    // copied before row i is overwritten by outputs
+    memcpy(history_.data() + (num_input_ % num_history_) * dim_,
+           addr + i * stride, sizeof(Float32) * dim_);
+    num_input_++;
+    if (num_output_ + right_ < num_input_) {
+      ComputeOutput(num_output_++, addr + num_output * stride);
+      num_output++;
+    }
+  }
+  return num_output;
+}
+
+Int32 ContextStage::Flush(Float32 *addr, Int32 stride) {
+  Int32 num_output = 0;
+  while (num_output_ < num_input_) {
+    ComputeOutput(num_output_++, addr + num_output * stride);
+    num_output++;
+  }
+  return num_output;
+}
+
+DeltaStage::DeltaStage(Int32 dim, const DeltaOpts &opts)
+    : ContextStage(dim, opts.order * opts.window, opts.order * opts.window),
+      order_(opts.order) {
+  opts.Check();
+  // same as Kaldi's DeltaFeatures
+  scales_.resize(order_ + 1);
+  scales_[0].push_back(1.0);
+  Int32 window = opts.window;
+  Float32 normalizer = 0;
+  for (Int32 j = -window; j <= window; j++) normalizer += j * j;
+  for (Int32 i = 1; i <= order_; i++) {
+    const std::vector<Float32> &prev = scales_[i - 1];
+    std::vector<Float32> &cur = scales_[i];
+    Int32 prev_offset = (prev.size() - 1) / 2,
+          cur_offset = prev_offset + window;
+    cur.resize(prev.size() + 2 * window, 0);
+    for (Int32 j = -window; j <= window; j++)
+      for (Int32 k = -prev_offset; k <= prev_offset; k++)
+        cur[j + k + cur_offset] += j * prev[k + prev_offset] / normalizer;
+  }
+}
+
+void DeltaStage::ComputeOutput(Int64 t, Float32 *addr) {
+  memset(addr, 0, sizeof(Float32) * OutputDim());
+  for (Int32 i = 0; i <= order_; i++) {
+    const std::vector<Float32> &scales = scales_[i];
+    Int32 max_offset = (scales.size() - 1) / 2;
+    Float32 *dst = addr + i * dim_;
+    for (Int32 j = -max_offset; j <= max_offset; j++) {
+      Float32 scale = scales[j + max_offset];
+      if (scale == 0) continue;
+      const Float32 *src = Frame(t + j);
+      for (Int32 d = 0; d < dim_; d++) dst[d] += scale * src[d];
+    }
+  }
+}
+
+void SpliceStage::ComputeOutput(Int64 t, Float32 *addr) {
+  for (Int32 j = -left_; j <= right_; j++)
+    memcpy(addr + (j + left_) * dim_, Frame(t + j), sizeof(Float32) * dim_);
+}
@@ -0,0 +1,226 @@
+// decoder/feature-stage.h
+// wujian@2018
+
+// Streaming stages applied on features from Computer: online CMVN, deltas and
+// splicing, like Kaldi's OnlineCmvn, OnlineDeltaFeature and OnlineSpliceFrames
+
+#ifndef FEATURE_STAGE_H
+#define FEATURE_STAGE_H
+
+#include "decoder/signal.h"
+
+class CmvnOpts : public Options {
+ public:
+  // CMVN is done only if norm_means
+  Bool norm_means, norm_vars;
+  // Number of frames (current one included) of the sliding window
+  Int32 cmn_window;
+  // Global stats are added (scaled) to the window ones until they have
+  // global_frames frames
+  Int32 global_frames;
+  // Kaldi CMVN stats (2 x (dim + 1) matrix, text or binary), egs: output of
+  // matrix-sum on cmvn.ark, no prior if empty
+  std::string global_stats;
+
+  CmvnOpts(Bool means = false, Bool vars = false, Int32 window = 600,
+           Int32 frames = 200)
+      : norm_means(means),
+        norm_vars(vars),
+        cmn_window(window),
+        global_frames(frames) {}
+
+  void Check() const {
+    ASSERT(cmn_window > 0 && global_frames >= 0);
+    ASSERT(norm_means || !norm_vars);
+  }
+
+  void ParseConfigure(ConfigureParser *parser) {
+    parser->AddOptions("CmvnOpts", "norm_means", &norm_means);
+    parser->AddOptions("CmvnOpts", "norm_vars", &norm_vars);
+    parser->AddOptions("CmvnOpts", "cmn_window", &cmn_window);
+    parser->AddOptions("CmvnOpts", "global_frames", &global_frames);
+    parser->AddOptions("CmvnOpts", "global_stats", &global_stats);
+  }
+
+  std::string Configure() {
+    std::ostringstream oss;
+    oss << "--CmvnOpts.norm_means=" << (norm_means ? "true" : "false")
+        << std::endl;
+    oss << "--CmvnOpts.norm_vars=" << (norm_vars ? "true" : "false")
+        << std::endl;
+    oss << "--CmvnOpts.cmn_window=" << cmn_window << std::endl;
+    oss << "--CmvnOpts.global_frames=" << global_frames << std::endl;
+    oss << "--CmvnOpts.global_stats=" << global_stats << std::endl;
+    return oss.str();
+  }
+};
+
+class DeltaOpts : public Options {
+ public:
+  // No deltas if order is 0, egs: 2 for delta + delta-delta
+  Int32 order, window;
+
+  DeltaOpts(Int32 order = 0, Int32 window = 2) : order(order), window(window) {}
+
+  void Check() const { ASSERT(order >= 0 && window > 0); }
+
+  void ParseConfigure(ConfigureParser *parser) {
+    parser->AddOptions("DeltaOpts", "order", &order);
+    parser->AddOptions("DeltaOpts", "window", &window);
+  }
+
+  std::string Configure() {
+    std::ostringstream oss;
+    oss << "--DeltaOpts.order=" << order << std::endl;
+    oss << "--DeltaOpts.window=" << window << std::endl;
+    return oss.str();
+  }
+};
+
+class SpliceOpts : public Options {
+ public:
+  // No splicing if both are 0
+  Int32 left_context, right_context;
+
+  SpliceOpts(Int32 left = 0, Int32 right = 0)
+      : left_context(left), right_context(right) {}
+
+  void Check() const { ASSERT(left_context >= 0 && right_context >= 0); }
+
+  void ParseConfigure(ConfigureParser *parser) {
+    parser->AddOptions("SpliceOpts", "left_context", &left_context);
+    parser->AddOptions("SpliceOpts", "right_context", &right_context);
+  }
+
+  std::string Configure() {
+    std::ostringstream oss;
+    oss << "--SpliceOpts.left_context=" << left_context << std::endl;
+    oss << "--SpliceOpts.right_context=" << right_context << std::endl;
+    return oss.str();
+  }
+};
+
+// A stage takes frames in time order and gives frames Latency() frames later
+// (then the last ones by Flush()), all done in place on rows of a block: row
+// stride should hold both InputDim() and OutputDim(). Input frames are kept in
+// a fixed buffer, so nothing is allocated per frame.
+class FeatureStage {
+ public:
+  virtual Int32 InputDim() const = 0;
+
+  virtual Int32 OutputDim() const = 0;
+
+  // Number of input frames needed after a frame to output it
+  virtual Int32 Latency() const = 0;
+
+  // Accept num_frames rows of addr as next input frames, overwrite the first
+  // rows with outputs ready, return number of them
+  virtual Int32 Process(Float32 *addr, Int32 stride, Int32 num_frames) = 0;
+
+  // Outputs of frames left (input ended), into rows of addr, return number of
+  // them. No more than Latency() rows
+  virtual Int32 Flush(Float32 *addr, Int32 stride) = 0;
+
+  // For a new utterance
+  virtual void Reset() = 0;
+
+  virtual ~FeatureStage() {}
+};
+
+// Mean (and variance) normalization over a sliding window of past frames,
+// with global stats as prior. Running sums are updated per frame, O(dim).
+class CmvnStage : public FeatureStage {
+ public:
+  CmvnStage(Int32 dim, const CmvnOpts &opts);
+
+  Int32 InputDim() const { return dim_; }
+
+  Int32 OutputDim() const { return dim_; }
+
+  Int32 Latency() const { return 0; }
+
+  Int32 Process(Float32 *addr, Int32 stride, Int32 num_frames);
+
+  Int32 Flush(Float32 *addr, Int32 stride) { return 0; }
+
+  void Reset();
+
+ private:
+  CmvnOpts opts_;
+  Int32 dim_;
+  // Frames of the window (ring of cmn_window rows), and number of frames seen
+  std::vector<Float32> window_;
+  Int64 num_frames_;
+  // Sum and sum of squares of frames in window
+  std::vector<Float64> sum_, sum_square_;
+  // Same for global stats, and its number of frames
+  std::vector<Float64> global_sum_, global_sum_square_;
+  Float64 global_count_;
+};
+
+// Stages of which output frame t is computed from input frames [t - left,
+// t + right], clamped to [0, last frame] at the edges
+class ContextStage : public FeatureStage {
+ public:
+  ContextStage(Int32 dim, Int32 left, Int32 right);
+
+  Int32 InputDim() const { return dim_; }
+
+  Int32 Latency() const { return right_; }
+
+  Int32 Process(Float32 *addr, Int32 stride, Int32 num_frames);
+
+  Int32 Flush(Float32 *addr, Int32 stride);
+
+  void Reset() { num_input_ = num_output_ = 0; }
+
+ protected:
+  // Output of frame t into addr, Frame() gives the input frames
+  virtual void ComputeOutput(Int64 t, Float32 *addr) = 0;
+
+  // Input frame t clamped to [0, num_input_ - 1]
+  const Float32 *Frame(Int64 t) const {
+    t = std::max(std::min(t, num_input_ - 1), static_cast<Int64>(0));
+    return history_.data() + (t % num_history_) * dim_;
+  }
+
+  Int32 dim_, left_, right_;
+
+ private:
+  // Ring of last left + right + 1 input frames
+  std::vector<Float32> history_;
+  Int32 num_history_;
+  Int64 num_input_, num_output_;
+};
+
+// Features followed by deltas up to order, as Kaldi's DeltaFeatures
+class DeltaStage : public ContextStage {
+ public:
+  DeltaStage(Int32 dim, const DeltaOpts &opts);
+
+  Int32 OutputDim() const { return dim_ * (order_ + 1); }
+
+ protected:
+  void ComputeOutput(Int64 t, Float32 *addr);
+
+ private:
+  Int32 order_;
+  // Coefficients of frames [t - left_, t + left_] for each order
+  std::vector<std::vector<Float32> > scales_;
+};
+
+// Input frames [t - left_context, t + right_context] concatenated
+class SpliceStage : public ContextStage {
+ public:
+  SpliceStage(Int32 dim, const SpliceOpts &opts)
+      : ContextStage(dim, opts.left_context, opts.right_context) {
+    opts.Check();
+  }
+
+  Int32 OutputDim() const { return dim_ * (left_ + right_ + 1); }
+
+ protected:
+  void ComputeOutput(Int64 t, Float32 *addr);
+};
+
+#endif
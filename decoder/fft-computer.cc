@@ -1,6 +1,7 @@
 // wujian@2018
 
 #include "fft-computer.h"
+#include "decoder/simd.h"
 
 void FFTComputer::ComplexBitReverse(Float32 *cplx_values, Int32 num_values) {
   for (Int32 j = 0, i = 0; i < num_values - 1; i++) {
@@ -19,8 +20,26 @@ void FFTComputer::ComplexBitReverse(Float32 *cplx_values, Int32 num_values) {
 
 void FFTComputer::ComplexFFT(Float32 *cplx_values, Int32 num_samples,
                              bool invert) {
-  Int32 n = num_samples >> 1, s = register_size_ / n;
-  // ASSERT(n == register_size_);
+  Int32 n = num_samples >> 1;
+  if (n != radix4_size_) {
+    Radix2FFT(cplx_values, n, invert);
+    return;
+  }
+  // IFFT(x) = conj(FFT(conj(x))) / n
+  if (invert)
+    for (Int32 i = 1; i < num_samples; i += 2) cplx_values[i] = -cplx_values[i];
+  Radix4FFT(cplx_values);
+  if (invert) {
+    Float32 scale = 1.0 / n;
+    for (Int32 i = 0; i < num_samples; i += 2) {
+      cplx_values[i] = cplx_values[i] * scale;
+      cplx_values[i + 1] = -cplx_values[i + 1] * scale;
+    }
+  }
+}
+
+void FFTComputer::Radix2FFT(Float32 *cplx_values, Int32 n, bool invert) {
+  Int32 num_samples = n << 1, s = register_size_ / n;
 
   ComplexBitReverse(cplx_values, n);
 
@@ -52,6 +71,101 @@ void FFTComputer::ComplexFFT(Float32 *cplx_values, Int32 num_samples,
     for (i = 0; i < num_samples; i++) cplx_values[i] = cplx_values[i] / n;
 }
 
+void FFTComputer::InitRadix4(Int32 n) {
+  radix4_size_ = 0;
+  if (n < 4 || (n & (n - 1))) return;
+  radix4_size_ = n;
+  for (Int32 j = 0, i = 0; i < n - 1; i++) {
+    if (i < j) swaps_.push_back(i), swaps_.push_back(j);
+    Int32 m = n >> 1;
+    while (j >= m) {
+      j = j - m;
+      m = m >> 1;
+    }
+    j = j + m;
+  }
+  // w = exp(+2 PI i / 4m), the sign used by Radix2FFT()
+  // starts after the radix-2 stage if log2(n) is odd
+  Int32 m = (n & 0x55555555) ? 1 : 2;
+  for (; m * 4 <= n; m <<= 2) {
+    for (Int32 p = 1; p <= 3; p++) {
+      for (Int32 part = 0; part < 2; part++) {
+        for (Int32 t = 0; t < m; t++) {
+          Float64 angle = PI2 * p * t / (4.0 * m);
+          Float32 value = part == 0 ? cos(angle) : sin(angle);
+          twiddles_.push_back(value);
+          twiddles_.push_back(value);
+        }
+      }
+    }
+  }
+}
+
+// Radix-4 decimation in time on bit-reversed input. With sub-DFTs B0, B1, B2,
+// B3 of size m (residue 0, 2, 1, 3 in bit-reversed order) and a0 = B0,
+// a1 = w^t B2, a2 = w^2t B1, a3 = w^3t B3, w^m = i:
+// X[t] = a0 + a1 + a2 + a3,    X[t + m] = a0 + i a1 - a2 - i a3,
+// X[t + 2m] = a0 - a1 + a2 - a3, X[t + 3m] = a0 - i a1 - a2 + i a3
+void FFTComputer::Radix4FFT(Float32 *cplx_values) {
+  Int32 n = radix4_size_;
+  for (UInt64 k = 0; k < swaps_.size(); k += 2) {
+    Int32 i = swaps_[k], j = swaps_[k + 1];
+    std::swap(REAL_PART(cplx_values, i), REAL_PART(cplx_values, j));
+    std::swap(IMAG_PART(cplx_values, i), IMAG_PART(cplx_values, j));
+  }
+  Int32 m = 1;
+  // one radix-2 stage if log2(n) is odd
+  if ((n & 0x55555555) == 0) {
+    for (Int32 i = 0; i < n * 2; i += 4) {
+      Float32 r = cplx_values[i + 2], c = cplx_values[i + 3];
+      cplx_values[i + 2] = cplx_values[i] - r;
+      cplx_values[i + 3] = cplx_values[i + 1] - c;
+      cplx_values[i] += r;
+      cplx_values[i + 1] += c;
+    }
+    m = 2;
+  }
+  const Float32 *twiddles = twiddles_.data();
+  for (; m * 4 <= n; m <<= 2) {
+    const Float32 *w1r = twiddles, *w1i = w1r + 2 * m, *w2r = w1i + 2 * m,
+                  *w2i = w2r + 2 * m, *w3r = w2i + 2 * m, *w3i = w3r + 2 * m;
+    twiddles += 12 * m;
+    for (Int32 base = 0; base < n; base += 4 * m) {
+      Float32 *x0 = cplx_values + base * 2, *x1 = x0 + m * 2,
+              *x2 = x1 + m * 2, *x3 = x2 + m * 2;
+      if (m == 1) {
+        // twiddles are all 1
+        Float32 a0r = x0[0], a0i = x0[1], a1r = x2[0], a1i = x2[1],
+                a2r = x1[0], a2i = x1[1], a3r = x3[0], a3i = x3[1];
+        Float32 s02r = a0r + a2r, s02i = a0i + a2i, d02r = a0r - a2r,
+                d02i = a0i - a2i, s13r = a1r + a3r, s13i = a1i + a3i,
+                d13r = a1r - a3r, d13i = a1i - a3i;
+        x0[0] = s02r + s13r, x0[1] = s02i + s13i;
+        x1[0] = d02r - d13i, x1[1] = d02i + d13r;
+        x2[0] = s02r - s13r, x2[1] = s02i - s13i;
+        x3[0] = d02r + d13i, x3[1] = d02i - d13r;
+        continue;
+      }
+      // two complex values each time
+      for (Int32 t = 0; t < m * 2; t += 4) {
+        Float32x4 a0 = Load4(x0 + t),
+                  a1 = ComplexMul4(Load4(x2 + t), Load4(w1r + t),
+                                   Load4(w1i + t)),
+                  a2 = ComplexMul4(Load4(x1 + t), Load4(w2r + t),
+                                   Load4(w2i + t)),
+                  a3 = ComplexMul4(Load4(x3 + t), Load4(w3r + t),
+                                   Load4(w3i + t));
+        Float32x4 s02 = Add4(a0, a2), d02 = Sub4(a0, a2), s13 = Add4(a1, a3),
+                  d13 = ComplexMulI4(Sub4(a1, a3));
+        Store4(x0 + t, Add4(s02, s13));
+        Store4(x1 + t, Add4(d02, d13));
+        Store4(x2 + t, Sub4(s02, s13));
+        Store4(x3 + t, Sub4(d02, d13));
+      }
+    }
+  }
+}
+
 void FFTComputer::RealFFT(Float32 *real_values, Int32 num_samples) {
   if (num_samples != register_size_) {
     LOG_FAIL << "Assert num_samples == register_size_ failed, " << num_samples
@@ -0,0 +1,153 @@
+// wujian@2018
+
+// Open-addressing replacement of HashList for active tokens
+
+#ifndef FLAT_HASH_LIST_H
+#define FLAT_HASH_LIST_H
+
+#include "decoder/common.h"
+
+// Same interface as HashList, so decoder could switch between them, but
+//  1) Find() probes a flat array of (key, elem) slots linearly instead of
+//     walking a bucket chain, a hit usually costs one cache line
+//  2) Elems are stored contiguously in insertion order, traversing the list
+//     is a sequential scan
+//  3) Two Elem buffers are used in turn: Clear() hands out the current one
+//     and starts filling the other, so the list of last frame stays valid
+//     while tokens of next frame are inserted. Delete() is a no-op, the
+//     whole buffer is reclaimed by the Clear() after next one
+//  4) Slots are invalidated by bumping a generation stamp, Clear() is O(1)
+// InsertMore() is not supported.
+template <class I, class T>
+class FlatHashList {
+ public:
+  struct Elem {
+    I key;
+    T val;
+    Elem *tail;
+  };
+
+  FlatHashList() : generation_(1), mask_(0), cur_(0) {
+    for (Int32 i = 0; i < 2; i++) {
+      head_[i] = last_[i] = NULL;
+      num_elems_[i] = 0;
+    }
+    Rehash(kMinSize);
+  }
+
+  ~FlatHashList() {
+    for (Int32 i = 0; i < 2; i++)
+      for (Elem *block : blocks_[i]) delete[] block;
+  }
+
+  // Gives the head of the current list to the user. The list is valid until
+  // next call of Clear()
+  Elem *Clear() {
+    Elem *ans = head_[cur_];
+    cur_ = 1 - cur_;
+    head_[cur_] = last_[cur_] = NULL;
+    num_elems_[cur_] = 0;
+    if (++generation_ == 0) {
+      // stamp wraps around, invalidate all slots explicitly
+      for (Slot &slot : slots_) slot.stamp = 0;
+      generation_ = 1;
+    }
+    return ans;
+  }
+
+  const Elem *GetList() const { return head_[cur_]; }
+
+  // Values could be changed in place through the list
+  Elem *GetList() { return head_[cur_]; }
+
+  // Elems are reclaimed per buffer, see Clear()
+  inline void Delete(Elem *e) {}
+
+  inline Elem *Find(I key) {
+    for (UInt64 index = Hash(key);; index = (index + 1) & mask_) {
+      const Slot &slot = slots_[index];
+      if (slot.stamp != generation_) return NULL;
+      if (slot.key == key) return slot.elem;
+    }
+  }
+
+  // Caller asserts that key is not present
+  inline void Insert(I key, T val) {
+    // keep load factor below 0.5
+    if ((num_elems_[cur_] + 1) * 2 > slots_.size()) Rehash(slots_.size() * 2);
+    Elem *elem = New();
+    elem->key = key;
+    elem->val = val;
+    elem->tail = NULL;
+    if (last_[cur_])
+      last_[cur_]->tail = elem;
+    else
+      head_[cur_] = elem;
+    last_[cur_] = elem;
+    Place(key, elem);
+  }
+
+  // Reserve at least sz slots, could be called at any time
+  void SetSize(size_t sz) {
+    if (sz > slots_.size()) Rehash(sz);
+  }
+
+  // Returns current number of slots
+  inline size_t Size() { return slots_.size(); }
+
+ private:
+  FlatHashList(const FlatHashList &) = delete;
+  FlatHashList &operator=(const FlatHashList &) = delete;
+
+  static const UInt64 kMinSize = 1024, kBlockSize = 4096;
+
+  struct Slot {
+    I key;
+    UInt32 stamp;  // valid only if equal to generation_
+    Elem *elem;
+  };
+
+  // Fibonacci hashing, consecutive states spread over the table
+  inline UInt64 Hash(I key) const {
+    UInt64 h = static_cast<UInt32>(key) * 0x9E3779B97F4A7C15ULL;
+    return (h >> 32) & mask_;
+  }
+
+  inline void Place(I key, Elem *elem) {
+    UInt64 index = Hash(key);
+    while (slots_[index].stamp == generation_) index = (index + 1) & mask_;
+    slots_[index].key = key;
+    slots_[index].stamp = generation_;
+    slots_[index].elem = elem;
+  }
+
+  // Elems are carved from fixed blocks, so their addresses are stable
+  inline Elem *New() {
+    UInt64 n = num_elems_[cur_]++;
+    std::vector<Elem *> &blocks = blocks_[cur_];
+    if (n / kBlockSize == blocks.size()) blocks.push_back(new Elem[kBlockSize]);
+    return blocks[n / kBlockSize] + n % kBlockSize;
+  }
+
+  // Grow to power of 2 no less than sz and re-insert current list
+  void Rehash(UInt64 sz) {
+    UInt64 size = kMinSize;
+    while (size < sz) size <<= 1;
+    Slot empty = {I(), 0, NULL};
+    slots_.assign(size, empty);
+    mask_ = size - 1;
+    generation_ = 1;
+    for (Elem *e = head_[cur_]; e != NULL; e = e->tail) Place(e->key, e);
+  }
+
+  std::vector<Slot> slots_;
+  UInt32 generation_;
+  UInt64 mask_;
+  // Double buffered elems, cur_ is the one being filled
+  std::vector<Elem *> blocks_[2];
+  Elem *head_[2], *last_[2];
+  UInt64 num_elems_[2];
+  Int32 cur_;
+};
+
+#endif
@@ -0,0 +1,92 @@
+// wujian@2018
+
+#include "decoder/fst-reorder.h"
+
+void BfsStateOrder(const SimpleFst &fst, std::vector<StateId> *order) {
+  ASSERT(order);
+  UInt64 num_states = fst.NumStates();
+  std::vector<Bool> visited(num_states, false);
+  order->clear();
+  order->reserve(num_states);
+  if (fst.Start() != NoStateId) {
+    visited[fst.Start()] = true;
+    order->push_back(fst.Start());
+  }
+  // order itself is the queue
+  for (UInt64 head = 0; head < order->size(); head++) {
+    StateId state = (*order)[head];
+    for (ArcIterator aiter(fst, state); !aiter.Done(); aiter.Next()) {
+      StateId next = aiter.Value().nextstate;
+      if (visited[next]) continue;
+      visited[next] = true;
+      order->push_back(next);
+    }
+  }
+  for (UInt64 s = 0; s < num_states; s++)
+    if (!visited[s]) order->push_back(s);
+}
+
+void FrequencyStateOrder(const SimpleFst &fst,
+                         const std::vector<UInt64> &counts,
+                         std::vector<StateId> *order) {
+  if (counts.size() != fst.NumStates())
+    LOG_FAIL << "Size of state counts mismatch with graph, " << counts.size()
+             << " vs " << fst.NumStates();
+  BfsStateOrder(fst, order);
+  std::stable_sort(order->begin(), order->end(),
+                   [&counts](StateId a, StateId b) {
+                     return counts[a] > counts[b];
+                   });
+}
+
+void ReorderStates(const std::vector<StateId> &order, SimpleFst *fst) {
+  ASSERT(fst);
+  UInt64 num_states = fst->NumStates();
+  if (order.size() != num_states)
+    LOG_FAIL << "Size of state order mismatch with graph, " << order.size()
+             << " vs " << num_states;
+  std::vector<StateId> new_id(num_states, NoStateId);
+  for (UInt64 s = 0; s < num_states; s++) {
+    StateId old_id = order[s];
+    if (old_id < 0 || old_id >= num_states || new_id[old_id] != NoStateId)
+      LOG_FAIL << "State order is not a permutation, state " << old_id
+               << " at " << s;
+    new_id[old_id] = s;
+  }
+  std::vector<State *> states(num_states);
+  for (UInt64 s = 0; s < num_states; s++) states[s] = fst->GetState(order[s]);
+  for (UInt64 s = 0; s < num_states; s++) {
+    State *state = states[s];
+    fst->SetState(s, state);
+    for (UInt64 i = 0; i < state->NumArcs(); i++) {
+      Arc arc = state->GetArc(i);
+      arc.nextstate = new_id[arc.nextstate];
+      state->SetArc(arc, i);
+    }
+  }
+  if (fst->Start() != NoStateId) fst->SetStart(new_id[fst->Start()]);
+}
+
+void ReadStateCounts(const std::string &filename, UInt64 num_states,
+                     std::vector<UInt64> *counts) {
+  ASSERT(counts);
+  BinaryInput bi(filename);
+  std::istream &is = bi.Stream();
+  counts->assign(num_states, 0);
+  Int64 state;
+  UInt64 count;
+  while (is >> state >> count) {
+    if (state < 0 || state >= num_states)
+      LOG_FAIL << "State " << state << " out of range in " << filename;
+    (*counts)[state] += count;
+  }
+  if (!is.eof()) LOG_FAIL << "Bad format of state counts " << filename;
+}
+
+void WriteStateCounts(const std::string &filename,
+                      const std::vector<UInt64> &counts) {
+  BinaryOutput bo(filename);
+  std::ostream &os = bo.Stream();
+  for (UInt64 s = 0; s < counts.size(); s++)
+    if (counts[s]) os << s << " " << counts[s] << "\n";
+}
@@ -0,0 +1,41 @@
+// wujian@2018
+
+// Renumber states of a graph for memory locality
+
+#ifndef FST_REORDER_H
+#define FST_REORDER_H
+
+#include "decoder/common.h"
+#include "decoder/simple-fst.h"
+
+// State ids of a converted HCLG follow the construction order of OpenFST, so
+// the successors of a state are scattered over the graph. The functions below
+// compute a new order (order[new_id] = old_id) and apply it, so states often
+// active together are kept close, egs:
+//
+// std::vector<StateId> order;
+// BfsStateOrder(fst, &order);
+// ReorderStates(order, &fst);
+
+// Breadth first from Start(), unreachable states are appended in the
+// original order
+void BfsStateOrder(const SimpleFst &fst, std::vector<StateId> *order);
+
+// States with larger counts (visits over a dev set, see
+// FasterDecoder::AccumulateActiveStates()) come first, ties and unvisited
+// states follow the BFS order
+void FrequencyStateOrder(const SimpleFst &fst,
+                         const std::vector<UInt64> &counts,
+                         std::vector<StateId> *order);
+
+// Renumber states and arcs, order should be a permutation of all states
+void ReorderStates(const std::vector<StateId> &order, SimpleFst *fst);
+
+// Text format, one "state-id count" per line
+void ReadStateCounts(const std::string &filename, UInt64 num_states,
+                     std::vector<UInt64> *counts);
+
+void WriteStateCounts(const std::string &filename,
+                      const std::vector<UInt64> &counts);
+
+#endif
@@ -29,7 +29,6 @@ template<class I, class T> HashList<I, T>::HashList() {
   list_head_ = NULL;
   bucket_list_tail_ = static_cast<size_t>(-1);  // invalid.
   hash_size_ = 0;
-  freed_head_ = NULL;
 }
 
 template<class I, class T> void HashList<I, T>::SetSize(size_t size) {
@@ -61,8 +60,7 @@ const typename HashList<I, T>::Elem* HashList<I, T>::GetList() const {
 
 template<class I, class T>
 inline void HashList<I, T>::Delete(Elem *e) {
-  e->tail = freed_head_;
-  freed_head_ = e;
+  holder_.Free(e);
 }
 
 template<class I, class T>
@@ -84,34 +82,16 @@ inline typename HashList<I, T>::Elem* HashList<I, T>::Find(I key) {
 
 template<class I, class T>
 inline typename HashList<I, T>::Elem* HashList<I, T>::New() {
-  if (freed_head_) {
-    Elem *ans = freed_head_;
-    freed_head_ = freed_head_->tail;
-    return ans;
-  } else {
-    Elem *tmp = new Elem[allocate_block_size_];
-    for (size_t i = 0; i+1 < allocate_block_size_; i++)
-      tmp[i].tail = tmp+i+1;
-    tmp[allocate_block_size_-1].tail = NULL;
-    freed_head_ = tmp;
-    allocated_.push_back(tmp);
-    return this->New();
-  }
+  return holder_.New();
 }
 
 template<class I, class T>
 HashList<I, T>::~HashList() {
   // First test whether we had any memory leak within the
   // HashList, i.e. things for which the user did not call Delete().
-  size_t num_in_list = 0, num_allocated = 0;
-  for (Elem *e = freed_head_; e != NULL; e = e->tail)
-    num_in_list++;
-  for (size_t i = 0; i < allocated_.size(); i++) {
-    num_allocated += allocate_block_size_;
-    delete[] allocated_[i];
-  }
-  if (num_in_list != num_allocated) {
-    LOG_WARN << "Possible memory leak: " << num_in_list << " != " << num_allocated
+  if (holder_.NumActive() != 0) {
+    LOG_WARN << "Possible memory leak: " << holder_.NumActive()
+             << " Elems are still in use"
              << ": you might have forgotten to call Delete on some Elems";
   }
 }
@@ -23,6 +23,7 @@
 #define HASH_LIST_H
 
 #include "decoder/common.h"
+#include "decoder/holder.h"
 
 
 /*  This header provides utilities for a structure that's used in a decoder (but
@@ -125,14 +126,8 @@ private:
 
     std::vector<HashBucket> buckets_;
 
-    Elem *freed_head_;  // head of list of currently freed elements. [ready for
-    // allocation]
-
-    std::vector<Elem*> allocated_;  // list of allocated blocks.
-
-    static const size_t allocate_block_size_ = 1024;  // Number of Elements to
-    // allocate in one block.  Must be largish so storing allocated_ doesn't
-    // become a problem.
+    Holder<Elem> holder_;  // Elements are allocated from here, in blocks of
+    // chunk_size elements.
 };
 
 
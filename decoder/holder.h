@@ -5,91 +5,293 @@
 #ifndef HOLDER_H
 #define HOLDER_H
 
-#include <queue>
-#include <set>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+
 #include "decoder/common.h"
 
 const Int32 chunk_size = 1024;
 
+// Statistics of object pool, used to size the pool
+struct AllocatorStats {
+  UInt64 num_new, num_free;       // calls of New()/Free()
+  UInt64 num_active, max_active;  // objects in use (and its peak)
+  UInt64 num_blocks, block_size;  // allocated chunks and objects per chunk
+
+  AllocatorStats()
+      : num_new(0),
+        num_free(0),
+        num_active(0),
+        max_active(0),
+        num_blocks(0),
+        block_size(0) {}
+
+  std::string ToString() const {
+    std::ostringstream oss;
+    oss << "new/free = " << num_new << "/" << num_free
+        << ", active/max-active = " << num_active << "/" << max_active
+        << ", blocks = " << num_blocks << " x " << block_size;
+    return oss.str();
+  }
+};
+
+template <class T>
+class HolderCache;
+
+// Fixed-size object pool: objects are carved from chunks and recycled through
+// an intrusive free list, so both New() and Free() are O(1). Release() gives
+// back all objects at once while keeping the chunks for reuse.
+// Ownership and double free checks are compiled in only with DECODER_DEBUG.
+// Holder itself is not thread-safe, each thread could use a HolderCache to
+// share one Holder.
 template <class T>
 class Holder {
  public:
-  Holder() { InitChunk(); }
+  Holder(UInt64 size = chunk_size) : free_head_(NULL), num_used_(0) {
+    ASSERT(size > 0);
+    stats_.block_size = size;
+    cur_offset_ = size;
+  }
 
   ~Holder() {
-    for (T* ptr : holder_)
-      if (ptr) delete[] ptr;
-    for (Bool* ptr : free_map_)
-      if (ptr) delete[] ptr;
+    for (Slot *chunk : holder_) delete[] chunk;
   }
 
-  void InitChunk() {
-    T* object_ptr = new T[chunk_size];
-    holder_.push_back(object_ptr);
-    for (Int32 i = 0; i < chunk_size; i++) unused_.push(object_ptr + i);
-    Bool* free_map = new Bool[chunk_size];
-    for (Int32 i = 0; i < chunk_size; i++) free_map[i] = true;
-    free_map_.push_back(free_map);
-  }
-
-  void Free(T* addr) {
-    if (!IsFree(addr)) {
-      unused_.push(addr);
-      Set(addr, true);
+  // Get an object constructed with given arguments
+  template <class... Args>
+  T *New(Args &&... args) {
+    Slot *slot = Pop();
+    stats_.num_new++;
+    if (++stats_.num_active > stats_.max_active)
+      stats_.max_active = stats_.num_active;
+    return new (Object(slot)) T(std::forward<Args>(args)...);
+  }
+
+  void Free(T *addr) {
+    addr->~T();
+    Push(ToSlot(addr));
+    stats_.num_free++;
+    stats_.num_active--;
+  }
+
+  // Free all objects in O(#chunks), chunks are kept for reuse. Do not call
+  // while some HolderCache still caches objects of this holder.
+  void Release() {
+#ifdef DECODER_DEBUG
+    for (Slot *chunk : holder_)
+      for (UInt64 i = 0; i < stats_.block_size; i++) chunk[i].in_use = false;
+#endif
+    free_head_ = NULL;
+    num_used_ = 0;
+    cur_offset_ = stats_.block_size;
+    stats_.num_free += stats_.num_active;
+    stats_.num_active = 0;
+  }
+
+  Int32 NumUnused() {
+    return holder_.size() * stats_.block_size - stats_.num_active;
+  }
+
+  Int32 NumActive() { return stats_.num_active; }
+
+  const AllocatorStats &Stats() const { return stats_; }
+
+ private:
+  friend class HolderCache<T>;
+
+  struct Slot {
+#ifdef DECODER_DEBUG
+    const Holder *owner;
+    Bool in_use;
+#endif
+    union Body {
+      Slot *next;
+      typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    } body;
+  };
+
+  static T *Object(Slot *slot) {
+    return reinterpret_cast<T *>(&slot->body.storage);
+  }
+
+  static Slot *ToSlot(T *addr) {
+    return reinterpret_cast<Slot *>(reinterpret_cast<char *>(addr) -
+                                    offsetof(Slot, body));
+  }
+
+  // Get a free slot
+  Slot *Pop() {
+    Slot *slot = free_head_;
+    if (slot) {
+      free_head_ = slot->body.next;
     } else {
-      LOG_WARN << "Double free for object " << addr;
+      if (cur_offset_ == stats_.block_size) InitChunk();
+      slot = holder_[num_used_ - 1] + cur_offset_++;
+#ifdef DECODER_DEBUG
+      slot->owner = this;
+#endif
     }
+#ifdef DECODER_DEBUG
+    slot->in_use = true;
+#endif
+    return slot;
   }
 
-  T* New() {
-    if (!unused_.size()) InitChunk();
-    T* head = Pop();
-    Set(head, false);
-    return head;
+  void Push(Slot *slot) {
+#ifdef DECODER_DEBUG
+    if (slot->owner != this)
+      LOG_FAIL << "Object " << Object(slot) << " is not owned by this holder";
+    if (!slot->in_use) LOG_FAIL << "Double free for object " << Object(slot);
+    slot->in_use = false;
+#endif
+    slot->body.next = free_head_;
+    free_head_ = slot;
   }
 
-  Int32 NumUnused() { return unused_.size(); }
+  // Move to next chunk, allocate one if all chunks are used up
+  void InitChunk() {
+    if (num_used_ == holder_.size()) {
+      holder_.push_back(new Slot[stats_.block_size]);
+      stats_.num_blocks++;
+    }
+    num_used_++;
+    cur_offset_ = 0;
+  }
 
-  Int32 NumActive() { return holder_.size() * chunk_size - unused_.size(); }
+  // Used by HolderCache with lock held: add New()/Free() calls made on a cache
+  // since its last batch, so stats count them as the ones made here
+  void AddCacheCounts(UInt64 num_new, UInt64 num_free) {
+    stats_.num_new += num_new;
+    stats_.num_active += num_new;
+    if (stats_.num_active > stats_.max_active)
+      stats_.max_active = stats_.num_active;
+    stats_.num_free += num_free;
+    stats_.num_active -= num_free;
+  }
 
- private:
-  // Get a free object
-  T* Pop() {
-    ASSERT(unused_.size() && "Unused queue is empty");
-    T* head = unused_.front();
-    unused_.pop();
+  // Used by HolderCache, pop/push n slots with lock held, slots cached are
+  // not counted as active
+  Slot *PopBatch(UInt64 n, UInt64 num_new, UInt64 num_free) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    AddCacheCounts(num_new, num_free);
+    Slot *head = NULL;
+    for (UInt64 i = 0; i < n; i++) {
+      Slot *slot = Pop();
+#ifdef DECODER_DEBUG
+      slot->in_use = false;
+#endif
+      slot->body.next = head;
+      head = slot;
+    }
     return head;
   }
 
-  void Index(T* addr, Int32* index, Int32* offset) {
-    Bool check = false;
-    for (Int32 i = 0; i < holder_.size(); i++) {
-      *index = i, *offset = addr - holder_[i];
-      if (*offset >= 0 && *offset < chunk_size) {
-        check = true;
-        break;
-      }
+  void PushBatch(Slot *head, UInt64 n, UInt64 num_new, UInt64 num_free) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    AddCacheCounts(num_new, num_free);
+    for (UInt64 i = 0; i < n; i++) {
+      Slot *next = head->body.next;
+#ifdef DECODER_DEBUG
+      head->in_use = true;
+#endif
+      Push(head);
+      head = next;
     }
-    if (!check) LOG_FAIL << "Seems some bugs existed";
   }
 
-  Bool IsFree(T* addr) {
-    Int32 index, offset;
-    Index(addr, &index, &offset);
-    return free_map_[index][offset];
+  // Cache allocated chunk
+  std::vector<Slot *> holder_;
+  // Head of freed objects
+  Slot *free_head_;
+  // Carving from holder_[num_used_ - 1] at cur_offset_
+  UInt64 num_used_, cur_offset_;
+  AllocatorStats stats_;
+  std::mutex mutex_;
+};
+
+// Per-thread cache of a shared Holder, which takes/returns objects from the
+// holder in batches, so the lock is only touched once per batch. New()/Free()
+// calls of the cache are added to the holder's stats with each batch and on
+// destruction, so Stats() is exact once caches are destroyed (max_active is
+// sampled at those points). Objects could be freed by either side, but the
+// holder should not be used directly while caches of it are alive.
+// egs:
+// Holder<Token> holder;
+// // in each worker thread
+// HolderCache<Token> cache(&holder);
+// Token *tok = cache.New(...);
+// cache.Free(tok);
+template <class T>
+class HolderCache {
+ public:
+  typedef typename Holder<T>::Slot Slot;
+
+  HolderCache(Holder<T> *holder, UInt64 batch_size = 64)
+      : holder_(holder),
+        batch_size_(batch_size),
+        head_(NULL),
+        num_cached_(0),
+        num_new_(0),
+        num_free_(0) {
+    ASSERT(holder_ && batch_size_ > 0);
+  }
+
+  ~HolderCache() {
+    holder_->PushBatch(head_, num_cached_, num_new_, num_free_);
+  }
+
+  template <class... Args>
+  T *New(Args &&... args) {
+    if (!head_) {
+      head_ = holder_->PopBatch(batch_size_, num_new_, num_free_);
+      num_cached_ = batch_size_;
+      num_new_ = num_free_ = 0;
+    }
+    Slot *slot = head_;
+    head_ = slot->body.next;
+    num_cached_--;
+    num_new_++;
+#ifdef DECODER_DEBUG
+    slot->in_use = true;
+#endif
+    return new (Holder<T>::Object(slot)) T(std::forward<Args>(args)...);
   }
 
-  void Set(T* addr, Bool state) {
-    Int32 index, offset;
-    Index(addr, &index, &offset);
-    free_map_[index][offset] = state;
+  void Free(T *addr) {
+    addr->~T();
+    Slot *slot = Holder<T>::ToSlot(addr);
+#ifdef DECODER_DEBUG
+    if (slot->owner != holder_)
+      LOG_FAIL << "Object " << addr << " is not owned by this holder";
+    if (!slot->in_use) LOG_FAIL << "Double free for object " << addr;
+    slot->in_use = false;
+#endif
+    slot->body.next = head_;
+    head_ = slot;
+    num_free_++;
+    // give back half of them if cache too much
+    if (++num_cached_ >= 2 * batch_size_) {
+      Slot *give = head_;
+      for (UInt64 i = 0; i < batch_size_; i++) head_ = head_->body.next;
+      num_cached_ -= batch_size_;
+      holder_->PushBatch(give, batch_size_, num_new_, num_free_);
+      num_new_ = num_free_ = 0;
+    }
   }
 
-  // Cache allocated chunk
-  std::vector<T*> holder_;
-  std::vector<Bool*> free_map_;
-  // Record unused items
-  std::queue<T*> unused_;
+ private:
+  HolderCache(const HolderCache &) = delete;
+  HolderCache &operator=(const HolderCache &) = delete;
+
+  Holder<T> *holder_;
+  UInt64 batch_size_;
+  Slot *head_;
+  UInt64 num_cached_;
+  // New()/Free() calls not added to the holder's stats yet
+  UInt64 num_new_, num_free_;
 };
 
-#endif
\ No newline at end of file
+#endif
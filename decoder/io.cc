@@ -1,7 +1,271 @@
 // decoder/io.cc
 // wujian@2018
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <sstream>
+
 #include "io.h"
+#include "simd.h"
+
+MappedFile::MappedFile(const std::string &filename)
+    : filename_(filename), data_(NULL), size_(0) {
+  Int32 fd = open(filename_.c_str(), O_RDONLY);
+  if (fd < 0) LOG_FAIL << "Open " << filename_ << " failed";
+  struct stat st;
+  if (fstat(fd, &st) != 0) LOG_FAIL << "Stat " << filename_ << " failed";
+  size_ = st.st_size;
+  if (size_) {
+    void *addr = mmap(NULL, size_, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) LOG_FAIL << "Mmap " << filename_ << " failed";
+    data_ = static_cast<const char *>(addr);
+  }
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (data_) munmap(const_cast<char *>(data_), size_);
+}
+
+// Parse the matrix which starts at the binary header ("\0B") in [begin, end)
+// of filename, return the end of the matrix
+static const char *ParseMatrix(const char *begin, const char *end,
+                               const std::string &filename,
+                               MatrixView *value) {
+  const char *p = begin;
+  if (end - p < 2 || p[0] != '\0' || p[1] != 'B')
+    LOG_FAIL << "Expect binary header(\\0B) of matrix in " << filename;
+  p += 2;
+  const char *space = static_cast<const char *>(memchr(p, ' ', end - p));
+  if (!space) LOG_FAIL << "Truncated archive " << filename;
+  std::string token(p, space);
+  p = space + 1;
+  UInt64 num_bytes = 0;
+  if (token == "FM") {
+    // \4 num_rows \4 num_cols
+    if (end - p < 10 || p[0] != 4 || p[5] != 4)
+      LOG_FAIL << "Bad header of matrix in " << filename;
+    memcpy(&value->num_rows, p + 1, 4);
+    memcpy(&value->num_cols, p + 6, 4);
+    p += 10;
+    value->compress_format = 0;
+    num_bytes = sizeof(Float32) * value->num_rows * value->num_cols;
+  } else if (token == "CM" || token == "CM2" || token == "CM3") {
+    // min_value, range, num_rows, num_cols
+    if (end - p < 16) LOG_FAIL << "Bad header of matrix in " << filename;
+    memcpy(&value->num_rows, p + 8, 4);
+    memcpy(&value->num_cols, p + 12, 4);
+    value->compress_format = token == "CM" ? 1 : (token == "CM2" ? 2 : 3);
+    UInt64 num_elems = static_cast<UInt64>(value->num_rows) * value->num_cols;
+    // 1: uint16 x 4 per column headers, uint8 values; 2: uint16; 3: uint8
+    num_bytes = 16 + (value->compress_format == 1
+                          ? 8 * value->num_cols + num_elems
+                          : num_elems * (value->compress_format == 2 ? 2 : 1));
+  } else {
+    LOG_FAIL << "Unsupported matrix type \'" << token << "\' in "
+             << filename;
+  }
+  if (value->num_rows < 0 || value->num_cols < 0 ||
+      static_cast<UInt64>(end - p) < num_bytes)
+    LOG_FAIL << "Truncated matrix in " << filename;
+  value->data = p;
+  return p + num_bytes;
+}
+
+// Same constants (and order of float operations) as Kaldi
+static inline Float32 Uint16ToFloat(Float32 min_value, Float32 range,
+                                    UInt16 value) {
+  return min_value + range * 1.52590218966964e-05F * value;
+}
+
+// Column-major uint8 with per column headers, 4 columns at a time: bytes of
+// one row are gathered from 4 columns, then mapped by the 3 linear pieces in
+// parallel and stored contiguously into the output row
+static void CopyOneByteWithColHeaders(const char *data, Float32 min_value,
+                                      Float32 range, Int32 num_rows,
+                                      Int32 num_cols, Float32 *addr,
+                                      Int32 stride) {
+  const UInt08 *headers = reinterpret_cast<const UInt08 *>(data),
+               *bytes = headers + 8 * num_cols;
+  // p0, p25, p75, p25 - p0, p75 - p25, p100 - p75 of each column
+  std::vector<Float32> params(6 * num_cols);
+  Float32 *p0 = params.data(), *p25 = p0 + num_cols, *p75 = p25 + num_cols,
+          *a1 = p75 + num_cols, *a2 = a1 + num_cols, *a3 = a2 + num_cols;
+  for (Int32 c = 0; c < num_cols; c++) {
+    UInt16 percentiles[4];
+    memcpy(percentiles, headers + 8 * c, sizeof(percentiles));
+    Float32 q0 = Uint16ToFloat(min_value, range, percentiles[0]),
+            q25 = Uint16ToFloat(min_value, range, percentiles[1]),
+            q75 = Uint16ToFloat(min_value, range, percentiles[2]),
+            q100 = Uint16ToFloat(min_value, range, percentiles[3]);
+    p0[c] = q0, p25[c] = q25, p75[c] = q75;
+    a1[c] = q25 - q0, a2[c] = q75 - q25, a3[c] = q100 - q75;
+  }
+  const Float32x4 k64 = Set4(64), k192 = Set4(192), s1 = Set4(1 / 64.0f),
+                  s2 = Set4(1 / 128.0f), s3 = Set4(1 / 63.0f);
+  Int32 c = 0;
+  for (; c + 4 <= num_cols; c += 4) {
+    const UInt08 *col = bytes + static_cast<UInt64>(c) * num_rows;
+    Float32x4 vp0 = Load4(p0 + c), vp25 = Load4(p25 + c),
+              vp75 = Load4(p75 + c), va1 = Load4(a1 + c),
+              va2 = Load4(a2 + c), va3 = Load4(a3 + c);
+    for (Int32 r = 0; r < num_rows; r++) {
+      Float32 values[4] = {
+          static_cast<Float32>(col[r]), static_cast<Float32>(col[num_rows + r]),
+          static_cast<Float32>(col[2 * num_rows + r]),
+          static_cast<Float32>(col[3 * num_rows + r])};
+      Float32x4 v = Load4(values);
+      Float32x4 f1 = Add4(vp0, Mul4(Mul4(va1, v), s1)),
+                f2 = Add4(vp25, Mul4(Mul4(va2, Sub4(v, k64)), s2)),
+                f3 = Add4(vp75, Mul4(Mul4(va3, Sub4(v, k192)), s3));
+      Store4(addr + static_cast<UInt64>(r) * stride + c,
+             SelectLessEqual4(v, k64, f1, SelectLessEqual4(v, k192, f2, f3)));
+    }
+  }
+  for (; c < num_cols; c++) {
+    const UInt08 *col = bytes + static_cast<UInt64>(c) * num_rows;
+    for (Int32 r = 0; r < num_rows; r++) {
+      Int32 v = col[r];
+      Float32 f;
+      if (v <= 64)
+        f = p0[c] + a1[c] * v * (1 / 64.0f);
+      else if (v <= 192)
+        f = p25[c] + a2[c] * (v - 64) * (1 / 128.0f);
+      else
+        f = p75[c] + a3[c] * (v - 192) * (1 / 63.0f);
+      addr[static_cast<UInt64>(r) * stride + c] = f;
+    }
+  }
+}
+
+void CopyMatrix(const MatrixView &matrix, Float32 *addr, Int32 stride) {
+  Int32 num_rows = matrix.num_rows, num_cols = matrix.num_cols;
+  ASSERT(num_cols <= stride);
+  if (matrix.compress_format == 0) {
+    for (Int32 r = 0; r < num_rows; r++)
+      memcpy(addr + static_cast<UInt64>(r) * stride,
+             matrix.data + sizeof(Float32) * r * num_cols,
+             sizeof(Float32) * num_cols);
+    return;
+  }
+  Float32 min_value, range;
+  memcpy(&min_value, matrix.data, sizeof(Float32));
+  memcpy(&range, matrix.data + 4, sizeof(Float32));
+  const char *data = matrix.data + 16;
+  switch (matrix.compress_format) {
+    case 1:
+      CopyOneByteWithColHeaders(data, min_value, range, num_rows, num_cols,
+                                addr, stride);
+      break;
+    case 2: {
+      // uint16 rows are decoded in place, the payload could be unaligned
+      Float32 increment = range * (1.0 / 65535.0);
+      const Float32x4 vmin = Set4(min_value), vinc = Set4(increment);
+      for (Int32 r = 0; r < num_rows; r++) {
+        const char *src = data + sizeof(UInt16) * r * num_cols;
+        Float32 *dst = addr + static_cast<UInt64>(r) * stride;
+        Int32 c = 0;
+        for (; c + 4 <= num_cols; c += 4) {
+          Float32x4 v = LoadUint16x4(src + sizeof(UInt16) * c);
+          Store4(dst + c, Add4(vmin, Mul4(vinc, v)));
+        }
+        for (; c < num_cols; c++) {
+          UInt16 value;
+          memcpy(&value, src + sizeof(UInt16) * c, sizeof(value));
+          dst[c] = min_value + increment * value;
+        }
+      }
+      break;
+    }
+    case 3: {
+      Float32 increment = range * (1.0 / 255.0);
+      const Float32x4 vmin = Set4(min_value), vinc = Set4(increment);
+      const UInt08 *bytes = reinterpret_cast<const UInt08 *>(data);
+      for (Int32 r = 0; r < num_rows; r++) {
+        const UInt08 *src = bytes + static_cast<UInt64>(r) * num_cols;
+        Float32 *dst = addr + static_cast<UInt64>(r) * stride;
+        Int32 c = 0;
+        for (; c + 4 <= num_cols; c += 4)
+          Store4(dst + c, Add4(vmin, Mul4(vinc, LoadUint8x4(src + c))));
+        for (; c < num_cols; c++) dst[c] = min_value + increment * src[c];
+      }
+      break;
+    }
+    default:
+      LOG_FAIL << "Unknown compress format " << matrix.compress_format;
+  }
+}
+
+ArchiveReader::ArchiveReader(const std::string &filename) {
+  if (filename.size() > 4 && filename.substr(filename.size() - 4) == ".scp")
+    IndexScp(filename);
+  else
+    IndexArchive(filename);
+  for (Int32 i = 0; i < items_.size(); i++) {
+    if (!index_.insert(std::make_pair(items_[i].key, i)).second)
+      LOG_WARN << "Duplicated key " << items_[i].key << " in " << filename;
+  }
+}
+
+ArchiveReader::~ArchiveReader() {
+  for (auto &archive : archives_) delete archive.second;
+}
+
+const MappedFile &ArchiveReader::Archive(const std::string &filename) {
+  MappedFile *&archive = archives_[filename];
+  if (!archive) archive = new MappedFile(filename);
+  return *archive;
+}
+
+void ArchiveReader::IndexArchive(const std::string &filename) {
+  const MappedFile &archive = Archive(filename);
+  const char *p = archive.Data(), *end = p + archive.Size();
+  while (p < end) {
+    // skip newlines (text archives) and spaces before key
+    while (p < end && isspace(*p)) p++;
+    if (p == end) break;
+    const char *space = static_cast<const char *>(memchr(p, ' ', end - p));
+    if (!space) LOG_FAIL << "Truncated archive " << filename;
+    Item item;
+    item.key.assign(p, space);
+    p = ParseMatrix(space + 1, end, filename, &item.value);
+    items_.push_back(item);
+  }
+}
+
+void ArchiveReader::IndexScp(const std::string &filename) {
+  std::ifstream scp(filename.c_str());
+  if (!scp.is_open()) LOG_FAIL << "Open " << filename << " failed";
+  std::string line, key, location;
+  while (std::getline(scp, line)) {
+    std::istringstream iss(line);
+    if (!(iss >> key >> location)) continue;
+    std::string::size_type colon = location.rfind(':');
+    if (colon == std::string::npos || location.back() == ']')
+      LOG_FAIL << "Expect \"path.ark:offset\" in " << filename << ", "
+               << "got " << location;
+    const MappedFile &archive = Archive(location.substr(0, colon));
+    UInt64 offset = std::stoull(location.substr(colon + 1));
+    if (offset >= archive.Size())
+      LOG_FAIL << "Offset out of range: " << location;
+    Item item;
+    item.key = key;
+    ParseMatrix(archive.Data() + offset, archive.Data() + archive.Size(),
+                location, &item.value);
+    items_.push_back(item);
+  }
+}
+
+Bool ArchiveReader::Find(const std::string &key, MatrixView *value) const {
+  auto iter = index_.find(key);
+  if (iter == index_.end()) return false;
+  if (value) *value = items_[iter->second].value;
+  return true;
+}
 
 void Seek(std::istream &is, Int64 off, std::ios_base::seekdir way) {
   is.seekg(off, way);
@@ -97,6 +361,8 @@ template void ReadBinaryBasicType<UInt64>(std::istream &is, UInt64 *t);
 
 template void ReadBinaryBasicType<Float32>(std::istream &is, Float32 *t);
 
+template void ReadBinaryBasicType<Float64>(std::istream &is, Float64 *t);
+
 template void WriteBinaryBasicType<Int32>(std::ostream &os, Int32 t);
 
 template void WriteBinaryBasicType<Int64>(std::ostream &os, Int64 t);
@@ -104,3 +370,5 @@ template void WriteBinaryBasicType<Int64>(std::ostream &os, Int64 t);
 template void WriteBinaryBasicType<UInt64>(std::ostream &os, UInt64 t);
 
 template void WriteBinaryBasicType<Float32>(std::ostream &os, Float32 t);
+
+template void WriteBinaryBasicType<Float64>(std::ostream &os, Float64 t);
@@ -8,6 +8,8 @@
 
 #include <fstream>
 #include <iostream>
+#include <unordered_map>
+#include <vector>
 
 #include "decoder/type.h"
 
@@ -47,6 +49,93 @@ class BinaryOutput {
   std::ofstream os_;
 };
 
+// Read-only memory mapping of a whole file. Pages are backed by the page
+// cache, so they are shared by all processes which map the same file.
+class MappedFile {
+ public:
+  MappedFile(const std::string &filename);
+
+  ~MappedFile();
+
+  const char *Data() const { return data_; }
+
+  UInt64 Size() const { return size_; }
+
+ private:
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  std::string filename_;
+  const char *data_;
+  UInt64 size_;
+};
+
+// Matrix stored in a mapped archive, nothing copied. For "FM", data points to
+// num_rows x num_cols floats (not always 4-byte aligned, which is fine on x86
+// and ARMv8). For compressed ones ("CM", "CM2", "CM3": compress_format 1, 2,
+// 3), data points to the global header after the token
+struct MatrixView {
+  const char *data;
+  Int32 num_rows, num_cols;
+  Int32 compress_format;
+
+  const Float32 *FloatData() const {
+    ASSERT(compress_format == 0 && "Not a float matrix");
+    return reinterpret_cast<const Float32 *>(data);
+  }
+};
+
+// Expand matrix into num_rows x num_cols floats, one row per stride floats.
+// Compressed ones are decompressed as Kaldi's CompressedMatrix::CopyToMat():
+// min_value + range * v / 65535 (CM2) or v / 255 (CM3) for uint16/uint8
+// values stored by rows, and for CM, uint8 values stored by columns mapped
+// piecewise linearly by uint16 percentiles (0, 25, 75, 100) of each column
+void CopyMatrix(const MatrixView &matrix, Float32 *addr, Int32 stride);
+
+// Random access of binary Kaldi archives. An .ark file is mapped and scanned
+// once to index the offset of each matrix, while an .scp file ("key
+// path.ark:offset" per line) gives the offsets directly, archives of it are
+// mapped once each. Matrices are returned as views into the mappings, valid
+// until the reader is destroyed. All the methods are const and thread safe,
+// so workers could iterate in parallel, egs: worker w of n reads items
+// w, w + n, w + 2n, ...
+class ArchiveReader {
+ public:
+  // filename ends with ".scp" for scp files, others are archives
+  ArchiveReader(const std::string &filename);
+
+  ~ArchiveReader();
+
+  Int32 NumItems() const { return items_.size(); }
+
+  const std::string &Key(Int32 index) const { return items_[index].key; }
+
+  const MatrixView &Value(Int32 index) const { return items_[index].value; }
+
+  // Return false if key is not in the archive
+  Bool Find(const std::string &key, MatrixView *value) const;
+
+ private:
+  ArchiveReader(const ArchiveReader &) = delete;
+  ArchiveReader &operator=(const ArchiveReader &) = delete;
+
+  struct Item {
+    std::string key;
+    MatrixView value;
+  };
+
+  void IndexArchive(const std::string &filename);
+
+  void IndexScp(const std::string &filename);
+
+  // Mapping of archive, mapped on the first use
+  const MappedFile &Archive(const std::string &filename);
+
+  std::vector<Item> items_;
+  std::unordered_map<std::string, Int32> index_;
+  std::unordered_map<std::string, MappedFile *> archives_;
+};
+
 void WriteBinary(std::ostream &os, const char *ptr, Int32 num_bytes);
 
 void ReadBinary(std::istream &is, char *ptr, Int32 num_bytes);
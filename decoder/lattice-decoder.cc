@@ -0,0 +1,489 @@
+// wujian@2018
+
+// From Kaldi's lattice-faster-decoder.{h,cc}
+
+#include "decoder/lattice-decoder.h"
+
+LatticeDecoder::LatticeDecoder(const DecodeGraph &graph,
+                               const DecodeOpts &decode_opts,
+                               const LatticeOpts &lattice_opts)
+    : fst_(graph.Fst()),
+      table_(graph.Table()),
+      final_best_cost_(0),
+      decoding_finalized_(false),
+      min_active_(decode_opts.min_active),
+      max_active_(decode_opts.max_active),
+      beam_(decode_opts.beam),
+      acoustic_scale_(decode_opts.acwt),
+      word_penalty_(decode_opts.penalty),
+      frame_subsampling_factor_(decode_opts.frame_subsampling_factor),
+      blank_id_(decode_opts.blank_id),
+      log_blank_threshold_(std::log(decode_opts.blank_threshold)),
+      num_frames_received_(0),
+      lattice_beam_(lattice_opts.lattice_beam),
+      prune_interval_(lattice_opts.prune_interval) {
+  num_pdfs_ = fst_.IsPdfLabeled() ? fst_.NumPdfs() : table_.NumPdfs();
+  ASSERT(min_active_ < max_active_);
+  ASSERT(frame_subsampling_factor_ >= 1);
+  ASSERT(blank_id_ < num_pdfs_);
+  ASSERT(lattice_beam_ > 0 && prune_interval_ > 0);
+  if (decode_opts.histogram_bins > 0)
+    LOG_WARN << "LatticeDecoder does not support histogram_bins = "
+             << decode_opts.histogram_bins << ", use exact cutoff instead";
+  if (decode_opts.num_threads > 1)
+    LOG_WARN << "LatticeDecoder does not support num_threads = "
+             << decode_opts.num_threads << ", use 1 thread instead";
+  toks_.SetSize(1000);
+}
+
+void LatticeDecoder::Reset() {
+  ClearActiveTokens();
+  num_frames_received_ = 0;
+  StateId start_state = fst_.Start();
+  ASSERT(start_state != NoStateId);
+  active_toks_.resize(1);
+  Token *start_tok = token_pool_.New(0.0, static_cast<Token *>(NULL));
+  active_toks_[0].toks = start_tok;
+  toks_.Insert(start_state, start_tok);
+  ProcessNonemitting(beam_);
+}
+
+void LatticeDecoder::DecodeFrame(Float32 *loglikes, Int32 num_pdfs) {
+  if (num_pdfs != num_pdfs_)
+    LOG_FAIL << "It seems that dimention of loglikes do not equal to number of "
+                "pdfs, "
+             << num_pdfs << " vs " << num_pdfs_;
+  if (active_toks_.empty() || decoding_finalized_)
+    LOG_FAIL << "Need call Reset() first to initialize decoder";
+  // same as FasterDecoderTpl::DecodeRow()
+  if (blank_id_ >= 0 && loglikes[blank_id_] > log_blank_threshold_) return;
+  if (NumDecodedFrames() % prune_interval_ == 0)
+    PruneActiveTokens(lattice_beam_ * 0.1);
+  Float32Loglikes row = {loglikes};
+  Float64 cutoff;
+  if (fst_.IsPdfLabeled()) {
+    PdfCost<Float32Loglikes> cost = {row, acoustic_scale_, word_penalty_};
+    cutoff = ProcessEmitting(cost);
+  } else {
+    TransitionCost<Float32Loglikes> cost = {row, table_.Table(),
+                                            acoustic_scale_, word_penalty_};
+    cutoff = ProcessEmitting(cost);
+  }
+  ProcessNonemitting(cutoff);
+}
+
+void LatticeDecoder::Decode(Float32 *loglikes, Int32 num_frames, Int32 stride,
+                            Int32 num_pdfs) {
+  ASSERT(num_pdfs <= stride);
+  // continue the phase of last call, as FasterDecoderTpl::Decode()
+  Int32 t = (frame_subsampling_factor_ -
+             num_frames_received_ % frame_subsampling_factor_) %
+            frame_subsampling_factor_;
+  num_frames_received_ += num_frames;
+  for (; t < num_frames; t += frame_subsampling_factor_)
+    DecodeFrame(loglikes + t * stride, num_pdfs);
+}
+
+inline LatticeDecoder::Token *LatticeDecoder::FindOrAddToken(StateId state,
+                                                             Int32 frame,
+                                                             Float64 tot_cost,
+                                                             Bool *changed) {
+  Elem *e_found = toks_.Find(state);
+  if (e_found == NULL) {
+    Token *&toks = active_toks_[frame].toks;
+    Token *new_tok = token_pool_.New(tot_cost, toks);
+    toks = new_tok;
+    toks_.Insert(state, new_tok);
+    if (changed) *changed = true;
+    return new_tok;
+  } else {
+    Token *tok = e_found->val;
+    if (tok->tot_cost > tot_cost) {
+      // links into this token keep valid
+      tok->tot_cost = tot_cost;
+      if (changed) *changed = true;
+    } else {
+      if (changed) *changed = false;
+    }
+    return tok;
+  }
+}
+
+// Same as FasterDecoder::GetCutoff() in exact mode
+Float64 LatticeDecoder::GetCutoff(Elem *list_head, UInt64 *tok_count,
+                                  Float32 *adaptive_beam, Elem **best_elem) {
+  Float64 best_cost = FLOAT64_INF;
+  UInt64 count = 0;
+  cost_active_.clear();
+  for (Elem *e = list_head; e != NULL; e = e->tail, count++) {
+    Float64 w = e->val->tot_cost;
+    cost_active_.push_back(w);
+    if (w < best_cost) {
+      best_cost = w;
+      if (best_elem) *best_elem = e;
+    }
+  }
+  if (tok_count != NULL) *tok_count = count;
+  return ExactActiveCutoff(&cost_active_, best_cost, beam_, min_active_,
+                           max_active_, adaptive_beam);
+}
+
+template <class Cost>
+Float64 LatticeDecoder::ProcessEmitting(const Cost &cost) {
+  Int32 frame = active_toks_.size() - 1;
+  active_toks_.resize(frame + 2);
+
+  Elem *last_toks = toks_.Clear();
+  UInt64 tok_cnt;
+  Float32 adaptive_beam;
+  Elem *best_elem = NULL;
+  Float64 cur_cutoff =
+      GetCutoff(last_toks, &tok_cnt, &adaptive_beam, &best_elem);
+  UInt64 new_sz = static_cast<UInt64>(static_cast<Float32>(tok_cnt) * 2);
+  if (new_sz > toks_.Size()) toks_.SetSize(new_sz);
+
+  Float64 next_cutoff = FLOAT64_INF;
+  if (best_elem) {
+    StateId state = best_elem->key;
+    Token *tok = best_elem->val;
+    const Arc *arc_begin = fst_.Arcs(state),
+              *arc_end = arc_begin + fst_.NumArcs(state);
+    for (const Arc *iter = arc_begin + fst_.NumInputEpsilons(state);
+         iter != arc_end; iter++) {
+      Float64 new_weight = iter->weight + tok->tot_cost + cost(iter->ilabel);
+      if (new_weight + adaptive_beam < next_cutoff)
+        next_cutoff = new_weight + adaptive_beam;
+    }
+  }
+
+  for (Elem *e = last_toks, *e_tail; e != NULL; e = e_tail) {
+    StateId state = e->key;
+    Token *tok = e->val;
+    if (tok->tot_cost <= cur_cutoff) {
+      const Arc *arc_begin = fst_.Arcs(state),
+                *arc_end = arc_begin + fst_.NumArcs(state);
+      for (const Arc *iter = arc_begin + fst_.NumInputEpsilons(state);
+           iter != arc_end; iter++) {
+        const Arc &arc = *iter;
+        Float32 ac_cost = cost(arc.ilabel);
+        Float64 tot_cost = tok->tot_cost + ac_cost + arc.weight;
+        if (tot_cost >= next_cutoff) continue;
+        if (tot_cost + adaptive_beam < next_cutoff)
+          next_cutoff = tot_cost + adaptive_beam;
+        Token *next_tok =
+            FindOrAddToken(arc.nextstate, frame + 1, tot_cost, NULL);
+        tok->links = link_pool_.New(next_tok, arc.ilabel, arc.olabel,
+                                    arc.weight, ac_cost, tok->links);
+      }
+    }
+    e_tail = e->tail;
+    toks_.Delete(e);
+  }
+  return next_cutoff;
+}
+
+void LatticeDecoder::ProcessNonemitting(Float64 cutoff) {
+  Int32 frame = active_toks_.size() - 1;
+  ASSERT(queue_.empty());
+  for (const Elem *e = toks_.GetList(); e != NULL; e = e->tail)
+    queue_.push_back(e->key);
+
+  while (!queue_.empty()) {
+    StateId state = queue_.back();
+    queue_.pop_back();
+    Token *tok = toks_.Find(state)->val;
+    Float64 cur_cost = tok->tot_cost;
+    if (cur_cost >= cutoff) continue;
+    // re-visited with a better cost, links need to be rebuilt
+    DeleteForwardLinks(tok);
+    const Arc *arc_begin = fst_.Arcs(state),
+              *arc_end = arc_begin + fst_.NumInputEpsilons(state);
+    for (const Arc *iter = arc_begin; iter != arc_end; iter++) {
+      const Arc &arc = *iter;
+      Float64 tot_cost = cur_cost + arc.weight;
+      if (tot_cost < cutoff) {
+        Bool changed;
+        Token *new_tok =
+            FindOrAddToken(arc.nextstate, frame, tot_cost, &changed);
+        tok->links =
+            link_pool_.New(new_tok, 0, arc.olabel, arc.weight, 0.0, tok->links);
+        if (changed) queue_.push_back(arc.nextstate);
+      }
+    }
+  }
+}
+
+void LatticeDecoder::DeleteForwardLinks(Token *tok) {
+  for (ForwardLink *link = tok->links, *next; link != NULL; link = next) {
+    next = link->next;
+    link_pool_.Free(link);
+  }
+  tok->links = NULL;
+}
+
+void LatticeDecoder::PruneForwardLinks(Int32 frame, Bool *extra_costs_changed,
+                                       Bool *links_pruned, Float32 delta) {
+  *extra_costs_changed = false, *links_pruned = false;
+  ASSERT(frame >= 0 && frame < active_toks_.size());
+  // epsilon links inside frame, iterate until extra costs converge
+  Bool changed = true;
+  while (changed) {
+    changed = false;
+    for (Token *tok = active_toks_[frame].toks; tok != NULL; tok = tok->next) {
+      Float64 tok_extra_cost = FLOAT64_INF;
+      for (ForwardLink *link = tok->links, *prev_link = NULL, *next_link;
+           link != NULL; link = next_link) {
+        next_link = link->next;
+        Token *next_tok = link->next_tok;
+        Float64 link_extra_cost =
+            next_tok->extra_cost +
+            ((tok->tot_cost + link->acoustic_cost + link->graph_cost) -
+             next_tok->tot_cost);
+        if (link_extra_cost > lattice_beam_) {
+          if (prev_link)
+            prev_link->next = next_link;
+          else
+            tok->links = next_link;
+          link_pool_.Free(link);
+          *links_pruned = true;
+        } else {
+          if (link_extra_cost < 0.0) link_extra_cost = 0.0;
+          if (link_extra_cost < tok_extra_cost)
+            tok_extra_cost = link_extra_cost;
+          prev_link = link;
+        }
+      }
+      if (std::fabs(tok_extra_cost - tok->extra_cost) > delta ||
+          (tok_extra_cost == FLOAT64_INF) != (tok->extra_cost == FLOAT64_INF))
+        changed = true;
+      tok->extra_cost = tok_extra_cost;
+    }
+    if (changed) *extra_costs_changed = true;
+  }
+}
+
+void LatticeDecoder::PruneForwardLinksFinal() {
+  Int32 frame = active_toks_.size() - 1;
+  // compute final costs and clear current token map
+  final_costs_.clear();
+  Float64 best_cost = FLOAT64_INF, best_cost_with_final = FLOAT64_INF;
+  for (Elem *e = toks_.Clear(), *e_tail; e != NULL; e = e_tail) {
+    Float32 final_cost = fst_.Final(e->key);
+    best_cost = std::min(best_cost, e->val->tot_cost);
+    if (final_cost != TROPICAL_ZERO32) {
+      final_costs_[e->val] = final_cost;
+      best_cost_with_final =
+          std::min(best_cost_with_final, e->val->tot_cost + final_cost);
+    }
+    e_tail = e->tail;
+    toks_.Delete(e);
+  }
+  // no final state reached, treat all tokens as final
+  Bool use_final = !final_costs_.empty();
+  final_best_cost_ = use_final ? best_cost_with_final : best_cost;
+
+  Bool changed = true;
+  while (changed) {
+    changed = false;
+    for (Token *tok = active_toks_[frame].toks; tok != NULL; tok = tok->next) {
+      Float64 final_cost = 0.0;
+      if (use_final) {
+        std::unordered_map<Token *, Float32>::const_iterator iter =
+            final_costs_.find(tok);
+        final_cost = iter == final_costs_.end() ? FLOAT64_INF : iter->second;
+      }
+      Float64 tok_extra_cost = tok->tot_cost + final_cost - final_best_cost_;
+      for (ForwardLink *link = tok->links, *prev_link = NULL, *next_link;
+           link != NULL; link = next_link) {
+        next_link = link->next;
+        Token *next_tok = link->next_tok;
+        Float64 link_extra_cost =
+            next_tok->extra_cost +
+            ((tok->tot_cost + link->acoustic_cost + link->graph_cost) -
+             next_tok->tot_cost);
+        if (link_extra_cost > lattice_beam_) {
+          if (prev_link)
+            prev_link->next = next_link;
+          else
+            tok->links = next_link;
+          link_pool_.Free(link);
+        } else {
+          if (link_extra_cost < 0.0) link_extra_cost = 0.0;
+          if (link_extra_cost < tok_extra_cost)
+            tok_extra_cost = link_extra_cost;
+          prev_link = link;
+        }
+      }
+      if (tok_extra_cost > lattice_beam_) tok_extra_cost = FLOAT64_INF;
+      if (tok_extra_cost != tok->extra_cost &&
+          !(std::fabs(tok_extra_cost - tok->extra_cost) < 1.0e-5))
+        changed = true;
+      tok->extra_cost = tok_extra_cost;
+    }
+  }
+  if (!use_final) {
+    // reached no final state, make all survived tokens final
+    for (Token *tok = active_toks_[frame].toks; tok != NULL; tok = tok->next)
+      final_costs_[tok] = 0.0;
+  }
+}
+
+void LatticeDecoder::PruneTokensForFrame(Int32 frame) {
+  ASSERT(frame >= 0 && frame < active_toks_.size());
+  Token *&toks = active_toks_[frame].toks;
+  for (Token *tok = toks, *prev_tok = NULL, *next_tok; tok != NULL;
+       tok = next_tok) {
+    next_tok = tok->next;
+    if (tok->extra_cost == FLOAT64_INF) {
+      // links to it have been pruned already
+      if (prev_tok)
+        prev_tok->next = next_tok;
+      else
+        toks = next_tok;
+      DeleteForwardLinks(tok);
+      token_pool_.Free(tok);
+    } else {
+      prev_tok = tok;
+    }
+  }
+}
+
+void LatticeDecoder::PruneActiveTokens(Float32 delta) {
+  Int32 cur_frame_plus_one = NumDecodedFrames();
+  for (Int32 f = cur_frame_plus_one - 1; f >= 0; f--) {
+    if (active_toks_[f].must_prune_forward_links) {
+      Bool extra_costs_changed = false, links_pruned = false;
+      PruneForwardLinks(f, &extra_costs_changed, &links_pruned, delta);
+      if (extra_costs_changed && f > 0)
+        active_toks_[f - 1].must_prune_forward_links = true;
+      if (links_pruned) active_toks_[f].must_prune_tokens = true;
+      active_toks_[f].must_prune_forward_links = false;
+    }
+    if (f + 1 < cur_frame_plus_one && active_toks_[f + 1].must_prune_tokens) {
+      PruneTokensForFrame(f + 1);
+      active_toks_[f + 1].must_prune_tokens = false;
+    }
+  }
+}
+
+void LatticeDecoder::FinalizeDecoding() {
+  Int32 final_frame_plus_one = NumDecodedFrames();
+  PruneForwardLinksFinal();
+  for (Int32 f = final_frame_plus_one - 1; f >= 0; f--) {
+    Bool extra_costs_changed, links_pruned;
+    // delta of zero means always update
+    PruneForwardLinks(f, &extra_costs_changed, &links_pruned, 0.0);
+    PruneTokensForFrame(f + 1);
+  }
+  PruneTokensForFrame(0);
+  decoding_finalized_ = true;
+}
+
+void LatticeDecoder::TopSortTokens(Token *tok_list,
+                                   std::vector<Token *> *topsorted_list) {
+  std::unordered_map<Token *, Int32> token2pos;
+  Int32 num_toks = 0;
+  for (Token *tok = tok_list; tok != NULL; tok = tok->next) num_toks++;
+  // tokens are prepended, so num_toks - 1, ..., 0 is the order of creation
+  Int32 cur_pos = 0;
+  for (Token *tok = tok_list; tok != NULL; tok = tok->next)
+    token2pos[tok] = num_toks - ++cur_pos;
+
+  // move the target of an epsilon link behind its source if needed
+  std::vector<Token *> reprocess, next_reprocess;
+  for (Token *tok = tok_list; tok != NULL; tok = tok->next)
+    reprocess.push_back(tok);
+  Int32 num_loops = 0;
+  while (!reprocess.empty()) {
+    if (++num_loops > 1000000)
+      LOG_FAIL << "Epsilon loops exist in your decoding graph";
+    next_reprocess.clear();
+    for (Token *tok : reprocess) {
+      Int32 pos = token2pos[tok];
+      for (ForwardLink *link = tok->links; link != NULL; link = link->next) {
+        if (link->ilabel != 0) continue;
+        std::unordered_map<Token *, Int32>::iterator iter =
+            token2pos.find(link->next_tok);
+        if (iter != token2pos.end() && iter->second < pos) {
+          iter->second = cur_pos++;
+          next_reprocess.push_back(link->next_tok);
+        }
+      }
+    }
+    std::swap(reprocess, next_reprocess);
+  }
+  topsorted_list->assign(cur_pos, NULL);
+  for (std::unordered_map<Token *, Int32>::iterator iter = token2pos.begin();
+       iter != token2pos.end(); iter++)
+    (*topsorted_list)[iter->second] = iter->first;
+}
+
+Bool LatticeDecoder::ReachedFinal() {
+  for (const Elem *e = toks_.GetList(); e != NULL; e = e->tail) {
+    if (e->val->tot_cost != FLOAT64_INF &&
+        fst_.Final(e->key) != TROPICAL_ZERO32)
+      return true;
+  }
+  return false;
+}
+
+Bool LatticeDecoder::GetLattice(Lattice *lat) {
+  ASSERT(lat);
+  lat->Clear();
+  if (active_toks_.empty())
+    LOG_FAIL << "Need call Reset() first to initialize decoder";
+  if (!decoding_finalized_) FinalizeDecoding();
+  Int32 num_frames = NumDecodedFrames();
+  // assign state ids frame by frame, tokens on each frame are sorted
+  std::unordered_map<Token *, Int32> tok_map;
+  std::vector<Token *> token_list;
+  for (Int32 f = 0; f <= num_frames; f++) {
+    if (active_toks_[f].toks == NULL) {
+      LOG_WARN << "No tokens active on frame " << f
+               << ": not producing lattice";
+      lat->Clear();
+      return false;
+    }
+    TopSortTokens(active_toks_[f].toks, &token_list);
+    for (Token *tok : token_list)
+      if (tok) tok_map[tok] = lat->AddState();
+  }
+  for (Int32 f = 0; f <= num_frames; f++) {
+    for (Token *tok = active_toks_[f].toks; tok != NULL; tok = tok->next) {
+      Int32 cur_state = tok_map[tok];
+      for (ForwardLink *link = tok->links; link != NULL; link = link->next) {
+        std::unordered_map<Token *, Int32>::const_iterator iter =
+            tok_map.find(link->next_tok);
+        ASSERT(iter != tok_map.end());
+        lat->AddArc(cur_state,
+                    LatticeArc(link->ilabel, link->olabel, link->graph_cost,
+                               link->acoustic_cost, iter->second));
+      }
+      if (f == num_frames) {
+        std::unordered_map<Token *, Float32>::const_iterator iter =
+            final_costs_.find(tok);
+        if (iter != final_costs_.end()) lat->SetFinal(cur_state, iter->second);
+      }
+    }
+  }
+  return true;
+}
+
+Bool LatticeDecoder::GetBestPath(std::vector<Int32> *word_sequence) {
+  Lattice lat;
+  if (!GetLattice(&lat)) return false;
+  return lat.GetBestPath(word_sequence);
+}
+
+void LatticeDecoder::ClearActiveTokens() {
+  for (Elem *e = toks_.Clear(), *e_tail; e != NULL; e = e_tail) {
+    e_tail = e->tail;
+    toks_.Delete(e);
+  }
+  // tokens and links are trivial structures, release them at once
+  active_toks_.clear();
+  final_costs_.clear();
+  token_pool_.Release();
+  link_pool_.Release();
+  decoding_finalized_ = false;
+}
@@ -0,0 +1,198 @@
+// wujian@2018
+
+// From Kaldi's lattice-faster-decoder.{h,cc}
+
+#ifndef LATTICE_DECODER_H
+#define LATTICE_DECODER_H
+
+#include <unordered_map>
+
+#include "decoder/common.h"
+#include "decoder/config.h"
+#include "decoder/decode-graph.h"
+#include "decoder/decoder.h"
+#include "decoder/hash-list.h"
+#include "decoder/holder.h"
+#include "decoder/lattice.h"
+
+struct LatticeOpts {
+  // Keep arcs whose best path is within lattice_beam of the best one
+  Float32 lattice_beam;
+  // Prune lattice every prune_interval frames, bounding memory for long audio
+  Int32 prune_interval;
+
+  LatticeOpts(Float32 lattice_beam = 8.0, Int32 prune_interval = 25)
+      : lattice_beam(lattice_beam), prune_interval(prune_interval) {}
+
+  LatticeOpts(const std::string &conf) : LatticeOpts(ConfigureTable(conf)) {}
+
+  // From a configure parsed once, without file access
+  LatticeOpts(const ConfigureTable &conf) : LatticeOpts() {
+    ConfigureParser parser(conf);
+    ParseConfigure(&parser);
+  }
+
+  void ParseConfigure(ConfigureParser *parser) {
+    parser->AddOptions("LatticeOpts", "lattice_beam", &lattice_beam);
+    parser->AddOptions("LatticeOpts", "prune_interval", &prune_interval);
+  }
+
+  std::string Configure() {
+    std::ostringstream oss;
+    oss << "--LatticeOpts.lattice_beam=" << lattice_beam << std::endl;
+    oss << "--LatticeOpts.prune_interval=" << prune_interval << std::endl;
+    return oss.str();
+  }
+};
+
+// Keep all surviving arcs (forward links) of tokens instead of one-best
+// back-pointers, and prune them with lattice_beam every prune_interval frames.
+// Options of DecodeOpts used as FasterDecoder: beam, max/min-active, acwt,
+// penalty, frame_subsampling_factor and blank_id/blank_threshold, with the
+// same cutoff (ExactActiveCutoff()) and acoustic costs (loglikes.h). Not used:
+// histogram_bins and num_threads (warned, exact cutoff and 1 thread instead),
+// precompute_cost (speed only) and endpoint_opts (no endpointing here). Only
+// ConstFst with HashList is supported.
+class LatticeDecoder {
+ public:
+  // graph should outlive the decoder
+  LatticeDecoder(const DecodeGraph &graph, const DecodeOpts &decode_opts,
+                 const LatticeOpts &lattice_opts);
+
+  ~LatticeDecoder() { ClearActiveTokens(); }
+
+  void Reset();
+
+  void DecodeFrame(Float32 *loglikes, Int32 num_pdfs);
+
+  // Takes one of every frame_subsampling_factor rows, as FasterDecoder
+  void Decode(Float32 *loglikes, Int32 num_frames, Int32 stride,
+              Int32 num_pdfs);
+
+  // Not counting subsampled or blank frames
+  Int32 NumDecodedFrames() { return active_toks_.size() - 1; }
+
+  Bool ReachedFinal();
+
+  // Final pruning with lattice_beam and output lattice, ilabels are graph's
+  // ilabels and olabels are words. Need Reset() before decoding again
+  Bool GetLattice(Lattice *lat);
+
+  // Best path in the lattice, finalize as GetLattice()
+  Bool GetBestPath(std::vector<Int32> *word_sequence);
+
+  // Number of tokens and links alive
+  UInt64 NumTokens() { return token_pool_.NumActive(); }
+
+  UInt64 NumLinks() { return link_pool_.NumActive(); }
+
+ private:
+  LatticeDecoder(const LatticeDecoder &) = delete;
+  LatticeDecoder &operator=(const LatticeDecoder &) = delete;
+
+  struct Token;
+
+  struct ForwardLink {
+    Token *next_tok;
+    Label ilabel, olabel;
+    Float32 graph_cost, acoustic_cost;
+    ForwardLink *next;
+
+    ForwardLink(Token *next_tok, Label ilabel, Label olabel, Float32 graph_cost,
+                Float32 acoustic_cost, ForwardLink *next)
+        : next_tok(next_tok),
+          ilabel(ilabel),
+          olabel(olabel),
+          graph_cost(graph_cost),
+          acoustic_cost(acoustic_cost),
+          next(next) {}
+  };
+
+  struct Token {
+    Float64 tot_cost;    // best cost from start to here
+    Float64 extra_cost;  // >= 0, extra cost of best path through it
+    ForwardLink *links;
+    Token *next;  // next token in the same frame
+
+    Token(Float64 tot_cost, Token *next)
+        : tot_cost(tot_cost), extra_cost(0), links(NULL), next(next) {}
+  };
+
+  // Tokens of one frame
+  struct TokenList {
+    Token *toks;
+    Bool must_prune_forward_links, must_prune_tokens;
+
+    TokenList()
+        : toks(NULL), must_prune_forward_links(true), must_prune_tokens(true) {}
+  };
+
+  typedef HashList<StateId, Token *>::Elem Elem;
+
+  // Find token of state in current frame, or add one. Update its cost if
+  // tot_cost is better, *changed is true if added or updated
+  inline Token *FindOrAddToken(StateId state, Int32 frame, Float64 tot_cost,
+                               Bool *changed);
+
+  Float64 GetCutoff(Elem *list_head, UInt64 *tok_count, Float32 *adaptive_beam,
+                    Elem **best_elem);
+
+  // Cost is PdfCost or TransitionCost in loglikes.h
+  template <class Cost>
+  Float64 ProcessEmitting(const Cost &cost);
+
+  void ProcessNonemitting(Float64 cutoff);
+
+  void DeleteForwardLinks(Token *tok);
+
+  // Prune links of tokens on frame and update extra_cost of tokens
+  void PruneForwardLinks(Int32 frame, Bool *extra_costs_changed,
+                         Bool *links_pruned, Float32 delta);
+
+  // As PruneForwardLinks() on the last frame, considering final costs
+  void PruneForwardLinksFinal();
+
+  // Delete tokens on frame whose extra_cost is infinity
+  void PruneTokensForFrame(Int32 frame);
+
+  // Prune lattice on all frames that may change
+  void PruneActiveTokens(Float32 delta);
+
+  // Final pruning, after this tokens_ is empty
+  void FinalizeDecoding();
+
+  // Tokens of a frame in topological order(by epsilon links), with NULLs
+  void TopSortTokens(Token *tok_list, std::vector<Token *> *topsorted_list);
+
+  void ClearActiveTokens();
+
+  const ConstFst &fst_;
+  const TransitionTable &table_;
+
+  // Tokens of current frame
+  HashList<StateId, Token *> toks_;
+  // Indexed by frame, active_toks_[0] has tokens before first frame
+  std::vector<TokenList> active_toks_;
+  // Final costs of tokens on last frame, computed in FinalizeDecoding()
+  std::unordered_map<Token *, Float32> final_costs_;
+  Float64 final_best_cost_;
+  Bool decoding_finalized_;
+
+  Holder<Token> token_pool_;
+  Holder<ForwardLink> link_pool_;
+
+  std::vector<StateId> queue_;
+  std::vector<Float32> cost_active_;
+
+  Int32 min_active_, max_active_;
+  Float32 beam_;
+  Float32 acoustic_scale_, word_penalty_;
+  Int32 frame_subsampling_factor_, blank_id_;
+  Float32 log_blank_threshold_;
+  // Rows passed to Decode() since Reset()
+  Int32 num_frames_received_, num_pdfs_;
+  Float32 lattice_beam_;
+  Int32 prune_interval_;
+};
+
+#endif
@@ -0,0 +1,302 @@
+// wujian@2018
+
+#include "decoder/lattice.h"
+
+#include <limits>
+#include <map>
+
+UInt64 Lattice::NumArcs() const {
+  UInt64 num_arcs = 0;
+  for (const std::vector<LatticeArc> &arcs : arcs_) num_arcs += arcs.size();
+  return num_arcs;
+}
+
+Bool Lattice::GetBestPath(std::vector<Int32> *word_sequence,
+                          Float64 *cost) const {
+  ASSERT(word_sequence);
+  word_sequence->clear();
+  Int32 num_states = NumStates();
+  if (!num_states) return false;
+  // states are sorted, one pass is enough
+  std::vector<Float64> best_cost(num_states, FLOAT64_INF);
+  std::vector<const LatticeArc *> best_arc(num_states, NULL);
+  std::vector<Int32> best_prev(num_states, NoStateId);
+  best_cost[0] = 0;
+  Int32 best_final = NoStateId;
+  Float64 best_final_cost = FLOAT64_INF;
+  for (Int32 s = 0; s < num_states; s++) {
+    if (best_cost[s] == FLOAT64_INF) continue;
+    if (best_cost[s] + finals_[s] < best_final_cost) {
+      best_final_cost = best_cost[s] + finals_[s];
+      best_final = s;
+    }
+    for (const LatticeArc &arc : arcs_[s]) {
+      Float64 new_cost = best_cost[s] + arc.graph_cost + arc.acoustic_cost;
+      if (new_cost < best_cost[arc.nextstate]) {
+        best_cost[arc.nextstate] = new_cost;
+        best_arc[arc.nextstate] = &arc;
+        best_prev[arc.nextstate] = s;
+      }
+    }
+  }
+  if (best_final == NoStateId) return false;
+  for (Int32 s = best_final; s != 0; s = best_prev[s])
+    if (best_arc[s]->olabel != 0) word_sequence->push_back(best_arc[s]->olabel);
+  std::reverse(word_sequence->begin(), word_sequence->end());
+  if (cost) *cost = best_final_cost;
+  return true;
+}
+
+// One lattice state in a subset of determinization, with the costs and
+// ilabels not yet output
+struct SubsetElement {
+  Int32 state;
+  Float64 graph_cost, acoustic_cost;
+  std::vector<Int32> alignment;
+
+  Float64 Cost() const { return graph_cost + acoustic_cost; }
+};
+
+typedef std::map<Int32, SubsetElement> Subset;
+
+// Keep the best element per lattice state
+static void AddElement(const SubsetElement &elem, Subset *subset) {
+  Subset::iterator iter = subset->find(elem.state);
+  if (iter == subset->end())
+    subset->insert(std::make_pair(elem.state, elem));
+  else if (elem.Cost() < iter->second.Cost())
+    iter->second = elem;
+}
+
+static SubsetElement FollowArc(const SubsetElement &elem,
+                               const LatticeArc &arc) {
+  SubsetElement next = elem;
+  next.state = arc.nextstate;
+  next.graph_cost += arc.graph_cost;
+  next.acoustic_cost += arc.acoustic_cost;
+  if (arc.ilabel) next.alignment.push_back(arc.ilabel);
+  return next;
+}
+
+// Costs quantized with delta 1/1024, as Kaldi's determinization
+static std::vector<Int64> SubsetKey(const Subset &subset) {
+  std::vector<Int64> key;
+  for (const auto &kv : subset) {
+    const SubsetElement &elem = kv.second;
+    key.push_back(elem.state);
+    key.push_back(std::llround(elem.graph_cost * 1024));
+    key.push_back(std::llround(elem.acoustic_cost * 1024));
+    key.push_back(elem.alignment.size());
+    key.insert(key.end(), elem.alignment.begin(), elem.alignment.end());
+  }
+  return key;
+}
+
+void Lattice::Determinize(CompactLattice *clat) const {
+  ASSERT(clat);
+  clat->Clear();
+  if (!NumStates()) return;
+  // subsets are numbered as found, and sorted topologically at last
+  std::map<std::vector<Int64>, Int32> subset_ids;
+  std::vector<Subset> subsets(1);
+  std::vector<CompactLattice::FinalWeight> finals;
+  std::vector<std::vector<CompactLatticeArc> > arcs;
+  subsets[0][0] = SubsetElement{0, 0, 0, std::vector<Int32>()};
+  subset_ids[SubsetKey(subsets[0])] = 0;
+  for (Int32 id = 0; id < subsets.size(); id++) {
+    // epsilon closure: arcs go to larger states, so one pass in state order
+    Subset closure = subsets[id];
+    for (Subset::iterator iter = closure.begin(); iter != closure.end();
+         ++iter) {
+      for (const LatticeArc &arc : arcs_[iter->first])
+        if (arc.olabel == 0) AddElement(FollowArc(iter->second, arc), &closure);
+    }
+    CompactLattice::FinalWeight final_weight;
+    Float64 best_final_cost = FLOAT64_INF;
+    std::map<Int32, Subset> next_subsets;
+    for (const auto &kv : closure) {
+      const SubsetElement &elem = kv.second;
+      if (finals_[elem.state] != TROPICAL_ZERO32 &&
+          elem.Cost() + finals_[elem.state] < best_final_cost) {
+        best_final_cost = elem.Cost() + finals_[elem.state];
+        final_weight.graph_cost = elem.graph_cost + finals_[elem.state];
+        final_weight.acoustic_cost = elem.acoustic_cost;
+        final_weight.alignment = elem.alignment;
+      }
+      for (const LatticeArc &arc : arcs_[elem.state])
+        if (arc.olabel != 0)
+          AddElement(FollowArc(elem, arc), &next_subsets[arc.olabel]);
+    }
+    finals.push_back(final_weight);
+    arcs.push_back(std::vector<CompactLatticeArc>());
+    for (auto &kv : next_subsets) {
+      Subset &subset = kv.second;
+      // output the costs of the best element and the common prefix of ilabels,
+      // keep the rest in the subset
+      const SubsetElement *best = NULL;
+      UInt64 prefix = std::numeric_limits<UInt64>::max();
+      for (const auto &elem_kv : subset) {
+        const SubsetElement &elem = elem_kv.second;
+        if (!best || elem.Cost() < best->Cost()) best = &elem;
+        if (prefix > elem.alignment.size()) prefix = elem.alignment.size();
+      }
+      for (const auto &elem_kv : subset) {
+        const std::vector<Int32> &alignment = elem_kv.second.alignment;
+        UInt64 i = 0;
+        while (i < prefix && alignment[i] == best->alignment[i]) i++;
+        prefix = i;
+      }
+      CompactLatticeArc arc(
+          kv.first, best->graph_cost, best->acoustic_cost,
+          std::vector<Int32>(best->alignment.begin(),
+                             best->alignment.begin() + prefix),
+          NoStateId);
+      for (auto &elem_kv : subset) {
+        SubsetElement &elem = elem_kv.second;
+        elem.graph_cost -= arc.graph_cost;
+        elem.acoustic_cost -= arc.acoustic_cost;
+        elem.alignment.erase(elem.alignment.begin(),
+                             elem.alignment.begin() + prefix);
+      }
+      std::vector<Int64> key = SubsetKey(subset);
+      if (subset_ids.count(key)) {
+        arc.nextstate = subset_ids[key];
+      } else {
+        arc.nextstate = subsets.size();
+        subset_ids[key] = arc.nextstate;
+        subsets.push_back(subset);
+      }
+      arcs[id].push_back(arc);
+    }
+    // not used any more
+    Subset().swap(subsets[id]);
+  }
+  // Kahn's algorithm, the start subset is the only one without incoming arcs
+  Int32 num_subsets = subsets.size();
+  std::vector<Int32> num_incoming(num_subsets, 0), state_ids(num_subsets);
+  std::vector<Int32> order;
+  for (Int32 id = 0; id < num_subsets; id++)
+    for (const CompactLatticeArc &arc : arcs[id]) num_incoming[arc.nextstate]++;
+  order.push_back(0);
+  for (Int32 i = 0; i < order.size(); i++) {
+    state_ids[order[i]] = i;
+    for (const CompactLatticeArc &arc : arcs[order[i]])
+      if (--num_incoming[arc.nextstate] == 0) order.push_back(arc.nextstate);
+  }
+  ASSERT(order.size() == num_subsets);
+  for (Int32 i = 0; i < num_subsets; i++) clat->AddState();
+  for (Int32 i = 0; i < num_subsets; i++) {
+    clat->SetFinal(i, finals[order[i]]);
+    for (CompactLatticeArc &arc : arcs[order[i]]) {
+      arc.nextstate = state_ids[arc.nextstate];
+      clat->AddArc(i, arc);
+    }
+  }
+}
+
+Bool Lattice::GetNBest(Int32 n,
+                       std::vector<std::vector<Int32> > *word_sequences,
+                       std::vector<Float64> *costs) const {
+  CompactLattice clat;
+  Determinize(&clat);
+  return clat.GetNBest(n, word_sequences, costs);
+}
+
+void Lattice::Write(std::ostream &os, const std::string &key) const {
+  os << key << std::endl;
+  for (Int32 s = 0; s < NumStates(); s++) {
+    for (const LatticeArc &arc : arcs_[s])
+      os << s << " " << arc.nextstate << " " << arc.ilabel << " " << arc.olabel
+         << " " << arc.graph_cost << "," << arc.acoustic_cost << std::endl;
+    if (finals_[s] != TROPICAL_ZERO32) os << s << " " << finals_[s] << ",0\n";
+  }
+  os << std::endl;
+}
+
+UInt64 CompactLattice::NumArcs() const {
+  UInt64 num_arcs = 0;
+  for (const std::vector<CompactLatticeArc> &arcs : arcs_)
+    num_arcs += arcs.size();
+  return num_arcs;
+}
+
+// A path reaching a state, from the rank-th best path of prev_state
+struct PartialPath {
+  Float64 cost;
+  Int32 prev_state, prev_rank;
+  const CompactLatticeArc *arc;
+
+  Bool operator<(const PartialPath &other) const { return cost < other.cost; }
+};
+
+// Keep paths sorted and at most n of them
+static void AddPath(const PartialPath &path, Int32 n,
+                    std::vector<PartialPath> *paths) {
+  if (paths->size() == n && !(path < paths->back())) return;
+  paths->insert(std::upper_bound(paths->begin(), paths->end(), path), path);
+  if (paths->size() > n) paths->pop_back();
+}
+
+Bool CompactLattice::GetNBest(Int32 n,
+                              std::vector<std::vector<Int32> > *word_sequences,
+                              std::vector<Float64> *costs) const {
+  ASSERT(word_sequences && n > 0);
+  word_sequences->clear();
+  if (costs) costs->clear();
+  Int32 num_states = NumStates();
+  if (!num_states) return false;
+  // paths[s] is complete when visiting s, as arcs go to larger states
+  std::vector<std::vector<PartialPath> > paths(num_states);
+  std::vector<PartialPath> final_paths;
+  paths[0].push_back(PartialPath{0, NoStateId, 0, NULL});
+  for (Int32 s = 0; s < num_states; s++) {
+    for (Int32 r = 0; r < paths[s].size(); r++) {
+      Float64 cost = paths[s][r].cost;
+      if (finals_[s].IsFinal())
+        AddPath(PartialPath{cost + finals_[s].graph_cost +
+                                finals_[s].acoustic_cost,
+                            s, r, NULL},
+                n, &final_paths);
+      for (const CompactLatticeArc &arc : arcs_[s])
+        AddPath(PartialPath{cost + arc.graph_cost + arc.acoustic_cost, s, r,
+                            &arc},
+                n, &paths[arc.nextstate]);
+    }
+  }
+  for (const PartialPath &final_path : final_paths) {
+    std::vector<Int32> word_sequence;
+    for (const PartialPath *path = &final_path; path->prev_state != NoStateId;
+         path = &paths[path->prev_state][path->prev_rank])
+      if (path->arc) word_sequence.push_back(path->arc->word);
+    std::reverse(word_sequence.begin(), word_sequence.end());
+    word_sequences->push_back(word_sequence);
+    if (costs) costs->push_back(final_path.cost);
+  }
+  return !final_paths.empty();
+}
+
+static void WriteWeight(std::ostream &os, Float32 graph_cost,
+                        Float32 acoustic_cost,
+                        const std::vector<Int32> &alignment) {
+  os << graph_cost << "," << acoustic_cost << ",";
+  for (UInt64 i = 0; i < alignment.size(); i++)
+    os << (i ? "_" : "") << alignment[i];
+}
+
+void CompactLattice::Write(std::ostream &os, const std::string &key) const {
+  os << key << std::endl;
+  for (Int32 s = 0; s < NumStates(); s++) {
+    for (const CompactLatticeArc &arc : arcs_[s]) {
+      os << s << " " << arc.nextstate << " " << arc.word << " ";
+      WriteWeight(os, arc.graph_cost, arc.acoustic_cost, arc.alignment);
+      os << std::endl;
+    }
+    if (finals_[s].IsFinal()) {
+      os << s << " ";
+      WriteWeight(os, finals_[s].graph_cost, finals_[s].acoustic_cost,
+                  finals_[s].alignment);
+      os << std::endl;
+    }
+  }
+  os << std::endl;
+}
@@ -0,0 +1,169 @@
+// wujian@2018
+
+// State-level lattice generated by LatticeDecoder
+
+#ifndef LATTICE_H
+#define LATTICE_H
+
+#include "decoder/common.h"
+
+// Costs are kept separately as Kaldi's LatticeWeight
+struct LatticeArc {
+  Int32 ilabel, olabel;
+  Float32 graph_cost, acoustic_cost;
+  Int32 nextstate;
+
+  LatticeArc(Int32 ilabel, Int32 olabel, Float32 graph_cost,
+             Float32 acoustic_cost, Int32 nextstate)
+      : ilabel(ilabel),
+        olabel(olabel),
+        graph_cost(graph_cost),
+        acoustic_cost(acoustic_cost),
+        nextstate(nextstate) {}
+};
+
+class CompactLattice;
+
+// Acyclic lattice, state 0 is the start state. States are topologically
+// sorted(arcs only go to larger state ids), as LatticeDecoder outputs.
+class Lattice {
+ public:
+  Lattice() {}
+
+  void Clear() {
+    finals_.clear();
+    arcs_.clear();
+  }
+
+  Int32 AddState() {
+    finals_.push_back(TROPICAL_ZERO32);
+    arcs_.push_back(std::vector<LatticeArc>());
+    return finals_.size() - 1;
+  }
+
+  void AddArc(Int32 state, const LatticeArc &arc) {
+    ASSERT(arc.nextstate > state && "Lattice should be topologically sorted");
+    arcs_[state].push_back(arc);
+  }
+
+  // Final weight has only graph cost
+  void SetFinal(Int32 state, Float32 cost) { finals_[state] = cost; }
+
+  Int32 Start() const { return finals_.empty() ? NoStateId : 0; }
+
+  Int32 NumStates() const { return finals_.size(); }
+
+  UInt64 NumArcs() const;
+
+  Float32 Final(Int32 state) const { return finals_[state]; }
+
+  const std::vector<LatticeArc> &Arcs(Int32 state) const {
+    return arcs_[state];
+  }
+
+  // Viterbi on lattice, get olabels (words) of the best path and its cost
+  Bool GetBestPath(std::vector<Int32> *word_sequence,
+                   Float64 *cost = NULL) const;
+
+  // Determinize on words, as Kaldi's DeterminizeLattice: each word sequence
+  // is kept once, with the costs and ilabels (alignment) of its best path
+  void Determinize(CompactLattice *clat) const;
+
+  // Best n distinct word sequences, sorted by cost. Return false if no path
+  Bool GetNBest(Int32 n, std::vector<std::vector<Int32> > *word_sequences,
+                std::vector<Float64> *costs = NULL) const;
+
+  // Kaldi's text format, which could be read by lattice-copy:
+  // key
+  // src dst ilabel olabel graph_cost,acoustic_cost
+  // final_state graph_cost,0
+  void Write(std::ostream &os, const std::string &key) const;
+
+ private:
+  std::vector<Float32> finals_;
+  std::vector<std::vector<LatticeArc> > arcs_;
+};
+
+// Arcs of CompactLattice carry one word and the ilabels between it and the
+// previous word
+struct CompactLatticeArc {
+  Int32 word;
+  Float32 graph_cost, acoustic_cost;
+  std::vector<Int32> alignment;
+  Int32 nextstate;
+
+  CompactLatticeArc(Int32 word, Float32 graph_cost, Float32 acoustic_cost,
+                    const std::vector<Int32> &alignment, Int32 nextstate)
+      : word(word),
+        graph_cost(graph_cost),
+        acoustic_cost(acoustic_cost),
+        alignment(alignment),
+        nextstate(nextstate) {}
+};
+
+// Word level lattice made by Lattice::Determinize(). It is deterministic(no
+// two arcs of a state share a word), so different paths are different word
+// sequences. States are topologically sorted as Lattice.
+class CompactLattice {
+ public:
+  struct FinalWeight {
+    Float32 graph_cost, acoustic_cost;
+    std::vector<Int32> alignment;
+
+    FinalWeight()
+        : graph_cost(TROPICAL_ZERO32), acoustic_cost(TROPICAL_ZERO32) {}
+
+    Bool IsFinal() const { return graph_cost != TROPICAL_ZERO32; }
+  };
+
+  CompactLattice() {}
+
+  void Clear() {
+    finals_.clear();
+    arcs_.clear();
+  }
+
+  Int32 AddState() {
+    finals_.push_back(FinalWeight());
+    arcs_.push_back(std::vector<CompactLatticeArc>());
+    return finals_.size() - 1;
+  }
+
+  void AddArc(Int32 state, const CompactLatticeArc &arc) {
+    ASSERT(arc.nextstate > state && "Lattice should be topologically sorted");
+    arcs_[state].push_back(arc);
+  }
+
+  void SetFinal(Int32 state, const FinalWeight &weight) {
+    finals_[state] = weight;
+  }
+
+  Int32 Start() const { return finals_.empty() ? NoStateId : 0; }
+
+  Int32 NumStates() const { return finals_.size(); }
+
+  UInt64 NumArcs() const;
+
+  const FinalWeight &Final(Int32 state) const { return finals_[state]; }
+
+  const std::vector<CompactLatticeArc> &Arcs(Int32 state) const {
+    return arcs_[state];
+  }
+
+  // K shortest paths on the acyclic graph: each state keeps its best n
+  // partial paths, states visited in topological order
+  Bool GetNBest(Int32 n, std::vector<std::vector<Int32> > *word_sequences,
+                std::vector<Float64> *costs = NULL) const;
+
+  // Kaldi's text format of CompactLattice:
+  // key
+  // src dst word graph_cost,acoustic_cost,ilabel_ilabel_...
+  // final_state graph_cost,acoustic_cost,ilabel_ilabel_...
+  void Write(std::ostream &os, const std::string &key) const;
+
+ private:
+  std::vector<FinalWeight> finals_;
+  std::vector<std::vector<CompactLatticeArc> > arcs_;
+};
+
+#endif
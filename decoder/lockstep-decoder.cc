@@ -0,0 +1,476 @@
+// wujian@2018
+
+#include "decoder/lockstep-decoder.h"
+
+// Best arc of a state not reached yet
+const UInt64 kNoArc = std::numeric_limits<UInt64>::max();
+
+// Map Float32 to UInt32 keeping the order (negative ones included)
+inline UInt32 OrderedBits(Float32 cost) {
+  UInt32 bits;
+  memcpy(&bits, &cost, sizeof(bits));
+  return (bits & 0x80000000) ? ~bits : bits | 0x80000000;
+}
+
+inline Float32 FromOrderedBits(UInt32 bits) {
+  bits = (bits & 0x80000000) ? bits & 0x7FFFFFFF : ~bits;
+  Float32 cost;
+  memcpy(&cost, &bits, sizeof(cost));
+  return cost;
+}
+
+// Cost in high 32 bits, so min of packed arcs is the one of min cost. Ties
+// are broken by source state (emitting arcs first), not by the order threads
+// reach it
+inline UInt64 PackArc(Float32 cost, StateId source, Bool epsilon) {
+  return (static_cast<UInt64>(OrderedBits(cost)) << 32) |
+         (static_cast<UInt64>(epsilon) << 31) | static_cast<UInt32>(source);
+}
+
+// Returns the value before
+inline UInt64 AtomicMin(std::atomic<UInt64> *addr, UInt64 value) {
+  UInt64 old = addr->load(std::memory_order_relaxed);
+  while (value < old &&
+         !addr->compare_exchange_weak(old, value, std::memory_order_relaxed))
+    ;
+  return old;
+}
+
+LockstepDecoder::Stream::Stream(UInt64 num_states, Int32 max_label)
+    : best(num_states),
+      changed(num_states, 0),
+      round(0),
+      pruned_frame(0),
+      cost_table(max_label + 1, 0),
+      active(false) {
+  for (std::atomic<UInt64> &arc : best)
+    arc.store(kNoArc, std::memory_order_relaxed);
+  token_index[0].resize(num_states);
+  token_index[1].resize(num_states);
+}
+
+LockstepDecoder::LockstepDecoder(const DecodeGraph &graph,
+                                 const DecodeOpts &opts)
+    : graph_(graph),
+      fst_(graph.Fst()),
+      opts_(opts),
+      worker_group_(opts.num_threads),
+      workers_(opts.num_threads) {
+  ASSERT(opts_.min_active < opts_.max_active);
+  ASSERT(opts_.min_active > 0 && opts_.max_active > 1);
+  // states are packed in 31 bits
+  ASSERT(fst_.NumStates() < (1ULL << 31));
+  // pdf of each ilabel, looked up once per frame instead of per arc
+  Int32 max_label = graph_.MaxLabel();
+  pdfs_.resize(max_label + 1, 0);
+  for (Int32 label = 1; label <= max_label; label++)
+    pdfs_[label] = fst_.IsPdfLabeled()
+                       ? label - 1
+                       : graph_.Table().TransitionIdToPdf(label);
+}
+
+LockstepDecoder::~LockstepDecoder() {
+  for (Stream *stream : streams_) delete stream;
+}
+
+Int32 LockstepDecoder::NewStream() {
+  Int32 id;
+  if (free_streams_.empty()) {
+    id = streams_.size();
+    streams_.push_back(new Stream(fst_.NumStates(), graph_.MaxLabel()));
+  } else {
+    id = free_streams_.back();
+    free_streams_.pop_back();
+  }
+  Stream *stream = streams_[id];
+  stream->active = true;
+  // start token and its epsilon closure
+  StateId start = fst_.Start();
+  ASSERT(start != NoStateId);
+  Token start_tok = {start, 0, -1, 0, false};
+  stream->frames.clear();
+  stream->frames.push_back(std::vector<Token>(1, start_tok));
+  stream->pruned_frame = 0;
+  stream->best[start].store(PackArc(0, start, false));
+  TokenIndex(stream, 0)[start] = 0;
+  stream->next_cutoff = FLOAT32_INF;
+  stream->queue.assign(1, 0);
+  SetBatch(&stream, 1);
+  ProcessNonemitting();
+  return id;
+}
+
+void LockstepDecoder::FreeStream(Int32 stream) {
+  Stream *s = GetStream(stream);
+  s->active = false;
+  // keep the capacity of the first frames for reuse
+  s->frames.clear();
+  free_streams_.push_back(stream);
+}
+
+void LockstepDecoder::DecodeFrames(const Float32 *loglikes,
+                                   const Int32 *streams, Int32 num_streams,
+                                   Int32 num_frames, Int32 stride,
+                                   Int32 num_pdfs) {
+  ASSERT(loglikes && streams && num_pdfs <= stride);
+  if (num_pdfs != graph_.NumPdfs())
+    LOG_FAIL << "It seems that dimention of loglikes do not equal to number "
+                "of pdfs, "
+             << num_pdfs << " vs " << graph_.NumPdfs();
+  batch_.clear();
+  for (Int32 i = 0; i < num_streams; i++)
+    batch_.push_back(GetStream(streams[i]));
+  SetBatch(batch_.data(), num_streams);
+  Int32 num_workers = workers_.size();
+  for (Int32 t = 0; t < num_frames; t++) {
+    worker_group_.Run([&](Int32 w) {
+      for (Int32 i = w; i < num_streams; i += num_workers)
+        ComputeCostTable(
+            batch_[i],
+            loglikes + (static_cast<UInt64>(i) * num_frames + t) * stride);
+    });
+    ProcessEmitting();
+    ProcessNonemitting();
+    // streams started in different calls are pruned at different frames
+    worker_group_.Run([&](Int32 w) {
+      for (Int32 i = w; i < num_streams; i += num_workers) {
+        Stream *stream = batch_[i];
+        if (stream->frames.size() - 1 >= stream->pruned_frame + kPruneInterval)
+          PruneTokens(stream);
+      }
+    });
+  }
+}
+
+Bool LockstepDecoder::ReachedFinal(Int32 stream) {
+  for (const Token &tok : GetStream(stream)->frames.back())
+    if (tok.cost != FLOAT32_INF && fst_.Final(tok.state) != 0) return true;
+  return false;
+}
+
+Bool LockstepDecoder::GetBestPath(Int32 stream,
+                                  std::vector<Int32> *word_sequence) {
+  ASSERT(word_sequence);
+  Stream *s = GetStream(stream);
+  const std::vector<Token> &toks = s->frames.back();
+  Bool is_final = ReachedFinal(stream);
+  Float64 best_cost = FLOAT64_INF;
+  Int32 best = -1;
+  for (UInt64 i = 0; i < toks.size(); i++) {
+    Float64 cost = toks[i].cost;
+    if (is_final) cost += fst_.Final(toks[i].state);
+    if (cost < best_cost) best_cost = cost, best = i;
+  }
+  if (best < 0) return false;
+  UInt64 frame = s->frames.size() - 1, num_words = 0;
+  for (Int32 index = best; index >= 0;) {
+    const Token &tok = s->frames[frame][index];
+    if (tok.olabel) {
+      word_sequence->push_back(tok.olabel);
+      num_words++;
+    }
+    index = tok.prev;
+    if (!tok.epsilon) frame--;
+  }
+  std::reverse(word_sequence->end() - num_words, word_sequence->end());
+  return true;
+}
+
+void LockstepDecoder::SetBatch(Stream *const *streams, Int32 num_streams) {
+  if (streams != batch_.data()) batch_.assign(streams, streams + num_streams);
+  for (Worker &worker : workers_) {
+    worker.reached.resize(num_streams);
+    worker.improved.resize(num_streams);
+    worker.offset.resize(num_streams);
+  }
+}
+
+void LockstepDecoder::ComputeCostTable(Stream *stream,
+                                       const Float32 *loglikes) {
+  Float32 *cost_table = stream->cost_table.data();
+  const Int32 *pdfs = pdfs_.data();
+  for (UInt64 label = 1; label < pdfs_.size(); label++)
+    cost_table[label] = -loglikes[pdfs[label]] * opts_.acwt + opts_.penalty;
+}
+
+// Same as FasterDecoder with exact cutoff, but the cutoff of next frame is
+// estimated only from the best token, it is not tightened during expansion
+void LockstepDecoder::ComputeCutoff(Stream *stream) {
+  const std::vector<Token> &toks = stream->frames.back();
+  if (toks.empty()) {
+    stream->cutoff = stream->next_cutoff = -FLOAT32_INF;
+    return;
+  }
+  const Token *best_tok = &toks[0];
+  costs_.clear();
+  for (const Token &tok : toks) {
+    if (tok.cost < best_tok->cost) best_tok = &tok;
+    costs_.push_back(tok.cost);
+  }
+  Float32 best_cost = best_tok->cost, cutoff = best_cost + opts_.beam,
+          adaptive_beam = opts_.beam;
+  if (costs_.size() > static_cast<UInt64>(opts_.max_active)) {
+    std::nth_element(costs_.begin(), costs_.begin() + opts_.max_active,
+                     costs_.end());
+    if (costs_[opts_.max_active] < cutoff) {
+      cutoff = costs_[opts_.max_active];
+      adaptive_beam = cutoff - best_cost + 0.5;
+    }
+  }
+  if (cutoff == best_cost + opts_.beam &&
+      costs_.size() > static_cast<UInt64>(opts_.min_active)) {
+    std::nth_element(costs_.begin(), costs_.begin() + opts_.min_active,
+                     costs_.end());
+    if (costs_[opts_.min_active] > cutoff) {
+      cutoff = costs_[opts_.min_active];
+      adaptive_beam = cutoff - best_cost + 0.5;
+    }
+  }
+  Float32 next_cutoff = FLOAT32_INF;
+  const Float32 *cost_table = stream->cost_table.data();
+  for (const Arc &arc : fst_.EmittingArcs(best_tok->state))
+    next_cutoff =
+        std::min(next_cutoff, best_tok->cost + arc.weight +
+                                  cost_table[arc.ilabel] + adaptive_beam);
+  stream->cutoff = cutoff, stream->next_cutoff = next_cutoff;
+}
+
+void LockstepDecoder::ProcessEmitting() {
+  for (Stream *stream : batch_) {
+    ComputeCutoff(stream);
+    stream->frames.emplace_back();
+  }
+  Int32 num_workers = workers_.size(), num_streams = batch_.size();
+  worker_group_.Run([&](Int32 w) {
+    for (Int32 i = 0; i < num_streams; i++) {
+      Stream *stream = batch_[i];
+      const std::vector<Token> &toks =
+          stream->frames[stream->frames.size() - 2];
+      const Float32 *cost_table = stream->cost_table.data();
+      Float32 cutoff = stream->cutoff, next_cutoff = stream->next_cutoff;
+      std::vector<StateId> &reached = workers_[w].reached[i];
+      reached.clear();
+      for (UInt64 n = toks.size() * w / num_workers,
+                  end = toks.size() * (w + 1) / num_workers;
+           n < end; n++) {
+        const Token &tok = toks[n];
+        if (tok.cost >= cutoff) continue;
+        for (const Arc &arc : fst_.EmittingArcs(tok.state)) {
+          Float32 cost = tok.cost + arc.weight + cost_table[arc.ilabel];
+          if (cost >= next_cutoff) continue;
+          if (AtomicMin(&stream->best[arc.nextstate],
+                        PackArc(cost, tok.state, false)) == kNoArc)
+            reached.push_back(arc.nextstate);
+        }
+      }
+    }
+  });
+  for (Int32 i = 0; i < num_streams; i++) AllocateTokens(i);
+  CreateTokens();
+  // all of them are expanded in the first epsilon round
+  for (Stream *stream : batch_) {
+    stream->queue.resize(stream->frames.back().size());
+    std::iota(stream->queue.begin(), stream->queue.end(), 0);
+  }
+}
+
+void LockstepDecoder::ProcessNonemitting() {
+  Int32 num_workers = workers_.size(), num_streams = batch_.size();
+  while (true) {
+    Bool done = true;
+    for (Stream *stream : batch_) {
+      if (stream->queue.empty()) continue;
+      stream->round++;
+      done = false;
+    }
+    if (done) break;
+    worker_group_.Run([&](Int32 w) {
+      for (Int32 i = 0; i < num_streams; i++) {
+        Stream *stream = batch_[i];
+        const std::vector<Token> &toks = stream->frames.back();
+        const std::vector<Int32> &queue = stream->queue;
+        Float32 cutoff = stream->next_cutoff;
+        std::vector<StateId> &reached = workers_[w].reached[i],
+                             &improved = workers_[w].improved[i];
+        reached.clear(), improved.clear();
+        for (UInt64 n = queue.size() * w / num_workers,
+                    end = queue.size() * (w + 1) / num_workers;
+             n < end; n++) {
+          const Token &tok = toks[queue[n]];
+          if (tok.cost > cutoff) continue;
+          for (const Arc &arc : fst_.EpsilonArcs(tok.state)) {
+            Float32 cost = tok.cost + arc.weight;
+            if (cost > cutoff) continue;
+            UInt64 packed = PackArc(cost, tok.state, true),
+                   old = AtomicMin(&stream->best[arc.nextstate], packed);
+            if (old == kNoArc)
+              reached.push_back(arc.nextstate);
+            else if (packed < old)
+              improved.push_back(arc.nextstate);
+          }
+        }
+      }
+    });
+    for (Int32 i = 0; i < num_streams; i++) AllocateTokens(i);
+    CreateTokens();
+    // new tokens and improved ones (once per round) are expanded again
+    for (Int32 i = 0; i < num_streams; i++) {
+      Stream *stream = batch_[i];
+      std::vector<Token> &toks = stream->frames.back();
+      std::vector<Int32> &token_index =
+          TokenIndex(stream, stream->frames.size() - 1);
+      stream->queue.clear();
+      updates_.clear();
+      for (Worker &worker : workers_) {
+        for (UInt64 n = 0; n < worker.reached[i].size(); n++)
+          stream->queue.push_back(worker.offset[i] + n);
+        for (StateId state : worker.improved[i]) {
+          if (stream->changed[state] == stream->round) continue;
+          stream->changed[state] = stream->round;
+          updates_.push_back(
+              std::make_pair(token_index[state], MakeToken(stream, state)));
+        }
+      }
+      // written after all made, MakeToken() reads costs before this round
+      for (const std::pair<Int32, Token> &update : updates_) {
+        toks[update.first] = update.second;
+        stream->queue.push_back(update.first);
+      }
+    }
+  }
+  // leave best arcs clean for next frame
+  worker_group_.Run([&](Int32 w) {
+    for (Int32 i = 0; i < num_streams; i++) {
+      Stream *stream = batch_[i];
+      const std::vector<Token> &toks = stream->frames.back();
+      for (UInt64 n = toks.size() * w / num_workers,
+                  end = toks.size() * (w + 1) / num_workers;
+           n < end; n++)
+        stream->best[toks[n].state].store(kNoArc, std::memory_order_relaxed);
+    }
+  });
+}
+
+void LockstepDecoder::AllocateTokens(Int32 index) {
+  std::vector<Token> &toks = batch_[index]->frames.back();
+  UInt64 size = toks.size();
+  for (Worker &worker : workers_) {
+    worker.offset[index] = size;
+    size += worker.reached[index].size();
+  }
+  toks.resize(size);
+}
+
+void LockstepDecoder::CreateTokens() {
+  Int32 num_streams = batch_.size();
+  worker_group_.Run([&](Int32 w) {
+    for (Int32 i = 0; i < num_streams; i++) {
+      Stream *stream = batch_[i];
+      std::vector<Token> &toks = stream->frames.back();
+      std::vector<Int32> &token_index =
+          TokenIndex(stream, stream->frames.size() - 1);
+      Int32 index = workers_[w].offset[i];
+      for (StateId state : workers_[w].reached[i]) {
+        toks[index] = MakeToken(stream, state);
+        token_index[state] = index++;
+        stream->changed[state] = stream->round;
+      }
+    }
+  });
+}
+
+LockstepDecoder::Token LockstepDecoder::MakeToken(Stream *stream,
+                                                  StateId state) {
+  UInt64 packed = stream->best[state].load(std::memory_order_relaxed);
+  UInt64 frame = stream->frames.size() - 1;
+  Token tok;
+  tok.state = state;
+  tok.cost = FromOrderedBits(packed >> 32);
+  tok.epsilon = (packed >> 31) & 1;
+  StateId source = packed & 0x7FFFFFFF;
+  // find the arc by recomputing the cost the same way as the expansion
+  if (tok.epsilon) {
+    tok.prev = TokenIndex(stream, frame)[source];
+    Float32 prev_cost = stream->frames[frame][tok.prev].cost;
+    for (const Arc &arc : fst_.EpsilonArcs(source)) {
+      if (arc.nextstate == state && prev_cost + arc.weight == tok.cost) {
+        tok.olabel = arc.olabel;
+        return tok;
+      }
+    }
+  } else {
+    tok.prev = TokenIndex(stream, frame - 1)[source];
+    Float32 prev_cost = stream->frames[frame - 1][tok.prev].cost;
+    const Float32 *cost_table = stream->cost_table.data();
+    for (const Arc &arc : fst_.EmittingArcs(source)) {
+      if (arc.nextstate == state &&
+          prev_cost + arc.weight + cost_table[arc.ilabel] == tok.cost) {
+        tok.olabel = arc.olabel;
+        return tok;
+      }
+    }
+  }
+  LOG_FAIL << "Could not find the best arc from state " << source
+           << " to state " << state;
+  return tok;
+}
+
+void LockstepDecoder::PruneTokens(Stream *stream) {
+  std::vector<std::vector<Token>> &frames = stream->frames;
+  UInt64 last = frames.size() - 1, first = last;
+  // new index of tokens in frames[first: last + 1] (-1 if dropped), index of
+  // frame f is index[last - f]. All tokens of the last frame are kept
+  std::vector<std::vector<Int32>> index(1);
+  index[0].resize(frames[last].size());
+  std::iota(index[0].begin(), index[0].end(), 0);
+  std::vector<Int32> stack;
+  for (UInt64 frame = last; frame > 0; frame--) {
+    // tokens of previous frame that kept ones come from by emitting arcs
+    std::vector<Int32> prev_index(frames[frame - 1].size(), -1);
+    const std::vector<Int32> &keep = index.back();
+    for (UInt64 n = 0; n < keep.size(); n++) {
+      const Token &tok = frames[frame][n];
+      if (keep[n] >= 0 && !tok.epsilon) prev_index[tok.prev] = 0;
+    }
+    // and the ones those come from by epsilon arcs
+    stack.clear();
+    for (UInt64 n = 0; n < prev_index.size(); n++)
+      if (prev_index[n] == 0) stack.push_back(n);
+    while (!stack.empty()) {
+      const Token &tok = frames[frame - 1][stack.back()];
+      stack.pop_back();
+      if (tok.epsilon && prev_index[tok.prev] < 0) {
+        prev_index[tok.prev] = 0;
+        stack.push_back(tok.prev);
+      }
+    }
+    UInt64 num_kept = 0;
+    for (Int32 &n : prev_index)
+      if (n >= 0) n = num_kept++;
+    index.push_back(std::move(prev_index));
+    first = frame - 1;
+    // all tokens before pruned_frame are on paths to it, so if a frame not
+    // after it keeps all its tokens, tokens before that frame are all kept
+    if (first <= stream->pruned_frame && num_kept == frames[first].size())
+      break;
+  }
+  for (UInt64 frame = first; frame <= last; frame++) {
+    const std::vector<Int32> &keep = index[last - frame];
+    std::vector<Token> &toks = frames[frame];
+    // keep[n] <= n, so tokens are moved forward in place
+    UInt64 num_kept = 0;
+    for (UInt64 n = 0; n < toks.size(); n++) {
+      if (keep[n] < 0) continue;
+      Token tok = toks[n];
+      if (tok.epsilon)
+        tok.prev = keep[tok.prev];
+      else if (frame != first)
+        tok.prev = index[last - frame + 1][tok.prev];
+      toks[num_kept++] = tok;
+    }
+    // release the memory of dropped ones
+    if (frame != last && num_kept < toks.capacity())
+      std::vector<Token>(toks.begin(), toks.begin() + num_kept).swap(toks);
+  }
+  stream->pruned_frame = last;
+}
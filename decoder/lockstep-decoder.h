@@ -0,0 +1,190 @@
+// wujian@2018
+
+// Decode a batch of streams frame by frame in lockstep, with data-parallel
+// token expansion (following Kaldi's CUDA decoder)
+
+#ifndef LOCKSTEP_DECODER_H
+#define LOCKSTEP_DECODER_H
+
+#include <atomic>
+#include <numeric>
+
+#include "decoder/common.h"
+#include "decoder/decode-graph.h"
+#include "decoder/decoder.h"
+#include "decoder/worker-group.h"
+
+// Same interface as BatchDecoder, but instead of running one FasterDecoder per
+// stream, each frame of all the streams is searched by a few passes over flat
+// token arrays, each pass run by all the workers of DecodeOpts.num_threads:
+//  1) expand emitting arcs of tokens in beam, recombine on nextstate by an
+//     atomic min of (cost, source state) packed in 64 bits
+//  2) create one token for each state reached, at offsets scanned from the
+//     number of states each worker reached first
+//  3) expand input epsilon arcs of new (or improved) tokens the same way, in
+//     rounds until no token changes
+// There is no per-token allocation, hash list or lock in the passes, and the
+// result does not depend on the order tokens are processed, so it is
+// deterministic for any number of threads. Tokens are kept for traceback
+// (index of prev token, olabel), words are traced back only on demand. Every
+// kPruneInterval frames, tokens of earlier frames that no token of the last
+// frame traces back to are dropped (see PruneTokens()), so a long stream
+// holds little more than its surviving paths.
+//
+// Costs are Float32 and the pruning cutoff of a frame is fixed before the
+// expansion (from the best token), so the result may differ slightly from
+// FasterDecoder. Each stream holds arrays of NumStates() (20 bytes per
+// state), for big graphs keep the number of streams small.
+// egs:
+// DecodeGraph graph("graph.fst", "trans.tab");
+// LockstepDecoder decoder(graph, DecodeOpts("decode.conf"));
+// Int32 streams[2] = {decoder.NewStream(), decoder.NewStream()};
+// // loglikes: 2 x num_frames x num_pdfs
+// decoder.DecodeFrames(loglikes, streams, 2, num_frames, num_pdfs, num_pdfs);
+// decoder.GetBestPath(streams[0], &word_ids);
+class LockstepDecoder {
+ public:
+  // graph should outlive the decoder. min_active, max_active, beam, acwt,
+  // penalty and num_threads of opts are used
+  LockstepDecoder(const DecodeGraph &graph, const DecodeOpts &opts);
+
+  ~LockstepDecoder();
+
+  // Start a new stream and return its id, ids of freed streams are reused
+  Int32 NewStream();
+
+  // Finish stream, do not use its id after this
+  void FreeStream(Int32 stream);
+
+  // Decode num_frames frames for each stream in streams[0: num_streams], all
+  // the streams advance one frame at a time. Frames of streams[i] are
+  // loglikes[i * num_frames * stride:], one frame per stride floats
+  void DecodeFrames(const Float32 *loglikes, const Int32 *streams,
+                    Int32 num_streams, Int32 num_frames, Int32 stride,
+                    Int32 num_pdfs);
+
+  Int32 NumDecodedFrames(Int32 stream) {
+    return GetStream(stream)->frames.size() - 1;
+  }
+
+  Bool ReachedFinal(Int32 stream);
+
+  // Trace back from the best token (with final weight if any final state
+  // reached), words are appended to word_sequence
+  Bool GetBestPath(Int32 stream, std::vector<Int32> *word_sequence);
+
+  Int32 NumActiveStreams() const {
+    return streams_.size() - free_streams_.size();
+  }
+
+ private:
+  LockstepDecoder(const LockstepDecoder &) = delete;
+  LockstepDecoder &operator=(const LockstepDecoder &) = delete;
+
+  struct Token {
+    StateId state;
+    Float32 cost;
+    // Index of previous token, in the same frame if epsilon, otherwise in the
+    // previous frame. -1 for the start token
+    Int32 prev;
+    Label olabel;
+    Bool epsilon;
+  };
+
+  struct Stream {
+    // Packed (cost, source state) of the best arc reaching each state in
+    // current frame, kNoArc if not reached
+    std::vector<std::atomic<UInt64>> best;
+    // Index of the token of each state, in frames of even and odd number,
+    // valid only for states in the frame
+    std::vector<Int32> token_index[2];
+    // Round of epsilon expansion the state was last changed in
+    std::vector<UInt32> changed;
+    UInt32 round;
+    // Tokens of each frame, frames[0] holds the start state and its closure
+    std::vector<std::vector<Token>> frames;
+    // Last frame when tokens were pruned, frames before it hold only tokens
+    // on paths to it
+    UInt64 pruned_frame;
+    // Cost of emitting arcs of current frame, indexed by ilabel
+    std::vector<Float32> cost_table;
+    // Tokens in beam are expanded, new tokens over next_cutoff are dropped
+    Float32 cutoff, next_cutoff;
+    // Tokens to expand in epsilon rounds, indices in current frame
+    std::vector<Int32> queue;
+    Bool active;
+
+    Stream(UInt64 num_states, Int32 max_label);
+  };
+
+  // Scratch of each worker, indexed by position of the stream in batch_
+  struct Worker {
+    // States reached first by the worker in current pass
+    std::vector<std::vector<StateId>> reached;
+    // States whose best arc improved in current epsilon round
+    std::vector<std::vector<StateId>> improved;
+    // Offset of reached states in the frame
+    std::vector<Int32> offset;
+  };
+
+  Stream *GetStream(Int32 stream) {
+    if (stream < 0 || stream >= streams_.size() || !streams_[stream]->active)
+      LOG_FAIL << "Stream " << stream << " is not active";
+    return streams_[stream];
+  }
+
+  // Tokens of frame f are indexed by token_index[f % 2]
+  std::vector<Int32> &TokenIndex(Stream *stream, UInt64 frame) {
+    return stream->token_index[frame % 2];
+  }
+
+  // Streams of next DecodeFrames() or NewStream(), resize scratch of workers
+  void SetBatch(Stream *const *streams, Int32 num_streams);
+
+  void ComputeCostTable(Stream *stream, const Float32 *loglikes);
+
+  // Cutoffs of the last frame, from beam, min_active and max_active
+  void ComputeCutoff(Stream *stream);
+
+  void ProcessEmitting();
+
+  // Expand input epsilon arcs of stream->queue until no token changes
+  void ProcessNonemitting();
+
+  // Give each worker its offset in the current frame for the states it
+  // reached first, and resize the frame to hold them
+  void AllocateTokens(Int32 index);
+
+  // Each worker fills the tokens of states it reached first
+  void CreateTokens();
+
+  // Token of state from its best arc
+  Token MakeToken(Stream *stream, StateId state);
+
+  // Drop tokens before the last frame that are not on any path to it, and
+  // renumber prev of the ones kept. Tokens of the last frame and their
+  // indices are not changed
+  void PruneTokens(Stream *stream);
+
+  // Frames between PruneTokens() of a stream
+  static const UInt64 kPruneInterval = 25;
+
+  const DecodeGraph &graph_;
+  const ConstFst &fst_;
+  DecodeOpts opts_;
+  WorkerGroup worker_group_;
+  std::vector<Worker> workers_;
+  // Indexed by stream id
+  std::vector<Stream *> streams_;
+  std::vector<Int32> free_streams_;
+  // pdf-id of each ilabel
+  std::vector<Int32> pdfs_;
+  // Streams decoded in current call
+  std::vector<Stream *> batch_;
+  // Used by ComputeCutoff()
+  std::vector<Float32> costs_;
+  // (index, token) of improved tokens in an epsilon round
+  std::vector<std::pair<Int32, Token>> updates_;
+};
+
+#endif
@@ -1,40 +1,144 @@
 // wujian@2018
 
 // A simple logger class
-// TODO: make it comparable with logging file
+// Messages below SetLogLevel() are skipped before their arguments are
+// formatted, and LOG_DEBUG sites are compiled out unless DECODER_DEBUG is
+// defined, so they could stay in hot loops. With SetLogAsync(true), lines are
+// written by a background thread, FAIL/ASSERT ones are flushed before abort().
 
 #ifndef LOG_H
 #define LOG_H
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
 #include <cstring>
 #include <ctime>
-#include <iomanip>
+#include <deque>
 #include <iostream>
+#include <mutex>
 #include <sstream>
+#include <thread>
+
+enum LogLevel { kDebug, kInfo, kWarn, kFail };
+
+#ifdef DECODER_DEBUG
+const bool kDebugLogging = true;
+#else
+const bool kDebugLogging = false;
+#endif
+
+// Min level of messages written, kInfo by default
+inline std::atomic<int> &LogLevelThreshold() {
+  static std::atomic<int> level(kInfo);
+  return level;
+}
+
+inline void SetLogLevel(LogLevel level) { LogLevelThreshold() = level; }
+
+inline bool LogEnabled(LogLevel level) {
+  return level >= LogLevelThreshold().load(std::memory_order_relaxed);
+}
+
+// Writes lines to std::cerr, directly or by a background thread
+class LogSink {
+ public:
+  static LogSink &Instance() {
+    static LogSink sink;
+    return sink;
+  }
+
+  void SetAsync(bool async) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (async == async_) return;
+    if (async) {
+      stop_ = false;
+      writer_ = std::thread(&LogSink::WriteLoop, this);
+    } else {
+      stop_ = true;
+      lock.unlock();
+      ready_.notify_one();
+      writer_.join();
+      lock.lock();
+    }
+    async_ = async;
+  }
+
+  void Write(const std::string &line, bool flush) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!async_) {
+      std::cerr << line << std::endl;
+      return;
+    }
+    lines_.push_back(line);
+    if (!flush) {
+      lock.unlock();
+      ready_.notify_one();
+      return;
+    }
+    // FAIL/ASSERT: wait for the lines taken by the writer, then write all the
+    // pending lines here, in order
+    idle_.wait(lock, [this] { return !writing_; });
+    for (const std::string &pending : lines_) std::cerr << pending << "\n";
+    lines_.clear();
+    std::cerr.flush();
+  }
+
+  ~LogSink() { SetAsync(false); }
+
+ private:
+  LogSink() : async_(false), stop_(false), writing_(false) {}
+
+  void WriteLoop() {
+    std::deque<std::string> lines;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      ready_.wait(lock, [this] { return stop_ || !lines_.empty(); });
+      lines.swap(lines_);
+      bool stop = stop_;
+      writing_ = true;
+      lock.unlock();
+      for (const std::string &line : lines) std::cerr << line << "\n";
+      std::cerr.flush();
+      lines.clear();
+      lock.lock();
+      writing_ = false;
+      idle_.notify_all();
+      if (stop && lines_.empty()) break;
+    }
+  }
+
+  bool async_, stop_;
+  // The writer holds lines taken from lines_ and not written yet
+  bool writing_;
+  std::deque<std::string> lines_;
+  std::mutex mutex_;
+  // ready_: lines_ not empty or stop_, idle_: writing_ turns false
+  std::condition_variable ready_, idle_;
+  std::thread writer_;
+};
+
+inline void SetLogAsync(bool async) { LogSink::Instance().SetAsync(async); }
 
 class Logger {
  public:
-  Logger(const std::string &type, const char *func, const char *file,
-         size_t line)
+  Logger(const char *type, const char *func, const char *file, size_t line)
       : type_(type), func_(func), file_(BaseName(file)), line_(line) {}
 
   ~Logger() {
     std::string msg = oss_.str();
-    while (true) {
-      std::string::iterator p = std::find(msg.begin(), msg.end(), '\n');
-      if (p == msg.end()) break;
-      msg.erase(p);
-    }
+    msg.erase(std::remove(msg.begin(), msg.end(), '\n'), msg.end());
     Log(msg);
   }
 
   void Log(const std::string &msg) {
-    std::ostringstream prefix;
-    prefix << Date() << " - " << type_ << " (" << func_ << "(...):" << file_
-           << ":" << line_ << ")";
-    std::cerr << prefix.str().c_str() << " " << msg.c_str() << std::endl;
-    if (type_ == "ASSERT" || type_ == "FAIL") abort();
+    bool fatal = !strcmp(type_, "ASSERT") || !strcmp(type_, "FAIL");
+    std::ostringstream line;
+    line << Date() << " - " << type_ << " (" << func_ << "(...):" << file_
+         << ":" << line_ << ") " << msg;
+    LogSink::Instance().Write(line.str(), fatal);
+    if (fatal) abort();
   }
 
   std::ostream &Stream() { return oss_; }
@@ -42,36 +146,42 @@ class Logger {
  private:
   std::ostringstream oss_;
 
-  std::string type_;  // FAIL, INFO, WARN, ASSERT
+  const char *type_;  // FAIL, INFO, WARN, DEBUG, ASSERT
   const char *func_;
   const char *file_;
   size_t line_;
 
   const char *BaseName(const char *path) {
-    int pos = strlen(path) - 1;
-    while (pos >= 0) {
-      if (path[pos] == '/') break;
-      pos--;
-    }
-    return path + pos + 1;
+    const char *pos = strrchr(path, '/');
+    return pos ? pos + 1 : path;
   }
 
   const std::string Date() {
-    std::ostringstream time_format;
+    char buffer[32];
     time_t time_now = time(0);
-    tm *tm = localtime(&time_now);
-    time_format << 1900 + tm->tm_year << "/" << std::setw(2)
-                << std::setfill('0') << 1 + tm->tm_mon << "/" << std::setw(2)
-                << std::setfill('0') << tm->tm_mday << " - " << std::setw(2)
-                << std::setfill('0') << tm->tm_hour << ":" << std::setw(2)
-                << std::setfill('0') << tm->tm_min << ":" << std::setw(2)
-                << std::setfill('0') << tm->tm_sec;
-    return time_format.str();
+    tm tm;
+    localtime_r(&time_now, &tm);
+    strftime(buffer, sizeof(buffer), "%Y/%m/%d - %H:%M:%S", &tm);
+    return buffer;
   }
 };
 
-#define LOG_WARN Logger("WARN", __FUNCTION__, __FILE__, __LINE__).Stream()
-#define LOG_INFO Logger("INFO", __FUNCTION__, __FILE__, __LINE__).Stream()
+// Turns "stream << ..." into void, so LOG_* could be the branch of "? :".
+// & binds looser than <<
+struct LogVoidify {
+  void operator&(std::ostream &) {}
+};
+
+// Logger is constructed (and arguments formatted) only if enabled
+#define LOG_IF(enabled, type)                                   \
+  !(enabled) ? (void)0                                          \
+             : LogVoidify() &                                   \
+                   Logger(type, __FUNCTION__, __FILE__, __LINE__).Stream()
+
+// kDebugLogging is constant, so the sites are removed by the compiler
+#define LOG_DEBUG LOG_IF(kDebugLogging && LogEnabled(kDebug), "DEBUG")
+#define LOG_INFO LOG_IF(LogEnabled(kInfo), "INFO")
+#define LOG_WARN LOG_IF(LogEnabled(kWarn), "WARN")
 #define LOG_FAIL Logger("FAIL", __FUNCTION__, __FILE__, __LINE__).Stream()
 
 #define ASSERT(cond)                                              \
@@ -83,4 +193,4 @@ class Logger {
           << "Assert '" << #cond << "' failed!";                  \
   } while (0)
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,133 @@
+// wujian@2018
+
+// Rows of loglikes in Float32, IEEE half precision or scaled int8, read by
+// the decoder pdf by pdf, so compressed rows are converted only for the pdfs
+// reached by active arcs
+
+#ifndef LOGLIKES_H
+#define LOGLIKES_H
+
+#include <cstring>
+
+#include "decoder/type.h"
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+// Half precision (bits in UInt16) to Float32, exact
+inline Float32 HalfToFloat(UInt16 half) {
+#if defined(__F16C__)
+  return _cvtsh_ss(half);
+#else
+  UInt32 sign = static_cast<UInt32>(half & 0x8000) << 16,
+         exponent = (half >> 10) & 0x1f, mantissa = half & 0x3ff, bits;
+  if (exponent == 0x1f) {
+    // inf or nan
+    bits = sign | 0x7f800000 | (mantissa << 13);
+  } else if (exponent) {
+    bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  } else if (mantissa) {
+    // subnormal, normalize it
+    exponent = 113;
+    while (!(mantissa & 0x400)) mantissa <<= 1, exponent--;
+    bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+  } else {
+    bits = sign;
+  }
+  Float32 value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+#endif
+}
+
+// Float32 to half precision, round to nearest even, overflow to inf
+inline UInt16 FloatToHalf(Float32 value) {
+#if defined(__F16C__)
+  return _cvtss_sh(value, 0);
+#else
+  UInt32 bits;
+  memcpy(&bits, &value, sizeof(bits));
+  UInt16 sign = (bits >> 16) & 0x8000;
+  Int32 exponent = static_cast<Int32>((bits >> 23) & 0xff) - 112;
+  UInt32 mantissa = bits & 0x7fffff;
+  if (exponent >= 0x1f) {
+    // nan keeps a payload bit, others are inf
+    if (((bits >> 23) & 0xff) == 0xff && mantissa) return sign | 0x7e00;
+    return sign | 0x7c00;
+  }
+  if (exponent <= 0) {
+    // subnormal or zero
+    if (exponent < -10) return sign;
+    mantissa |= 0x800000;
+    Int32 shift = 14 - exponent;
+    UInt32 half = mantissa >> shift, rest = mantissa & ((1u << shift) - 1),
+           middle = 1u << (shift - 1);
+    if (rest > middle || (rest == middle && (half & 1))) half++;
+    return sign | half;
+  }
+  UInt32 half = (exponent << 10) | (mantissa >> 13), rest = mantissa & 0x1fff;
+  // carry into exponent is right, up to inf
+  if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) half++;
+  return sign | half;
+#endif
+}
+
+struct Float32Loglikes {
+  const Float32 *data;
+
+  Float32 operator[](Int32 pdf) const { return data[pdf]; }
+};
+
+struct Float16Loglikes {
+  const UInt16 *data;
+
+  Float32 operator[](Int32 pdf) const { return HalfToFloat(data[pdf]); }
+};
+
+// loglikes[p] = data[p] * scale. A constant added to all the pdfs of a frame
+// does not change the search, so rows could be shifted to max = 0 before
+// quantization to use the full int8 range
+struct Int8Loglikes {
+  const Int08 *data;
+  Float32 scale;
+
+  Float32 operator[](Int32 pdf) const { return data[pdf] * scale; }
+};
+
+// Acoustic costs (scaled negative loglikes plus penalty) of arcs by ilabel.
+// The decoder chooses one of them per frame and its arc loop is compiled for
+// each, so no option or label type is checked per arc
+
+// ilabel indexes a table filled once per frame
+struct TableCost {
+  const Float32 *table;
+
+  Float32 operator()(Int32 ilabel) const { return table[ilabel]; }
+};
+
+// ilabel is pdf-id + 1
+template <class Loglikes>
+struct PdfCost {
+  const Loglikes &loglikes;
+  Float32 acwt, penalty;
+
+  Float32 operator()(Int32 ilabel) const {
+    return -loglikes[ilabel - 1] * acwt + penalty;
+  }
+};
+
+// ilabel is transition-id, pdf = pdfs[ilabel - 1]. Labels should have been
+// checked (egs: by DecodeGraph)
+template <class Loglikes>
+struct TransitionCost {
+  const Loglikes &loglikes;
+  const Int32 *pdfs;
+  Float32 acwt, penalty;
+
+  Float32 operator()(Int32 ilabel) const {
+    return -loglikes[pdfs[ilabel - 1]] * acwt + penalty;
+  }
+};
+
+#endif
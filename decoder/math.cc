@@ -3,6 +3,8 @@
 
 #include "math.h"
 
+#include "decoder/simd.h"
+
 Int32 RoundUpToNearestPowerOfTwo(Int32 n) {
   n--;
   n |= n >> 1;
@@ -19,4 +21,38 @@ Float32 ToMelScale(Float32 linear) {
   return 1127.0f * logf(1.0f + linear / 700.0f);
 }
 
-Float32 ToDB(Float32 linear) { return 10 * log10f(std::max(EPS_F32, linear)); }
\ No newline at end of file
+Float32 ToDB(Float32 linear) { return 10 * log10f(std::max(EPS_F32, linear)); }
+
+void MatrixMultiply(const Float32 *A, Int32 lda, const Float32 *B, Int32 ldb,
+                    Float32 *C, Int32 ldc, Int32 M, Int32 K, Int32 N) {
+  for (Int32 i = 0; i < M; i++) {
+    const Float32 *a = A + i * lda;
+    Float32 *c = C + i * ldc;
+    for (Int32 j = 0; j < N; j++) c[j] = 0;
+    for (Int32 k = 0; k < K; k++) {
+      const Float32 *b = B + k * ldb;
+      Float32 scale = a[k];
+      if (scale == 0) continue;
+      for (Int32 j = 0; j < N; j++) c[j] += scale * b[j];
+    }
+  }
+}
+
+void MatrixMultiplyInt8(const Int16 *A, Int32 lda, const Int08 *B, Int32 ldb,
+                        Int32 *C, Int32 ldc, Int32 M, Int32 K, Int32 N) {
+  Int32 i = 0;
+  for (; i + 4 <= M; i += 4) {
+    const Int16 *a = A + i * lda;
+    Int32 *c = C + i * ldc, j = 0;
+    for (; j + 2 <= N; j += 2)
+      DotInt8Block<4, 2>(a, lda, B + j * ldb, ldb, K, c + j, ldc);
+    if (j < N) DotInt8Block<4, 1>(a, lda, B + j * ldb, ldb, K, c + j, ldc);
+  }
+  for (; i < M; i++) {
+    const Int16 *a = A + i * lda;
+    Int32 *c = C + i * ldc, j = 0;
+    for (; j + 2 <= N; j += 2)
+      DotInt8Block<1, 2>(a, lda, B + j * ldb, ldb, K, c + j, ldc);
+    if (j < N) DotInt8Block<1, 1>(a, lda, B + j * ldb, ldb, K, c + j, ldc);
+  }
+}
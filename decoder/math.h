@@ -36,4 +36,16 @@ Float32 ToMelScale(Float32 linear);
 
 Float32 ToDB(Float32 linear);
 
+// C = A * B, A: M x K, B: K x N, C: M x N, all row major with row strides
+// lda/ldb/ldc. Rows of B are accumulated into rows of C, so the inner loop is
+// contiguous and could be vectorized by the compiler
+void MatrixMultiply(const Float32 *A, Int32 lda, const Float32 *B, Int32 ldb,
+                    Float32 *C, Int32 ldc, Int32 M, Int32 K, Int32 N);
+
+// C = A * B^T, A: M x K int8 values in int16 (QuantizeInt8() in simd.h), B:
+// N x K int8, C: M x N int32. Blocked by 4 rows of A and 2 rows of B, so each
+// vector loaded is used several times
+void MatrixMultiplyInt8(const Int16 *A, Int32 lda, const Int08 *B, Int32 ldb,
+                        Int32 *C, Int32 ldc, Int32 M, Int32 K, Int32 N);
+
 #endif
\ No newline at end of file
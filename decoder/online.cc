@@ -15,35 +15,265 @@ FeatureType StringToFeatureType(const std::string &type) {
     return kUnkown;
 }
 
-FeatureExtractor::FeatureExtractor(const std::string &conf,
-                                   const std::string &type)
-    : computer_(NULL) {
+// Geometric mean over arithmetic mean of power spectrum (DC excluded)
+static Float32 SpectralFlatness(const Float32 *power, Int32 dim) {
+  Float64 log_sum = 0, sum = 0;
+  for (Int32 d = 1; d < dim; d++) {
+    log_sum += LogFloat32(power[d]);
+    sum += power[d];
+  }
+  Float64 mean = std::max(sum / (dim - 1), static_cast<Float64>(EPS_F32));
+  return static_cast<Float32>(exp(log_sum / (dim - 1)) / mean);
+}
+
+Vad::Vad(const VadOpts &opts)
+    : opts_(opts), splitter_(opts.frame_opts), fft_computer_(NULL) {
+  opts_.Check();
+  padding_length_ = splitter_.PaddingLength();
+  // no FFT if flatness is not checked
+  if (opts_.max_flatness < 1) {
+    fft_computer_ = new FFTComputer(padding_length_);
+    spectrum_.resize(padding_length_ / 2 + 1);
+  }
+  Reset();
+}
+
+void Vad::ComputeFrames(Float32 *signal, Int32 num_samps, Int32 t,
+                        Int32 num_frames, VadStatus *status) {
+  // signal starts at a frame, as FeatureExtractor::GetFrames() gives
+  splitter_.Reset();
+  for (Int32 b = 0; b < num_frames; b += kFeatureBlockSize) {
+    Int32 n = std::min(kFeatureBlockSize, num_frames - b);
+    frames_cache_.resize(n * padding_length_);
+    energy_cache_.resize(n);
+    Float32 *frames = frames_cache_.data();
+    memset(frames, 0, sizeof(Float32) * padding_length_ * n);
+    splitter_.FrameBlock(signal, num_samps, t + b, n, frames, padding_length_,
+                         energy_cache_.data());
+    for (Int32 i = 0; i < n; i++) {
+      Float32 flatness = 0;
+      if (fft_computer_) {
+        Float32 *frame = frames + i * padding_length_;
+        fft_computer_->RealFFT(frame, padding_length_);
+        ComputeSpectrum(frame, padding_length_, spectrum_.data(), true, false);
+        flatness = SpectralFlatness(spectrum_.data(), spectrum_.size());
+      }
+      status[b + i] = AcceptFrame(energy_cache_[i], flatness);
+    }
+  }
+}
+
+VadStatus Vad::AcceptFrame(Float32 raw_energy, Float32 flatness) {
+  Float32 energy = LogFloat32(raw_energy);
+  if (!num_frames_) noise_floor_ = energy;
+  num_frames_++;
+  Bool speech =
+      energy > std::max(opts_.min_energy,
+                        noise_floor_ + opts_.energy_threshold) &&
+      flatness <= opts_.max_flatness;
+  // falls fast and rises slowly, so follows the energy valleys
+  noise_floor_ += (energy < noise_floor_ ? opts_.noise_down : opts_.noise_up) *
+                  (energy - noise_floor_);
+  if (speech) {
+    hangover_ = opts_.hangover_frames;
+    return kActive;
+  }
+  if (hangover_ > 0) {
+    hangover_--;
+    return kActive;
+  }
+  return kSilence;
+}
+
+FeatureExtractor::FeatureExtractor(const ConfigureTable &conf,
+                                   const std::string &type,
+                                   Int32 max_buffered_samps)
+    : computer_(NULL), resampler_(NULL), num_received_(0), frame_begin_(0) {
   type_ = StringToFeatureType(type);
   ConfigureParser parser(conf);
   // initialize
   SpectrogramOpts spectrogram_opts;
   FbankOpts fbank_opts;
   MfccOpts mfcc_opts;
+  const FrameOpts *frame_opts = NULL;
   switch (type_) {
     case kSpectrogram:
       LOG_INFO << "Create FeatureExtractor(Spectrogram)";
       spectrogram_opts.ParseConfigure(&parser);
       computer_ = new SpectrogramComputer(spectrogram_opts);
+      frame_opts = &spectrogram_opts.frame_opts;
       break;
     case kFbank:
       LOG_INFO << "Create FeatureExtractor(Fbank)";
       fbank_opts.ParseConfigure(&parser);
       computer_ = new FbankComputer(fbank_opts);
+      frame_opts = &fbank_opts.spectrogram_opts.frame_opts;
       break;
     case kMfcc:
       LOG_INFO << "Create FeatureExtractor(Mfcc)";
       mfcc_opts.ParseConfigure(&parser);
       computer_ = new MfccComputer(mfcc_opts);
+      frame_opts = &mfcc_opts.fbank_opts.spectrogram_opts.frame_opts;
       break;
     case kUnkown:
       LOG_FAIL << "Unknown feature type: " << type;
       break;
   }
+  frame_length_ = frame_opts->frame_length;
+  frame_shift_ = frame_opts->frame_shift;
+  if (max_buffered_samps <= 0)
+    max_buffered_samps = frame_opts->sample_rate + frame_length_;
+  if (max_buffered_samps < frame_length_)
+    LOG_FAIL << "Ring buffer could not hold a frame: " << max_buffered_samps
+             << " vs " << frame_length_;
+  capacity_ = max_buffered_samps;
+  ring_.resize(capacity_ * 2);
+  sample_rate_ = frame_opts->sample_rate;
+  resample_opts_.ParseConfigure(&parser);
+  CmvnOpts cmvn_opts;
+  DeltaOpts delta_opts;
+  SpliceOpts splice_opts;
+  cmvn_opts.ParseConfigure(&parser);
+  delta_opts.ParseConfigure(&parser);
+  splice_opts.ParseConfigure(&parser);
+  Int32 dim = computer_->FeatureDim(), num_flushed = 0;
+  stage_stride_ = dim;
+  if (cmvn_opts.norm_means) stages_.push_back(new CmvnStage(dim, cmvn_opts));
+  if (delta_opts.order)
+    stages_.push_back(new DeltaStage(stages_.empty() ? dim : FeatureDim(),
+                                     delta_opts));
+  if (splice_opts.left_context || splice_opts.right_context)
+    stages_.push_back(new SpliceStage(stages_.empty() ? dim : FeatureDim(),
+                                      splice_opts));
+  for (FeatureStage *stage : stages_) {
+    stage_stride_ = std::max(stage_stride_, stage->OutputDim());
+    num_flushed += stage->Latency();
+  }
+  flushed_.resize(std::max(num_flushed, 1) * stage_stride_);
+  SetInputRate(resample_opts_.input_rate);
+}
+
+void FeatureExtractor::SetInputRate(Int32 input_rate) {
+  if (resampler_) delete resampler_;
+  resampler_ = NULL;
+  if (input_rate && input_rate != sample_rate_)
+    resampler_ = new Resampler(input_rate, sample_rate_, resample_opts_);
+  Reset();
+}
+
+void FeatureExtractor::AcceptWaveform(const Float32 *samples,
+                                      Int32 num_samps) {
+  if (!resampler_) {
+    PushSamples(samples, num_samps);
+    return;
+  }
+  Int32 num_output = resampler_->MaxOutputSamples(num_samps);
+  if (resampled_.size() < num_output) resampled_.resize(num_output);
+  num_output =
+      resampler_->Resample(samples, num_samps, false, resampled_.data());
+  PushSamples(resampled_.data(), num_output);
+}
+
+void FeatureExtractor::InputFinished() {
+  input_finished_ = true;
+  if (!resampler_) return;
+  Int32 num_output = resampler_->MaxOutputSamples(0);
+  if (resampled_.size() < num_output) resampled_.resize(num_output);
+  num_output = resampler_->Resample(NULL, 0, true, resampled_.data());
+  PushSamples(resampled_.data(), num_output);
+}
+
+void FeatureExtractor::PushSamples(const Float32 *samples, Int32 num_samps) {
+  if (num_received_ + num_samps - frame_begin_ > capacity_)
+    LOG_FAIL << "Ring buffer overflow: " << num_received_ - frame_begin_
+             << " + " << num_samps << " samples vs capacity " << capacity_
+             << ", call GetFrames() more often";
+  UInt64 pos = num_received_ % capacity_;
+  for (Int32 n = 0; n < num_samps; n++) {
+    ring_[pos] = ring_[pos + capacity_] = samples[n];
+    if (++pos == capacity_) pos = 0;
+  }
+  num_received_ += num_samps;
+}
+
+Int32 FeatureExtractor::GetFrames(Float32 *addr, Int32 stride,
+                                  Int32 max_frames) {
+  return GetFrames(addr, stride, max_frames, NULL, NULL);
+}
+
+Int32 FeatureExtractor::GetFrames(Float32 *addr, Int32 stride,
+                                  Int32 max_frames, Vad *vad,
+                                  VadStatus *status) {
+  ASSERT(FeatureDim() <= stride);
+  Int32 num_frames = std::min(NumBufferedFrames(), max_frames);
+  if (num_frames <= 0) return GetFlushedFrames(addr, stride, max_frames);
+  Float32 *signal = ring_.data() + frame_begin_ % capacity_;
+  Int32 num_samps = frame_length_ + (num_frames - 1) * frame_shift_;
+  // window starts at a frame, no samples discarded before
+  computer_->Reset();
+  Int32 latency = 0;
+  for (FeatureStage *stage : stages_) latency += stage->Latency();
+  if (vad) {
+    ASSERT(status);
+    if (latency)
+      LOG_FAIL << "Vad gating is not supported with deltas or splicing";
+    if (vad->FrameLength() != frame_length_ ||
+        vad->FrameShift() != frame_shift_)
+      LOG_FAIL << "Framing of Vad mismatch with FeatureExtractor: "
+               << vad->FrameLength() << "/" << vad->FrameShift() << " vs "
+               << frame_length_ << "/" << frame_shift_;
+    vad->ComputeFrames(signal, num_samps, 0, num_frames, status);
+  }
+  // blocks of (active) frames
+  for (Int32 t = 0; t < num_frames;) {
+    if (vad && status[t] == kSilence) {
+      t++;
+      continue;
+    }
+    Int32 n = 1;
+    while (n < kFeatureBlockSize && t + n < num_frames &&
+           (!vad || status[t + n] == kActive))
+      n++;
+    computer_->ComputeFrames(signal, num_samps, t, n, addr + t * stride,
+                             stride, NULL);
+    // silent frames are skipped by CMVN too
+    if (vad) RunStages(addr + t * stride, stride, n, false);
+    t += n;
+  }
+  frame_begin_ += num_frames * frame_shift_;
+  Int32 num_output =
+      vad ? num_frames : RunStages(addr, stride, num_frames, false);
+  num_stage_input_ += num_frames;
+  num_stage_output_ += num_output;
+  return num_output;
+}
+
+Int32 FeatureExtractor::RunStages(Float32 *addr, Int32 stride,
+                                  Int32 num_frames, Bool flush) {
+  for (FeatureStage *stage : stages_) {
+    num_frames = stage->Process(addr, stride, num_frames);
+    if (flush) num_frames += stage->Flush(addr + num_frames * stride, stride);
+  }
+  return num_frames;
+}
+
+Int32 FeatureExtractor::GetFlushedFrames(Float32 *addr, Int32 stride,
+                                         Int32 max_frames) {
+  if (!input_finished_) return 0;
+  if (flushed_offset_ == num_flushed_) {
+    if (num_stage_input_ == num_stage_output_) return 0;
+    num_flushed_ = RunStages(flushed_.data(), stage_stride_, 0, true);
+    flushed_offset_ = 0;
+  }
+  Int32 num_frames = std::min(max_frames, num_flushed_ - flushed_offset_),
+        dim = FeatureDim();
+  for (Int32 i = 0; i < num_frames; i++)
+    memcpy(addr + i * stride,
+           flushed_.data() + (flushed_offset_ + i) * stage_stride_,
+           sizeof(Float32) * dim);
+  flushed_offset_ += num_frames;
+  num_stage_output_ += num_frames;
+  return num_frames;
 }
 
 Int32 FeatureExtractor::Compute(Float32 *signal, Int32 num_samps, Float32 *addr,
@@ -53,7 +283,19 @@ Int32 FeatureExtractor::Compute(Float32 *signal, Int32 num_samps, Float32 *addr,
     case kSpectrogram:
     case kFbank:
     case kMfcc:
+      if (resampler_) {
+        resampler_->Reset();
+        resampled_.resize(resampler_->MaxOutputSamples(num_samps));
+        num_samps =
+            resampler_->Resample(signal, num_samps, true, resampled_.data());
+        signal = resampled_.data();
+      }
+      ASSERT(FeatureDim() <= stride);
       num_frames = ComputeFeature(computer_, signal, num_samps, addr, stride);
+      if (stages_.size()) {
+        for (FeatureStage *stage : stages_) stage->Reset();
+        num_frames = RunStages(addr, stride, num_frames, true);
+      }
       break;
     case kUnkown:
       LOG_FAIL
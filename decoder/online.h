@@ -1,8 +1,6 @@
 // decoder/online.h
 
 // wujian@2018
-// TODO: improve vad or use py-webrtcvad in python scripts
-// py-webrtcvad: https://github.com/wiseman/py-webrtcvad
 
 #ifndef ONLINE_H
 #define ONLINE_H
@@ -11,34 +9,265 @@
 
 #include "decoder/common.h"
 #include "decoder/config.h"
+#include "decoder/feature-stage.h"
+#include "decoder/resample.h"
 #include "decoder/signal.h"
 
 enum VadStatus { kSilence, kActive };
 
+class VadOpts : public Options {
+ public:
+  // Framing must be same as the features gated by Vad
+  FrameOpts frame_opts;
+  // A frame is speech if its log raw energy is energy_threshold above the
+  // noise floor and above min_energy
+  Float32 energy_threshold, min_energy;
+  // Speech frames should also have spectral flatness (geometric / arithmetic
+  // mean of power spectrum, 1 for white noise) not above max_flatness, not
+  // checked (no FFT) if max_flatness >= 1
+  Float32 max_flatness;
+  // Noise floor follows log energy at rate noise_down if energy is below it,
+  // noise_up if above
+  Float32 noise_down, noise_up;
+  // Number of frames kept active after the last speech frame
+  Int32 hangover_frames;
+
+  VadOpts(Float32 threshold = 3.0, Float32 min_energy = 0.0,
+          Float32 max_flatness = 1.0, Int32 hangover = 30)
+      : energy_threshold(threshold),
+        min_energy(min_energy),
+        max_flatness(max_flatness),
+        noise_down(0.1),
+        noise_up(0.002),
+        hangover_frames(hangover) {}
+
+  void Check() const {
+    frame_opts.Check();
+    ASSERT(energy_threshold >= 0 && hangover_frames >= 0);
+    ASSERT(noise_down > 0 && noise_down <= 1);
+    ASSERT(noise_up >= 0 && noise_up <= 1);
+  }
+
+  void ParseConfigure(ConfigureParser *parser) {
+    frame_opts.ParseConfigure(parser);
+    parser->AddOptions("VadOpts", "energy_threshold", &energy_threshold);
+    parser->AddOptions("VadOpts", "min_energy", &min_energy);
+    parser->AddOptions("VadOpts", "max_flatness", &max_flatness);
+    parser->AddOptions("VadOpts", "noise_down", &noise_down);
+    parser->AddOptions("VadOpts", "noise_up", &noise_up);
+    parser->AddOptions("VadOpts", "hangover_frames", &hangover_frames);
+  }
+
+  std::string Configure() {
+    std::ostringstream oss;
+    oss << frame_opts.Configure();
+    oss << "--VadOpts.energy_threshold=" << energy_threshold << std::endl;
+    oss << "--VadOpts.min_energy=" << min_energy << std::endl;
+    oss << "--VadOpts.max_flatness=" << max_flatness << std::endl;
+    oss << "--VadOpts.noise_down=" << noise_down << std::endl;
+    oss << "--VadOpts.noise_up=" << noise_up << std::endl;
+    oss << "--VadOpts.hangover_frames=" << hangover_frames << std::endl;
+    return oss.str();
+  }
+};
+
+// Streaming energy VAD with an adaptive noise floor, optional spectral
+// flatness check and hangover smoothing. Frames are split by FrameSplitter
+// (same raw energy as Computer::ComputeFrame() returns), decisions are
+// causal and state is kept across calls until Reset().
+// egs:
+// Vad vad(vad_opts);
+// extractor.GetFrames(addr, stride, max_frames, &vad, status);
+class Vad {
+ public:
+  Vad(const VadOpts &opts);
+
+  // Status of frames [t, t + num_frames) of signal, in time order
+  void ComputeFrames(Float32 *signal, Int32 num_samps, Int32 t,
+                     Int32 num_frames, VadStatus *status);
+
+  // Status of next frame given its raw energy (and spectral flatness), for
+  // callers that already have it from Computer::ComputeFrame()
+  VadStatus AcceptFrame(Float32 raw_energy, Float32 flatness = 0);
+
+  void Reset() {
+    splitter_.Reset();
+    num_frames_ = hangover_ = 0;
+  }
+
+  Int32 FrameLength() { return splitter_.FrameLength(); }
+
+  Int32 FrameShift() { return splitter_.FrameShift(); }
+
+  // Current noise floor (log energy)
+  Float32 NoiseFloor() const { return noise_floor_; }
+
+  ~Vad() {
+    if (fft_computer_) delete fft_computer_;
+  }
+
+ private:
+  Vad(const Vad &) = delete;
+  Vad &operator=(const Vad &) = delete;
+
+  VadOpts opts_;
+  FrameSplitter splitter_;
+  FFTComputer *fft_computer_;
+  Int32 padding_length_;
+  // Frames, raw energies and power spectrum of a block
+  std::vector<Float32> frames_cache_, energy_cache_, spectrum_;
+  // Frames seen since Reset() and frames left in hangover
+  Int32 num_frames_, hangover_;
+  Float32 noise_floor_;
+};
+
 enum FeatureType { kSpectrogram, kFbank, kMfcc, kUnkown };
 
 FeatureType StringToFeatureType(const std::string &type);
 
 // Simple FeatureExtractor(mfcc/spectrogram/fbank)
+// Two ways to use:
+//  1) Compute(): feed signal chunks, pre-size output with NumFrames()
+//  2) streaming: AcceptWaveform() any number of samples, and read computed
+//     frames by GetFrames() once ReadyFrames() > 0. Samples are kept in a
+//     fixed ring buffer of max_buffered_samps samples (one second plus a frame
+//     if 0), nothing is allocated or logged per call after the first frames.
+//     Frames are same as Compute() on the whole signal.
+// Input of other rate than FrameOpts.sample_rate (ResampleOpts.input_rate in
+// conf, or SetInputRate()) is resampled by a Resampler before both ways.
+// Features are then passed through stages enabled in conf: CMVN (CmvnOpts),
+// deltas (DeltaOpts) and splicing (SpliceOpts), in this order. Outputs of
+// deltas and splicing lag behind by their right context in streaming, the
+// last frames are given after InputFinished().
 class FeatureExtractor {
  public:
-  FeatureExtractor(const std::string &conf, const std::string &type);
+  FeatureExtractor(const std::string &conf, const std::string &type,
+                   Int32 max_buffered_samps = 0)
+      : FeatureExtractor(ConfigureTable(conf), type, max_buffered_samps) {}
+
+  // From a configure parsed once, extractors created per stream do not
+  // touch the file
+  FeatureExtractor(const ConfigureTable &conf, const std::string &type,
+                   Int32 max_buffered_samps = 0);
 
   Int32 Compute(Float32 *signal, Int32 num_samps, Float32 *addr, Int32 stride);
 
-  void Reset() { computer_->Reset(); }
+  // Append samples for streaming use, LOG_FAIL if ring buffer overflows, i.e.
+  // GetFrames() not called in time
+  void AcceptWaveform(const Float32 *samples, Int32 num_samps);
+
+  // No more samples of current stream, flush the resampler (if any) so the
+  // last samples could be framed, and the stages once all frames are read
+  void InputFinished();
+
+  // Sample rate of following input, 0 or FrameOpts.sample_rate to disable
+  // resampling. Samples accepted are dropped as Reset()
+  void SetInputRate(Int32 input_rate);
+
+  Int32 InputRate() const {
+    return resampler_ ? resampler_->InputRate() : sample_rate_;
+  }
+
+  // Max number of (input) samples AcceptWaveform() could take now
+  Int32 NumFreeSamples() const {
+    Int32 num_free = capacity_ - (num_received_ - frame_begin_);
+    return resampler_ ? resampler_->MaxInputSamples(num_free) : num_free;
+  }
+
+  // Number of frames GetFrames() could take now (fewer given back while
+  // stages lag), plus frames left in stages after InputFinished()
+  Int32 ReadyFrames() const {
+    Int32 num_pending =
+        input_finished_ ? num_stage_input_ - num_stage_output_ : 0;
+    return NumBufferedFrames() + num_pending;
+  }
+
+  // Compute at most max_frames ready frames into addr (row stride stride),
+  // return number of frames done
+  Int32 GetFrames(Float32 *addr, Int32 stride, Int32 max_frames);
+
+  // Same as above, but status of each frame is given by vad, and features
+  // are computed for active frames only (rows of silent frames untouched).
+  // vad should have same framing and see all the frames since Reset(). Not
+  // supported with deltas or splicing
+  Int32 GetFrames(Float32 *addr, Int32 stride, Int32 max_frames, Vad *vad,
+                  VadStatus *status);
+
+  // Time framing, FFT, mel and DCT into profiler (if built with
+  // DECODER_PROFILE), NULL to disable
+  void SetProfiler(Profiler *profiler) { computer_->SetProfiler(profiler); }
 
-  Int32 FeatureDim() { return computer_->FeatureDim(); }
+  // Also drop the samples accepted
+  void Reset() {
+    computer_->Reset();
+    if (resampler_) resampler_->Reset();
+    for (FeatureStage *stage : stages_) stage->Reset();
+    num_received_ = frame_begin_ = 0;
+    num_stage_input_ = num_stage_output_ = num_flushed_ = flushed_offset_ = 0;
+    input_finished_ = false;
+  }
+
+  Int32 FeatureDim() {
+    return stages_.empty() ? computer_->FeatureDim()
+                           : stages_.back()->OutputDim();
+  }
 
-  Int32 NumFrames(Int32 num_samps) { return computer_->NumFrames(num_samps); }
+  // num_samps of input rate
+  Int32 NumFrames(Int32 num_samps) {
+    return computer_->NumFrames(
+        resampler_ ? resampler_->NumOutputSamples(num_samps) : num_samps);
+  }
 
   ~FeatureExtractor() {
     if (computer_ != NULL) delete computer_;
+    if (resampler_ != NULL) delete resampler_;
+    for (FeatureStage *stage : stages_) delete stage;
   }
 
  private:
+  // Number of frames of samples in ring buffer
+  Int32 NumBufferedFrames() const {
+    UInt64 num_buffered = num_received_ - frame_begin_;
+    if (num_buffered < frame_length_) return 0;
+    return (num_buffered - frame_length_) / frame_shift_ + 1;
+  }
+
+  // Append samples (of FrameOpts.sample_rate) into ring buffer
+  void PushSamples(const Float32 *samples, Int32 num_samps);
+
+  // Pass num_frames rows through stages, flush them if flush, return number
+  // of output rows
+  Int32 RunStages(Float32 *addr, Int32 stride, Int32 num_frames, Bool flush);
+
+  // Give at most max_frames frames left in stages after InputFinished()
+  Int32 GetFlushedFrames(Float32 *addr, Int32 stride, Int32 max_frames);
+
   FeatureType type_;
   Computer *computer_;
+
+  // Sample rate of features, NULL resampler_ if input is same
+  Int32 sample_rate_;
+  ResampleOpts resample_opts_;
+  Resampler *resampler_;
+  // Output of resampler_
+  std::vector<Float32> resampled_;
+
+  // CMVN, deltas and splicing (those enabled)
+  std::vector<FeatureStage *> stages_;
+  // Frames passed to stages and given by GetFrames() since Reset()
+  Int32 num_stage_input_, num_stage_output_;
+  // Outputs of stages flushed, rows of stage_stride_ floats
+  std::vector<Float32> flushed_;
+  Int32 stage_stride_, num_flushed_, flushed_offset_;
+  Bool input_finished_;
+
+  Int32 frame_length_, frame_shift_;
+  // Samples are written twice, at i and i + capacity, so any window of the
+  // last capacity samples is contiguous in memory
+  std::vector<Float32> ring_;
+  UInt64 capacity_;
+  // Number of samples accepted since Reset() and start of next frame
+  UInt64 num_received_, frame_begin_;
 };
 
 
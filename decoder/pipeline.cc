@@ -0,0 +1,124 @@
+// wujian@2018
+
+#include "decoder/pipeline.h"
+
+DecodePipeline::DecodePipeline(FeatureExtractor *extractor,
+                               AcousticModel *model, FasterDecoder *decoder,
+                               Int32 chunk_size, Vad *vad)
+    : extractor_(extractor),
+      model_(model),
+      decoder_(decoder),
+      vad_(vad),
+      profiler_(NULL),
+      chunk_size_(chunk_size) {
+  ASSERT(extractor && model && decoder && chunk_size > 0);
+  // chunks start at decoded frames
+  frame_step_ = decoder_->FrameSubsamplingFactor();
+  chunk_size_ = (chunk_size_ + frame_step_ - 1) / frame_step_ * frame_step_;
+  left_context_ = model_->LeftContext();
+  right_context_ = model_->RightContext();
+  ASSERT(left_context_ >= 0 && right_context_ >= 0);
+  feat_dim_ = extractor_->FeatureDim();
+  num_pdfs_ = model_->OutputDim();
+  if (model_->InputDim() != feat_dim_)
+    LOG_FAIL << "Dimention of features mismatch with acoustic model: "
+             << feat_dim_ << " vs " << model_->InputDim();
+  max_rows_ = left_context_ + chunk_size_ + right_context_;
+  feats_.resize(max_rows_ * feat_dim_);
+  last_feat_.resize(feat_dim_);
+  loglikes_.resize(chunk_size_ / frame_step_ * num_pdfs_);
+  if (vad_) status_.resize(max_rows_);
+  Reset();
+}
+
+void DecodePipeline::Reset() {
+  extractor_->Reset();
+  decoder_->Reset();
+  if (vad_) vad_->Reset();
+  num_rows_ = num_feats_ = num_silence_frames_ = 0;
+}
+
+void DecodePipeline::SetProfiler(Profiler *profiler) {
+  profiler_ = profiler;
+  extractor_->SetProfiler(profiler);
+  decoder_->SetProfiler(profiler);
+}
+
+void DecodePipeline::AcceptWaveform(const Float32 *samples, Int32 num_samps) {
+  while (num_samps > 0) {
+    // ring buffer of extractor is emptied by ReadFeatures()
+    Int32 num_accept = std::min(num_samps, extractor_->NumFreeSamples());
+    extractor_->AcceptWaveform(samples, num_accept);
+    ReadFeatures();
+    samples += num_accept;
+    num_samps -= num_accept;
+  }
+}
+
+void DecodePipeline::InputFinished() {
+  // samples left in resampler of extractor
+  extractor_->InputFinished();
+  ReadFeatures();
+  if (!num_feats_) return;
+  memcpy(last_feat_.data(), feats_.data() + (num_rows_ - 1) * feat_dim_,
+         sizeof(Float32) * feat_dim_);
+  for (Int32 i = 0; i < right_context_; i++) AppendFeature(last_feat_.data());
+  if (num_rows_ > left_context_ + right_context_)
+    DecodeChunk(num_rows_ - left_context_ - right_context_);
+}
+
+void DecodePipeline::ReadFeatures() {
+  while (extractor_->ReadyFrames()) {
+    // first frame alone, it is also padded as left context
+    Float32 *feats = feats_.data() + num_rows_ * feat_dim_;
+    Int32 max_frames = num_feats_ ? max_rows_ - num_rows_ : 1, num_frames;
+    if (vad_) {
+      num_frames = extractor_->GetFrames(feats, feat_dim_, max_frames, vad_,
+                                         status_.data());
+      num_frames = DropSilence(feats, num_frames);
+    } else {
+      num_frames = extractor_->GetFrames(feats, feat_dim_, max_frames);
+    }
+    num_rows_ += num_frames;
+    num_feats_ += num_frames;
+    if (num_frames && num_feats_ == num_frames)
+      for (Int32 i = 0; i < left_context_; i++) AppendFeature(feats_.data());
+    FlushIfFull();
+  }
+}
+
+Int32 DecodePipeline::DropSilence(Float32 *feats, Int32 num_frames) {
+  Int32 num_kept = 0;
+  for (Int32 t = 0; t < num_frames; t++) {
+    if (status_[t] == kSilence) continue;
+    if (num_kept != t)
+      memcpy(feats + num_kept * feat_dim_, feats + t * feat_dim_,
+             sizeof(Float32) * feat_dim_);
+    num_kept++;
+  }
+  num_silence_frames_ += num_frames - num_kept;
+  return num_kept;
+}
+
+void DecodePipeline::AppendFeature(const Float32 *feat) {
+  memcpy(feats_.data() + num_rows_ * feat_dim_, feat,
+         sizeof(Float32) * feat_dim_);
+  num_rows_++;
+  FlushIfFull();
+}
+
+void DecodePipeline::DecodeChunk(Int32 num_frames) {
+  {
+    ProfileScope scope(profiler_, kModelStage);
+    model_->ComputeSubsampled(feats_.data(), feat_dim_, num_frames,
+                              frame_step_, loglikes_.data(), num_pdfs_);
+  }
+  // already subsampled, DecodeFrame() on each row
+  Int32 num_rows = (num_frames + frame_step_ - 1) / frame_step_;
+  for (Int32 t = 0; t < num_rows; t++)
+    decoder_->DecodeFrame(loglikes_.data() + t * num_pdfs_, num_pdfs_);
+  // keep context rows for next chunk
+  num_rows_ -= num_frames;
+  memmove(feats_.data(), feats_.data() + num_frames * feat_dim_,
+          sizeof(Float32) * num_rows_ * feat_dim_);
+}
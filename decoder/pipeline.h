@@ -0,0 +1,144 @@
+// wujian@2018
+
+// Chain feature extraction, acoustic model and decoding on chunks of frames
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "decoder/common.h"
+#include "decoder/decoder.h"
+#include "decoder/online.h"
+
+// Acoustic model plugged into DecodePipeline, which computes loglikes of a
+// chunk of frames from features of the chunk plus its context
+class AcousticModel {
+ public:
+  // Dimention of input features
+  virtual Int32 InputDim() = 0;
+
+  // Dimention of output loglikes, number of pdfs
+  virtual Int32 OutputDim() = 0;
+
+  // Number of frames needed before/after each output frame, features are
+  // padded with first/last frame at the edges of an utterance
+  virtual Int32 LeftContext() { return 0; }
+
+  virtual Int32 RightContext() { return 0; }
+
+  // feats: LeftContext() + num_frames + RightContext() rows, one frame per
+  // feat_stride floats. loglikes: num_frames rows for the middle frames
+  virtual void Compute(const Float32 *feats, Int32 feat_stride,
+                       Int32 num_frames, Float32 *loglikes,
+                       Int32 loglike_stride) = 0;
+
+  // Same input as Compute(), but only frames 0, step, 2 * step ... are
+  // computed, row i of loglikes for frame i * step. The default one calls
+  // Compute() frame by frame, models override it to share work across frames
+  virtual void ComputeSubsampled(const Float32 *feats, Int32 feat_stride,
+                                 Int32 num_frames, Int32 step,
+                                 Float32 *loglikes, Int32 loglike_stride) {
+    if (step == 1) {
+      Compute(feats, feat_stride, num_frames, loglikes, loglike_stride);
+      return;
+    }
+    for (Int32 t = 0; t < num_frames; t += step)
+      Compute(feats + t * feat_stride, feat_stride, 1,
+              loglikes + (t / step) * loglike_stride, loglike_stride);
+  }
+
+  virtual ~AcousticModel() {}
+};
+
+// Wave -> features -> loglikes -> decoder, frames are handed over in chunks
+// through two fixed buffers, (left + chunk_size + right) rows of features and
+// chunk_size rows of loglikes, so memory does not grow with utterance length.
+// Features are written by FeatureExtractor::GetFrames() in place, and a chunk
+// is sent to model and decoder once its right context is ready.
+// With DecodeOpts.frame_subsampling_factor n > 1, chunk_size is rounded up
+// to a multiple of n and the model computes only the frames decoded
+// (ComputeSubsampled()), 1/n of the model cost.
+// With a Vad, frames it marks silent are dropped before the feature buffer
+// (features not computed either), so model and decoder see speech segments
+// only, joined one after another.
+// egs:
+// DecodePipeline pipeline(&extractor, &model, &decoder);
+// pipeline.AcceptWaveform(samples, num_samps);  // any number of times
+// pipeline.InputFinished();
+// pipeline.GetBestPath(&word_ids);
+// pipeline.Reset();  // for next utterance
+// All the components should outlive the pipeline and not be used by others
+// until Reset()
+class DecodePipeline {
+ public:
+  DecodePipeline(FeatureExtractor *extractor, AcousticModel *model,
+                 FasterDecoder *decoder, Int32 chunk_size = 32,
+                 Vad *vad = NULL);
+
+  // Reset pipeline and all the components for a new utterance
+  void Reset();
+
+  // Feed samples, chunks are decoded as soon as ready
+  void AcceptWaveform(const Float32 *samples, Int32 num_samps);
+
+  // No more samples, decode the rest frames with right context padded
+  void InputFinished();
+
+  Int32 NumDecodedFrames() { return decoder_->NumDecodedFrames(); }
+
+  // Number of frames dropped by Vad in current utterance
+  Int32 NumSilenceFrames() { return num_silence_frames_; }
+
+  Bool GetBestPath(std::vector<Int32> *word_sequence) {
+    return decoder_->GetBestPath(word_sequence);
+  }
+
+  // Profile feature extraction, model and decoder of this stream into
+  // profiler (if built with DECODER_PROFILE), NULL to disable
+  void SetProfiler(Profiler *profiler);
+
+ private:
+  DecodePipeline(const DecodePipeline &) = delete;
+  DecodePipeline &operator=(const DecodePipeline &) = delete;
+
+  // Move ready features of extractor into feature buffer
+  void ReadFeatures();
+
+  // Remove rows of silent frames in [feats, feats + num_frames * feat_dim_)
+  // given status_, return number of rows kept
+  Int32 DropSilence(Float32 *feats, Int32 num_frames);
+
+  // Append a copy of feat to feature buffer (for padding)
+  void AppendFeature(const Float32 *feat);
+
+  // Decode a chunk if feature buffer is full
+  void FlushIfFull() {
+    if (num_rows_ == max_rows_) DecodeChunk(chunk_size_);
+  }
+
+  // Run model and decoder on num_frames frames (one of every frame_step_),
+  // keep context for next chunk
+  void DecodeChunk(Int32 num_frames);
+
+  FeatureExtractor *extractor_;
+  AcousticModel *model_;
+  FasterDecoder *decoder_;
+  Vad *vad_;
+  Profiler *profiler_;
+  Int32 chunk_size_, left_context_, right_context_, feat_dim_, num_pdfs_;
+  // Frame subsampling factor of decoder
+  Int32 frame_step_;
+  // Window of padded features, one frame per feat_dim_ floats, first row is
+  // the left context of next output frame
+  std::vector<Float32> feats_;
+  // Last frame of utterance, for right padding
+  std::vector<Float32> last_feat_;
+  std::vector<Float32> loglikes_;
+  // Number of rows in feats_, capacity is left + chunk_size + right
+  Int32 num_rows_, max_rows_;
+  // Number of feature frames seen (kept) in current utterance
+  Int32 num_feats_, num_silence_frames_;
+  // Vad status of frames from GetFrames()
+  std::vector<VadStatus> status_;
+};
+
+#endif
@@ -0,0 +1,129 @@
+// decoder/profiler.cc
+// wujian@2018
+
+#include "decoder/profiler.h"
+
+const char *ProfileStageName(ProfileStage stage) {
+  switch (stage) {
+    case kFramingStage:
+      return "framing";
+    case kFftStage:
+      return "fft";
+    case kMelStage:
+      return "mel";
+    case kDctStage:
+      return "dct";
+    case kModelStage:
+      return "model";
+    case kDecodeStage:
+      return "decode";
+    default:
+      return "unknown";
+  }
+}
+
+void Profiler::AddStage(ProfileStage stage, Int64 begin, Int64 end) {
+  ASSERT(stage >= 0 && stage < kNumProfileStages);
+  stage_time_[stage].Add(end - begin);
+  Event event;
+  event.time = begin, event.duration = end - begin;
+  event.stage = stage;
+  AddEvent(event);
+}
+
+void Profiler::AddFrame(const DecodeFrameStats &stats, Int64 time) {
+  num_frames_++;
+  active_tokens_.Add(stats.num_active_tokens);
+  arcs_.Add(stats.num_arcs);
+  epsilon_iters_.Add(stats.num_epsilon_iters);
+  new_tokens_.Add(stats.num_new_tokens);
+  beam_.Add(stats.beam);
+  Event event;
+  event.time = time, event.duration = 0;
+  event.stage = kNumProfileStages;
+  event.stats = stats;
+  AddEvent(event);
+}
+
+void Profiler::Reset() {
+  for (Int32 s = 0; s < kNumProfileStages; s++)
+    stage_time_[s] = ProfileCounter();
+  active_tokens_ = arcs_ = epsilon_iters_ = new_tokens_ = beam_ =
+      ProfileCounter();
+  num_frames_ = num_dropped_ = 0;
+  events_.clear();
+}
+
+static void WriteCounter(const char *name, const ProfileCounter &counter,
+                         std::ostream &os) {
+  os << "\"" << name << "\": {\"total\": " << counter.total
+     << ", \"mean\": " << counter.Mean() << ", \"max\": " << counter.max
+     << "}";
+}
+
+void Profiler::WriteJson(std::ostream &os) const {
+  // counts are written in full
+  std::streamsize precision = os.precision(15);
+  os << "{\"id\": " << id_ << ", \"stages\": {";
+  for (Int32 s = 0; s < kNumProfileStages; s++) {
+    const ProfileCounter &time = stage_time_[s];
+    // in milliseconds
+    os << (s ? ", " : "") << "\""
+       << ProfileStageName(static_cast<ProfileStage>(s))
+       << "\": {\"calls\": " << time.count
+       << ", \"total_ms\": " << time.total * 1e-6
+       << ", \"max_ms\": " << time.max * 1e-6 << "}";
+  }
+  os << "}, \"decoder\": {\"frames\": " << num_frames_ << ", ";
+  WriteCounter("active_tokens", active_tokens_, os);
+  os << ", ";
+  WriteCounter("arcs", arcs_, os);
+  os << ", ";
+  WriteCounter("epsilon_iters", epsilon_iters_, os);
+  os << ", ";
+  WriteCounter("new_tokens", new_tokens_, os);
+  os << ", ";
+  WriteCounter("beam", beam_, os);
+  os << "}, \"dropped_events\": " << num_dropped_ << "}";
+  os.precision(precision);
+}
+
+void Profiler::WriteChromeTrace(std::ostream &os) const {
+  ::WriteChromeTrace(std::vector<const Profiler *>(1, this), os);
+}
+
+// Timestamps are in microseconds, one thread (tid) per stream
+void WriteChromeTrace(const std::vector<const Profiler *> &profilers,
+                      std::ostream &os) {
+  std::ios::fmtflags flags = os.flags();
+  std::streamsize precision = os.precision(3);
+  os.setf(std::ios::fixed, std::ios::floatfield);
+  os << "{\"traceEvents\": [";
+  Bool first = true;
+  for (const Profiler *profiler : profilers) {
+    for (const Profiler::Event &event : profiler->events_) {
+      os << (first ? "\n" : ",\n");
+      first = false;
+      if (event.stage != kNumProfileStages) {
+        os << "{\"name\": \""
+           << ProfileStageName(static_cast<ProfileStage>(event.stage))
+           << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << profiler->id_
+           << ", \"ts\": " << event.time * 1e-3
+           << ", \"dur\": " << event.duration * 1e-3 << "}";
+      } else {
+        const DecodeFrameStats &stats = event.stats;
+        os << "{\"name\": \"search " << profiler->id_
+           << "\", \"ph\": \"C\", \"pid\": 0, \"tid\": " << profiler->id_
+           << ", \"ts\": " << event.time * 1e-3
+           << ", \"args\": {\"active_tokens\": " << stats.num_active_tokens
+           << ", \"arcs\": " << stats.num_arcs
+           << ", \"epsilon_iters\": " << stats.num_epsilon_iters
+           << ", \"new_tokens\": " << stats.num_new_tokens
+           << ", \"beam\": " << stats.beam << "}}";
+      }
+    }
+  }
+  os << "\n], \"displayTimeUnit\": \"ms\"}" << std::endl;
+  os.flags(flags);
+  os.precision(precision);
+}
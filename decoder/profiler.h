@@ -0,0 +1,173 @@
+// decoder/profiler.h
+// wujian@2018
+
+// Per-stream performance counters: time spent in each stage of feature
+// extraction and decoding, and per-frame search statistics of FasterDecoder.
+// Sites are compiled in only with DECODER_PROFILE (kProfiling is constant, so
+// disabled ones are removed by the compiler) and record into the Profiler set
+// on the component, if any. A Profiler is not thread safe, use one per stream.
+// egs:
+// Profiler profiler(0);
+// pipeline.SetProfiler(&profiler);
+// ... decode utterances
+// profiler.WriteJson(os);  // aggregated
+// profiler.WriteChromeTrace(os);  // for chrome://tracing or Perfetto
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "decoder/common.h"
+
+#ifdef DECODER_PROFILE
+const bool kProfiling = true;
+#else
+const bool kProfiling = false;
+#endif
+
+enum ProfileStage {
+  kFramingStage,  // framing, DC removal, pre-emphasis and windowing
+  kFftStage,      // FFT and power/magnitude spectrum
+  kMelStage,      // mel filter bank
+  kDctStage,      // DCT and liftering
+  kModelStage,    // acoustic model in DecodePipeline
+  kDecodeStage,   // FasterDecoder::DecodeFrame()
+  kNumProfileStages
+};
+
+const char *ProfileStageName(ProfileStage stage);
+
+// Search statistics of one decoded frame
+struct DecodeFrameStats {
+  // Tokens alive before pruning (given by last frame)
+  UInt32 num_active_tokens;
+  // Emitting and epsilon arcs visited
+  UInt32 num_arcs;
+  // States popped in ProcessNonemitting()
+  UInt32 num_epsilon_iters;
+  // Tokens allocated (including those freed at once)
+  UInt32 num_new_tokens;
+  // Cutoff of emitting tokens, relative to the best cost (adaptive beam)
+  Float32 beam;
+
+  DecodeFrameStats() { Reset(); }
+
+  void Reset() {
+    num_active_tokens = num_arcs = num_epsilon_iters = num_new_tokens = 0;
+    beam = 0;
+  }
+};
+
+// Sum and max of a value
+struct ProfileCounter {
+  UInt64 count;
+  Float64 total, max;
+
+  ProfileCounter() : count(0), total(0), max(0) {}
+
+  void Add(Float64 value) {
+    count++;
+    total += value;
+    max = std::max(max, value);
+  }
+
+  Float64 Mean() const { return count ? total / count : 0; }
+};
+
+class Profiler {
+ public:
+  // id tells streams apart in traces (tid), at most max_events trace events
+  // are kept, the later ones are counted only
+  Profiler(Int32 id = 0, Int32 max_events = 1 << 20)
+      : id_(id), max_events_(max_events) {
+    Reset();
+  }
+
+  // Time [begin, end) (NowNanoseconds()) spent in stage
+  void AddStage(ProfileStage stage, Int64 begin, Int64 end);
+
+  // Stats of next decoded frame, end of its decoding at time
+  void AddFrame(const DecodeFrameStats &stats, Int64 time);
+
+  // Clear counters and events
+  void Reset();
+
+  Int32 Id() const { return id_; }
+
+  // Time in stage, in nanoseconds, count is number of calls
+  const ProfileCounter &StageTime(ProfileStage stage) const {
+    return stage_time_[stage];
+  }
+
+  Int64 NumFrames() const { return num_frames_; }
+
+  const ProfileCounter &ActiveTokens() const { return active_tokens_; }
+
+  const ProfileCounter &Arcs() const { return arcs_; }
+
+  const ProfileCounter &EpsilonIters() const { return epsilon_iters_; }
+
+  const ProfileCounter &NewTokens() const { return new_tokens_; }
+
+  const ProfileCounter &Beam() const { return beam_; }
+
+  // Number of events dropped (beyond max_events)
+  Int64 NumDropped() const { return num_dropped_; }
+
+  // Aggregated counters as a JSON object
+  void WriteJson(std::ostream &os) const;
+
+  // Events in Chrome trace format (JSON object with "traceEvents")
+  void WriteChromeTrace(std::ostream &os) const;
+
+ private:
+  friend void WriteChromeTrace(const std::vector<const Profiler *> &profilers,
+                               std::ostream &os);
+
+  // Stage timing (ph "X") or decoder stats (ph "C") of a frame
+  struct Event {
+    Int64 time, duration;
+    Int32 stage;  // kNumProfileStages for decoder stats
+    DecodeFrameStats stats;
+  };
+
+  void AddEvent(const Event &event) {
+    if (events_.size() < static_cast<UInt64>(max_events_))
+      events_.push_back(event);
+    else
+      num_dropped_++;
+  }
+
+  Int32 id_, max_events_;
+  ProfileCounter stage_time_[kNumProfileStages];
+  Int64 num_frames_, num_dropped_;
+  ProfileCounter active_tokens_, arcs_, epsilon_iters_, new_tokens_, beam_;
+  std::vector<Event> events_;
+};
+
+// Merge events of streams into one trace
+void WriteChromeTrace(const std::vector<const Profiler *> &profilers,
+                      std::ostream &os);
+
+// Time the scope into stage of profiler, nothing is done if profiler is NULL
+// or not built with DECODER_PROFILE
+class ProfileScope {
+ public:
+  ProfileScope(Profiler *profiler, ProfileStage stage)
+      : profiler_(kProfiling ? profiler : NULL), stage_(stage) {
+    if (profiler_) begin_ = NowNanoseconds();
+  }
+
+  ~ProfileScope() {
+    if (profiler_) profiler_->AddStage(stage_, begin_, NowNanoseconds());
+  }
+
+ private:
+  ProfileScope(const ProfileScope &) = delete;
+  ProfileScope &operator=(const ProfileScope &) = delete;
+
+  Profiler *profiler_;
+  ProfileStage stage_;
+  Int64 begin_;
+};
+
+#endif
@@ -0,0 +1,111 @@
+// decoder/resample.cc
+// wujian@2018
+
+#include "resample.h"
+#include "simd.h"
+
+static Int32 Gcd(Int32 a, Int32 b) {
+  while (b) {
+    Int32 r = a % b;
+    a = b;
+    b = r;
+  }
+  return a;
+}
+
+// Hanning windowed sinc with cutoff (Hz) and num_zeros zero crossings on each
+// side, same as Kaldi's LinearResample::FilterFunc()
+static Float64 WindowedSinc(Float64 t, Float64 cutoff, Int32 num_zeros) {
+  if (fabs(t) >= num_zeros / (2.0 * cutoff)) return 0;
+  Float64 window = 0.5 * (1 + cos(2 * M_PI * cutoff / num_zeros * t));
+  Float64 filter = t != 0 ? sin(2 * M_PI * cutoff * t) / (M_PI * t)
+                          : 2 * cutoff;
+  return filter * window;
+}
+
+// Sum of a[i] * b[i], n is multiple of 4
+static Float32 Dot4(const Float32 *a, const Float32 *b, Int32 n) {
+  Float32x4 sum = Set4(0);
+  for (Int32 i = 0; i < n; i += 4)
+    sum = Add4(sum, Mul4(Load4(a + i), Load4(b + i)));
+  Float32 lanes[4];
+  Store4(lanes, sum);
+  return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+Resampler::Resampler(Int32 input_rate, Int32 output_rate,
+                     const ResampleOpts &opts)
+    : input_rate_(input_rate), output_rate_(output_rate) {
+  opts.Check();
+  ASSERT(input_rate > 0 && output_rate > 0);
+  Int32 gcd = Gcd(input_rate, output_rate);
+  input_period_ = input_rate / gcd;
+  output_period_ = output_rate / gcd;
+  Float64 cutoff = 0.5 * opts.filter_cutoff * std::min(input_rate, output_rate),
+          window_width = opts.num_zeros / (2 * cutoff);
+  offsets_.resize(output_period_);
+  std::vector<Int32> num_taps(output_period_);
+  Int32 max_taps = 0;
+  for (Int32 i = 0; i < output_period_; i++) {
+    Float64 output_t = static_cast<Float64>(i) / output_rate;
+    Int32 min_index = ceil((output_t - window_width) * input_rate),
+          max_index = floor((output_t + window_width) * input_rate);
+    offsets_[i] = min_index;
+    num_taps[i] = max_index - min_index + 1;
+    max_taps = std::max(max_taps, num_taps[i]);
+  }
+  num_taps_ = (max_taps + 3) / 4 * 4;
+  filters_.resize(output_period_ * num_taps_, 0);
+  for (Int32 i = 0; i < output_period_; i++) {
+    Float64 output_t = static_cast<Float64>(i) / output_rate;
+    Float32 *filter = filters_.data() + i * num_taps_;
+    for (Int32 j = 0; j < num_taps[i]; j++) {
+      Float64 input_t = static_cast<Float64>(offsets_[i] + j) / input_rate;
+      filter[j] = WindowedSinc(input_t - output_t, cutoff, opts.num_zeros) /
+                  input_rate;
+    }
+  }
+  buffer_.reserve(num_taps_ * 4);
+  Reset();
+  LOG_INFO << "Resample " << input_rate << " => " << output_rate << ", "
+           << output_period_ << " phases of " << num_taps_ << " taps";
+}
+
+Int32 Resampler::Resample(const Float32 *input, Int32 num_samps, Bool flush,
+                          Float32 *output) {
+  buffer_.insert(buffer_.end(), input, input + num_samps);
+  num_received_ += num_samps;
+  Int64 num_total = flush ? NumOutputSamples(num_received_) : 0;
+  Int32 n = 0;
+  while (true) {
+    Int64 first = FirstInput(num_output_);
+    if (flush ? num_output_ >= num_total : first + num_taps_ > num_received_)
+      break;
+    const Float32 *filter =
+        filters_.data() + (num_output_ % output_period_) * num_taps_;
+    if (first >= buffer_begin_ && first + num_taps_ <= num_received_) {
+      output[n] = Dot4(filter, buffer_.data() + (first - buffer_begin_),
+                       num_taps_);
+    } else {
+      // zeros out of [0, num_received_), only at the begin or the flush
+      Float32 sum = 0;
+      for (Int32 j = 0; j < num_taps_; j++) {
+        if (first + j < buffer_begin_ || first + j >= num_received_) continue;
+        sum += filter[j] * buffer_[first + j - buffer_begin_];
+      }
+      output[n] = sum;
+    }
+    n++;
+    num_output_++;
+  }
+  if (flush) {
+    Reset();
+    return n;
+  }
+  // keep samples needed by next outputs only
+  Int64 keep = std::min(std::max(FirstInput(num_output_), buffer_begin_),
+                        num_received_);
+  buffer_.erase(buffer_.begin(), buffer_.begin() + (keep - buffer_begin_));
+  buffer_begin_ = keep;
+  return n;
+}
@@ -0,0 +1,112 @@
+// decoder/resample.h
+// wujian@2018
+
+// Streaming polyphase resampler, windowed sinc filters as Kaldi's
+// LinearResample, so features of resampled audio are close to Kaldi's
+
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include "decoder/signal.h"
+
+class ResampleOpts : public Options {
+ public:
+  // Sample rate of input audio, 0 means same as FrameOpts.sample_rate (no
+  // resampling), could be changed per stream by
+  // FeatureExtractor::SetInputRate()
+  Int32 input_rate;
+  // Number of zero crossings of sinc on each side, the filter is longer and
+  // sharper with more
+  Int32 num_zeros;
+  // Cutoff of low pass filter, as ratio of the lower nyquist
+  Float32 filter_cutoff;
+
+  ResampleOpts(Int32 rate = 0, Int32 zeros = 6, Float32 cutoff = 0.95)
+      : input_rate(rate), num_zeros(zeros), filter_cutoff(cutoff) {}
+
+  void Check() const {
+    ASSERT(input_rate >= 0 && num_zeros > 0);
+    ASSERT(filter_cutoff > 0 && filter_cutoff <= 1);
+  }
+
+  void ParseConfigure(ConfigureParser *parser) {
+    parser->AddOptions("ResampleOpts", "input_rate", &input_rate);
+    parser->AddOptions("ResampleOpts", "num_zeros", &num_zeros);
+    parser->AddOptions("ResampleOpts", "filter_cutoff", &filter_cutoff);
+  }
+
+  std::string Configure() {
+    std::ostringstream oss;
+    oss << "--ResampleOpts.input_rate=" << input_rate << std::endl;
+    oss << "--ResampleOpts.num_zeros=" << num_zeros << std::endl;
+    oss << "--ResampleOpts.filter_cutoff=" << filter_cutoff << std::endl;
+    return oss.str();
+  }
+};
+
+// With L/M = output_rate/input_rate in lowest terms, output sample k (at time
+// k / output_rate) is a dot product of filter k % L with input samples from
+// (k / L) * M + offset[k % L]. Filters of the L phases are precomputed with
+// the same number of taps (multiple of 4, zero padded) for SIMD. Input before
+// the first sample and after the last (flushed) one is zero.
+// egs:
+// Resampler resampler(8000, 16000, opts);
+// std::vector<Float32> output(resampler.MaxOutputSamples(num_samps));
+// Int32 n = resampler.Resample(samples, num_samps, false, output.data());
+class Resampler {
+ public:
+  Resampler(Int32 input_rate, Int32 output_rate, const ResampleOpts &opts);
+
+  // Resample next num_samps input samples into output, return number of
+  // output samples. Outputs lag behind inputs by half of the filter unless
+  // flush, which gives outputs up to the end and resets the resampler
+  Int32 Resample(const Float32 *input, Int32 num_samps, Bool flush,
+                 Float32 *output);
+
+  // Bound of outputs of Resample() given num_samps
+  Int32 MaxOutputSamples(Int32 num_samps) const {
+    return (static_cast<Int64>(num_samps) + num_taps_) * output_period_ /
+               input_period_ +
+           2;
+  }
+
+  // Max number of input samples which give at most num_output outputs,
+  // flush excluded
+  Int32 MaxInputSamples(Int32 num_output) const {
+    if (num_output <= 1) return 0;
+    return static_cast<Int64>(num_output - 1) * input_period_ / output_period_;
+  }
+
+  // Number of outputs of whole signal of num_samps samples
+  Int32 NumOutputSamples(Int64 num_samps) const {
+    return (num_samps * output_period_ + input_period_ - 1) / input_period_;
+  }
+
+  Int32 InputRate() const { return input_rate_; }
+
+  Int32 OutputRate() const { return output_rate_; }
+
+  void Reset() {
+    buffer_.clear();
+    buffer_begin_ = num_received_ = num_output_ = 0;
+  }
+
+ private:
+  // Index of first input sample of output k
+  Int64 FirstInput(Int64 k) const {
+    return k / output_period_ * input_period_ + offsets_[k % output_period_];
+  }
+
+  Int32 input_rate_, output_rate_;
+  // input_rate / gcd and output_rate / gcd (M and L)
+  Int32 input_period_, output_period_;
+  Int32 num_taps_;
+  // Filters of each phase, output_period_ x num_taps_, and their first input
+  std::vector<Float32> filters_;
+  std::vector<Int32> offsets_;
+  // Input samples from buffer_begin_, which could be needed by next outputs
+  std::vector<Float32> buffer_;
+  Int64 buffer_begin_, num_received_, num_output_;
+};
+
+#endif
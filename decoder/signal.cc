@@ -3,8 +3,6 @@
 
 #include "signal.h"
 
-Bool debug_mel = false;
-
 std::string WindowToString(WindowType window) {
   switch (window) {
     case kBlackMan:
@@ -86,7 +84,7 @@ void Preemphasize(Float32 *frame, Int32 frame_length, Float32 preemph_coeff) {
 // Compute mel-filter coefficients
 void ComputeMelFilters(Int32 num_fft_bins, Int32 num_mel_bins,
                        Int32 center_freq, Int32 lower_bound, Int32 upper_bound,
-                       std::vector<std::vector<Float32> > *weights) {
+                       std::vector<MelFilter> *filters) {
   if (lower_bound < 0 || lower_bound >= center_freq || upper_bound < 0 ||
       upper_bound > center_freq || upper_bound <= lower_bound)
     LOG_FAIL << "Bad frequency range: [" << lower_bound << ", " << upper_bound
@@ -95,7 +93,7 @@ void ComputeMelFilters(Int32 num_fft_bins, Int32 num_mel_bins,
   ASSERT(num_mel_bins >= 3);
   // egs: 257
   ASSERT(RoundUpToNearestPowerOfTwo(num_fft_bins - 1) == num_fft_bins - 1);
-  weights->resize(num_mel_bins);
+  filters->resize(num_mel_bins);
   // Bound in melscale
   Float32 mel_upper_bound = ToMelScale(upper_bound),
           mel_lower_bound = ToMelScale(lower_bound);
@@ -106,25 +104,26 @@ void ComputeMelFilters(Int32 num_fft_bins, Int32 num_mel_bins,
 
   for (Int32 bin = 0; bin < num_mel_bins; bin++) {
     Float32 center_mel = mel_lower_bound + (bin + 1) * mel_band_width;
-    // Fill with zero
-    std::vector<Float32> &filter = (*weights)[bin];
-    filter.resize(num_fft_bins, 0.0);
-    if (debug_mel) {
-      LOG_INFO << center_mel - mel_band_width << "/" << center_mel << "/"
-               << center_mel + mel_band_width;
-      std::cerr << "For bin " << bin << ": ";
-    }
+    MelFilter &filter = (*filters)[bin];
+    filter.offset = 0;
+    filter.weights.clear();
     // Compute coefficient for each bin
     for (Int32 f = 0; f < num_fft_bins; f++) {
       Float32 mel = ToMelScale(linear_bw * f);
       if (mel > center_mel - mel_band_width &&
           mel < center_mel + mel_band_width) {
-        filter[f] = mel <= center_mel ? (mel - center_mel) / mel_band_width + 1
-                                      : (center_mel - mel) / mel_band_width + 1;
-        if (debug_mel) std::cerr << filter[f] << " ";
+        // Bins inside are contiguous as mel scale is monotonic
+        if (filter.weights.empty()) filter.offset = f;
+        Float32 weight = mel <= center_mel
+                             ? (mel - center_mel) / mel_band_width + 1
+                             : (center_mel - mel) / mel_band_width + 1;
+        filter.weights.push_back(weight);
       }
     }
-    if (debug_mel) std::cerr << std::endl;
+    LOG_DEBUG << "Mel bin " << bin << "(" << center_mel - mel_band_width
+              << "/" << center_mel << "/" << center_mel + mel_band_width
+              << "): " << filter.weights.size() << " fft bins from "
+              << filter.offset;
   }
 }
 
@@ -149,28 +148,17 @@ void ComputeDctMatrix(Float32 *dct_matrix_, Int32 num_rows, Int32 num_cols) {
     }
 }
 
-// template<class Computer>
 Int32 ComputeFeature(Computer *computer, Float32 *signal, Int32 num_samps,
                      Float32 *addr, Int32 stride) {
   ASSERT(computer->FeatureDim() <= stride);
   Int32 num_frames = computer->NumFrames(num_samps);
-  for (Int32 t = 0; t < num_frames; t++)
-    computer->ComputeFrame(signal, num_samps, t, addr + t * stride);
+  for (Int32 t = 0; t < num_frames; t += kFeatureBlockSize)
+    computer->ComputeFrames(signal, num_samps, t,
+                            std::min(kFeatureBlockSize, num_frames - t),
+                            addr + t * stride, stride, NULL);
   return num_frames;
 }
 
-// template
-// Int32 ComputeFeature(SpectrogramComputer *computer, Float32 *signal, Int32
-// num_samps, Float32 *addr, Int32 stride);//
-
-// template
-// Int32 ComputeFeature(FbankComputer *computer, Float32 *signal, Int32
-// num_samps, Float32 *addr, Int32 stride);//
-
-// template
-// Int32 ComputeFeature(MfccComputer *computer, Float32 *signal, Int32
-// num_samps, Float32 *addr, Int32 stride);
-
 // Fix frame on time t
 void FrameSplitter::FixFrame(Float32 *signal, Int32 t, Float32 *frame_addr) {
   Int32 frame_length = frame_opts_.frame_length;
@@ -194,9 +182,9 @@ void FrameSplitter::FixFrame(Float32 *signal, Int32 t, Float32 *frame_addr) {
     2) Preemphasize
     3) Apply window
 */
-void FrameSplitter::FrameForIndex(Float32 *signal, Int32 num_samps, Int32 index,
-                                  Float32 *frame_addr, Float32 *raw_energy) {
-  Int32 num_frames = NumFrames(num_samps);
+void FrameSplitter::ProcessFrame(Float32 *signal, Int32 num_samps,
+                                 Int32 num_frames, Int32 index,
+                                 Float32 *frame_addr, Float32 *raw_energy) {
   ASSERT(num_frames > index);
   // Copy to dest addr
   FixFrame(signal, index, frame_addr);
@@ -205,7 +193,6 @@ void FrameSplitter::FrameForIndex(Float32 *signal, Int32 num_samps, Int32 index,
     // update prev_discard_size_
     prev_discard_size_ =
         num_samps + prev_discard_size_ - num_frames * frame_opts_.frame_shift;
-    LOG_INFO << "Cache " << prev_discard_size_ << " discarded samples";
     if (frame_opts_.frame_length > frame_opts_.frame_shift) {
       ASSERT(prev_discard_size_);
       memcpy(online_use_, signal + num_samps - prev_discard_size_,
@@ -238,69 +225,127 @@ void FrameSplitter::FrameForIndex(Float32 *signal, Int32 num_samps, Int32 index,
       frame_addr[n] = frame_addr[n] * window_[n];
 }
 
+void FrameSplitter::FrameBlock(Float32 *signal, Int32 num_samps, Int32 t,
+                               Int32 num_frames, Float32 *frames, Int32 stride,
+                               Float32 *raw_energy) {
+  ASSERT(frame_opts_.frame_length <= stride);
+  // prev_discard_size_ changes after last frame, so count once
+  Int32 num_total_frames = NumFrames(num_samps);
+  ASSERT(t + num_frames <= num_total_frames);
+  for (Int32 i = 0; i < num_frames; i++)
+    ProcessFrame(signal, num_samps, num_total_frames, t + i,
+                 frames + i * stride, raw_energy ? raw_energy + i : NULL);
+}
+
 Float32 SpectrogramComputer::ComputeFrame(Float32 *signal, Int32 num_samps,
                                           Int32 t, Float32 *spectrum_addr) {
-  Int32 num_frames = splitter.NumFrames(num_samps);
   Float32 raw_energy;
-  ASSERT(t < num_frames);
+  ComputeFrames(signal, num_samps, t, 1, spectrum_addr, FeatureDim(),
+                &raw_energy);
+  return raw_energy;
+}
+
+void SpectrogramComputer::ComputeFrames(Float32 *signal, Int32 num_samps,
+                                        Int32 t, Int32 num_frames,
+                                        Float32 *spectrum_addr, Int32 stride,
+                                        Float32 *raw_energy) {
+  ASSERT(FeatureDim() <= stride);
+  realfft_cache_.resize(num_frames * padding_length_);
+  energy_cache_.resize(num_frames);
+  Float32 *frames = realfft_cache_.data();
   // SetZero for padding windows
-  memset(realfft_cache_, 0, sizeof(Float32) * padding_length_);
-  memset(spectrum_addr, 0, sizeof(Float32) * FeatureDim());
-  // Load current frame into cache
-  splitter.FrameForIndex(signal, num_samps, t, realfft_cache_, &raw_energy);
+  memset(frames, 0, sizeof(Float32) * padding_length_ * num_frames);
+  // Load frames into cache
+  {
+    ProfileScope scope(profiler_, kFramingStage);
+    splitter.FrameBlock(signal, num_samps, t, num_frames, frames,
+                        padding_length_, energy_cache_.data());
+  }
+  ProfileScope scope(profiler_, kFftStage);
   // Run RealFFT
-  fft_computer->RealFFT(realfft_cache_, padding_length_);
+  for (Int32 i = 0; i < num_frames; i++)
+    fft_computer->RealFFT(frames + i * padding_length_, padding_length_);
   // Compute (Log)(Power/Magnitude) spectrum
-  ComputeSpectrum(realfft_cache_, padding_length_, spectrum_addr, apply_pow_,
-                  apply_log_);
-  // Using log-energy or not
-  if (use_log_raw_energy_) spectrum_addr[0] = LogFloat32(raw_energy);
-  return raw_energy;
+  for (Int32 i = 0; i < num_frames; i++) {
+    Float32 *spectrum = spectrum_addr + i * stride;
+    ComputeSpectrum(frames + i * padding_length_, padding_length_, spectrum,
+                    apply_pow_, apply_log_);
+    // Using log-energy or not
+    if (use_log_raw_energy_) spectrum[0] = LogFloat32(energy_cache_[i]);
+  }
+  if (raw_energy)
+    memcpy(raw_energy, energy_cache_.data(), sizeof(Float32) * num_frames);
 }
 
 Float32 FbankComputer::ComputeFrame(Float32 *signal, Int32 num_samps, Int32 t,
                                     Float32 *fbank_addr) {
+  Float32 raw_energy;
+  ComputeFrames(signal, num_samps, t, 1, fbank_addr, FeatureDim(),
+                &raw_energy);
+  return raw_energy;
+}
+
+void FbankComputer::ComputeFrames(Float32 *signal, Int32 num_samps, Int32 t,
+                                  Int32 num_frames, Float32 *fbank_addr,
+                                  Int32 stride, Float32 *raw_energy) {
+  ASSERT(FeatureDim() <= stride);
   Int32 num_fft_bins = spectrogram_computer_.FeatureDim();
-  ASSERT(t < spectrogram_computer_.NumFrames(num_samps));
-  memset(fbank_addr, 0, sizeof(Float32) * FeatureDim());
+  spectrum_cache_.resize(num_frames * num_fft_bins);
   // Compute linear-spectrogram, no energy
-  Float32 raw_energy =
-      spectrogram_computer_.ComputeFrame(signal, num_samps, t, spectrum_cache_);
-  // Weight spectrogram with mel coefficients
+  spectrogram_computer_.ComputeFrames(signal, num_samps, t, num_frames,
+                                      spectrum_cache_.data(), num_fft_bins,
+                                      raw_energy);
+  ProfileScope scope(profiler_, kMelStage);
+  // Weight spectrogram with mel coefficients, only over nonzero weights
   for (Int32 f = 0; f < num_bins_; f++) {
-    ASSERT(mel_coeff_[f].size() == num_fft_bins);
-    const Float32 *weights = mel_coeff_[f].data();
-    Float32 mel_energy = 0;
-    // if use openblas
-    // Float32 mel_energy = VdotV(weights, spectrum_cache_, num_fft_bins);
-    for (Int32 i = 0; i < num_fft_bins; i++)
-      mel_energy += spectrum_cache_[i] * weights[i];
-    // log mel-fbank or linear mel-fbank
-    fbank_addr[f] = apply_log_ ? LogFloat32(mel_energy) : mel_energy;
+    const MelFilter &filter = mel_filters_[f];
+    const Float32 *weights = filter.weights.data();
+    Int32 num_weights = filter.weights.size();
+    for (Int32 i = 0; i < num_frames; i++) {
+      const Float32 *spectrum =
+          spectrum_cache_.data() + i * num_fft_bins + filter.offset;
+      Float32 mel_energy = 0;
+      for (Int32 k = 0; k < num_weights; k++)
+        mel_energy += spectrum[k] * weights[k];
+      // log mel-fbank or linear mel-fbank
+      fbank_addr[i * stride + f] =
+          apply_log_ ? LogFloat32(mel_energy) : mel_energy;
+    }
   }
-  return raw_energy;
 }
 
 Float32 MfccComputer::ComputeFrame(Float32 *signal, Int32 num_samps, Int32 t,
                                    Float32 *mfcc_addr) {
-  ASSERT(t < fbank_computer.NumFrames(num_samps));
-  // Zero mfcc_addr
-  memset(mfcc_addr, 0, sizeof(Float32) * FeatureDim());
-  Float32 raw_energy =
-      fbank_computer.ComputeFrame(signal, num_samps, t, mel_energy_cache_);
+  Float32 raw_energy;
+  ComputeFrames(signal, num_samps, t, 1, mfcc_addr, FeatureDim(), &raw_energy);
+  return raw_energy;
+}
+
+void MfccComputer::ComputeFrames(Float32 *signal, Int32 num_samps, Int32 t,
+                                 Int32 num_frames, Float32 *mfcc_addr,
+                                 Int32 stride, Float32 *raw_energy) {
+  ASSERT(FeatureDim() <= stride);
   Int32 num_mel_bins = fbank_computer.FeatureDim();
-  // mfcc = dct_matrix_ * mel_energy
+  mel_energy_cache_.resize(num_frames * num_mel_bins);
+  energy_cache_.resize(num_frames);
+  fbank_computer.ComputeFrames(signal, num_samps, t, num_frames,
+                               mel_energy_cache_.data(), num_mel_bins,
+                               energy_cache_.data());
+  ProfileScope scope(profiler_, kDctStage);
+  // mfcc = mel_energy * dct_matrix_^T
   // dct_matrix_: only use first num_ceps rows
-  for (Int32 i = 0; i < num_ceps_; i++) {
-    for (Int32 j = 0; j < num_mel_bins; j++)
-      mfcc_addr[i] +=
-          (dct_matrix_[i * num_mel_bins + j] * mel_energy_cache_[j]);
-  }
-  // Scale
-  if (cepstral_lifter_ != 0.0) {
-    for (Int32 i = 0; i < num_ceps_; i++)
-      mfcc_addr[i] = mfcc_addr[i] * lifter_coeffs_[i];
+  MatrixMultiply(mel_energy_cache_.data(), num_mel_bins, dct_transpose_.data(),
+                 num_ceps_, mfcc_addr, stride, num_frames, num_mel_bins,
+                 num_ceps_);
+  for (Int32 i = 0; i < num_frames; i++) {
+    Float32 *mfcc = mfcc_addr + i * stride;
+    // Scale
+    if (cepstral_lifter_ != 0.0) {
+      for (Int32 c = 0; c < num_ceps_; c++)
+        mfcc[c] = mfcc[c] * lifter_coeffs_[c];
+    }
+    if (use_energy_) mfcc[0] = LogFloat32(energy_cache_[i]);
   }
-  if (use_energy_) mfcc_addr[0] = LogFloat32(raw_energy);
-  return raw_energy;
+  if (raw_energy)
+    memcpy(raw_energy, energy_cache_.data(), sizeof(Float32) * num_frames);
 }
@@ -11,6 +11,7 @@
 #include "decoder/common.h"
 #include "decoder/config.h"
 #include "decoder/fft-computer.h"
+#include "decoder/profiler.h"
 
 // Preemphasize function
 void Preemphasize(Float32 *frame, Int32 frame_length, Float32 preemph_coeff);
@@ -28,10 +29,17 @@ void ComputeWindow(Int32 window_size, Float32 *window, WindowType window_type);
 void ComputeSpectrum(Float32 *realfft, Int32 dim, Float32 *spectrum,
                      Bool apply_pow, Bool apply_log);
 
+// Nonzero part of a triangular mel-filter: weights of fft bins
+// [offset, offset + weights.size())
+struct MelFilter {
+  Int32 offset;
+  std::vector<Float32> weights;
+};
+
 // Compute mel-filter coefficients
 void ComputeMelFilters(Int32 num_fft_bins, Int32 num_mel_bins,
                        Int32 sample_rate, Int32 lower_bound, Int32 upper_bound,
-                       std::vector<std::vector<Float32> > *weights);
+                       std::vector<MelFilter> *filters);
 
 // Compute DCT transform matrix
 void ComputeDctMatrix(Float32 *dct_matrix_, Int32 num_rows, Int32 num_cols);
@@ -47,17 +55,43 @@ class Options {
 // FeatureDim(): which gives dimention of features
 // NumFrames(): which work out number of frames
 // ComputeFrame(): which compute feature for a single frame
+// ComputeFrames(): which compute features for a block of frames
 class Computer {
  public:
   virtual Float32 ComputeFrame(Float32 *signal, Int32 num_samps, Int32 t,
                                Float32 *spectrum_addr) = 0;
+
+  // Compute features of frame [t, t + num_frames) into addr (row stride
+  // stride) and raw energy of each frame into raw_energy (if not NULL).
+  // Default one goes frame by frame, computers below run each stage on the
+  // whole block
+  virtual void ComputeFrames(Float32 *signal, Int32 num_samps, Int32 t,
+                             Int32 num_frames, Float32 *addr, Int32 stride,
+                             Float32 *raw_energy) {
+    for (Int32 i = 0; i < num_frames; i++) {
+      Float32 energy =
+          ComputeFrame(signal, num_samps, t + i, addr + i * stride);
+      if (raw_energy) raw_energy[i] = energy;
+    }
+  }
+
   virtual Int32 FeatureDim() = 0;
   virtual Int32 NumFrames(Int32 num_samps) = 0;
   virtual void Reset() = 0;
+
+  // Time stages of ComputeFrames() into profiler, NULL to disable
+  virtual void SetProfiler(Profiler *profiler) { profiler_ = profiler; }
+
   virtual ~Computer(){};
+
+ protected:
+  Profiler *profiler_ = NULL;
 };
 
-// template<class Computer>
+// Number of frames passed to Computer::ComputeFrames() by ComputeFeature()
+const Int32 kFeatureBlockSize = 32;
+
+// Compute features for whole signal, kFeatureBlockSize frames at a time
 Int32 ComputeFeature(Computer *computer, Float32 *signal, Int32 num_samps,
                      Float32 *addr, Int32 stride);
 
@@ -132,10 +166,8 @@ class FrameSplitter {
 
   // Framing whole signal at a time into assigned memory address
   Int32 Frame(Float32 *signal, Int32 num_samps, Float32 *frames, Int32 stride) {
-    ASSERT(frame_opts_.frame_length <= stride);
     Int32 num_frames = NumFrames(num_samps);
-    for (Int32 t = 0; t < num_frames; t++)
-      FrameForIndex(signal, num_samps, t, frames + stride * t, NULL);
+    FrameBlock(signal, num_samps, 0, num_frames, frames, stride, NULL);
     return num_frames;
   }
 
@@ -143,7 +175,15 @@ class FrameSplitter {
 
   // Copy Frame at time 'index' into assigned memory address
   void FrameForIndex(Float32 *signal, Int32 num_samps, Int32 index,
-                     Float32 *frame, Float32 *raw_energy);
+                     Float32 *frame, Float32 *raw_energy) {
+    ProcessFrame(signal, num_samps, NumFrames(num_samps), index, frame,
+                 raw_energy);
+  }
+
+  // Copy frames [t, t + num_frames) into frames (row stride stride), raw
+  // energy of each frame into raw_energy (if not NULL)
+  void FrameBlock(Float32 *signal, Int32 num_samps, Int32 t, Int32 num_frames,
+                  Float32 *frames, Int32 stride, Float32 *raw_energy);
 
   // Compute number of frames given number of samples
   // Consider online scenario here
@@ -177,6 +217,10 @@ class FrameSplitter {
  private:
   void FixFrame(Float32 *signal, Int32 t, Float32 *frame_addr);
 
+  // FrameForIndex() with number of frames known
+  void ProcessFrame(Float32 *signal, Int32 num_samps, Int32 num_frames,
+                    Int32 index, Float32 *frame_addr, Float32 *raw_energy);
+
   FrameOpts frame_opts_;
   Float32 *window_;
   // online_use_[0: prev_discard_size_]: cache previous discard samples
@@ -241,16 +285,18 @@ class SpectrogramComputer : public Computer {
         splitter(spectrogram_opts.frame_opts) {
     padding_length_ = splitter.PaddingLength();
     fft_computer = new FFTComputer(padding_length_);
-    realfft_cache_ = new Float32[padding_length_];
   }
 
   // Compute spectrum for frame t
   Float32 ComputeFrame(Float32 *signal, Int32 num_samps, Int32 t,
                        Float32 *spectrum_addr);
 
+  void ComputeFrames(Float32 *signal, Int32 num_samps, Int32 t,
+                     Int32 num_frames, Float32 *spectrum_addr, Int32 stride,
+                     Float32 *raw_energy);
+
   ~SpectrogramComputer() {
     if (fft_computer) delete fft_computer;
-    if (realfft_cache_) delete[] realfft_cache_;
   }
 
   Int32 PaddingLength() { return padding_length_; }
@@ -266,7 +312,8 @@ class SpectrogramComputer : public Computer {
   Int32 padding_length_;
   FrameSplitter splitter;
   FFTComputer *fft_computer;
-  Float32 *realfft_cache_;
+  // Padded frames and raw energies of a block
+  std::vector<Float32> realfft_cache_, energy_cache_;
 };
 
 class FbankOpts : public Options {
@@ -333,23 +380,27 @@ class FbankComputer : public Computer {
     ASSERT(!spectrogram_opts.apply_log && !spectrogram_opts.use_log_raw_energy);
     Int32 center_freq = spectrogram_opts.frame_opts.sample_rate >> 1;
     // spectrogram_computer_ = new SpectrogramComputer(spectrogram_opts);
-    spectrum_cache_ = new Float32[spectrogram_computer_.FeatureDim()];
     upper_bound_ = fbank_opts.upper_bound > 0.0
                        ? fbank_opts.upper_bound
                        : center_freq + fbank_opts.upper_bound;
     ComputeMelFilters(spectrogram_computer_.FeatureDim(), num_bins_,
-                      center_freq, lower_bound_, upper_bound_, &mel_coeff_);
-  }
-
-  ~FbankComputer() {
-    if (spectrum_cache_) delete[] spectrum_cache_;
+                      center_freq, lower_bound_, upper_bound_, &mel_filters_);
   }
 
   void Reset() { spectrogram_computer_.Reset(); }
 
+  void SetProfiler(Profiler *profiler) {
+    profiler_ = profiler;
+    spectrogram_computer_.SetProfiler(profiler);
+  }
+
   Float32 ComputeFrame(Float32 *signal, Int32 num_samps, Int32 t,
                        Float32 *fbank_addr);
 
+  void ComputeFrames(Float32 *signal, Int32 num_samps, Int32 t,
+                     Int32 num_frames, Float32 *fbank_addr, Int32 stride,
+                     Float32 *raw_energy);
+
   Int32 FeatureDim() { return num_bins_; }
 
   Int32 NumFrames(Int32 num_samps) {
@@ -357,10 +408,10 @@ class FbankComputer : public Computer {
   }
 
  protected:
-  Float32 *spectrum_cache_;
   Int32 num_bins_, lower_bound_, upper_bound_;
   Bool apply_log_;
-  std::vector<std::vector<Float32> > mel_coeff_;
+  std::vector<MelFilter> mel_filters_;
+  std::vector<Float32> spectrum_cache_;
   SpectrogramComputer spectrogram_computer_;
 };
 
@@ -428,20 +479,32 @@ class MfccComputer : public Computer {
     // Allocate memory for DCT matrix, only use first num_ceps rows
     dct_matrix_ = new Float32[num_ceps_ * num_mel_bins];
     ComputeDctMatrix(dct_matrix_, num_ceps_, num_mel_bins);
-    mel_energy_cache_ = new Float32[num_mel_bins];
+    // num_mel_bins x num_ceps, mfcc = mel_energy * dct_transpose_
+    dct_transpose_.resize(num_mel_bins * num_ceps_);
+    for (Int32 i = 0; i < num_ceps_; i++)
+      for (Int32 j = 0; j < num_mel_bins; j++)
+        dct_transpose_[j * num_ceps_ + i] = dct_matrix_[i * num_mel_bins + j];
   }
 
   ~MfccComputer() {
     if (lifter_coeffs_) delete[] lifter_coeffs_;
     if (dct_matrix_) delete[] dct_matrix_;
-    if (mel_energy_cache_) delete[] mel_energy_cache_;
   }
 
   void Reset() { fbank_computer.Reset(); }
 
+  void SetProfiler(Profiler *profiler) {
+    profiler_ = profiler;
+    fbank_computer.SetProfiler(profiler);
+  }
+
   Float32 ComputeFrame(Float32 *signal, Int32 num_samps, Int32 t,
                        Float32 *mfcc_addr);
 
+  void ComputeFrames(Float32 *signal, Int32 num_samps, Int32 t,
+                     Int32 num_frames, Float32 *mfcc_addr, Int32 stride,
+                     Float32 *raw_energy);
+
   Int32 FeatureDim() { return num_ceps_; }
 
   Int32 NumFrames(Int32 num_samps) {
@@ -451,7 +514,8 @@ class MfccComputer : public Computer {
  private:
   Int32 num_ceps_;
   Bool use_energy_;
-  Float32 cepstral_lifter_, *lifter_coeffs_, *dct_matrix_, *mel_energy_cache_;
+  Float32 cepstral_lifter_, *lifter_coeffs_, *dct_matrix_;
+  std::vector<Float32> dct_transpose_, mel_energy_cache_, energy_cache_;
   FbankComputer fbank_computer;
 };
 
@@ -0,0 +1,404 @@
+// wujian@2018
+
+// Minimal 4 x Float32 vector wrapper, int8 quantization and matrix kernel and
+// int16 conversion: AVX2/SSE2, NEON or plain C++
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "decoder/type.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+
+typedef __m128 Float32x4;
+
+inline Float32x4 Load4(const Float32 *ptr) { return _mm_loadu_ps(ptr); }
+
+inline Float32x4 Set4(Float32 value) { return _mm_set1_ps(value); }
+
+inline void Store4(Float32 *ptr, Float32x4 a) { _mm_storeu_ps(ptr, a); }
+
+inline Float32x4 Add4(Float32x4 a, Float32x4 b) { return _mm_add_ps(a, b); }
+
+inline Float32x4 Sub4(Float32x4 a, Float32x4 b) { return _mm_sub_ps(a, b); }
+
+inline Float32x4 Mul4(Float32x4 a, Float32x4 b) { return _mm_mul_ps(a, b); }
+
+// [a0, a1, a2, a3] => [a1, a0, a3, a2]
+inline Float32x4 SwapPairs4(Float32x4 a) {
+  return _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1));
+}
+
+// [a0, a1, a2, a3] => [-a0, a1, -a2, a3]
+inline Float32x4 NegateEven4(Float32x4 a) {
+  const Int32 sign = static_cast<Int32>(0x80000000);
+  return _mm_xor_ps(a, _mm_castsi128_ps(_mm_set_epi32(0, sign, 0, sign)));
+}
+
+// a[i] <= b[i] ? x[i] : y[i]
+inline Float32x4 SelectLessEqual4(Float32x4 a, Float32x4 b, Float32x4 x,
+                                  Float32x4 y) {
+  Float32x4 mask = _mm_cmple_ps(a, b);
+  return _mm_or_ps(_mm_and_ps(mask, x), _mm_andnot_ps(mask, y));
+}
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+
+typedef float32x4_t Float32x4;
+
+inline Float32x4 Load4(const Float32 *ptr) { return vld1q_f32(ptr); }
+
+inline Float32x4 Set4(Float32 value) { return vdupq_n_f32(value); }
+
+inline void Store4(Float32 *ptr, Float32x4 a) { vst1q_f32(ptr, a); }
+
+inline Float32x4 Add4(Float32x4 a, Float32x4 b) { return vaddq_f32(a, b); }
+
+inline Float32x4 Sub4(Float32x4 a, Float32x4 b) { return vsubq_f32(a, b); }
+
+inline Float32x4 Mul4(Float32x4 a, Float32x4 b) { return vmulq_f32(a, b); }
+
+inline Float32x4 SwapPairs4(Float32x4 a) { return vrev64q_f32(a); }
+
+inline Float32x4 NegateEven4(Float32x4 a) {
+  const Float32 sign[4] = {-1, 1, -1, 1};
+  return vmulq_f32(a, vld1q_f32(sign));
+}
+
+inline Float32x4 SelectLessEqual4(Float32x4 a, Float32x4 b, Float32x4 x,
+                                  Float32x4 y) {
+  return vbslq_f32(vcleq_f32(a, b), x, y);
+}
+
+#else
+
+struct Float32x4 {
+  Float32 v[4];
+};
+
+inline Float32x4 Load4(const Float32 *ptr) {
+  Float32x4 a = {{ptr[0], ptr[1], ptr[2], ptr[3]}};
+  return a;
+}
+
+inline Float32x4 Set4(Float32 value) {
+  Float32x4 a = {{value, value, value, value}};
+  return a;
+}
+
+inline void Store4(Float32 *ptr, Float32x4 a) {
+  for (Int32 i = 0; i < 4; i++) ptr[i] = a.v[i];
+}
+
+inline Float32x4 Add4(Float32x4 a, Float32x4 b) {
+  for (Int32 i = 0; i < 4; i++) a.v[i] += b.v[i];
+  return a;
+}
+
+inline Float32x4 Sub4(Float32x4 a, Float32x4 b) {
+  for (Int32 i = 0; i < 4; i++) a.v[i] -= b.v[i];
+  return a;
+}
+
+inline Float32x4 Mul4(Float32x4 a, Float32x4 b) {
+  for (Int32 i = 0; i < 4; i++) a.v[i] *= b.v[i];
+  return a;
+}
+
+inline Float32x4 SwapPairs4(Float32x4 a) {
+  Float32x4 b = {{a.v[1], a.v[0], a.v[3], a.v[2]}};
+  return b;
+}
+
+inline Float32x4 NegateEven4(Float32x4 a) {
+  a.v[0] = -a.v[0], a.v[2] = -a.v[2];
+  return a;
+}
+
+inline Float32x4 SelectLessEqual4(Float32x4 a, Float32x4 b, Float32x4 x,
+                                  Float32x4 y) {
+  for (Int32 i = 0; i < 4; i++) x.v[i] = a.v[i] <= b.v[i] ? x.v[i] : y.v[i];
+  return x;
+}
+
+#endif
+
+// Two complex values [r0, i0, r1, i1] times [wr0, wr0, wr1, wr1] +
+// i[wi0, wi0, wi1, wi1]
+inline Float32x4 ComplexMul4(Float32x4 a, Float32x4 wr, Float32x4 wi) {
+  return Add4(Mul4(a, wr), NegateEven4(Mul4(SwapPairs4(a), wi)));
+}
+
+// Two complex values times i
+inline Float32x4 ComplexMulI4(Float32x4 a) {
+  return NegateEven4(SwapPairs4(a));
+}
+
+// dst[i] = src[i] for Int16 samples, src needs no alignment
+#if defined(__SSE2__)
+
+inline void Int16ToFloat(const Int16 *src, Int32 n, Float32 *dst) {
+  Int32 i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    // sign extended by shifting the high half of each int32 lane
+    __m128i x0 = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16),
+            x1 = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+    _mm_storeu_ps(dst + i, _mm_cvtepi32_ps(x0));
+    _mm_storeu_ps(dst + i + 4, _mm_cvtepi32_ps(x1));
+  }
+  for (; i < n; i++) dst[i] = src[i];
+}
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+inline void Int16ToFloat(const Int16 *src, Int32 n, Float32 *dst) {
+  Int32 i = 0;
+  for (; i + 8 <= n; i += 8) {
+    int16x8_t x = vld1q_s16(src + i);
+    vst1q_f32(dst + i, vcvtq_f32_s32(vmovl_s16(vget_low_s16(x))));
+    vst1q_f32(dst + i + 4, vcvtq_f32_s32(vmovl_s16(vget_high_s16(x))));
+  }
+  for (; i < n; i++) dst[i] = src[i];
+}
+
+#else
+
+inline void Int16ToFloat(const Int16 *src, Int32 n, Float32 *dst) {
+  for (Int32 i = 0; i < n; i++) dst[i] = src[i];
+}
+
+#endif
+
+// 4 unsigned 16 bits (or 8 bits) values at ptr as floats, ptr needs no
+// alignment (e.g. payloads of compressed matrices in a mapped archive)
+#if defined(__SSE2__)
+
+inline Float32x4 LoadUint16x4(const void *ptr) {
+  __m128i x = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(ptr));
+  return _mm_cvtepi32_ps(_mm_unpacklo_epi16(x, _mm_setzero_si128()));
+}
+
+inline Float32x4 LoadUint8x4(const void *ptr) {
+  Int32 bytes;
+  memcpy(&bytes, ptr, sizeof(bytes));
+  __m128i zero = _mm_setzero_si128(),
+          x = _mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero);
+  return _mm_cvtepi32_ps(_mm_unpacklo_epi16(x, zero));
+}
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+inline Float32x4 LoadUint16x4(const void *ptr) {
+  uint8x8_t x = vld1_u8(static_cast<const UInt08 *>(ptr));
+  return vcvtq_f32_u32(vmovl_u16(vreinterpret_u16_u8(x)));
+}
+
+inline Float32x4 LoadUint8x4(const void *ptr) {
+  UInt32 bytes;
+  memcpy(&bytes, ptr, sizeof(bytes));
+  uint16x8_t x = vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(bytes)));
+  return vcvtq_f32_u32(vmovl_u16(vget_low_u16(x)));
+}
+
+#else
+
+inline Float32x4 LoadUint16x4(const void *ptr) {
+  UInt16 values[4];
+  memcpy(values, ptr, sizeof(values));
+  Float32x4 a;
+  for (Int32 i = 0; i < 4; i++) a.v[i] = values[i];
+  return a;
+}
+
+inline Float32x4 LoadUint8x4(const void *ptr) {
+  const UInt08 *values = static_cast<const UInt08 *>(ptr);
+  Float32x4 a;
+  for (Int32 i = 0; i < 4; i++) a.v[i] = values[i];
+  return a;
+}
+
+#endif
+
+// dst[i] = round(src[i] * inv_scale) clamped to [-127, 127], rounding half to
+// even. The int8 values are kept in int16 lanes, as DotInt8Block() takes them
+inline Int16 QuantizeInt8(Float32 value, Float32 inv_scale) {
+  return std::max(-127.0f, std::min(127.0f, std::nearbyint(value * inv_scale)));
+}
+
+#if defined(__SSE2__)
+
+inline void QuantizeInt8(const Float32 *src, Int32 n, Float32 inv_scale,
+                         Int16 *dst) {
+  const __m128 scale = _mm_set1_ps(inv_scale), upper = _mm_set1_ps(127),
+               lower = _mm_set1_ps(-127);
+  Int32 i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128 x0 = _mm_mul_ps(_mm_loadu_ps(src + i), scale),
+           x1 = _mm_mul_ps(_mm_loadu_ps(src + i + 4), scale);
+    x0 = _mm_max_ps(_mm_min_ps(x0, upper), lower);
+    x1 = _mm_max_ps(_mm_min_ps(x1, upper), lower);
+    __m128i q = _mm_packs_epi32(_mm_cvtps_epi32(x0), _mm_cvtps_epi32(x1));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), q);
+  }
+  for (; i < n; i++) dst[i] = QuantizeInt8(src[i], inv_scale);
+}
+
+#else
+
+inline void QuantizeInt8(const Float32 *src, Int32 n, Float32 inv_scale,
+                         Int16 *dst) {
+  for (Int32 i = 0; i < n; i++) dst[i] = QuantizeInt8(src[i], inv_scale);
+}
+
+#endif
+
+// dot[r * ldd + o] = sum of a[r * lda + k] * b[o * ldb + k] (k < n), for R
+// rows of int8 activations (in int16 lanes, from QuantizeInt8()) and O rows of
+// int8 weights. Weights are widened to int16 as they are loaded, and each
+// loaded vector is used R (weights) or O (activations) times. Products are
+// added into int32 lanes (AVX512-VNNI vpdpwssd, AVX2/SSE2 madd, NEON vmlal),
+// so no overflow for n < 2^16
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+// Sum of 8 int32 lanes
+inline Int32 HorizontalSum8(__m256i sum) {
+  __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum),
+                               _mm256_extracti128_si256(sum, 1));
+  half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+  half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(half);
+}
+
+// sum + pairwise x[i] * y[i]
+inline __m256i MaddInt16(__m256i sum, __m256i x, __m256i y) {
+#if defined(__AVX512VNNI__) && defined(__AVX512VL__)
+  return _mm256_dpwssd_epi32(sum, x, y);
+#else
+  return _mm256_add_epi32(sum, _mm256_madd_epi16(x, y));
+#endif
+}
+
+template <Int32 R, Int32 O>
+inline void DotInt8Block(const Int16 *a, Int32 lda, const Int08 *b, Int32 ldb,
+                         Int32 n, Int32 *dot, Int32 ldd) {
+  __m256i sum[R][O];
+  for (Int32 r = 0; r < R; r++)
+    for (Int32 o = 0; o < O; o++) sum[r][o] = _mm256_setzero_si256();
+  Int32 k = 0;
+  for (; k + 16 <= n; k += 16) {
+    __m256i w[O];
+    for (Int32 o = 0; o < O; o++)
+      w[o] = _mm256_cvtepi8_epi16(
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + o * ldb + k)));
+    for (Int32 r = 0; r < R; r++) {
+      __m256i x = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i *>(a + r * lda + k));
+      for (Int32 o = 0; o < O; o++) sum[r][o] = MaddInt16(sum[r][o], x, w[o]);
+    }
+  }
+  for (Int32 r = 0; r < R; r++) {
+    for (Int32 o = 0; o < O; o++) {
+      Int32 value = HorizontalSum8(sum[r][o]);
+      for (Int32 i = k; i < n; i++) value += a[r * lda + i] * b[o * ldb + i];
+      dot[r * ldd + o] = value;
+    }
+  }
+}
+
+#elif defined(__SSE2__)
+
+template <Int32 R, Int32 O>
+inline void DotInt8Block(const Int16 *a, Int32 lda, const Int08 *b, Int32 ldb,
+                         Int32 n, Int32 *dot, Int32 ldd) {
+  __m128i sum[R][O];
+  for (Int32 r = 0; r < R; r++)
+    for (Int32 o = 0; o < O; o++) sum[r][o] = _mm_setzero_si128();
+  Int32 k = 0;
+  for (; k + 16 <= n; k += 16) {
+    // sign extended by shifting the high byte of each int16 lane
+    __m128i w[O][2];
+    for (Int32 o = 0; o < O; o++) {
+      __m128i y =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + o * ldb + k));
+      w[o][0] = _mm_srai_epi16(_mm_unpacklo_epi8(y, y), 8);
+      w[o][1] = _mm_srai_epi16(_mm_unpackhi_epi8(y, y), 8);
+    }
+    for (Int32 r = 0; r < R; r++) {
+      const __m128i *x = reinterpret_cast<const __m128i *>(a + r * lda + k);
+      __m128i x0 = _mm_loadu_si128(x), x1 = _mm_loadu_si128(x + 1);
+      for (Int32 o = 0; o < O; o++) {
+        sum[r][o] = _mm_add_epi32(sum[r][o], _mm_madd_epi16(x0, w[o][0]));
+        sum[r][o] = _mm_add_epi32(sum[r][o], _mm_madd_epi16(x1, w[o][1]));
+      }
+    }
+  }
+  for (Int32 r = 0; r < R; r++) {
+    for (Int32 o = 0; o < O; o++) {
+      __m128i s = sum[r][o];
+      s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+      s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+      Int32 value = _mm_cvtsi128_si32(s);
+      for (Int32 i = k; i < n; i++) value += a[r * lda + i] * b[o * ldb + i];
+      dot[r * ldd + o] = value;
+    }
+  }
+}
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+template <Int32 R, Int32 O>
+inline void DotInt8Block(const Int16 *a, Int32 lda, const Int08 *b, Int32 ldb,
+                         Int32 n, Int32 *dot, Int32 ldd) {
+  int32x4_t sum[R][O];
+  for (Int32 r = 0; r < R; r++)
+    for (Int32 o = 0; o < O; o++) sum[r][o] = vdupq_n_s32(0);
+  Int32 k = 0;
+  for (; k + 8 <= n; k += 8) {
+    int16x8_t w[O];
+    for (Int32 o = 0; o < O; o++) w[o] = vmovl_s8(vld1_s8(b + o * ldb + k));
+    for (Int32 r = 0; r < R; r++) {
+      int16x8_t x = vld1q_s16(a + r * lda + k);
+      for (Int32 o = 0; o < O; o++) {
+        sum[r][o] =
+            vmlal_s16(sum[r][o], vget_low_s16(x), vget_low_s16(w[o]));
+        sum[r][o] =
+            vmlal_s16(sum[r][o], vget_high_s16(x), vget_high_s16(w[o]));
+      }
+    }
+  }
+  for (Int32 r = 0; r < R; r++) {
+    for (Int32 o = 0; o < O; o++) {
+      int32x4_t s = sum[r][o];
+      Int32 value = vgetq_lane_s32(s, 0) + vgetq_lane_s32(s, 1) +
+                    vgetq_lane_s32(s, 2) + vgetq_lane_s32(s, 3);
+      for (Int32 i = k; i < n; i++) value += a[r * lda + i] * b[o * ldb + i];
+      dot[r * ldd + o] = value;
+    }
+  }
+}
+
+#else
+
+template <Int32 R, Int32 O>
+inline void DotInt8Block(const Int16 *a, Int32 lda, const Int08 *b, Int32 ldb,
+                         Int32 n, Int32 *dot, Int32 ldd) {
+  for (Int32 r = 0; r < R; r++) {
+    for (Int32 o = 0; o < O; o++) {
+      Int32 value = 0;
+      for (Int32 i = 0; i < n; i++) value += a[r * lda + i] * b[o * ldb + i];
+      dot[r * ldd + o] = value;
+    }
+  }
+}
+
+#endif
+
+#endif
@@ -110,6 +110,8 @@ class SimpleFst {
 
   UInt64 NumArcs(StateId state) const { return states_[state]->NumArcs(); }
 
+  const Arc *Arcs(StateId state) const { return states_[state]->Arcs(); }
+
   void SetStart(StateId state) { start_ = state; }
 
   void SetFinal(StateId state, Weight weight) {
@@ -160,7 +162,8 @@ for (StateIterator siter(fst);
 */
 class StateIterator {
  public:
-  StateIterator(const SimpleFst &fst)
+  template <class FST>
+  StateIterator(const FST &fst)
       : cur_state_(0), num_states_(fst.NumStates()) {}
 
   bool Done() { return cur_state_ >= num_states_; }
@@ -183,12 +186,13 @@ for(ArcIterator aiter(fst, s);
     ...
 }
 */
+// Works for any graph which keeps arcs of a state contiguous, egs:
+// SimpleFst/ConstFst
 class ArcIterator {
  public:
-  ArcIterator(const SimpleFst &fst, StateId state)
-      : cur_arc_(0),
-        num_arcs_(fst.NumArcs(state)),
-        arc_ptr_(fst.GetState(state)->Arcs()) {}
+  template <class FST>
+  ArcIterator(const FST &fst, StateId state)
+      : cur_arc_(0), num_arcs_(fst.NumArcs(state)), arc_ptr_(fst.Arcs(state)) {}
 
   bool Done() { return cur_arc_ >= num_arcs_; }
 
@@ -203,6 +207,10 @@ class ArcIterator {
   const Arc *arc_ptr_;
 };
 
+void ReadBinaryArc(std::istream &is, Arc *arc);
+
+void WriteBinaryArc(std::ostream &os, Arc arc);
+
 void ReadSimpleFst(const std::string &filename, SimpleFst *fst);
 
 #endif
\ No newline at end of file
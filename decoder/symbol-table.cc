@@ -0,0 +1,125 @@
+// wujian@2018
+
+#include "decoder/symbol-table.h"
+
+#include <sstream>
+
+void SymbolTable::SetPointers() {
+  if (own_offsets_.empty()) own_offsets_.push_back(0);
+  num_symbols_ = own_offsets_.size() - 1;
+  offsets_ = own_offsets_.data();
+  chars_ = own_chars_.data();
+}
+
+void SymbolTable::ReadText(std::istream &is) {
+  std::vector<std::string> symbols;
+  std::string line, symbol, rest;
+  Int64 id;
+  UInt64 num_lines = 0;
+  while (std::getline(is, line)) {
+    num_lines++;
+    std::istringstream iss(line);
+    if (!(iss >> symbol)) continue;
+    if (!(iss >> id) || (iss >> rest) || id < 0 ||
+        id >= std::numeric_limits<Int32>::max())
+      LOG_FAIL << "Format error at line " << num_lines << ": " << line;
+    if (id >= symbols.size()) symbols.resize(id + 1);
+    if (!symbols[id].empty())
+      LOG_FAIL << "Duplicated id " << id << " at line " << num_lines;
+    symbols[id] = symbol;
+  }
+  if (mapped_) delete mapped_;
+  mapped_ = NULL;
+  own_offsets_.resize(symbols.size() + 1);
+  own_chars_.clear();
+  for (Int32 i = 0; i < symbols.size(); i++) {
+    own_offsets_[i] = own_chars_.size();
+    own_chars_.insert(own_chars_.end(), symbols[i].begin(), symbols[i].end());
+    own_chars_.push_back('\0');
+  }
+  own_offsets_.back() = own_chars_.size();
+  SetPointers();
+  LOG_INFO << "Read symbol table, " << num_symbols_ << " symbols";
+}
+
+void SymbolTable::Write(std::ostream &os) const {
+  SymbolTableHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kSymbolTableMagic, sizeof(header.magic));
+  header.version = kSymbolTableVersion;
+  header.num_symbols = num_symbols_;
+  header.num_chars = offsets_[num_symbols_];
+  WriteBinary(os, reinterpret_cast<const char *>(&header), sizeof(header));
+  WriteBinary(os, reinterpret_cast<const char *>(offsets_),
+              sizeof(UInt64) * (num_symbols_ + 1));
+  WriteBinary(os, chars_, header.num_chars);
+  LOG_INFO << "Write symbol table, " << num_symbols_ << " symbols";
+}
+
+void SymbolTable::Map(const std::string &fname) {
+  MappedFile *mapped = new MappedFile(fname);
+  if (mapped->Size() < sizeof(SymbolTableHeader))
+    LOG_FAIL << "File " << fname << " is too small to be a SymbolTable";
+  const char *base = mapped->Data();
+  const SymbolTableHeader *header =
+      reinterpret_cast<const SymbolTableHeader *>(base);
+  if (memcmp(header->magic, kSymbolTableMagic, sizeof(header->magic)) != 0)
+    LOG_FAIL << "File " << fname << " is not in SymbolTable format";
+  if (header->version != kSymbolTableVersion)
+    LOG_FAIL << "Unsupported SymbolTable version " << header->version
+             << ", expect " << kSymbolTableVersion;
+  UInt64 chars_offset =
+      sizeof(SymbolTableHeader) + (header->num_symbols + 1) * sizeof(UInt64);
+  if (header->num_symbols < 0 ||
+      chars_offset + header->num_chars > mapped->Size())
+    LOG_FAIL << "Bad layout of SymbolTable " << fname << ", file truncated?";
+  const UInt64 *offsets =
+      reinterpret_cast<const UInt64 *>(base + sizeof(SymbolTableHeader));
+  if (offsets[header->num_symbols] != header->num_chars ||
+      (header->num_chars && base[chars_offset + header->num_chars - 1]))
+    LOG_FAIL << "Check symbols of SymbolTable " << fname << " failed";
+  if (mapped_) delete mapped_;
+  mapped_ = mapped;
+  own_offsets_.clear();
+  own_chars_.clear();
+  num_symbols_ = header->num_symbols;
+  offsets_ = offsets;
+  chars_ = base + chars_offset;
+  LOG_INFO << "Map symbol table, " << num_symbols_ << " symbols";
+}
+
+void SymbolTable::Load(const std::string &fname) {
+  if (IsSymbolTable(fname)) {
+    Map(fname);
+  } else {
+    BinaryInput bi(fname);
+    ReadText(bi.Stream());
+  }
+}
+
+void SymbolTable::Join(const std::vector<Int32> &ids, std::string *str,
+                       const char *sep) const {
+  ASSERT(str);
+  for (Int32 i = 0; i < ids.size(); i++) {
+    if (i) str->append(sep);
+    str->append(Symbol(ids[i]));
+  }
+}
+
+Bool IsSymbolTable(const std::string &filename) {
+  BinaryInput bi(filename);
+  char magic[sizeof(kSymbolTableMagic)];
+  bi.Stream().read(magic, sizeof(magic));
+  if (bi.Stream().gcount() != sizeof(magic)) return false;
+  return memcmp(magic, kSymbolTableMagic, sizeof(magic)) == 0;
+}
+
+void ReadSymbolTable(const std::string &filename, SymbolTable *symbols) {
+  ASSERT(symbols);
+  symbols->Load(filename);
+}
+
+void WriteSymbolTable(const std::string &filename, const SymbolTable &symbols) {
+  BinaryOutput bo(filename);
+  symbols.Write(bo.Stream());
+}
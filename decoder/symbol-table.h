@@ -0,0 +1,94 @@
+// wujian@2018
+
+// Word symbol table (words.txt) with mmap-able binary format
+
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+
+#include "decoder/common.h"
+#include "decoder/io.h"
+
+// On-disk layout of SymbolTable (native endian):
+// SymbolTableHeader | UInt64 offsets x (num_symbols + 1) | chars
+// Symbol of id i is chars[offsets[i]: offsets[i + 1]], terminated by '\0', so
+// the file could be mmaped and symbols returned in place without any copy.
+const char kSymbolTableMagic[8] = {'S', 'Y', 'M', 'T', 'A', 'B', 'L', 'E'};
+const UInt32 kSymbolTableVersion = 1;
+
+struct SymbolTableHeader {
+  char magic[8];
+  UInt32 version;
+  Int32 num_symbols;
+  UInt64 num_chars;
+};
+
+// Map word ids to strings in O(1). Ids not present in words.txt map to ""
+// egs:
+// SymbolTable symbols("words.bin");  // or "words.txt"
+// std::string text = symbols.Join(word_ids);
+class SymbolTable {
+ public:
+  SymbolTable() : mapped_(NULL) { SetPointers(); }
+
+  // Load symbols from file, see ReadSymbolTable()
+  SymbolTable(const std::string &fname) : mapped_(NULL) { Load(fname); }
+
+  ~SymbolTable() {
+    if (mapped_) delete mapped_;
+  }
+
+  // Read text format of Kaldi/OpenFst: "<symbol> <id>" on each line
+  void ReadText(std::istream &is);
+
+  // Write in binary SymbolTable format
+  void Write(std::ostream &os) const;
+
+  // Map file in binary SymbolTable format, no parsing and no copy
+  void Map(const std::string &fname);
+
+  // Map if fname is in binary format, otherwise read as text format
+  void Load(const std::string &fname);
+
+  Bool IsMapped() const { return mapped_ != NULL; }
+
+  // Number of ids, i.e. max id + 1
+  Int32 NumSymbols() const { return num_symbols_; }
+
+  const char *Symbol(Int32 id) const {
+    ASSERT(id >= 0 && id < num_symbols_);
+    return chars_ + offsets_[id];
+  }
+
+  // Symbols of ids joined by sep, appended to str
+  void Join(const std::vector<Int32> &ids, std::string *str,
+            const char *sep = " ") const;
+
+  std::string Join(const std::vector<Int32> &ids, const char *sep = " ") const {
+    std::string str;
+    Join(ids, &str, sep);
+    return str;
+  }
+
+ private:
+  SymbolTable(const SymbolTable &) = delete;
+  SymbolTable &operator=(const SymbolTable &) = delete;
+
+  // Point to own_* buffers
+  void SetPointers();
+
+  Int32 num_symbols_;
+  // Point to own_* or mapped memory
+  const UInt64 *offsets_;
+  const char *chars_;
+  std::vector<UInt64> own_offsets_;
+  std::vector<char> own_chars_;
+  MappedFile *mapped_;
+};
+
+Bool IsSymbolTable(const std::string &filename);
+
+void ReadSymbolTable(const std::string &filename, SymbolTable *symbols);
+
+void WriteSymbolTable(const std::string &filename, const SymbolTable &symbols);
+
+#endif
@@ -0,0 +1,409 @@
+// wujian@2018
+
+#include "decoder/tdnn.h"
+#include "decoder/simd.h"
+
+const Float32 kInt8Range = 127;
+
+// Kaldi's Matrix<BaseFloat>::Write in binary mode
+static void ReadMatrix(std::istream &is, std::vector<Float32> *data,
+                       Int32 *num_rows, Int32 *num_cols) {
+  ExpectToken(is, "FM");
+  ReadBinaryBasicType(is, num_rows);
+  ReadBinaryBasicType(is, num_cols);
+  data->resize(*num_rows * *num_cols);
+  ReadBinary(is, reinterpret_cast<char *>(data->data()),
+             sizeof(Float32) * data->size());
+}
+
+// Kaldi's Vector<BaseFloat>::Write in binary mode
+static void ReadVector(std::istream &is, std::vector<Float32> *data) {
+  Int32 dim;
+  ExpectToken(is, "FV");
+  ReadBinaryBasicType(is, &dim);
+  data->resize(dim);
+  ReadBinary(is, reinterpret_cast<char *>(data->data()),
+             sizeof(Float32) * dim);
+}
+
+static void WriteVector(std::ostream &os, const std::vector<Float32> &data) {
+  WriteToken(os, "FV");
+  WriteBinaryBasicType(os, static_cast<Int32>(data.size()));
+  WriteBinary(os, reinterpret_cast<const char *>(data.data()),
+              sizeof(Float32) * data.size());
+}
+
+// Round to int8 in [-127, 127]
+static inline Int08 QuantizeValue(Float32 value, Float32 inv_scale) {
+  Float32 q = std::round(value * inv_scale);
+  return static_cast<Int08>(std::max(-kInt8Range, std::min(kInt8Range, q)));
+}
+
+Tdnn::Tdnn(const std::string &param, const std::string &context,
+           Bool quantize)
+    : calibrating_(false), output_step_(1) {
+  ReadParams(param);
+  ParseContext(context);
+  if (quantize) Quantize();
+  Reset();
+}
+
+void Tdnn::ReadParams(const std::string &param) {
+  BinaryInput bi(param);
+  std::istream &is = bi.Stream();
+  std::string token;
+  while (is >> token) {
+    // consume space
+    is.get();
+    TdnnLayer layer;
+    layer.input_dim = layer.output_dim = 0;
+    layer.history_rows = 0;
+    layer.int8 = false;
+    layer.input_scale = layer.input_range = 0;
+    if (token == "QLinear") {
+      layer.type = kLinear;
+      layer.int8 = true;
+      ReadBinaryBasicType(is, &layer.input_scale);
+      ExpectToken(is, "QM");
+      ReadBinaryBasicType(is, &layer.output_dim);
+      ReadBinaryBasicType(is, &layer.input_dim);
+      layer.qweight.resize(layer.output_dim * layer.input_dim);
+      ReadBinary(is, reinterpret_cast<char *>(layer.qweight.data()),
+                 layer.qweight.size());
+      ReadVector(is, &layer.qscale);
+      ReadVector(is, &layer.bias);
+      if (layer.qscale.size() != layer.output_dim ||
+          layer.bias.size() != layer.output_dim)
+        LOG_FAIL << "Size of scale/bias mismatch with weight in QLinear layer";
+    } else if (token == "Linear") {
+      layer.type = kLinear;
+      std::vector<Float32> weight;
+      Int32 num_rows, num_cols;
+      ReadMatrix(is, &weight, &num_rows, &num_cols);
+      ReadVector(is, &layer.bias);
+      if (layer.bias.size() != num_rows)
+        LOG_FAIL << "Size of bias mismatch with weight in Linear layer "
+                 << layer.bias.size() << " vs " << num_rows;
+      // num_cols x num_rows
+      layer.weight.resize(weight.size());
+      for (Int32 r = 0; r < num_rows; r++)
+        for (Int32 c = 0; c < num_cols; c++)
+          layer.weight[c * num_rows + r] = weight[r * num_cols + c];
+      layer.input_dim = num_cols, layer.output_dim = num_rows;
+    } else if (token == "BatchNorm") {
+      layer.type = kBatchNorm;
+      ReadVector(is, &layer.weight);
+      ReadVector(is, &layer.bias);
+      if (layer.weight.size() != layer.bias.size())
+        LOG_FAIL << "Size of scale mismatch with offset in BatchNorm layer";
+    } else if (token == "ReLU") {
+      layer.type = kReLU;
+    } else if (token == "LogSoftmax") {
+      layer.type = kLogSoftmax;
+    } else {
+      LOG_FAIL << "Unknown component in " << param << ": " << token;
+    }
+    if (layers_.empty() && layer.type != kLinear)
+      LOG_FAIL << "The first component of " << param << " should be Linear";
+    layers_.push_back(layer);
+  }
+  if (layers_.empty()) LOG_FAIL << "No components in " << param;
+}
+
+void Tdnn::ParseContext(const std::string &context) {
+  std::istringstream iss(context);
+  std::string layer_context;
+  std::vector<TdnnLayer *> linear_layers;
+  for (Int32 i = 0; i < layers_.size(); i++) {
+    if (layers_[i].type != kLinear) continue;
+    linear_layers.push_back(&layers_[i]);
+    last_linear_ = i;
+  }
+  Int32 num_linear = 0, frame_dim = 0;
+  left_context_ = right_context_ = 0;
+  while (std::getline(iss, layer_context, ';')) {
+    if (num_linear == linear_layers.size())
+      LOG_FAIL << "More layers in context \"" << context << "\" than "
+               << linear_layers.size() << " Linear layers";
+    TdnnLayer &layer = *linear_layers[num_linear];
+    std::istringstream offsets(layer_context);
+    std::string offset;
+    while (std::getline(offsets, offset, ','))
+      layer.offsets.push_back(std::stoi(offset));
+    if (layer.offsets.empty() ||
+        !std::is_sorted(layer.offsets.begin(), layer.offsets.end()))
+      LOG_FAIL << "Context of layer " << num_linear
+               << " should be ascending offsets: " << layer_context;
+    Int32 num_offsets = layer.offsets.size();
+    if (layer.input_dim % num_offsets)
+      LOG_FAIL << "Input dimention of Linear layer " << num_linear << " ("
+               << layer.input_dim << ") mismatch with context "
+               << layer_context;
+    // dimention of one spliced frame
+    Int32 input_dim = layer.input_dim / num_offsets;
+    if (num_linear && input_dim != frame_dim)
+      LOG_FAIL << "Input dimention of Linear layer " << num_linear
+               << " mismatch: expected " << frame_dim * num_offsets << ", get "
+               << layer.input_dim;
+    if (!num_linear) input_dim_ = input_dim;
+    frame_dim = layer.output_dim;
+    left_context_ -= layer.offsets.front();
+    right_context_ += layer.offsets.back();
+    num_linear++;
+  }
+  if (num_linear != linear_layers.size())
+    LOG_FAIL << "Context \"" << context << "\" gives " << num_linear
+             << " layers, but " << linear_layers.size() << " Linear layers";
+  output_dim_ = frame_dim;
+  for (TdnnLayer &layer : layers_) {
+    if (layer.type == kLinear) {
+      frame_dim = layer.output_dim;
+    } else if (layer.type == kBatchNorm && layer.weight.size() != frame_dim) {
+      LOG_FAIL << "Dimention of BatchNorm mismatch: " << layer.weight.size()
+               << " vs " << frame_dim;
+    }
+  }
+}
+
+void Tdnn::Reset() {
+  for (TdnnLayer &layer : layers_) layer.history_rows = 0;
+}
+
+void Tdnn::Calibrate(const Float32 *feats, Int32 feat_stride,
+                     Int32 num_frames) {
+  std::vector<Float32> loglikes(num_frames * output_dim_);
+  calibrating_ = true;
+  Compute(feats, feat_stride, num_frames, loglikes.data(), output_dim_);
+  calibrating_ = false;
+}
+
+void Tdnn::Quantize() {
+  for (TdnnLayer &layer : layers_) {
+    if (layer.type != kLinear || layer.int8) continue;
+    Int32 input_dim = layer.input_dim, output_dim = layer.output_dim;
+    layer.qweight.resize(output_dim * input_dim);
+    layer.qscale.resize(output_dim);
+    for (Int32 o = 0; o < output_dim; o++) {
+      Float32 range = 0;
+      for (Int32 i = 0; i < input_dim; i++)
+        range = std::max(range, std::abs(layer.weight[i * output_dim + o]));
+      Float32 scale = range > 0 ? range / kInt8Range : 1;
+      layer.qscale[o] = scale;
+      for (Int32 i = 0; i < input_dim; i++)
+        layer.qweight[o * input_dim + i] =
+            QuantizeValue(layer.weight[i * output_dim + o], 1 / scale);
+    }
+    layer.input_scale = layer.input_range / kInt8Range;
+    layer.int8 = true;
+    std::vector<Float32>().swap(layer.weight);
+  }
+}
+
+void Tdnn::Write(const std::string &param) {
+  BinaryOutput bo(param);
+  std::ostream &os = bo.Stream();
+  for (const TdnnLayer &layer : layers_) {
+    switch (layer.type) {
+      case kLinear:
+        if (layer.int8) {
+          WriteToken(os, "QLinear");
+          WriteBinaryBasicType(os, layer.input_scale);
+          WriteToken(os, "QM");
+          WriteBinaryBasicType(os, layer.output_dim);
+          WriteBinaryBasicType(os, layer.input_dim);
+          WriteBinary(os, reinterpret_cast<const char *>(layer.qweight.data()),
+                      layer.qweight.size());
+          WriteVector(os, layer.qscale);
+        } else {
+          WriteToken(os, "Linear");
+          WriteToken(os, "FM");
+          WriteBinaryBasicType(os, layer.output_dim);
+          WriteBinaryBasicType(os, layer.input_dim);
+          std::vector<Float32> weight(layer.weight.size());
+          for (Int32 o = 0; o < layer.output_dim; o++)
+            for (Int32 i = 0; i < layer.input_dim; i++)
+              weight[o * layer.input_dim + i] =
+                  layer.weight[i * layer.output_dim + o];
+          WriteBinary(os, reinterpret_cast<const char *>(weight.data()),
+                      sizeof(Float32) * weight.size());
+        }
+        WriteVector(os, layer.bias);
+        break;
+      case kBatchNorm:
+        WriteToken(os, "BatchNorm");
+        WriteVector(os, layer.weight);
+        WriteVector(os, layer.bias);
+        break;
+      case kReLU:
+        WriteToken(os, "ReLU");
+        break;
+      case kLogSoftmax:
+        WriteToken(os, "LogSoftmax");
+        break;
+    }
+  }
+}
+
+void Tdnn::Compute(const Float32 *feats, Int32 feat_stride, Int32 num_frames,
+                   Float32 *loglikes, Int32 loglike_stride) {
+  Reset();
+  Int32 num_output = AcceptFrames(
+      feats, feat_stride, left_context_ + num_frames + right_context_,
+      loglikes, loglike_stride);
+  ASSERT(num_output == num_frames);
+  Reset();
+}
+
+void Tdnn::ComputeSubsampled(const Float32 *feats, Int32 feat_stride,
+                             Int32 num_frames, Int32 step, Float32 *loglikes,
+                             Int32 loglike_stride) {
+  ASSERT(step >= 1);
+  Reset();
+  output_step_ = step;
+  Int32 num_output = AcceptFrames(
+      feats, feat_stride, left_context_ + num_frames + right_context_,
+      loglikes, loglike_stride);
+  output_step_ = 1;
+  ASSERT(num_output == (num_frames + step - 1) / step);
+  Reset();
+}
+
+void Tdnn::AffineTransform(TdnnLayer &layer, const Float32 *input,
+                           Int32 stride, Int32 num_rows) {
+  if (calibrating_) {
+    for (Int32 t = 0; t < num_rows; t++)
+      for (Int32 i = 0; i < layer.input_dim; i++)
+        layer.input_range =
+            std::max(layer.input_range, std::abs(input[t * stride + i]));
+  }
+  if (layer.int8) {
+    AffineTransformInt8(layer, input, stride, num_rows);
+    return;
+  }
+  Float32 *output = layer.output.data();
+  MatrixMultiply(input, stride, layer.weight.data(), layer.output_dim, output,
+                 layer.output_dim, num_rows, layer.input_dim, layer.output_dim);
+  for (Int32 t = 0; t < num_rows; t++)
+    for (Int32 d = 0; d < layer.output_dim; d++)
+      output[t * layer.output_dim + d] += layer.bias[d];
+}
+
+void Tdnn::AffineTransformInt8(TdnnLayer &layer, const Float32 *input,
+                               Int32 stride, Int32 num_rows) {
+  Int32 input_dim = layer.input_dim, output_dim = layer.output_dim;
+  Float32 scale = layer.input_scale;
+  if (scale <= 0) {
+    Float32 range = 0;
+    for (Int32 t = 0; t < num_rows; t++)
+      for (Int32 i = 0; i < input_dim; i++)
+        range = std::max(range, std::abs(input[t * stride + i]));
+    scale = range > 0 ? range / kInt8Range : 1;
+  }
+  layer.qinput.resize(num_rows * input_dim);
+  layer.qoutput.resize(num_rows * output_dim);
+  Int16 *qinput = layer.qinput.data();
+  Int32 *qoutput = layer.qoutput.data();
+  for (Int32 t = 0; t < num_rows; t++)
+    QuantizeInt8(input + t * stride, input_dim, 1 / scale,
+                 qinput + t * input_dim);
+  MatrixMultiplyInt8(qinput, input_dim, layer.qweight.data(), input_dim,
+                     qoutput, output_dim, num_rows, input_dim, output_dim);
+  Float32 *output = layer.output.data();
+  const Float32 *qscale = layer.qscale.data(), *bias = layer.bias.data();
+  for (Int32 t = 0; t < num_rows; t++)
+    for (Int32 o = 0; o < output_dim; o++)
+      output[t * output_dim + o] =
+          qoutput[t * output_dim + o] * (scale * qscale[o]) + bias[o];
+}
+
+Int32 Tdnn::ForwardLinear(TdnnLayer *layer, const Float32 *input,
+                          Int32 stride, Int32 num_rows, Int32 step) {
+  Int32 num_offsets = layer->offsets.size(),
+        frame_dim = layer->input_dim / num_offsets,
+        width = layer->offsets.back() - layer->offsets.front();
+  layer->output.resize(num_rows * layer->output_dim);
+  // no context, use input directly
+  if (width == 0) {
+    num_rows = (num_rows + step - 1) / step;
+    AffineTransform(*layer, input, stride * step, num_rows);
+    return num_rows;
+  }
+  // append input rows to history
+  layer->history.resize((layer->history_rows + num_rows) * frame_dim);
+  for (Int32 r = 0; r < num_rows; r++)
+    memcpy(layer->history.data() + (layer->history_rows + r) * frame_dim,
+           input + r * stride, sizeof(Float32) * frame_dim);
+  layer->history_rows += num_rows;
+  Int32 num_output = layer->history_rows - width;
+  if (num_output <= 0) return 0;
+  // rows 0, step, 2 * step ... of all the num_output rows
+  Int32 num_computed = (num_output + step - 1) / step;
+
+  const Float32 *history = layer->history.data(), *spliced = history;
+  Int32 spliced_stride = frame_dim;
+  // row t of spliced inputs is frames t + offsets - offsets[0] of history,
+  // just a window of history if offsets are consecutive
+  if (width + 1 != num_offsets) {
+    layer->splice.resize(num_computed * layer->input_dim);
+    for (Int32 t = 0; t < num_computed; t++)
+      for (Int32 i = 0; i < num_offsets; i++)
+        memcpy(layer->splice.data() + t * layer->input_dim + i * frame_dim,
+               history + (t * step + layer->offsets[i] - layer->offsets[0]) *
+                             frame_dim,
+               sizeof(Float32) * frame_dim);
+    spliced = layer->splice.data();
+    spliced_stride = layer->input_dim;
+  } else {
+    spliced_stride *= step;
+  }
+  layer->output.resize(num_computed * layer->output_dim);
+  AffineTransform(*layer, spliced, spliced_stride, num_computed);
+  // keep last width rows for next call
+  memmove(layer->history.data(), history + num_output * frame_dim,
+          sizeof(Float32) * width * frame_dim);
+  layer->history_rows = width;
+  return num_computed;
+}
+
+Int32 Tdnn::AcceptFrames(const Float32 *feats, Int32 feat_stride,
+                         Int32 num_frames, Float32 *loglikes,
+                         Int32 loglike_stride) {
+  const Float32 *input = feats;
+  Int32 stride = feat_stride, num_rows = num_frames, dim = input_dim_;
+  // rows after the first Linear layer could be modified in place
+  Float32 *rows = NULL;
+  for (Int32 l = 0; l < layers_.size(); l++) {
+    TdnnLayer &layer = layers_[l];
+    switch (layer.type) {
+      case kLinear:
+        num_rows = ForwardLinear(&layer, input, stride, num_rows,
+                                 l == last_linear_ ? output_step_ : 1);
+        rows = layer.output.data();
+        input = rows, stride = dim = layer.output_dim;
+        break;
+      case kBatchNorm:
+        for (Int32 t = 0; t < num_rows; t++)
+          for (Int32 d = 0; d < dim; d++)
+            rows[t * dim + d] =
+                rows[t * dim + d] * layer.weight[d] + layer.bias[d];
+        break;
+      case kReLU:
+        for (Int32 i = 0; i < num_rows * dim; i++)
+          rows[i] = std::max(rows[i], 0.0f);
+        break;
+      case kLogSoftmax:
+        for (Int32 t = 0; t < num_rows; t++) {
+          Float32 *row = rows + t * dim;
+          Float32 max = *std::max_element(row, row + dim), sum = 0;
+          for (Int32 d = 0; d < dim; d++) sum += expf(row[d] - max);
+          Float32 log_sum = max + logf(sum);
+          for (Int32 d = 0; d < dim; d++) row[d] -= log_sum;
+        }
+        break;
+    }
+  }
+  for (Int32 t = 0; t < num_rows; t++)
+    memcpy(loglikes + t * loglike_stride, rows + t * dim,
+           sizeof(Float32) * dim);
+  return num_rows;
+}
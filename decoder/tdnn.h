@@ -0,0 +1,137 @@
+// wujian@2018
+
+// TDNN forward pass on parameters exported by copy-nnet3-linear-params
+
+#ifndef TDNN_H
+#define TDNN_H
+
+#include "decoder/common.h"
+#include "decoder/pipeline.h"
+
+// Components of the parameter file, egs: Linear BatchNorm ReLU ... LogSoftmax
+enum TdnnLayerType { kLinear, kBatchNorm, kReLU, kLogSoftmax };
+
+// Parameters are read from the output of copy-nnet3-linear-params: a
+// sequence of tokens "Linear" (FM weight, FV bias), "BatchNorm" (FV scale, FV
+// offset), "ReLU" and "LogSoftmax". The frame offsets spliced by each Linear
+// layer are given by context, same as python/example/kaldi_helper/tdnn.py,
+// egs: "-2,-1,0,1,2;0;-1,0,2;-3,0,3;-7,0,2;-3,0,3;0;0".
+//
+// Linear layers are GEMMs over all the frames of a call: rows of the layer
+// input are spliced once (not at all if offsets are consecutive, the window is
+// read in place), then multiplied by the transposed weight.
+//
+// Int8 mode (Quantize(), or "QLinear" layers in file): weights of Linear
+// layers are int8 with one scale per output channel, inputs are int8 with one
+// scale per layer, from Calibrate() on some features or worked out from the
+// rows of each call if not calibrated. Accumulation is exact in int32,
+// bias/BatchNorm/ReLU/LogSoftmax stay in float. Write() saves quantized
+// layers as "QLinear" (act_scale, QM int8 weight, FV scales, FV bias), about
+// 1/4 of float size.
+//
+// Two ways to use:
+//  1) Compute() of AcousticModel: features with LeftContext()/RightContext()
+//     frames padded, nothing kept between calls
+//  2) streaming: AcceptFrames() any number of (padded) frames, the last rows
+//     of each Linear layer input are cached, so frames are never computed
+//     twice. Reset() for next utterance
+class Tdnn : public AcousticModel {
+ public:
+  // Quantize after loading if quantize = true
+  Tdnn(const std::string &param, const std::string &context,
+       Bool quantize = false);
+
+  Int32 InputDim() { return input_dim_; }
+
+  Int32 OutputDim() { return output_dim_; }
+
+  Int32 LeftContext() { return left_context_; }
+
+  Int32 RightContext() { return right_context_; }
+
+  void Compute(const Float32 *feats, Int32 feat_stride, Int32 num_frames,
+               Float32 *loglikes, Int32 loglike_stride);
+
+  // The last Linear layer and those after it (usually the largest one, to
+  // number of pdfs) run on the subsampled frames only
+  void ComputeSubsampled(const Float32 *feats, Int32 feat_stride,
+                         Int32 num_frames, Int32 step, Float32 *loglikes,
+                         Int32 loglike_stride);
+
+  // Drop the cached frames of streaming use
+  void Reset();
+
+  // Run float forward on features (padded as Compute()) and keep the max
+  // absolute value of each Linear layer input, used by later Quantize()
+  void Calibrate(const Float32 *feats, Int32 feat_stride, Int32 num_frames);
+
+  // Convert float Linear layers to int8
+  void Quantize();
+
+  // Write parameters in the format of copy-nnet3-linear-params, with "QLinear"
+  // for quantized layers
+  void Write(const std::string &param);
+
+  // Push num_frames frames, write loglikes of frames which have full context
+  // now and return number of them
+  Int32 AcceptFrames(const Float32 *feats, Int32 feat_stride,
+                     Int32 num_frames, Float32 *loglikes,
+                     Int32 loglike_stride);
+
+ private:
+  Tdnn(const Tdnn &) = delete;
+  Tdnn &operator=(const Tdnn &) = delete;
+
+  struct TdnnLayer {
+    TdnnLayerType type;
+    // For kLinear: dimention of a input frame and output frame
+    Int32 input_dim, output_dim;
+    // Spliced offsets of kLinear, sorted
+    std::vector<Int32> offsets;
+    // Transposed weight of kLinear, scale of kBatchNorm
+    std::vector<Float32> weight;
+    // Bias of kLinear, offset of kBatchNorm
+    std::vector<Float32> bias;
+    // For int8 kLinear: weight (output_dim x input_dim) and its scale per
+    // output channel, scale of input (0 if worked out on each call), input
+    // quantized (in int16 lanes) and int32 output of each call
+    Bool int8;
+    std::vector<Int08> qweight;
+    std::vector<Int16> qinput;
+    std::vector<Int32> qoutput;
+    std::vector<Float32> qscale;
+    Float32 input_scale;
+    // Max absolute value of input seen by Calibrate()
+    Float32 input_range;
+    // For kLinear, input rows cached and spliced inputs, output rows
+    std::vector<Float32> history, splice, output;
+    Int32 history_rows;
+  };
+
+  void ReadParams(const std::string &param);
+
+  void ParseContext(const std::string &context);
+
+  // layer.output = input * layer.weight + layer.bias, input rows are
+  // layer.input_dim floats, one per stride floats
+  void AffineTransform(TdnnLayer &layer, const Float32 *input, Int32 stride,
+                       Int32 num_rows);
+
+  // Return number of output rows, saved in layer->output. Only one of every
+  // step output rows is computed (history is not valid for streaming then)
+  Int32 ForwardLinear(TdnnLayer *layer, const Float32 *input, Int32 stride,
+                      Int32 num_rows, Int32 step = 1);
+
+  // Int8 version of AffineTransform()
+  void AffineTransformInt8(TdnnLayer &layer, const Float32 *input,
+                           Int32 stride, Int32 num_rows);
+
+  std::vector<TdnnLayer> layers_;
+  Int32 input_dim_, output_dim_, left_context_, right_context_;
+  // Collect input_range of Linear layers
+  Bool calibrating_;
+  // Index of the last Linear layer in layers_, subsampled by output_step_
+  Int32 last_linear_, output_step_;
+};
+
+#endif
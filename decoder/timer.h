@@ -1,25 +1,34 @@
 // wujian@2018
 
-#include <sys/time.h>
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <chrono>
 
 #include "decoder/type.h"
 
 const Int32 SEC_TO_USEC = 1000 * 1000;
 
+// Monotonic clock (not affected by system time changes), in nanoseconds
+inline Int64 NowNanoseconds() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
 class Timer {
  public:
   Timer() { Reset(); }
 
-  void Reset() { gettimeofday(&start_, NULL); }
+  void Reset() { start_ = NowNanoseconds(); }
 
+  // In seconds
   Float64 Elapsed() const {
-    struct timeval stop;
-    gettimeofday(&stop, NULL);
-    Int64 beg = start_.tv_sec * SEC_TO_USEC + start_.tv_usec,
-          end = stop.tv_sec * SEC_TO_USEC + stop.tv_usec;
-    return static_cast<Float64>(end - beg) / SEC_TO_USEC;
+    return static_cast<Float64>(NowNanoseconds() - start_) * 1e-9;
   }
 
  private:
-  struct timeval start_;
-};
\ No newline at end of file
+  Int64 start_;
+};
+
+#endif
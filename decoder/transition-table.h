@@ -41,7 +41,7 @@ class TransitionTable {
                 sizeof(Int32) * num_tids_);
   }
 
-  Int32 TransitionIdToPdf(Int32 tid) {
+  Int32 TransitionIdToPdf(Int32 tid) const {
     ASSERT(tid >= 1 && "TransitionId could not be negative");
     if (tid > num_tids_) {
       LOG_FAIL << "Index out of total number of transition ids, " << tid << "/"
@@ -62,7 +62,8 @@ class TransitionTable {
   Int32 *table_;
 };
 
-void ReadTransitionTable(const std::string &filename, TransitionTable *table) {
+inline void ReadTransitionTable(const std::string &filename,
+                                TransitionTable *table) {
   BinaryInput bi(filename);
   ASSERT(table);
   table->Read(bi.Stream());
@@ -2,6 +2,7 @@
 // wujian@2018.8
 
 #include "wave.h"
+#include "simd.h"
 
 bool CheckHeader(WaveHeader &header, Int32 byte_per_sample) {
   if ((strncmp(reinterpret_cast<char *>(header.chunk_id), "RIFF", 4) != 0) ||
@@ -18,7 +19,7 @@ bool CheckHeader(WaveHeader &header, Int32 byte_per_sample) {
 
 WaveHeader GenWavHeader(Int32 num_samples, Int32 num_channels,
                         Int32 sample_rate, Int32 byte_per_sample) {
-  UInt32 num_bytes = num_samples * byte_per_sample;
+  UInt32 num_bytes = num_samples * num_channels * byte_per_sample;
   WaveHeader header = {
       'R',
       'I',
@@ -46,69 +47,306 @@ WaveHeader GenWavHeader(Int32 num_samples, Int32 num_channels,
   return header;
 }
 
-void Wave::Read(std::istream &is) {
-  ReadBinary(is, reinterpret_cast<char *>(&header_), sizeof(header_));
-  byte_per_sample_ = header_.bits_per_sample / 8;
-  if (!CheckHeader(header_, byte_per_sample_))
+void ReadWaveInfo(std::istream &is, WaveInfo *info) {
+  WaveHeader header;
+  ReadBinary(is, reinterpret_cast<char *>(&header), sizeof(header));
+  Int32 byte_per_sample = header.bits_per_sample / 8;
+  if (!CheckHeader(header, byte_per_sample))
     LOG_FAIL << "Check wave header failed";
-  // Skip other parameters between format part and data part
-  is.seekg(header_.format_size - 16, std::ios::cur);
-  char data_id[4];
-  ReadBinary(is, data_id, sizeof(data_id));
-  ASSERT(strncmp(data_id, "data", sizeof(data_id)) == 0);
+  // Skip other parameters between format part and data part, for
+  // WAVE_FORMAT_EXTENSIBLE, audio format leads the sub format GUID after
+  // cb_size, valid_bits_per_sample and channel_mask
+  std::vector<char> extension(header.format_size - 16 + header.format_size % 2);
+  if (extension.size()) ReadBinary(is, extension.data(), extension.size());
+  UInt16 audio_format = header.audio_format;
+  if (audio_format == 0xfffe) {
+    if (extension.size() < 24) LOG_FAIL << "Bad extensible format of wave";
+    memcpy(&audio_format, extension.data() + 8, sizeof(audio_format));
+  }
+  if (audio_format == 1 && header.bits_per_sample == 16)
+    info->format = kPcmInt16;
+  else if (audio_format == 1 && header.bits_per_sample == 24)
+    info->format = kPcmInt24;
+  else if (audio_format == 1 && header.bits_per_sample == 32)
+    info->format = kPcmInt32;
+  else if (audio_format == 3 && header.bits_per_sample == 32)
+    info->format = kPcmFloat32;
+  else
+    LOG_FAIL << "Unsupported wave format " << audio_format << " with "
+             << header.bits_per_sample << " bits per sample";
+  // Skip chunks before data, ignore() works on pipes too
+  char chunk_id[4];
   UInt32 num_bytes;
-  ReadBinary(is, reinterpret_cast<char *>(&num_bytes), sizeof(num_bytes));
-  num_samples_ = num_bytes / byte_per_sample_;
-  // check num_samples_ here
-  data_ = new Float32[num_samples_];
-  if (byte_per_sample_ != 2)
-    LOG_FAIL << "Now only support for Int16 encode, get int"
-             << header_.bits_per_sample;
-  Int16 *cache = new Int16[num_samples_];
-  ReadBinary(is, reinterpret_cast<char *>(cache), sizeof(Int16) * num_samples_);
-  for (Int32 i = 0; i < num_samples_; i++)
-    data_[i] = static_cast<Float32>(cache[i]);
-  delete[] cache;
-  num_channels_ = header_.num_channels;
-  sample_rate_ = header_.sample_rate;
+  while (true) {
+    ReadBinary(is, chunk_id, sizeof(chunk_id));
+    ReadBinary(is, reinterpret_cast<char *>(&num_bytes), sizeof(num_bytes));
+    if (strncmp(chunk_id, "data", sizeof(chunk_id)) == 0) break;
+    is.ignore(num_bytes + num_bytes % 2);
+  }
+  info->num_channels = header.num_channels;
+  info->sample_rate = header.sample_rate;
+  info->byte_per_sample = byte_per_sample;
+  info->num_samples = num_bytes / header.block_align;
+}
+
+static inline Float32 Int16Sample(const char *p) {
+  Int16 sample;
+  memcpy(&sample, p, sizeof(sample));
+  return sample;
+}
+
+// Little endian 24 bits in the high bytes of Int32, then / 65536
+static inline Float32 Int24Sample(const char *p) {
+  const UInt08 *bytes = reinterpret_cast<const UInt08 *>(p);
+  Int32 sample = static_cast<Int32>((static_cast<UInt32>(bytes[2]) << 24) |
+                                    (static_cast<UInt32>(bytes[1]) << 16) |
+                                    (static_cast<UInt32>(bytes[0]) << 8));
+  return sample * (1.0f / 65536);
+}
+
+static inline Float32 Int32Sample(const char *p) {
+  Int32 sample;
+  memcpy(&sample, p, sizeof(sample));
+  return sample * (1.0f / 65536);
+}
+
+static inline Float32 Float32Sample(const char *p) {
+  Float32 sample;
+  memcpy(&sample, p, sizeof(sample));
+  return sample * 32768;
+}
+
+template <Float32 (*Sample)(const char *)>
+static void Deinterleave(const char *src, Int32 num_channels,
+                         Int32 byte_per_sample, Int32 num_samples,
+                         Float32 *addr, Int32 stride) {
+  Int32 block_align = num_channels * byte_per_sample;
+  for (Int32 c = 0; c < num_channels; c++) {
+    const char *p = src + c * byte_per_sample;
+    Float32 *dst = addr + static_cast<Int64>(c) * stride;
+    for (Int32 n = 0; n < num_samples; n++, p += block_align)
+      dst[n] = Sample(p);
+  }
+}
+
+void DeinterleaveSamples(const char *src, const WaveInfo &info,
+                         Int32 num_samples, Float32 *addr, Int32 stride) {
+  Int32 num_channels = info.num_channels, bytes = info.byte_per_sample;
+  ASSERT(num_channels == 1 || stride >= num_samples);
+  switch (info.format) {
+    case kPcmInt16:
+      // the common case, unaligned loads are fine on x86 and ARMv8
+      if (num_channels == 1)
+        Int16ToFloat(reinterpret_cast<const Int16 *>(src), num_samples, addr);
+      else
+        Deinterleave<Int16Sample>(src, num_channels, bytes, num_samples, addr,
+                                  stride);
+      break;
+    case kPcmInt24:
+      Deinterleave<Int24Sample>(src, num_channels, bytes, num_samples, addr,
+                                stride);
+      break;
+    case kPcmInt32:
+      Deinterleave<Int32Sample>(src, num_channels, bytes, num_samples, addr,
+                                stride);
+      break;
+    case kPcmFloat32:
+      Deinterleave<Float32Sample>(src, num_channels, bytes, num_samples, addr,
+                                  stride);
+      break;
+  }
+}
+
+// Interleave channel major samples into Int16, return number of samples
+// clipped
+static Int32 InterleaveSamples(const Float32 *addr, Int32 stride,
+                               Int32 num_channels, Int32 num_samples,
+                               Int16 *dst) {
+  Int32 num_clipped = 0;
+  for (Int32 c = 0; c < num_channels; c++) {
+    const Float32 *src = addr + static_cast<Int64>(c) * stride;
+    for (Int32 n = 0; n < num_samples; n++) {
+      Int32 sample32 = static_cast<Int32>(truncf(src[n]));
+      if (sample32 < MIN_INT16 || sample32 > MAX_INT16) {
+        num_clipped++;
+        sample32 = std::max(std::min(sample32, static_cast<Int32>(MAX_INT16)),
+                            static_cast<Int32>(MIN_INT16));
+      }
+      dst[n * num_channels + c] = static_cast<Int16>(sample32);
+    }
+  }
+  return num_clipped;
+}
+
+WaveReader::WaveReader(const std::string &filename, Bool use_mmap)
+    : input_(NULL), is_(NULL), mapped_(NULL), data_(NULL), num_read_(0) {
+  input_ = new BinaryInput(filename);
+  ReadWaveInfo(input_->Stream(), &info_);
+  if (!use_mmap) {
+    is_ = &input_->Stream();
+    return;
+  }
+  UInt64 offset = input_->Stream().tellg();
+  delete input_;
+  input_ = NULL;
+  mapped_ = new MappedFile(filename);
+  data_ = mapped_->Data() + offset;
+  // streamed wave may have no right size in header
+  Int64 block_align = info_.num_channels * info_.byte_per_sample,
+        num_samples = (mapped_->Size() - offset) / block_align;
+  if (info_.num_samples > num_samples) {
+    LOG_WARN << "Expect " << info_.num_samples << " samples, but only "
+             << num_samples << " in " << filename;
+    info_.num_samples = num_samples;
+  }
+}
+
+WaveReader::WaveReader(std::istream &is)
+    : input_(NULL), is_(&is), mapped_(NULL), data_(NULL), num_read_(0) {
+  ReadWaveInfo(is, &info_);
+}
+
+WaveReader::~WaveReader() {
+  if (input_) delete input_;
+  if (mapped_) delete mapped_;
+}
+
+Int32 WaveReader::Read(Float32 *addr, Int32 stride, Int32 max_samples) {
+  Int32 num_samples = static_cast<Int32>(
+      std::min(static_cast<Int64>(max_samples), info_.num_samples - num_read_));
+  if (num_samples <= 0) return 0;
+  Int32 block_align = info_.num_channels * info_.byte_per_sample;
+  const char *src = NULL;
+  if (mapped_) {
+    src = data_ + num_read_ * block_align;
+  } else {
+    cache_.resize(num_samples * block_align);
+    is_->read(cache_.data(), cache_.size());
+    Int32 num_got = is_->gcount() / block_align;
+    if (num_got < num_samples) {
+      LOG_WARN << "Expect " << info_.num_samples << " samples, but only "
+               << num_read_ + num_got << " in stream";
+      info_.num_samples = num_read_ + num_got;
+      num_samples = num_got;
+    }
+    src = cache_.data();
+  }
+  DeinterleaveSamples(src, info_, num_samples, addr, stride);
+  num_read_ += num_samples;
+  return num_samples;
+}
+
+WaveWriter::WaveWriter(const std::string &filename, Int32 num_channels,
+                       Int32 sample_rate)
+    : output_(new BinaryOutput(filename)),
+      num_channels_(num_channels),
+      sample_rate_(sample_rate),
+      num_samples_(0),
+      num_clipped_(0) {
+  ASSERT(num_channels > 0);
+  // sizes are placeholders until Close()
+  WaveHeader header = GenWavHeader(0, num_channels_, sample_rate_, 2);
+  UInt32 num_bytes = 0;
+  WriteBinary(output_->Stream(), reinterpret_cast<char *>(&header),
+              sizeof(header));
+  WriteBinary(output_->Stream(), "data", 4);
+  WriteBinary(output_->Stream(), reinterpret_cast<char *>(&num_bytes),
+              sizeof(num_bytes));
+}
+
+void WaveWriter::Write(const Float32 *addr, Int32 stride, Int32 num_samples) {
+  ASSERT(output_ && "Write after WaveWriter::Close()");
+  ASSERT(num_channels_ == 1 || stride >= num_samples);
+  cache_.resize(std::min(num_samples, kWaveBlockSize) * num_channels_);
+  for (Int32 n = 0; n < num_samples; n += kWaveBlockSize) {
+    Int32 num_block = std::min(kWaveBlockSize, num_samples - n);
+    num_clipped_ += InterleaveSamples(addr + n, stride, num_channels_,
+                                      num_block, cache_.data());
+    WriteBinary(output_->Stream(), reinterpret_cast<char *>(cache_.data()),
+                sizeof(Int16) * num_block * num_channels_);
+  }
+  num_samples_ += num_samples;
+}
+
+void WaveWriter::Close() {
+  if (!output_) return;
+  std::ostream &os = output_->Stream();
+  WaveHeader header =
+      GenWavHeader(num_samples_, num_channels_, sample_rate_, 2);
+  UInt32 num_bytes = num_samples_ * num_channels_ * sizeof(Int16);
+  Seek(os, 0, std::ios::beg);
+  WriteBinary(os, reinterpret_cast<char *>(&header), sizeof(header));
+  Seek(os, 4, std::ios::cur);
+  WriteBinary(os, reinterpret_cast<char *>(&num_bytes), sizeof(num_bytes));
+  if (num_clipped_)
+    LOG_INFO << "Clipped " << num_clipped_ << " samples, total "
+             << num_samples_ * num_channels_;
+  delete output_;
+  output_ = NULL;
+}
+
+void Wave::Read(std::istream &is) {
+  WaveReader reader(is);
+  Read(reader);
+}
+
+void Wave::Read(WaveReader &reader) {
+  if (data_ && hold_memory_) delete[] data_;
+  num_channels_ = reader.NumChannels();
+  sample_rate_ = reader.SampleRate();
+  num_samples_ = reader.NumSamples();
+  byte_per_sample_ = 2;
+  // samples are converted into data_ directly, no copy of whole file
+  data_ = new Float32[static_cast<Int64>(num_samples_) * num_channels_];
   hold_memory_ = true;
-  if (header_.chunk_size != header_.format_size + 20 + num_bytes) {
-    LOG_WARN << "Read " << num_samples_ << " samples(" << num_bytes
-             << " bytes), "
-             << "but chunk_size(" << header_.chunk_size << ") do not equal to "
-             << "format_size(" << header_.format_size << ") + 20 + num_bytes("
-             << num_bytes << ")";
+  Int32 num_read = 0, n;
+  do {
+    n = reader.Read(data_ + num_read, num_samples_,
+                    std::min(kWaveBlockSize, num_samples_ - num_read));
+    num_read += n;
+  } while (n);
+  if (num_read != num_samples_) {
+    // truncated stream, move channels together
+    for (Int32 c = 1; c < num_channels_; c++)
+      memmove(data_ + c * num_read, data_ + c * num_samples_,
+              sizeof(Float32) * num_read);
+    num_samples_ = num_read;
   }
+  header_ =
+      GenWavHeader(num_samples_, num_channels_, sample_rate_, byte_per_sample_);
 }
 
 void Wave::Write(std::ostream &os) {
   // check header
   if (!CheckHeader(header_, byte_per_sample_))
     LOG_FAIL << "Check wave header failed, could not dump to disk";
-  Int32 num_bytes = num_samples_ * byte_per_sample_;
+  Int32 num_bytes = num_samples_ * num_channels_ * byte_per_sample_;
   const char *data_id = "data";
   WriteBinary(os, reinterpret_cast<char *>(&header_), sizeof(header_));
   WriteBinary(os, data_id, 4);
   WriteBinary(os, reinterpret_cast<char *>(&num_bytes), sizeof(num_bytes));
+  std::vector<Int16> cache(std::min(num_samples_, kWaveBlockSize) *
+                           num_channels_);
   Int32 num_clipped = 0;
-  for (Int32 n = 0; n < num_samples_; n++) {
-    Int32 sample32 = static_cast<Int32>(truncf(data_[n]));
-    Int16 sample16 = static_cast<Int16>(sample32);
-    if (sample16 < MIN_INT16 || sample16 > MAX_INT16) num_clipped++;
-    sample16 = std::max(std::min(sample16, MAX_INT16), MIN_INT16);
-    WriteBinary(os, reinterpret_cast<char *>(&sample16), sizeof(sample16));
+  for (Int32 n = 0; n < num_samples_; n += kWaveBlockSize) {
+    Int32 num_block = std::min(kWaveBlockSize, num_samples_ - n);
+    num_clipped += InterleaveSamples(data_ + n, num_samples_, num_channels_,
+                                     num_block, cache.data());
+    WriteBinary(os, reinterpret_cast<char *>(cache.data()),
+                sizeof(Int16) * num_block * num_channels_);
   }
   if (num_clipped)
-    LOG_INFO << "Clipped " << num_clipped << " samples, total " << num_samples_;
+    LOG_INFO << "Clipped " << num_clipped << " samples, total "
+             << num_samples_ * num_channels_;
 }
 
 void ReadWave(const std::string &filename, Wave *wave) {
-  BinaryInput bi(filename);
   ASSERT(wave);
-  wave->Read(bi.Stream());
+  WaveReader reader(filename, true);
+  wave->Read(reader);
 }
 
 void WriteWave(const std::string &filename, Wave &wave) {
   BinaryOutput bo(filename);
   wave.Write(bo.Stream());
-}
\ No newline at end of file
+}
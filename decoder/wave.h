@@ -16,7 +16,7 @@ struct WaveHeader {
   char format_id[4];       // "fmt "
   UInt32 format_size;      // format header total bit size exclude format_id &
                            // format_size
-  UInt16 audio_format;     // 1
+  UInt16 audio_format;     // 1 (PCM), 3 (IEEE float) or 0xfffe (extensible)
   UInt16 num_channels;     // 1/2/..
   UInt32 sample_rate;      // 16000
   UInt32 byte_rate;        // sample_rate * num_channel * sizeof(T)
@@ -27,9 +27,113 @@ struct WaveHeader {
 
 bool CheckHeader(WaveHeader &header, Int32 byte_per_sample);
 
+// num_samples of each channel
 WaveHeader GenWavHeader(Int32 num_samples, Int32 num_channels,
                         Int32 sample_rate, Int32 byte_per_sample);
 
+// Encoding of samples in data chunk
+enum SampleFormat { kPcmInt16, kPcmInt24, kPcmInt32, kPcmFloat32 };
+
+// Number of samples (of each channel) converted at a time
+const Int32 kWaveBlockSize = 4096;
+
+// Format and data chunk of a wave file
+struct WaveInfo {
+  SampleFormat format;
+  Int32 num_channels, sample_rate, byte_per_sample;
+  // Number of samples of each channel
+  Int64 num_samples;
+};
+
+// Parse header and skip chunks before "data" (egs: LIST), so is is left at
+// the first sample
+void ReadWaveInfo(std::istream &is, WaveInfo *info);
+
+// Convert num_samples interleaved samples (src, any alignment) into channel
+// major floats, channel c to addr + c * stride. Integers are scaled to Int16
+// range, egs: Int24 / 256, and floats (in [-1, 1]) times 32768
+void DeinterleaveSamples(const char *src, const WaveInfo &info,
+                         Int32 num_samples, Float32 *addr, Int32 stride);
+
+// Chunked reader of wave files: samples are converted block by block from a
+// mapping of the file or a stream straight into caller buffers, so hours of
+// audio could be fed to FeatureExtractor::AcceptWaveform() at constant memory.
+// egs:
+// WaveReader reader("long.wav", true);
+// std::vector<Float32> samples(1600 * reader.NumChannels());
+// while (Int32 n = reader.Read(samples.data(), 1600, 1600))
+//   extractor.AcceptWaveform(samples.data(), n);  // channel 0
+class WaveReader {
+ public:
+  // Read filename by blocks, or map it if use_mmap
+  WaveReader(const std::string &filename, Bool use_mmap = false);
+
+  // Read from is (egs: a pipe) which starts at the header, is should outlive
+  // the reader
+  WaveReader(std::istream &is);
+
+  ~WaveReader();
+
+  const WaveInfo &Info() const { return info_; }
+
+  Int32 NumChannels() const { return info_.num_channels; }
+
+  Int32 SampleRate() const { return info_.sample_rate; }
+
+  Int64 NumSamples() const { return info_.num_samples; }
+
+  // Read at most max_samples samples of each channel, channel c to addr + c *
+  // stride, return number of samples read, 0 at the end of data
+  Int32 Read(Float32 *addr, Int32 stride, Int32 max_samples);
+
+ private:
+  WaveReader(const WaveReader &) = delete;
+  WaveReader &operator=(const WaveReader &) = delete;
+
+  WaveInfo info_;
+  // one of them: stream (maybe owned by input_) or mapping
+  BinaryInput *input_;
+  std::istream *is_;
+  MappedFile *mapped_;
+  // next sample of the mapping
+  const char *data_;
+  // Number of samples (of each channel) read
+  Int64 num_read_;
+  // Bytes of a block read from stream
+  std::vector<char> cache_;
+};
+
+// Chunked writer of Int16 wave files, sizes in the header are filled when
+// closed, so the number of samples is not needed ahead
+class WaveWriter {
+ public:
+  WaveWriter(const std::string &filename, Int32 num_channels = 1,
+             Int32 sample_rate = 16000);
+
+  ~WaveWriter() { Close(); }
+
+  // Write num_samples samples of each channel, channel c from addr + c *
+  // stride, clipped to Int16 range
+  void Write(const Float32 *addr, Int32 stride, Int32 num_samples);
+
+  // Fill sizes in header, called by the destructor if not called
+  void Close();
+
+  Int64 NumSamples() const { return num_samples_; }
+
+  // Number of samples clipped
+  Int64 NumClipped() const { return num_clipped_; }
+
+ private:
+  WaveWriter(const WaveWriter &) = delete;
+  WaveWriter &operator=(const WaveWriter &) = delete;
+
+  BinaryOutput *output_;
+  Int32 num_channels_, sample_rate_;
+  Int64 num_samples_, num_clipped_;
+  std::vector<Int16> cache_;
+};
+
 class Wave {
  public:
   // egs:
@@ -43,6 +147,7 @@ class Wave {
         byte_per_sample_(-1),
         hold_memory_(false) {}
 
+  // data is channel major, num_samples of each channel
   // egs:
   // Wave wave(data, 23456);
   // WriteWave("demo.wav", wave);
@@ -63,12 +168,18 @@ class Wave {
     if (data_ && hold_memory_) delete[] data_;
   }
 
+  // Int16/Int24/Int32/Float32 samples, deinterleaved
   void Read(std::istream &is);
 
+  // Read all the samples left in reader
+  void Read(WaveReader &reader);
+
+  // Written in Int16
   void Write(std::ostream &os);
 
   Int32 NumChannels() { return num_channels_; }
 
+  // Number of samples of each channel
   Int32 NumSamples() { return num_samples_; }
 
   Int32 SampleRate() { return sample_rate_; }
@@ -76,12 +187,18 @@ class Wave {
   // Bug: could not be called twice if normalized=true
   Float32 *Data(Bool normalized = false) {
     if (normalized) {
-      for (Int32 i = 0; i < num_samples_; i++)
+      for (Int32 i = 0; i < num_samples_ * num_channels_; i++)
         data_[i] = data_[i] / static_cast<Float32>(MAX_INT16);
     }
     return data_;
   }
 
+  // Samples of channel c
+  Float32 *ChannelData(Int32 c) {
+    ASSERT(c >= 0 && c < num_channels_);
+    return data_ + static_cast<Int64>(c) * num_samples_;
+  }
+
  private:
   Int32 num_channels_, num_samples_, sample_rate_;
   Int32 byte_per_sample_;
@@ -90,8 +207,9 @@ class Wave {
   Bool hold_memory_;
 };
 
+// Samples are read from a mapping of filename
 void ReadWave(const std::string &filename, Wave *wave);
 
 void WriteWave(const std::string &filename, Wave &wave);
 
-#endif
\ No newline at end of file
+#endif
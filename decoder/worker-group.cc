@@ -0,0 +1,64 @@
+// wujian@2018
+
+#include "decoder/worker-group.h"
+
+WorkerGroup::WorkerGroup(Int32 num_workers)
+    : num_workers_(num_workers),
+      func_(NULL),
+      step_(0),
+      num_running_(0),
+      stopped_(false) {
+  ASSERT(num_workers_ > 0);
+  for (Int32 w = 1; w < num_workers_; w++)
+    threads_.push_back(std::thread(&WorkerGroup::Work, this, w));
+}
+
+WorkerGroup::~WorkerGroup() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopped_ = true;
+  }
+  start_cond_.notify_all();
+  for (std::thread &thread : threads_) thread.join();
+}
+
+void WorkerGroup::Run(const std::function<void(Int32)> &func) {
+  if (num_workers_ == 1) {
+    func(0);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    func_ = &func;
+    num_running_ = num_workers_ - 1;
+    step_++;
+  }
+  start_cond_.notify_all();
+  func(0);
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_cond_.wait(lock, [this] { return num_running_ == 0; });
+  func_ = NULL;
+}
+
+void WorkerGroup::Work(Int32 worker) {
+  UInt64 last_step = 0;
+  while (true) {
+    const std::function<void(Int32)> *func;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      start_cond_.wait(lock, [this, last_step] {
+        return stopped_ || step_ != last_step;
+      });
+      if (stopped_) return;
+      last_step = step_;
+      func = func_;
+    }
+    (*func)(worker);
+    Bool last_one;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      last_one = --num_running_ == 0;
+    }
+    if (last_one) done_cond_.notify_one();
+  }
+}
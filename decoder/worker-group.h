@@ -0,0 +1,52 @@
+// wujian@2018
+
+// Fixed group of threads running data-parallel steps of one call together
+
+#ifndef WORKER_GROUP_H
+#define WORKER_GROUP_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "decoder/common.h"
+
+// Unlike DecodeServer, which runs independent utterances, all workers run the
+// same function on their own part of one step (egs: tokens of one frame), and
+// Run() returns when all of them finished. The caller thread is worker 0, so
+// num_workers - 1 threads are started, and they stay alive across calls.
+// egs:
+// WorkerGroup group(4);
+// group.Run([&](Int32 w) { Process(begin[w], end[w]); });
+class WorkerGroup {
+ public:
+  WorkerGroup(Int32 num_workers);
+
+  ~WorkerGroup();
+
+  Int32 NumWorkers() const { return num_workers_; }
+
+  // Call func(w) for w in [0, num_workers) concurrently, one call per worker.
+  // Not reentrant, func should not call Run()
+  void Run(const std::function<void(Int32)> &func);
+
+ private:
+  WorkerGroup(const WorkerGroup &) = delete;
+  WorkerGroup &operator=(const WorkerGroup &) = delete;
+
+  void Work(Int32 worker);
+
+  Int32 num_workers_;
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable start_cond_, done_cond_;
+  // Function of current step, a new step is announced by bumping step_
+  const std::function<void(Int32)> *func_;
+  UInt64 step_;
+  // Workers (except the caller) not finished current step
+  Int32 num_running_;
+  Bool stopped_;
+};
+
+#endif
@@ -7,26 +7,66 @@ from libc.stdint cimport *
 from libcpp cimport bool
 
 cdef extern from "decoder/type.h":
+    ctypedef int8_t Int08
+    ctypedef uint16_t UInt16
     ctypedef int32_t Int32
     ctypedef int64_t Int64
     ctypedef float  Float32
     ctypedef double Float64
     ctypedef bool Bool
 
-# wrappers for feature extractor
+# wrappers for feature extractor, methods without GIL could run in nogil
+# sections
 cdef extern from "decoder/online.h":
     cdef cppclass FeatureExtractor:
         FeatureExtractor(const string&, const string&) except +
-        Int32 Compute(Float32*, Int32, Float32*, Int32) except +
+        Int32 Compute(Float32*, Int32, Float32*, Int32) nogil
         Int32 FeatureDim()
         Int32 NumFrames(Int32 num_samps)
+        void AcceptWaveform(const Float32*, Int32) nogil
+        Int32 ReadyFrames()
+        Int32 GetFrames(Float32*, Int32, Int32) nogil
         void Reset()
 
 # wrappers for decoder  
+cdef extern from "decoder/symbol-table.h":
+    cdef cppclass SymbolTable:
+        SymbolTable(const string&) except +
+        Int32 NumSymbols()
+        const char *Symbol(Int32)
+        void Join(const vector[Int32]&, string*, const char*)
+
+cdef extern from "decoder/decode-graph.h":
+    cdef cppclass DecodeGraph:
+        DecodeGraph(const string&, const string&) except +
+        Int32 NumPdfs()
+
 cdef extern from "decoder/decoder.h":
+    cdef cppclass DecodeOpts:
+        DecodeOpts(const string&) except +
+
     cdef cppclass FasterDecoder:
-        FasterDecoder(const string&, const string&, const string&) except +
-        void Reset()
-        void Decode(Float32*, Int32, Int32, Int32)
-        void DecodeFrame(Float32*, Int32)
-        Bool GetBestPath(vector[Int32]*)
+        FasterDecoder(const DecodeGraph&, const DecodeOpts&) except +
+        void Reset() nogil
+        void Decode(Float32*, Int32, Int32, Int32) nogil
+        void Decode(const UInt16*, Int32, Int32, Int32) nogil
+        void Decode(const Int08*, const Float32*, Int32, Int32, Int32) nogil
+        void DecodeFrame(Float32*, Int32) nogil
+        Bool GetBestPath(vector[Int32]*) nogil
+        Bool GetBestPath(const SymbolTable&, string*) nogil
+
+cdef extern from "decoder/decode-server.h":
+    cdef cppclass DecodeServerOpts:
+        DecodeServerOpts(Int32, Int32, Bool)
+
+    cdef cppclass DecodeResult:
+        Int64 index
+        Bool succeed
+        vector[Int32] word_ids
+
+    cdef cppclass DecodeServer:
+        DecodeServer(const DecodeGraph&, const DecodeOpts&,
+                     const DecodeServerOpts&) except +
+        void Submit(const string&, const Float32*, Int32, Int32, Int32) nogil
+        void Close() nogil
+        Bool GetResult(DecodeResult*) nogil
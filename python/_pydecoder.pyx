@@ -5,6 +5,7 @@ import numpy as pynp
 
 from libcpp.string cimport string
 from libcpp.vector cimport vector
+from cython.operator cimport dereference as deref
 
 cimport _pydecoder as pydecoder
 
@@ -26,42 +27,206 @@ cdef class PyFeatureExtractor:
     def reset(self):
         self.extractor.Reset()
 
-    def compute(self, np.ndarray[F32, ndim=1] wav):
-        cdef Int32 num_frames = self.extractor.NumFrames(wav.size)
-        cdef np.ndarray[F32, ndim=2] feats = pynp.zeros([num_frames, \
-                                                        self.extractor.FeatureDim()], \
-                                                        dtype=pynp.float32)
-        cdef Float32 *feats_ptr = <Float32*>feats.data
-        cdef Int32 stride = feats.strides[-1]
-        self.extractor.Compute(<Float32*>wav.data, wav.size, <Float32*>feats.data, stride)
+    def compute(self, wav, out=None):
+        """
+        Features of the whole wav, written into out (float32, num_frames x
+        feature_dim at least, rows could be strided) if given. wav is copied
+        only if it is not contiguous float32. Call reset() before another wav,
+        as state of framing is kept across calls.
+
+        Breaking change: feature row stride passed to FeatureExtractor is now
+        strides[0] // 4 (number of floats), earlier versions passed
+        strides[-1] (bytes of one float), which only fit feature_dim <= 4
+        """
+        cdef F32[::1] samples = pynp.ascontiguousarray(wav, dtype=pynp.float32)
+        cdef Int32 num_frames = self.extractor.NumFrames(samples.shape[0])
+        cdef F32[:, :] feats = self._feature_buffer(num_frames, out)
+        cdef Int32 stride = feats.strides[0] // sizeof(F32)
+        if num_frames:
+            with nogil:
+                self.extractor.Compute(&samples[0], samples.shape[0],
+                                       &feats[0, 0], stride)
+        return feats.base if out is None else out
+
+    def accept_waveform(self, wav):
+        cdef F32[::1] samples = pynp.ascontiguousarray(wav, dtype=pynp.float32)
+        if samples.shape[0]:
+            with nogil:
+                self.extractor.AcceptWaveform(&samples[0], samples.shape[0])
+
+    def get_frames(self, out=None):
+        """
+        Ready frames, written into out if given, which could be larger and
+        the number of frames written is num_frames = ready_frames(). Row
+        stride is in floats, as compute()
+        """
+        cdef Int32 num_frames = self.extractor.ReadyFrames()
+        cdef F32[:, :] feats = self._feature_buffer(num_frames, out)
+        cdef Int32 stride = feats.strides[0] // sizeof(F32)
+        if num_frames:
+            with nogil:
+                self.extractor.GetFrames(&feats[0, 0], stride, num_frames)
+        return feats.base if out is None else out
+
+    def ready_frames(self):
+        return self.extractor.ReadyFrames()
+
+    cdef F32[:, :] _feature_buffer(self, Int32 num_frames, out):
+        cdef Int32 dim = self.extractor.FeatureDim()
+        if out is None:
+            return pynp.empty([num_frames, dim], dtype=pynp.float32)
+        cdef F32[:, :] feats = out
+        if feats.shape[0] < num_frames or feats.shape[1] != dim or \
+                (dim > 1 and feats.strides[1] != sizeof(F32)):
+            raise ValueError("Expect out of {:d} x {:d} at least, with "
+                             "contiguous rows".format(num_frames, dim))
         return feats
 
+cdef class PySymbolTable:
+    cdef pydecoder.SymbolTable *symbols
+
+    def __cinit__(self, words):
+        """
+        words: words.txt, or its binary form from convert-symbol-table, which
+        is mmaped without parsing
+        """
+        cdef string words_str = to_cstr(words)
+        self.symbols = new SymbolTable(words_str)
+
+    def __dealloc__(self):
+        del self.symbols
+
+    def __len__(self):
+        return self.symbols.NumSymbols()
+
+    def __getitem__(self, Int32 idx):
+        if idx < 0 or idx >= self.symbols.NumSymbols():
+            raise IndexError("Word id {:d} out of range".format(idx))
+        return self.symbols.Symbol(idx).decode("utf-8")
+
+    def join(self, word_ids, sep=" "):
+        cdef vector[Int32] ids = word_ids
+        cdef Int32 idx
+        for idx in ids:
+            if idx < 0 or idx >= self.symbols.NumSymbols():
+                raise IndexError("Word id {:d} out of range".format(idx))
+        cdef string sep_str = to_cstr(sep), text
+        self.symbols.Join(ids, &text, sep_str.c_str())
+        return text.decode("utf-8")
+
 cdef class PyDecoder:
-    cdef pydecoder.FasterDecoder *decoder 
-    cdef vector[Int32] word_seq
+    cdef pydecoder.DecodeGraph *graph
+    cdef pydecoder.DecodeOpts *opts
+    cdef pydecoder.FasterDecoder *decoder
 
     def __cinit__(self, fst, tab, opt_conf):
         cdef string fst_str = to_cstr(fst), tab_str = to_cstr(tab)
         cdef string conf_str = to_cstr(opt_conf)
-        self.decoder = new FasterDecoder(fst_str, tab_str, conf_str)
+        self.graph = new DecodeGraph(fst_str, tab_str)
+        self.opts = new DecodeOpts(conf_str)
+        self.decoder = new FasterDecoder(deref(self.graph), deref(self.opts))
         self.decoder.Reset()
 
     def __dealloc__(self):
         del self.decoder
+        del self.opts
+        del self.graph
 
     def reset(self):
         self.decoder.Reset()
 
-    def decode(self, np.ndarray[F32, ndim=2] loglikes):
-        cdef Int32 stride = loglikes.strides[-1]
+    def decode(self, np.ndarray loglikes, np.ndarray scales=None):
+        """
+        loglikes: float32/float16 matrix (num_frames x num_pdfs), or int8 one
+        with float32 scales (num_frames) of each row. Rows could be strided,
+        GIL is released while decoding
+        """
+        if loglikes.ndim != 2:
+            raise ValueError("Expect 2D loglikes, got {:d}D".format(loglikes.ndim))
+        if loglikes.shape[1] > 1 and loglikes.strides[1] != loglikes.itemsize or \
+                loglikes.strides[0] % loglikes.itemsize:
+            loglikes = pynp.ascontiguousarray(loglikes)
+        # row stride in number of values
+        cdef Int32 stride = loglikes.strides[0] // loglikes.itemsize
         cdef Int32 num_frames = loglikes.shape[0], num_pdfs = loglikes.shape[1]
-        cdef Float32 *data_ptr = <Float32*>loglikes.data
+        cdef void *data = <void*>loglikes.data
+        cdef np.ndarray[F32, ndim=1] scales_f32
+        cdef Float32 *scales_ptr = NULL
         # print("LogLikelihoods: {:d} x {:d}, stride = {:d}".format(num_frames, num_pdfs, stride))
-        self.decoder.Decode(data_ptr, num_frames, stride, num_pdfs)
+        if loglikes.dtype == pynp.float32:
+            with nogil:
+                self.decoder.Decode(<Float32*>data, num_frames, stride, num_pdfs)
+        elif loglikes.dtype == pynp.float16:
+            with nogil:
+                self.decoder.Decode(<const UInt16*>data, num_frames, stride, num_pdfs)
+        elif loglikes.dtype == pynp.int8:
+            if scales is None or scales.size != num_frames:
+                raise ValueError("Expect one scale per frame for int8 loglikes")
+            scales_f32 = pynp.ascontiguousarray(scales, dtype=pynp.float32)
+            scales_ptr = <Float32*>scales_f32.data
+            with nogil:
+                self.decoder.Decode(<const Int08*>data, scales_ptr, num_frames,
+                                    stride, num_pdfs)
+        else:
+            raise TypeError("Unsupported dtype of loglikes: {}".format(loglikes.dtype))
 
     def best_sequence(self):
-        self.decoder.GetBestPath(&self.word_seq)
-        best_seq =  [id for id in self.word_seq]
-        self.word_seq.clear()
-        return best_seq
-
+        cdef vector[Int32] word_seq
+        with nogil:
+            self.decoder.GetBestPath(&word_seq)
+        return word_seq
+
+    def best_text(self, PySymbolTable symbols not None):
+        """
+        Words of best sequence mapped by symbols, separated by spaces
+        """
+        cdef string text
+        cdef pydecoder.SymbolTable *table = symbols.symbols
+        with nogil:
+            self.decoder.GetBestPath(deref(table), &text)
+        return text.decode("utf-8")
+
+    def decode_many(self, loglikes_list, Int32 num_threads=4):
+        """
+        Decode utterances (float32 loglikes each) on num_threads native
+        threads sharing the graph of this decoder, return best sequences in
+        order. Loglikes are not copied unless their frames are not contiguous
+        """
+        cdef Int32 num_utts = len(loglikes_list)
+        if num_utts == 0:
+            return []
+        arrays = []
+        for loglikes in loglikes_list:
+            loglikes = pynp.asarray(loglikes, dtype=pynp.float32)
+            if loglikes.ndim != 2:
+                raise ValueError("Expect 2D loglikes, got {:d}D".format(loglikes.ndim))
+            if loglikes.shape[1] > 1 and loglikes.strides[1] != loglikes.itemsize or \
+                    loglikes.strides[0] % loglikes.itemsize:
+                loglikes = pynp.ascontiguousarray(loglikes)
+            arrays.append(loglikes)
+        # all utterances are queued at once, so Submit() never blocks
+        cdef pydecoder.DecodeServer *server = new DecodeServer(
+            deref(self.graph), deref(self.opts),
+            DecodeServerOpts(max(num_threads, 1), num_utts, True))
+        cdef vector[Float32*] data_ptrs
+        cdef vector[Int32] num_frames, strides, num_pdfs
+        cdef np.ndarray[F32, ndim=2] array
+        for array in arrays:
+            data_ptrs.push_back(<Float32*>array.data)
+            num_frames.push_back(array.shape[0])
+            strides.push_back(array.strides[0] // sizeof(F32))
+            num_pdfs.push_back(array.shape[1])
+        cdef vector[vector[Int32]] word_seqs
+        cdef pydecoder.DecodeResult result
+        cdef string key
+        cdef Int32 u
+        word_seqs.resize(num_utts)
+        with nogil:
+            for u in range(num_utts):
+                server.Submit(key, data_ptrs[u], num_frames[u], strides[u],
+                              num_pdfs[u])
+            server.Close()
+            while server.GetResult(&result):
+                word_seqs[result.index].swap(result.word_ids)
+        del server
+        return word_seqs
@@ -4,6 +4,7 @@
 
 from _pydecoder import PyDecoder
 from _pydecoder import PyFeatureExtractor
+from _pydecoder import PySymbolTable
 
 
 class Decoder(object):
@@ -13,24 +14,16 @@ class Decoder(object):
                  decode_conf="decode.conf",
                  words="words.txt"):
         self.decoder = PyDecoder(graph, table, decode_conf)
-        self.symb = self._cache_sym(words)
-
-    def _cache_sym(self, fname):
-        symb = []
-        with open(fname, "r") as f:
-            for line in f:
-                tokens = line.split()
-                if len(tokens) != 2:
-                    raise RuntimeError("Format error: {}".format(line))
-                symb.append(tokens[0])
-        return symb
-
-    def decode(self, loglikes):
+        # words.txt or its binary form, loaded natively
+        self.symb = PySymbolTable(words)
+
+    def decode(self, loglikes, scales=None):
+        """
+        loglikes: float32/float16 matrix, or int8 one with scales of each row
+        """
         self.decoder.reset()
-        self.decoder.decode(loglikes)
-        best_sequence = self.decoder.best_sequence()
-        word_sequence = [self.symb[idx] for idx in best_sequence]
-        return " ".join(word_sequence)
+        self.decoder.decode(loglikes, scales)
+        return self.decoder.best_text(self.symb)
 
 
 class LogLikeDecoder(Decoder):
@@ -0,0 +1,176 @@
+#!/usr/bin/env python
+
+# wujian@2018
+"""
+Smoke test of the Python bindings, on a tiny graph written here. Build the
+extension in place and run it:
+    python setup.py build_ext --inplace
+    LD_LIBRARY_PATH=../lib python test_pydecoder.py
+"""
+import os
+import struct
+import subprocess
+import tempfile
+import threading
+
+import numpy as np
+
+from _pydecoder import PyDecoder, PyFeatureExtractor, PySymbolTable
+
+NUM_PDFS = 2
+WORDS = ["<eps>", "hello", "world"]
+
+
+def write_basic(f, fmt, value):
+    # WriteBinaryBasicType(): size in one byte, then the value
+    data = struct.pack("<" + fmt, value)
+    f.write(struct.pack("<b", len(data)) + data)
+
+
+def write_graph(dirname):
+    """
+    One state graph (SimpleFst format) with a self-loop per word: word w on
+    transition-id w, which is pdf w - 1, so each frame emits one word
+    """
+    graph = os.path.join(dirname, "graph.fst")
+    with open(graph, "wb") as f:
+        write_basic(f, "i", 0)  # start
+        write_basic(f, "q", 1)  # num_states
+        write_basic(f, "q", NUM_PDFS)  # num_arcs
+        write_basic(f, "f", 0.0)  # final
+        write_basic(f, "q", NUM_PDFS)
+        for word in range(1, NUM_PDFS + 1):
+            # ReadBinaryArc(): ilabel, olabel, weight, nextstate
+            arc = struct.pack("<iifi", word, word, 0.0, 0)
+            f.write(struct.pack("<b", len(arc)) + arc)
+    table = os.path.join(dirname, "trans.tab")
+    with open(table, "wb") as f:
+        write_basic(f, "i", NUM_PDFS)
+        write_basic(f, "i", NUM_PDFS)
+        f.write(struct.pack("<{:d}i".format(NUM_PDFS), *range(NUM_PDFS)))
+    conf = os.path.join(dirname, "decode.conf")
+    with open(conf, "w") as f:
+        f.write("--DecodeOpts.beam=10\n--DecodeOpts.min_active=1\n"
+                "--DecodeOpts.max_active=100\n")
+    return graph, table, conf
+
+
+def make_loglikes(words):
+    loglikes = np.full([len(words), NUM_PDFS], -3.0, dtype=np.float32)
+    for t, word in enumerate(words):
+        loglikes[t, word - 1] = -0.1
+    return loglikes
+
+
+def test_decoder(dirname):
+    graph, table, conf = write_graph(dirname)
+    decoder = PyDecoder(graph, table, conf)
+    words = [1, 2, 2, 1, 2]
+    loglikes = make_loglikes(words)
+
+    def decode(*args):
+        decoder.reset()
+        decoder.decode(*args)
+        return list(decoder.best_sequence())
+
+    assert decode(loglikes) == words
+    # strided rows are read in place
+    wide = np.zeros([len(words), NUM_PDFS + 3], dtype=np.float32)
+    wide[:, :NUM_PDFS] = loglikes
+    assert decode(wide[:, :NUM_PDFS]) == words
+    assert decode(loglikes.astype(np.float16)) == words
+    scales = np.full(len(words), 3.0 / 127, dtype=np.float32)
+    int8_loglikes = np.round(loglikes / scales[:, None]).astype(np.int8)
+    assert decode(int8_loglikes, scales) == words
+
+    utts = [[1, 2], [2, 2, 2, 1], [1], [2, 1, 2, 1, 1, 2]]
+    batch = [make_loglikes(utt) for utt in utts]
+    batch[1] = np.asfortranarray(batch[1])
+    assert [list(seq) for seq in decoder.decode_many(batch, 2)] == utts
+    assert decoder.decode_many([]) == []
+
+    # GIL is released while decoding, one decoder per thread
+    results = [None] * len(utts)
+
+    def worker(u):
+        thread_decoder = PyDecoder(graph, table, conf)
+        thread_decoder.decode(batch[u])
+        results[u] = list(thread_decoder.best_sequence())
+
+    threads = [
+        threading.Thread(target=worker, args=(u, )) for u in range(len(utts))
+    ]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    assert results == utts
+    print("PyDecoder: OK")
+
+
+def test_symbols(dirname):
+    graph, table, conf = write_graph(dirname)
+    words_txt = os.path.join(dirname, "words.txt")
+    with open(words_txt, "w") as f:
+        for idx, word in enumerate(WORDS):
+            f.write("{} {:d}\n".format(word, idx))
+    tables = [words_txt]
+    # binary form is mapped, if the tool is built
+    tool = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..",
+                        "bin", "convert-symbol-table")
+    if os.path.exists(tool):
+        words_bin = os.path.join(dirname, "words.bin")
+        subprocess.check_call([tool, words_txt, words_bin])
+        tables.append(words_bin)
+
+    decoder = PyDecoder(graph, table, conf)
+    words = [1, 2, 2, 1, 2]
+    for fname in tables:
+        symbols = PySymbolTable(fname)
+        assert len(symbols) == len(WORDS)
+        assert [symbols[idx] for idx in range(len(WORDS))] == WORDS
+        for idx in [-1, len(WORDS)]:
+            try:
+                symbols[idx]
+                assert False, "expect IndexError for {:d}".format(idx)
+            except IndexError:
+                pass
+        assert symbols.join([2, 1]) == "world hello"
+        assert symbols.join([2, 1], sep="-") == "world-hello"
+        assert symbols.join([]) == ""
+        decoder.reset()
+        decoder.decode(make_loglikes(words))
+        assert decoder.best_text(symbols) == " ".join(WORDS[w] for w in words)
+    print("PySymbolTable: OK")
+
+
+def test_feature(dirname):
+    conf = os.path.join(dirname, "fbank.conf")
+    with open(conf, "w") as f:
+        f.write("--FbankOpts.num_mel_bins=40\n--FrameOpts.window=hamming\n")
+    extractor = PyFeatureExtractor(conf, "fbank")
+    wav = np.random.RandomState(777).randn(16000).astype(np.float32) * 1000
+    feats = extractor.compute(wav)
+    num_frames, dim = feats.shape
+    assert num_frames > 0 and dim == 40
+    # rows of out are strided, and out could be larger
+    out = np.zeros([num_frames + 3, dim + 7], dtype=np.float32)
+    extractor.reset()
+    assert extractor.compute(wav, out=out[:, :dim]) is not None
+    assert np.array_equal(out[:num_frames, :dim], feats)
+    assert not out[:, dim:].any()
+    # streaming, frames ready so far are same as compute()
+    extractor.reset()
+    extractor.accept_waveform(wav)
+    ready = extractor.ready_frames()
+    frames = extractor.get_frames()
+    assert frames.shape == (ready, dim) and 0 < ready <= num_frames
+    assert np.allclose(frames, feats[:ready], atol=1e-4)
+    print("PyFeatureExtractor: OK")
+
+
+if __name__ == "__main__":
+    dirname = tempfile.mkdtemp()
+    test_decoder(dirname)
+    test_symbols(dirname)
+    test_feature(dirname)
@@ -0,0 +1,81 @@
+// wujian@2018
+
+#include "decoder/batch-decoder.h"
+
+const Int32 batch_frames = 20;
+
+// Decode all utterances in parallel streams, compare with FasterDecoder
+int main(int argc, char const *argv[]) {
+  DecodeGraph graph("graph.fst", "trans.tab");
+  DecodeOpts opts("decode.conf");
+
+  ArchiveReader reader("posts.ref.ark");
+  std::vector<std::string> utts;
+  std::vector<std::vector<Float32> > loglikes;
+  Int32 num_pdfs = 0;
+  for (Int32 u = 0; u < reader.NumItems(); u++) {
+    const MatrixView &matrix = reader.Value(u);
+    num_pdfs = matrix.num_cols;
+    utts.push_back(reader.Key(u));
+    loglikes.push_back(std::vector<Float32>(matrix.num_rows * num_pdfs));
+    CopyMatrix(matrix, loglikes.back().data(), num_pdfs);
+  }
+  Int32 num_utts = utts.size();
+
+  Timer timer;
+  std::vector<std::vector<Int32> > ref_words(num_utts);
+  FasterDecoder decoder(graph, opts);
+  for (Int32 u = 0; u < num_utts; u++) {
+    decoder.Reset();
+    decoder.Decode(loglikes[u].data(), loglikes[u].size() / num_pdfs, num_pdfs,
+                   num_pdfs);
+    decoder.GetBestPath(&ref_words[u]);
+  }
+  LOG_INFO << "Decode " << num_utts << " utterances one by one, cost "
+           << timer.Elapsed() << "s";
+
+  // all streams start at the same time, batch_frames for each stream per call
+  timer.Reset();
+  BatchDecoder batch_decoder(graph, opts);
+  std::vector<Int32> streams(num_utts);
+  for (Int32 u = 0; u < num_utts; u++) streams[u] = batch_decoder.NewStream();
+  ASSERT(batch_decoder.NumActiveStreams() == num_utts);
+  std::vector<Float32> batch(num_utts * batch_frames * num_pdfs);
+  std::vector<Int32> batch_streams, batch_utts;
+  for (Int32 t = 0;; t += batch_frames) {
+    batch_streams.clear(), batch_utts.clear();
+    for (Int32 u = 0; u < num_utts; u++) {
+      if (t + batch_frames > loglikes[u].size() / num_pdfs) continue;
+      memcpy(batch.data() + batch_streams.size() * batch_frames * num_pdfs,
+             loglikes[u].data() + t * num_pdfs,
+             sizeof(Float32) * batch_frames * num_pdfs);
+      batch_streams.push_back(streams[u]);
+      batch_utts.push_back(u);
+    }
+    if (batch_streams.empty()) break;
+    batch_decoder.DecodeFrames(batch.data(), batch_streams.data(),
+                               batch_streams.size(), batch_frames, num_pdfs,
+                               num_pdfs);
+  }
+  // remaining frames of each stream
+  for (Int32 u = 0; u < num_utts; u++) {
+    Int32 done = batch_decoder.NumDecodedFrames(streams[u]),
+          left = loglikes[u].size() / num_pdfs - done;
+    if (left)
+      batch_decoder.DecodeFrames(loglikes[u].data() + done * num_pdfs,
+                                 &streams[u], 1, left, num_pdfs, num_pdfs);
+  }
+  for (Int32 u = 0; u < num_utts; u++) {
+    std::vector<Int32> word_ids;
+    batch_decoder.GetBestPath(streams[u], &word_ids);
+    batch_decoder.FreeStream(streams[u]);
+    if (word_ids != ref_words[u])
+      LOG_FAIL << "Mismatch results of utterance " << utts[u];
+  }
+  LOG_INFO << "Decode " << num_utts << " utterances in " << num_utts
+           << " streams, cost " << timer.Elapsed() << "s";
+  ASSERT(batch_decoder.NumActiveStreams() == 0);
+  // freed decoders are reused
+  ASSERT(batch_decoder.NewStream() < num_utts);
+  return 0;
+}
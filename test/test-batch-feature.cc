@@ -0,0 +1,119 @@
+// wujian@2018
+
+#include "decoder/batch-feature.h"
+#include "decoder/wave.h"
+
+// Max difference relative to reference values (absolute one below 1)
+Float32 MaxDifference(const std::vector<Float32> &feats,
+                      const std::vector<Float32> &ref_feats) {
+  ASSERT(feats.size() == ref_feats.size());
+  Float32 max_diff = 0;
+  for (UInt64 i = 0; i < feats.size(); i++)
+    max_diff = std::max(max_diff, std::abs(feats[i] - ref_feats[i]) /
+                                      std::max(1.0f, std::abs(ref_feats[i])));
+  return max_diff;
+}
+
+// Channels computed together by BatchFeatureComputer vs one Computer each,
+// and streams fed by packets vs whole channels
+void TestBatchFeature(const std::string &name, const FeatureTables &tables,
+                      Computer *computer,
+                      const std::vector<std::vector<Float32> > &channels) {
+  Int32 num_channels = channels.size(), dim = tables.FeatureDim();
+  std::vector<std::vector<Float32> > ref_feats(num_channels),
+      feats(num_channels), stream_feats(num_channels);
+  std::vector<const Float32 *> signals(num_channels);
+  std::vector<Float32 *> addrs(num_channels);
+  std::vector<Int32> num_samps(num_channels), num_frames(num_channels);
+  Timer timer;
+  for (Int32 c = 0; c < num_channels; c++) {
+    num_samps[c] = channels[c].size();
+    computer->Reset();
+    ref_feats[c].resize(computer->NumFrames(num_samps[c]) * dim);
+    ComputeFeature(computer, const_cast<Float32 *>(channels[c].data()),
+                   num_samps[c], ref_feats[c].data(), dim);
+  }
+  Float64 ref_time_cost = timer.Elapsed();
+
+  BatchFeatureComputer batch_computer(tables);
+  for (Int32 c = 0; c < num_channels; c++) {
+    signals[c] = channels[c].data();
+    feats[c].resize(tables.NumFrames(num_samps[c]) * dim);
+    addrs[c] = feats[c].data();
+  }
+  timer.Reset();
+  batch_computer.Compute(signals.data(), num_samps.data(), num_channels,
+                         addrs.data(), dim, num_frames.data());
+  Float64 time_cost = timer.Elapsed();
+  Float32 max_diff = 0;
+  for (Int32 c = 0; c < num_channels; c++) {
+    ASSERT(num_frames[c] * dim == ref_feats[c].size());
+    max_diff = std::max(max_diff, MaxDifference(feats[c], ref_feats[c]));
+  }
+  LOG_INFO << name << " of " << num_channels << " channels, one by one cost "
+           << ref_time_cost << "s, together cost " << time_cost
+           << "s, max difference " << max_diff;
+  ASSERT(max_diff < 5e-3);
+
+  // 10ms packets of channels in turn, frames are taken every 4 packets
+  const Int32 packet_size = tables.SampleRate() / 100;
+  std::vector<Int32> streams(num_channels);
+  for (Int32 c = 0; c < num_channels; c++) {
+    streams[c] = batch_computer.NewStream();
+    stream_feats[c].resize(feats[c].size());
+  }
+  std::vector<Int32> num_done(num_channels, 0);
+  for (Int32 p = 0, done = 0; !done; p++) {
+    done = 1;
+    for (Int32 c = 0; c < num_channels; c++) {
+      Int32 begin = p * packet_size,
+            n = std::min(packet_size, std::max(num_samps[c] - begin, 0));
+      if (n) batch_computer.AcceptWaveform(streams[c], signals[c] + begin, n);
+      done = done && !n;
+      addrs[c] = stream_feats[c].data() + num_done[c] * dim;
+    }
+    if (p % 4 && !done) continue;
+    batch_computer.GetFrames(streams.data(), num_channels, addrs.data(), dim,
+                             std::numeric_limits<Int32>::max(),
+                             num_frames.data());
+    for (Int32 c = 0; c < num_channels; c++) num_done[c] += num_frames[c];
+  }
+  for (Int32 c = 0; c < num_channels; c++) {
+    ASSERT(num_done[c] * dim == feats[c].size());
+    ASSERT(batch_computer.ReadyFrames(streams[c]) == 0);
+    ASSERT(stream_feats[c] == feats[c]);
+    batch_computer.FreeStream(streams[c]);
+  }
+  ASSERT(batch_computer.NumActiveStreams() == 0);
+}
+
+int main(int argc, char const *argv[]) {
+  Wave egs;
+  ReadWave("egs.wav", &egs);
+  // channels of a call: the wave, scaled and delayed ones
+  const Int32 num_channels = 6;
+  std::vector<std::vector<Float32> > channels(num_channels);
+  for (Int32 c = 0; c < num_channels; c++) {
+    Int32 delay = c * 37;
+    channels[c].assign(egs.Data() + delay, egs.Data() + egs.NumSamples());
+    for (Float32 &sample : channels[c]) sample *= 1.0f / (c + 1);
+  }
+
+  SpectrogramOpts spectrogram_opts;
+  SpectrogramComputer spectrogram(spectrogram_opts);
+  TestBatchFeature("spectrogram", FeatureTables(spectrogram_opts),
+                   &spectrogram, channels);
+  FbankOpts fbank_opts;
+  fbank_opts.num_mel_bins = 40;
+  FbankComputer fbank(fbank_opts);
+  TestBatchFeature("fbank", FeatureTables(fbank_opts), &fbank, channels);
+  MfccOpts mfcc_opts;
+  {
+    ConfigureParser parser("mfcc.conf");
+    mfcc_opts.ParseConfigure(&parser);
+  }
+  MfccComputer mfcc(mfcc_opts);
+  TestBatchFeature("mfcc", FeatureTables(ConfigureTable("mfcc.conf"), "mfcc"),
+                   &mfcc, channels);
+  return 0;
+}
@@ -0,0 +1,101 @@
+// wujian@2018
+
+#include "decoder/compact-fst.h"
+#include "decoder/decoder.h"
+
+// Same topology and labels, weights differ within quantization error
+Bool CheckEqual(const ConstFst &fst, const CompactFst &compact_fst) {
+  if (fst.Start() != compact_fst.Start() ||
+      fst.NumStates() != compact_fst.NumStates() ||
+      fst.NumArcs() != compact_fst.NumArcs())
+    return false;
+  Float32 error = compact_fst.WeightError() * 1.01;
+  for (StateIterator siter(fst); !siter.Done(); siter.Next()) {
+    StateId state = siter.Value();
+    if (fst.NumArcs(state) != compact_fst.NumArcs(state) ||
+        fst.NumInputEpsilons(state) != compact_fst.NumInputEpsilons(state))
+      return false;
+    Weight final = fst.Final(state), compact_final = compact_fst.Final(state);
+    if (std::isinf(final) != std::isinf(compact_final) ||
+        (!std::isinf(final) && std::abs(final - compact_final) > error))
+      return false;
+    const Arc *arc = fst.Arcs(state);
+    for (const Arc &compact_arc : compact_fst.Arcs(state)) {
+      if (arc->ilabel != compact_arc.ilabel ||
+          arc->olabel != compact_arc.olabel ||
+          arc->nextstate != compact_arc.nextstate ||
+          std::abs(arc->weight - compact_arc.weight) > error)
+        return false;
+      arc++;
+    }
+  }
+  return true;
+}
+
+// Word level Levenshtein distance
+Int32 EditDistance(const std::vector<Int32> &ref,
+                   const std::vector<Int32> &hyp) {
+  std::vector<Int32> prev(hyp.size() + 1), cur(hyp.size() + 1);
+  for (Int32 j = 0; j <= hyp.size(); j++) prev[j] = j;
+  for (Int32 i = 1; i <= ref.size(); i++) {
+    cur[0] = i;
+    for (Int32 j = 1; j <= hyp.size(); j++)
+      cur[j] = std::min(std::min(prev[j], cur[j - 1]) + 1,
+                        prev[j - 1] + (ref[i - 1] != hyp[j - 1]));
+    std::swap(prev, cur);
+  }
+  return prev[hyp.size()];
+}
+
+int main(int argc, char const *argv[]) {
+  ConstFst fst("graph.fst");
+  Timer timer;
+  CompactFst compact_fst(fst);
+  LOG_INFO << "Encode CompactFst cost " << timer.Elapsed() << " s, "
+           << compact_fst.MemoryUsage() << " vs " << fst.MemoryUsage()
+           << " bytes";
+  ASSERT(CheckEqual(fst, compact_fst));
+
+  WriteCompactFst("graph.compact.fst", compact_fst);
+  CompactFst read_fst("graph.compact.fst");
+  ASSERT(CheckEqual(fst, read_fst));
+  ASSERT(read_fst.MemoryUsage() == compact_fst.MemoryUsage());
+
+  // compare decoding results
+  DecodeOpts opts("decode.conf");
+  DecodeGraph graph("graph.fst", "trans.tab");
+  CompactDecodeGraph compact_graph("graph.compact.fst", "trans.tab");
+  FasterDecoder decoder(graph, opts);
+  CompactFasterDecoder compact_decoder(compact_graph, opts);
+
+  ArchiveReader reader("posts.ref.ark");
+  Int32 num_frames, num_pdfs, num_words = 0, num_errs = 0;
+  Float64 time_cost = 0, compact_time_cost = 0;
+  std::vector<Float32> loglikes;
+  std::vector<Int32> word_ids, compact_word_ids;
+  for (Int32 u = 0; u < reader.NumItems(); u++) {
+    const MatrixView &matrix = reader.Value(u);
+    num_frames = matrix.num_rows, num_pdfs = matrix.num_cols;
+    loglikes.resize(num_frames * num_pdfs);
+    CopyMatrix(matrix, loglikes.data(), num_pdfs);
+    timer.Reset();
+    word_ids.clear();
+    decoder.Reset();
+    decoder.Decode(loglikes.data(), num_frames, num_pdfs, num_pdfs);
+    decoder.GetBestPath(&word_ids);
+    time_cost += timer.Elapsed();
+
+    timer.Reset();
+    compact_word_ids.clear();
+    compact_decoder.Reset();
+    compact_decoder.Decode(loglikes.data(), num_frames, num_pdfs, num_pdfs);
+    compact_decoder.GetBestPath(&compact_word_ids);
+    compact_time_cost += timer.Elapsed();
+    num_words += word_ids.size();
+    num_errs += EditDistance(word_ids, compact_word_ids);
+  }
+  LOG_INFO << "CompactFst vs ConstFst: " << num_errs << "/" << num_words
+           << " words differ, cost " << compact_time_cost << "s vs "
+           << time_cost << "s";
+  return 0;
+}
@@ -0,0 +1,69 @@
+// wujian@2018
+
+#include "decoder/compose-fst.h"
+#include "decoder/decoder.h"
+
+// Free grammar of all the output labels in fst: one state with a zero cost
+// loop per word, entered from the start state through an epsilon arc
+void MakeFreeGrammar(const ConstFst &fst, SimpleFst *grammar) {
+  std::vector<Label> words;
+  for (StateIterator siter(fst); !siter.Done(); siter.Next())
+    for (ArcIterator aiter(fst, siter.Value()); !aiter.Done(); aiter.Next())
+      if (aiter.Value().olabel) words.push_back(aiter.Value().olabel);
+  std::sort(words.begin(), words.end());
+  words.erase(std::unique(words.begin(), words.end()), words.end());
+  StateId start = grammar->AddState(), loop = grammar->AddState();
+  grammar->SetStart(start);
+  grammar->SetFinal(loop, 0);
+  grammar->AddArc(start, Arc(0, 0, 0, loop));
+  for (Label word : words) grammar->AddArc(loop, Arc(word, word, 0, loop));
+}
+
+// HCLG o free G is HCLG itself, so results should not change
+int main(int argc, char const *argv[]) {
+  DecodeGraph hclg("graph.fst", "trans.tab");
+  SimpleFst grammar;
+  MakeFreeGrammar(hclg.Fst(), &grammar);
+  ConstFst g(grammar);
+  DecodeOpts opts("decode.conf");
+  FasterDecoder decoder(hclg, opts);
+  // small cache, so arcs are dropped and expanded again, and states are
+  // dropped between utterances
+  const UInt64 max_states = 4096;
+  ComposeFst compose_fst(hclg, g, 4096, max_states);
+  ComposeFasterDecoder compose_decoder(compose_fst, hclg.Table(), opts);
+
+  ArchiveReader reader("posts.ref.ark");
+  Int32 num_frames, num_pdfs, num_utts = 0;
+  Float64 time_cost = 0, compose_time_cost = 0;
+  std::vector<Float32> loglikes;
+  std::vector<Int32> word_ids, compose_word_ids;
+  for (Int32 u = 0; u < reader.NumItems(); u++) {
+    const MatrixView &matrix = reader.Value(u);
+    num_frames = matrix.num_rows, num_pdfs = matrix.num_cols;
+    loglikes.resize(num_frames * num_pdfs);
+    CopyMatrix(matrix, loglikes.data(), num_pdfs);
+    Timer timer;
+    word_ids.clear();
+    decoder.Reset();
+    decoder.Decode(loglikes.data(), num_frames, num_pdfs, num_pdfs);
+    decoder.GetBestPath(&word_ids);
+    time_cost += timer.Elapsed();
+
+    timer.Reset();
+    compose_word_ids.clear();
+    compose_decoder.Reset();
+    ASSERT(compose_fst.NumStates() <= max_states);
+    compose_decoder.Decode(loglikes.data(), num_frames, num_pdfs, num_pdfs);
+    compose_decoder.GetBestPath(&compose_word_ids);
+    compose_time_cost += timer.Elapsed();
+    ASSERT(word_ids == compose_word_ids);
+    num_utts++;
+  }
+  LOG_INFO << "Decode " << num_utts << " utterances on HCLG o G, cost "
+           << compose_time_cost << "s vs " << time_cost << "s, "
+           << compose_fst.NumStates() << " states reached, "
+           << compose_fst.NumCachedArcs() << " arcs cached ("
+           << compose_fst.MemoryUsage() << " bytes)";
+  return 0;
+}
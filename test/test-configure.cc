@@ -2,6 +2,7 @@
 
 #include <Eigen/Dense>
 #include "decoder/config.h"
+#include "decoder/decoder.h"
 #include "decoder/signal.h"
 #include "decoder/wave.h"
 
@@ -33,6 +34,42 @@ void TestConfigure() {
   LOG_INFO << "Shape of mfcc: " << num_frames << " x " << dim;
   std::cout << mfcc << std::endl;
 }
+// Options parsed once and shared, same as parsing the file each time
+void TestConfigureTable() {
+  ConfigureTable table("mfcc.conf");
+  MfccOpts ref_opts;
+  {
+    ConfigureParser parser("mfcc.conf");
+    ref_opts.ParseConfigure(&parser);
+  }
+  Timer timer;
+  const Int32 num_copies = 1000;
+  for (Int32 i = 0; i < num_copies; i++) {
+    MfccOpts mfcc_opts;
+    ConfigureParser parser(table);
+    mfcc_opts.ParseConfigure(&parser);
+    ASSERT(mfcc_opts.Configure() == ref_opts.Configure());
+  }
+  LOG_INFO << "Parse " << num_copies << " MfccOpts from ConfigureTable cost "
+           << timer.Elapsed() << "s";
+
+  std::istringstream iss(
+      "# comment\n"
+      "--DecodeOpts.beam=12.5\n"
+      "\n"
+      "  --DecodeOpts.max_active=5000  \n"
+      "--DecodeOpts.precompute_cost=true\n"
+      "--EndpointOpts.rule1_min_trailing_silence=3.0\n");
+  ConfigureTable decode_table(iss, "<string>");
+  ASSERT(decode_table.NumOptions() == 4);
+  ASSERT(decode_table.Find("DecodeOpts", "beam") == 0);
+  ASSERT(decode_table.Find("DecodeOpts", "acwt") == -1);
+  DecodeOpts decode_opts(decode_table);
+  ASSERT(decode_opts.beam == 12.5f && decode_opts.max_active == 5000 &&
+         decode_opts.precompute_cost && decode_opts.min_active == 200);
+  ASSERT(decode_opts.endpoint_opts.rule1.min_trailing_silence == 3.0f);
+}
+
 /*
 --MfccOpts.num_ceps=40
 --MfccOpts.cepstral_lifter=40.0
@@ -41,5 +78,6 @@ void TestConfigure() {
 */
 int main(int argc, char const *argv[]) {
   TestConfigure();
+  TestConfigureTable();
   return 0;
 }
@@ -0,0 +1,73 @@
+// wujian@2018
+
+#include "decoder/const-fst.h"
+
+// Check whether ConstFst keeps same topology with SimpleFst, arcs of
+// ConstFst are partitioned (input epsilon arcs first) with relative order kept
+Bool CheckEqual(const SimpleFst &fst, const ConstFst &const_fst) {
+  if (fst.Start() != const_fst.Start() ||
+      fst.NumStates() != const_fst.NumStates())
+    return false;
+  for (StateIterator siter(fst); !siter.Done(); siter.Next()) {
+    StateId state = siter.Value();
+    if (fst.NumArcs(state) != const_fst.NumArcs(state) ||
+        fst.Final(state) != const_fst.Final(state))
+      return false;
+    const Arc *eps_arc = const_fst.Arcs(state),
+              *emit_arc = eps_arc + const_fst.NumInputEpsilons(state);
+    for (ArcIterator aiter(fst, state); !aiter.Done(); aiter.Next()) {
+      const Arc &arc = aiter.Value(),
+                &const_arc = (arc.ilabel == 0 ? *eps_arc++ : *emit_arc++);
+      if (arc.ilabel != const_arc.ilabel || arc.olabel != const_arc.olabel ||
+          arc.weight != const_arc.weight ||
+          arc.nextstate != const_arc.nextstate)
+        return false;
+    }
+    if (eps_arc != const_fst.Arcs(state) + const_fst.NumInputEpsilons(state))
+      return false;
+  }
+  return true;
+}
+
+int main(int argc, char const *argv[]) {
+  SimpleFst fst;
+  Timer timer;
+  ReadSimpleFst("graph.fst", &fst);
+  LOG_INFO << "Read SimpleFst cost " << timer.Elapsed() << " s";
+
+  timer.Reset();
+  ConstFst frozen_fst(fst);
+  LOG_INFO << "Freeze SimpleFst cost " << timer.Elapsed() << " s";
+  ASSERT(CheckEqual(fst, frozen_fst));
+
+  timer.Reset();
+  ConstFst const_fst("graph.fst");
+  LOG_INFO << "Read ConstFst cost " << timer.Elapsed() << " s, "
+           << const_fst.MemoryUsage() << " bytes";
+  ASSERT(CheckEqual(fst, const_fst));
+
+  WriteConstFst("graph.const.fst", const_fst);
+  timer.Reset();
+  ConstFst mapped_fst("graph.const.fst");
+  LOG_INFO << "Map ConstFst cost " << timer.Elapsed() << " s";
+  ASSERT(mapped_fst.IsMapped());
+  ASSERT(CheckEqual(fst, mapped_fst));
+
+  TransitionTable table;
+  ReadTransitionTable("trans.tab", &table);
+  mapped_fst.RelabelToPdfs(table);
+  ASSERT(!mapped_fst.IsMapped() && mapped_fst.IsPdfLabeled());
+  WriteConstFst("graph.pdf.fst", mapped_fst);
+  ConstFst pdf_fst("graph.pdf.fst");
+  ASSERT(pdf_fst.NumPdfs() == table.NumPdfs());
+  for (StateIterator siter(fst); !siter.Done(); siter.Next()) {
+    StateId state = siter.Value();
+    const Arc *arcs = const_fst.Arcs(state), *pdf_arcs = pdf_fst.Arcs(state);
+    for (UInt64 i = 0; i < pdf_fst.NumArcs(state); i++) {
+      Label ilabel = arcs[i].ilabel;
+      ASSERT(pdf_arcs[i].ilabel ==
+             (ilabel ? table.TransitionIdToPdf(ilabel) + 1 : 0));
+    }
+  }
+  return 0;
+}
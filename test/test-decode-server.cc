@@ -0,0 +1,84 @@
+// wujian@2018
+
+#include "decoder/decode-server.h"
+
+void TestDecodeServer(const DecodeGraph &graph, const DecodeOpts &opts,
+                      const DecodeServerOpts &server_opts,
+                      const std::vector<std::string> &utts,
+                      const std::vector<std::vector<Float32> > &loglikes,
+                      Int32 num_pdfs,
+                      const std::vector<std::vector<Int32> > &ref_words,
+                      Bool borrow = false) {
+  Timer timer;
+  DecodeServer server(graph, opts, server_opts);
+  // submit in another thread, which blocks if max_pending reached
+  std::thread producer([&] {
+    for (Int32 u = 0; u < utts.size(); u++) {
+      Int32 num_frames = loglikes[u].size() / num_pdfs;
+      if (borrow) {
+        server.Submit(utts[u], loglikes[u].data(), num_frames, num_pdfs,
+                      num_pdfs);
+      } else {
+        std::vector<Float32> copy = loglikes[u];
+        server.Submit(utts[u], std::move(copy), num_frames, num_pdfs);
+      }
+    }
+    server.Close();
+  });
+  DecodeResult result;
+  Int32 num_results = 0;
+  while (server.GetResult(&result)) {
+    if (server_opts.ordered) ASSERT(result.index == num_results);
+    ASSERT(result.succeed && result.key == utts[result.index]);
+    if (result.word_ids != ref_words[result.index])
+      LOG_FAIL << "Mismatch results of utterance " << result.key;
+    num_results++;
+  }
+  producer.join();
+  ASSERT(num_results == utts.size());
+  LOG_INFO << "Decode " << num_results << " utterances with "
+           << server_opts.num_workers << " workers("
+           << (server_opts.ordered ? "ordered" : "unordered")
+           << (borrow ? ", borrowed loglikes" : "") << "), cost "
+           << timer.Elapsed() << "s";
+}
+
+int main(int argc, char const *argv[]) {
+  DecodeGraph graph("graph.fst", "trans.tab");
+  DecodeOpts opts("decode.conf");
+
+  ArchiveReader reader("posts.ref.ark");
+  std::vector<std::string> utts;
+  std::vector<std::vector<Float32> > loglikes;
+  Int32 num_pdfs = 0;
+  for (Int32 u = 0; u < reader.NumItems(); u++) {
+    const MatrixView &matrix = reader.Value(u);
+    num_pdfs = matrix.num_cols;
+    utts.push_back(reader.Key(u));
+    loglikes.push_back(std::vector<Float32>(matrix.num_rows * num_pdfs));
+    CopyMatrix(matrix, loglikes.back().data(), num_pdfs);
+  }
+
+  Timer timer;
+  std::vector<std::vector<Int32> > ref_words(utts.size());
+  FasterDecoder decoder(graph, opts);
+  for (Int32 u = 0; u < utts.size(); u++) {
+    decoder.Reset();
+    decoder.Decode(loglikes[u].data(), loglikes[u].size() / num_pdfs, num_pdfs,
+                   num_pdfs);
+    decoder.GetBestPath(&ref_words[u]);
+  }
+  LOG_INFO << "Decode " << utts.size() << " utterances one by one, cost "
+           << timer.Elapsed() << "s";
+
+  Int32 num_cores = std::max(std::thread::hardware_concurrency(), 1u);
+  TestDecodeServer(graph, opts, DecodeServerOpts(num_cores, 2, true), utts,
+                   loglikes, num_pdfs, ref_words);
+  TestDecodeServer(graph, opts, DecodeServerOpts(num_cores, 2, false), utts,
+                   loglikes, num_pdfs, ref_words);
+  TestDecodeServer(graph, opts, DecodeServerOpts(4, 64, true), utts, loglikes,
+                   num_pdfs, ref_words);
+  TestDecodeServer(graph, opts, DecodeServerOpts(num_cores, 2, true), utts,
+                   loglikes, num_pdfs, ref_words, true);
+  return 0;
+}
@@ -4,24 +4,9 @@
 
 const Int32 traceback_interval = 400;  // 4s
 
-Bool ReadLoglikeInArchive(std::istream &is, std::string *token, Int32 *num_rows,
-                          Int32 *num_cols) {
-  is >> *token;
-  if (is.eof()) return false;
-  ASSERT(isspace(is.peek()) && "Expect space after each token");
-  is.get();
-  ASSERT(is.get() == '\0' && is.get() == 'B' && "Expect binary header(\\0B)");
-  ExpectToken(is, "FM");
-  ReadBinaryBasicType(is, num_rows);
-  ReadBinaryBasicType(is, num_cols);
-  LOG_INFO << "Get matrix " << *token << ": " << *num_rows << " x "
-           << *num_cols;
-  return true;
-}
-
-void TestOfflineDecode(FasterDecoder &decoder, Float32 *loglikes,
-                       Int32 num_frames, Int32 num_pdfs,
-                       std::vector<Int32> *word_ids) {
+template <class Decoder>
+void TestOfflineDecode(Decoder &decoder, Float32 *loglikes, Int32 num_frames,
+                       Int32 num_pdfs, std::vector<Int32> *word_ids) {
   word_ids->clear();
   decoder.Reset();
   decoder.Decode(loglikes, num_frames, num_pdfs, num_pdfs);
@@ -34,25 +19,151 @@ void TestOfflineDecode(FasterDecoder &decoder, Float32 *loglikes,
   decoder.GetBestPath(word_ids);
 }
 
+// Get partial results every traceback_interval frames without Reset()
 void TestOnlineDecode(FasterDecoder &decoder, Float32 *loglikes,
                       Int32 num_frames, Int32 num_pdfs,
                       std::vector<Int32> *word_ids) {
   word_ids->clear();
   decoder.Reset();
-  Int32 decode_frames = 0, num_chunks = 0;
+  std::vector<Int32> stable_words, partial_words;
+  Int32 num_partials = 0, endpoint = -1;
   for (Int32 t = 0; t < num_frames; t++) {
     decoder.DecodeFrame(loglikes + t * num_pdfs, num_pdfs);
+    if (endpoint < 0 && decoder.EndpointDetected()) endpoint = t;
     if ((t + 1) % traceback_interval == 0) {
-      decoder.GetBestPath(word_ids);
-      decode_frames += decoder.NumDecodedFrames(), num_chunks += 1;
-      decoder.Reset();
+      decoder.GetPartialPath(&stable_words, &partial_words);
+      num_partials++;
     }
   }
+  decoder.GetPartialPath(&stable_words, &partial_words);
   decoder.GetBestPath(word_ids);
-  decode_frames += decoder.NumDecodedFrames();
-  ASSERT(decode_frames == num_frames);
-  LOG_INFO << "Decode in " << num_chunks << " chunks(" << traceback_interval
-           << " frames per chunk, total " << num_frames << " frames";
+  ASSERT(decoder.NumDecodedFrames() == num_frames);
+  // stable words never change
+  ASSERT(stable_words.size() <= word_ids->size() &&
+         std::equal(stable_words.begin(), stable_words.end(),
+                    word_ids->begin()));
+  LOG_INFO << "Decode with " << num_partials << " partial results("
+           << traceback_interval << " frames per partial), " << num_frames
+           << " frames, " << stable_words.size() << "/" << word_ids->size()
+           << " words stabilized before the end, endpoint at frame "
+           << endpoint;
+}
+
+// Decode one of every 3 frames and skip the most blank-like 20% of them (pdf
+// 0 as blank), in chunks of 7 frames. Same as full decoding of these frames
+void TestSkippedDecode(const SimpleFst &fst, const TransitionTable &table,
+                       const DecodeOpts &opts, Float32 *loglikes,
+                       Int32 num_frames, Int32 num_pdfs) {
+  const Int32 factor = 3, chunk_size = 7;
+  std::vector<Float32> blank_loglikes;
+  for (Int32 t = 0; t < num_frames; t += factor)
+    blank_loglikes.push_back(loglikes[t * num_pdfs]);
+  std::sort(blank_loglikes.begin(), blank_loglikes.end());
+  DecodeOpts skip_opts = opts;
+  skip_opts.frame_subsampling_factor = factor;
+  skip_opts.blank_id = 0;
+  skip_opts.blank_threshold =
+      expf(blank_loglikes[blank_loglikes.size() * 4 / 5]);
+  FasterDecoder decoder(fst, table, skip_opts);
+  decoder.Reset();
+  for (Int32 t = 0; t < num_frames; t += chunk_size)
+    decoder.Decode(loglikes + t * num_pdfs,
+                   std::min(chunk_size, num_frames - t), num_pdfs, num_pdfs);
+  std::vector<Int32> word_ids, ref_word_ids;
+  decoder.GetBestPath(&word_ids);
+
+  std::vector<Float32> kept;
+  Float32 log_threshold = logf(skip_opts.blank_threshold);
+  for (Int32 t = 0; t < num_frames; t += factor)
+    if (loglikes[t * num_pdfs] <= log_threshold)
+      kept.insert(kept.end(), loglikes + t * num_pdfs,
+                  loglikes + (t + 1) * num_pdfs);
+  FasterDecoder ref_decoder(fst, table, opts);
+  Int32 num_kept = kept.size() / num_pdfs;
+  TestOfflineDecode(ref_decoder, kept.data(), num_kept, num_pdfs,
+                    &ref_word_ids);
+  ASSERT(decoder.NumDecodedFrames() == num_kept);
+  ASSERT(decoder.NumDecodedFrames() + decoder.NumSkippedFrames() ==
+         (num_frames + factor - 1) / factor);
+  ASSERT(word_ids == ref_word_ids);
+  LOG_INFO << "Subsampled decoding: " << num_kept << "/" << num_frames
+           << " frames decoded, " << decoder.NumSkippedFrames()
+           << " blank frames skipped, " << word_ids.size() << " words";
+}
+
+// Save the state half way, restore it into another decoder and continue, same
+// as decoding without interruption
+void TestSaveRestore(const SimpleFst &fst, const TransitionTable &table,
+                     const DecodeOpts &opts, Float32 *loglikes,
+                     Int32 num_frames, Int32 num_pdfs,
+                     const std::vector<Int32> &ref_word_ids) {
+  FasterDecoder decoder(fst, table, opts), restored(fst, table, opts);
+  Int32 half = num_frames / 2;
+  decoder.Reset();
+  decoder.Decode(loglikes, half, num_pdfs, num_pdfs);
+  std::string buffer, again;
+  decoder.SaveState(&buffer);
+  // no uninitialized bytes in the saved state
+  decoder.SaveState(&again);
+  ASSERT(buffer == again);
+  restored.RestoreState(buffer);
+  ASSERT(restored.NumDecodedFrames() == half);
+  restored.Decode(loglikes + half * num_pdfs, num_frames - half, num_pdfs,
+                  num_pdfs);
+  std::vector<Int32> word_ids;
+  restored.GetBestPath(&word_ids);
+  ASSERT(word_ids == ref_word_ids);
+  LOG_INFO << "Restore decoder state at frame " << half << " from "
+           << buffer.size() << " bytes";
+}
+
+// All the halves (except nan) go through Float32 and back unchanged
+void TestHalfConversion() {
+  for (UInt32 half = 0; half < 65536; half++) {
+    Float32 value = HalfToFloat(half);
+    if (std::isnan(value)) continue;
+    ASSERT(FloatToHalf(value) == half);
+  }
+  ASSERT(HalfToFloat(FloatToHalf(-1.5f)) == -1.5f);
+  ASSERT(std::isinf(HalfToFloat(FloatToHalf(1e6f))));
+}
+
+// Convert loglikes to half precision and int8 (rows shifted to max = 0, one
+// scale per frame)
+void CompressLoglikes(const Float32 *loglikes, Int32 num_frames,
+                      Int32 num_pdfs, std::vector<UInt16> *half_loglikes,
+                      std::vector<Int08> *int8_loglikes,
+                      std::vector<Float32> *scales) {
+  half_loglikes->resize(num_frames * num_pdfs);
+  int8_loglikes->resize(num_frames * num_pdfs);
+  scales->resize(num_frames);
+  for (Int32 t = 0; t < num_frames; t++) {
+    const Float32 *row = loglikes + t * num_pdfs;
+    Float32 max = *std::max_element(row, row + num_pdfs),
+            min = *std::min_element(row, row + num_pdfs);
+    Float32 scale = max > min ? (max - min) / 127 : 1;
+    (*scales)[t] = scale;
+    for (Int32 p = 0; p < num_pdfs; p++) {
+      (*half_loglikes)[t * num_pdfs + p] = FloatToHalf(row[p]);
+      (*int8_loglikes)[t * num_pdfs + p] =
+          static_cast<Int08>(std::round((row[p] - max) / scale));
+    }
+  }
+}
+
+// Word level Levenshtein distance
+Int32 EditDistance(const std::vector<Int32> &ref,
+                   const std::vector<Int32> &hyp) {
+  std::vector<Int32> prev(hyp.size() + 1), cur(hyp.size() + 1);
+  for (Int32 j = 0; j <= hyp.size(); j++) prev[j] = j;
+  for (Int32 i = 1; i <= ref.size(); i++) {
+    cur[0] = i;
+    for (Int32 j = 1; j <= hyp.size(); j++)
+      cur[j] = std::min(std::min(prev[j], cur[j - 1]) + 1,
+                        prev[j - 1] + (ref[i - 1] != hyp[j - 1]));
+    std::swap(prev, cur);
+  }
+  return prev[hyp.size()];
 }
 
 // Run command:
@@ -63,41 +174,133 @@ int main(int argc, char const *argv[]) {
   ReadTransitionTable("trans.tab", &table);
   SimpleFst fst;
   ReadSimpleFst("graph.fst", &fst);
+  TestHalfConversion();
   DecodeOpts opts("decode.conf");
   std::cerr << "Decode options: \n" << opts.Configure();
   FasterDecoder decoder(fst, table, opts);
+  // compare histogram pruning with exact one
+  DecodeOpts hist_opts = opts;
+  hist_opts.histogram_bins = opts.histogram_bins ? 0 : 256;
+  FasterDecoder hist_decoder(fst, table, hist_opts);
+  // same search on open addressing token map
+  FlatFasterDecoder flat_decoder(fst, table, opts);
+  // emitting arcs expanded by 4 threads on every frame
+  DecodeOpts parallel_opts = opts;
+  parallel_opts.num_threads = 4;
+  parallel_opts.parallel_min_tokens = 0;
+  FasterDecoder parallel_decoder(fst, table, parallel_opts);
+  Float64 time_cost = 0, hist_time_cost = 0, flat_time_cost = 0,
+          parallel_time_cost = 0, half_time_cost = 0, int8_time_cost = 0;
+  Int32 num_words = 0, num_errs = 0, num_flat_errs = 0, num_parallel_errs = 0,
+        num_half_errs = 0, num_int8_errs = 0;
+  std::vector<UInt16> half_loglikes;
+  std::vector<Int08> int8_loglikes;
+  std::vector<Float32> scales;
+  std::vector<Int32> half_word_ids, int8_word_ids;
 
-  BinaryInput bo("posts.ref.ark");
+  // loglikes are read in place from the mapped archive, or decompressed into
+  // a buffer for compressed ones
+  ArchiveReader reader("posts.ref.ark");
+  std::vector<Float32> buffer;
   Int32 count = 0, num_frames, num_pdfs;
   std::string utt_id;
   // std::vector<Float32> loglikes;
-  std::vector<Int32> word_ids;
+  std::vector<Int32> word_ids, hist_word_ids, flat_word_ids, online_word_ids,
+      parallel_word_ids, rerun_word_ids;
 
-  while (true) {
-    utt_id.clear();
-    Bool go =
-        ReadLoglikeInArchive(bo.Stream(), &utt_id, &num_frames, &num_pdfs);
-    if (!go) break;
-    // loglikes.resize(num_frames * num_pdfs);
-    Float32 *loglikes = new Float32[num_frames * num_pdfs];
-    ReadBinary(bo.Stream(), reinterpret_cast<char *>(loglikes),
-               sizeof(Float32) * num_frames * num_pdfs);
+  for (Int32 u = 0; u < reader.NumItems(); u++) {
+    utt_id = reader.Key(u);
+    const MatrixView &matrix = reader.Value(u);
+    num_frames = matrix.num_rows, num_pdfs = matrix.num_cols;
+    LOG_INFO << "Get matrix " << utt_id << ": " << num_frames << " x "
+             << num_pdfs;
+    Float32 *loglikes;
+    if (matrix.compress_format) {
+      buffer.resize(num_frames * num_pdfs);
+      CopyMatrix(matrix, buffer.data(), num_pdfs);
+      loglikes = buffer.data();
+    } else {
+      loglikes = const_cast<Float32 *>(matrix.FloatData());
+    }
     Timer timer;
     TestOfflineDecode(decoder, loglikes, num_frames, num_pdfs, &word_ids);
+    time_cost += timer.Elapsed();
     LOG_INFO << "Decode utterance(offline) " << utt_id << ": cost "
              << timer.Elapsed() << "s";
+    timer.Reset();
+    TestOfflineDecode(hist_decoder, loglikes, num_frames, num_pdfs,
+                      &hist_word_ids);
+    hist_time_cost += timer.Elapsed();
+    num_words += word_ids.size();
+    num_errs += EditDistance(word_ids, hist_word_ids);
+    timer.Reset();
+    TestOfflineDecode(flat_decoder, loglikes, num_frames, num_pdfs,
+                      &flat_word_ids);
+    flat_time_cost += timer.Elapsed();
+    num_flat_errs += EditDistance(word_ids, flat_word_ids);
+    timer.Reset();
+    TestOfflineDecode(parallel_decoder, loglikes, num_frames, num_pdfs,
+                      &parallel_word_ids);
+    parallel_time_cost += timer.Elapsed();
+    num_parallel_errs += EditDistance(word_ids, parallel_word_ids);
+    // same as 1 thread, and deterministic
+    ASSERT(parallel_word_ids == word_ids);
+    if (count == 0) {
+      TestOfflineDecode(parallel_decoder, loglikes, num_frames, num_pdfs,
+                        &rerun_word_ids);
+      ASSERT(rerun_word_ids == parallel_word_ids);
+    }
+    // compressed loglikes
+    CompressLoglikes(loglikes, num_frames, num_pdfs, &half_loglikes,
+                     &int8_loglikes, &scales);
+    timer.Reset();
+    decoder.Reset();
+    decoder.Decode(half_loglikes.data(), num_frames, num_pdfs, num_pdfs);
+    half_word_ids.clear();
+    decoder.GetBestPath(&half_word_ids);
+    half_time_cost += timer.Elapsed();
+    num_half_errs += EditDistance(word_ids, half_word_ids);
+    timer.Reset();
+    decoder.Reset();
+    decoder.Decode(int8_loglikes.data(), scales.data(), num_frames, num_pdfs,
+                   num_pdfs);
+    int8_word_ids.clear();
+    decoder.GetBestPath(&int8_word_ids);
+    int8_time_cost += timer.Elapsed();
+    num_int8_errs += EditDistance(word_ids, int8_word_ids);
     for (Int32 i = 0; i < word_ids.size(); i++)
       std::cout << (i == 0 ? utt_id : "") << " " << word_ids[i]
                 << (i == word_ids.size() - 1 ? "\n" : "");
-    // timer.Reset();
-    // TestOnlineDecode(decoder, loglikes.data(), num_frames, num_pdfs,
-    //                  &word_ids);
-    // LOG_INFO << "Decode utterance(online)  " << utt_id << ": cost
-    // " << timer.Elapsed() << "s"; for (Int32 i = 0; i < word_ids.size(); i++)
-    //     std::cout << (i == 0 ? utt_id : "") << " " << word_ids[i] << (i ==
-    //     word_ids.size() - 1 ? "\n": "");
+    timer.Reset();
+    TestOnlineDecode(decoder, loglikes, num_frames, num_pdfs,
+                     &online_word_ids);
+    LOG_INFO << "Decode utterance(online)  " << utt_id << ": cost "
+             << timer.Elapsed() << "s";
+    // partial traceback does not change the search
+    ASSERT(online_word_ids == word_ids);
+    if (count == 0) {
+      TestSkippedDecode(fst, table, opts, loglikes, num_frames, num_pdfs);
+      TestSaveRestore(fst, table, opts, loglikes, num_frames, num_pdfs,
+                      word_ids);
+    }
     count++;
-    delete[] loglikes;
   }
+  LOG_INFO << "Token allocator: " << decoder.TokenStats().ToString();
+  LOG_INFO << "histogram_bins = " << hist_opts.histogram_bins << " vs "
+           << opts.histogram_bins << ": " << num_errs << "/" << num_words
+           << " words differ, cost " << hist_time_cost << "s vs " << time_cost
+           << "s";
+  LOG_INFO << "FlatHashList vs HashList: " << num_flat_errs << "/"
+           << num_words << " words differ, cost " << flat_time_cost
+           << "s vs " << time_cost << "s";
+  LOG_INFO << parallel_opts.num_threads << " threads vs 1: "
+           << num_parallel_errs << "/" << num_words << " words differ, cost "
+           << parallel_time_cost << "s vs " << time_cost << "s";
+  LOG_INFO << "Float16 vs Float32 loglikes: " << num_half_errs << "/"
+           << num_words << " words differ, cost " << half_time_cost
+           << "s vs " << time_cost << "s";
+  LOG_INFO << "Int8 vs Float32 loglikes: " << num_int8_errs << "/"
+           << num_words << " words differ, cost " << int8_time_cost
+           << "s vs " << time_cost << "s";
   return 0;
 }
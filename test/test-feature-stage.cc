@@ -0,0 +1,88 @@
+// wujian@2018
+
+#include <Eigen/Dense>
+#include "decoder/feature-stage.h"
+
+using namespace Eigen;
+
+typedef Matrix<Float32, Dynamic, Dynamic, RowMajor> Mat;
+
+// Feed rows of feats (stride >= OutputDim()) in blocks of random size, then
+// flush, return number of rows out
+Int32 RunStage(FeatureStage *stage, Mat *feats) {
+  Int32 num_frames = feats->rows(), stride = feats->cols(), num_output = 0;
+  stage->Reset();
+  for (Int32 t = 0; t < num_frames;) {
+    Int32 n = std::min(rand() % 7 + 1, num_frames - t);
+    // rows [num_output, t) are free: move input rows next to them
+    for (Int32 i = 0; i < n; i++)
+      feats->row(num_output + i) = feats->row(t + i);
+    num_output +=
+        stage->Process(feats->data() + num_output * stride, stride, n);
+    t += n;
+  }
+  return num_output +
+         stage->Flush(feats->data() + num_output * stride, stride);
+}
+
+void TestCmvn() {
+  const Int32 N = 100, dim = 13;
+  Mat feats = Mat::Random(N, dim), ref = feats;
+  CmvnOpts opts(true, true, 30);
+  CmvnStage cmvn(dim, opts);
+  ASSERT(RunStage(&cmvn, &feats) == N);
+  Float32 max_diff = 0;
+  for (Int32 t = 1; t < N; t++) {
+    Int32 begin = std::max(0, t - 29), n = t - begin + 1;
+    Mat window = ref.block(begin, 0, n, dim);
+    RowVectorXf mean = window.colwise().mean();
+    RowVectorXf var = window.array().square().colwise().mean() -
+                      mean.array().square();
+    RowVectorXf expect = (ref.row(t) - mean).array() / var.array().sqrt();
+    max_diff =
+        std::max(max_diff, (expect - feats.row(t)).cwiseAbs().maxCoeff());
+  }
+  LOG_INFO << "Sliding window CMVN, max diff: " << max_diff;
+  ASSERT(max_diff < 1e-3);
+}
+
+void TestDeltaAndSplice() {
+  const Int32 N = 50, dim = 5;
+  Mat ref = Mat::Random(N, dim);
+  // delta + delta-delta with window 2
+  DeltaOpts delta_opts(2, 2);
+  DeltaStage delta(dim, delta_opts);
+  Mat feats = Mat::Zero(N, delta.OutputDim());
+  feats.leftCols(dim) = ref;
+  ASSERT(RunStage(&delta, &feats) == N);
+  auto frame = [&](Int32 t) {
+    return ref.row(std::max(0, std::min(t, N - 1)));
+  };
+  Float32 max_diff = 0;
+  for (Int32 t = 0; t < N; t++) {
+    RowVectorXf first = RowVectorXf::Zero(dim);
+    for (Int32 j = -2; j <= 2; j++) first += j * frame(t + j) / 10.0;
+    max_diff = std::max(max_diff, (feats.block(t, 0, 1, dim) - ref.row(t))
+                                      .cwiseAbs()
+                                      .maxCoeff());
+    max_diff = std::max(
+        max_diff, (feats.block(t, dim, 1, dim) - first).cwiseAbs().maxCoeff());
+  }
+  LOG_INFO << "Delta, max diff: " << max_diff;
+  ASSERT(max_diff < 1e-5);
+
+  SpliceOpts splice_opts(3, 2);
+  SpliceStage splice(dim, splice_opts);
+  feats = Mat::Zero(N, splice.OutputDim());
+  feats.leftCols(dim) = ref;
+  ASSERT(RunStage(&splice, &feats) == N);
+  for (Int32 t = 0; t < N; t++)
+    for (Int32 j = -3; j <= 2; j++)
+      ASSERT(feats.block(t, (j + 3) * dim, 1, dim) == frame(t + j));
+}
+
+int main(int argc, char const *argv[]) {
+  TestCmvn();
+  TestDeltaAndSplice();
+  return 0;
+}
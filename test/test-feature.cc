@@ -105,10 +105,34 @@ void TestFrameSplitter() {
   std::cout << frames << std::endl;
 }
 
+// ComputeFeature() runs blocks of frames, should be same as frame by frame
+template <class FeatureComputer, class FeatureOpts>
+void TestComputeFrames(const FeatureOpts &opts) {
+  FeatureComputer computer(opts), frame_computer(opts);
+  Wave egs;
+  ReadWave("egs.wav", &egs);
+
+  Int32 num_samples = egs.NumSamples();
+  Int32 num_frames = computer.NumFrames(num_samples),
+        dim = computer.FeatureDim();
+  Mat feats = Mat::Zero(num_frames, dim), frame_feats = feats;
+  ComputeFeature(&computer, egs.Data(), num_samples, feats.data(),
+                 feats.stride());
+  for (Int32 t = 0; t < num_frames; t++)
+    frame_computer.ComputeFrame(egs.Data(), num_samples, t,
+                                frame_feats.data() + t * frame_feats.stride());
+  Float32 diff = (feats - frame_feats).cwiseAbs().maxCoeff();
+  LOG_INFO << "Block vs frame by frame: " << diff;
+  ASSERT(diff < 1e-4);
+}
+
 int main(int argc, char const *argv[]) {
   // TestFrameSplitter();
   // TestSpectrogram();
   // TestFBank();
   TestMfcc();
+  TestComputeFrames<MfccComputer>(MfccOpts());
+  TestComputeFrames<FbankComputer>(FbankOpts());
+  TestComputeFrames<SpectrogramComputer>(SpectrogramOpts());
   return 0;
 }
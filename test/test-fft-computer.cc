@@ -5,6 +5,36 @@
 
 using namespace Eigen;
 
+// Max difference of RealFFT between two engines
+Float32 CompareEngines(Int32 N) {
+  VectorXf real_vector = VectorXf::Random(N), ref_vector = real_vector;
+  FFTComputer fftcomputer(N, kRadix4FFT), ref_fftcomputer(N, kRadix2FFT);
+  fftcomputer.RealFFT(real_vector.data(), N);
+  ref_fftcomputer.RealFFT(ref_vector.data(), N);
+  return (real_vector - ref_vector).cwiseAbs().maxCoeff();
+}
+
+// Max difference after ComplexFFT + inverse ComplexFFT
+Float32 RoundTrip(Int32 N) {
+  VectorXf cplx_vector = VectorXf::Random(N), ref_vector = cplx_vector;
+  FFTComputer fftcomputer(N);
+  fftcomputer.ComplexFFT(cplx_vector.data(), N, false);
+  fftcomputer.ComplexFFT(cplx_vector.data(), N, true);
+  return (cplx_vector - ref_vector).cwiseAbs().maxCoeff();
+}
+
+void BenchEngine(Int32 N, FFTEngine engine, Int32 num_iters) {
+  VectorXf real_vector = VectorXf::Random(N), buffer(N);
+  FFTComputer fftcomputer(N, engine);
+  Timer timer;
+  for (Int32 i = 0; i < num_iters; i++) {
+    buffer = real_vector;
+    fftcomputer.RealFFT(buffer.data(), N);
+  }
+  LOG_INFO << (engine == kRadix4FFT ? "radix-4" : "radix-2") << " RealFFT("
+           << N << ") x " << num_iters << " cost " << timer.Elapsed() << "s";
+}
+
 int main() {
   Int32 N = 8;
 
@@ -14,5 +44,14 @@ int main() {
 
   fftcomputer.RealFFT(reinterpret_cast<Float32*>(real_vector.data()), N);
   std::cout << real_vector << std::endl;
+
+  for (Int32 n = 4; n <= 4096; n <<= 1) {
+    Float32 diff = CompareEngines(n), error = RoundTrip(n);
+    LOG_INFO << "N = " << n << ", radix-4 vs radix-2: " << diff
+             << ", inverse error: " << error;
+    ASSERT(diff < 1e-4 * n && error < 1e-5 * n);
+  }
+  BenchEngine(512, kRadix2FFT, 100000);
+  BenchEngine(512, kRadix4FFT, 100000);
   return 0;
-}
\ No newline at end of file
+}
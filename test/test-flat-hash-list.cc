@@ -0,0 +1,110 @@
+// wujian@2018
+
+#include "decoder/flat-hash-list.h"
+#include "decoder/hash-list.h"
+
+const Int32 num_states = 2000000, num_frames = 200, num_finds = 4;
+
+template <class HashListType>
+void ClearList(HashListType *toks) {
+  for (auto *e = toks->Clear(), *e_tail = e; e != NULL; e = e_tail) {
+    e_tail = e->tail;
+    toks->Delete(e);
+  }
+}
+
+// Check that both containers agree on a few frames
+template <template <class, class> class HashListT>
+void TestHashList() {
+  typedef typename HashListT<Int32, Int32>::Elem Elem;
+  HashListT<Int32, Int32> toks;
+  toks.SetSize(100);
+  for (Int32 frame = 0; frame < 3; frame++) {
+    Elem *last = toks.Clear();
+    Int32 num_last = 0;
+    for (Elem *e = last, *e_tail; e != NULL; e = e_tail, num_last++) {
+      // last list keeps valid while inserting
+      ASSERT(e->val == e->key * 2 + frame - 1);
+      toks.Insert(e->key + 1, (e->key + 1) * 2 + frame);
+      e_tail = e->tail;
+      toks.Delete(e);
+    }
+    ASSERT(frame == 0 || num_last == 5000);
+    if (frame == 0)
+      for (Int32 k = 0; k < 5000; k++) toks.Insert(k * 3, k * 6);
+    for (Int32 k = 0; k < 5000; k++) {
+      Elem *e = toks.Find(k * 3 + frame);
+      ASSERT(e && e->key == k * 3 + frame);
+      ASSERT(toks.Find(k * 3 + frame + 1) == NULL);
+    }
+  }
+  ClearList(&toks);
+}
+
+inline UInt32 Mix(UInt32 x) {
+  x ^= x >> 16;
+  x *= 0x7feb352d;
+  x ^= x >> 15;
+  x *= 0x846ca68b;
+  x ^= x >> 16;
+  return x;
+}
+
+// Mimic ProcessEmitting(): each frame hands over the list of last frame,
+// expands each token into num_finds successors, and those survived from
+// pruning hit Find() and then Insert(). Pruning keeps about num_active tokens
+// and only depends on the state, so both containers give the same tokens.
+template <template <class, class> class HashListT>
+Float64 Benchmark(Int32 num_active, UInt64 *checksum) {
+  typedef typename HashListT<Int32, Int32>::Elem Elem;
+  HashListT<Int32, Int32> toks;
+  toks.SetSize(num_active * 2);
+  for (Int32 i = 0; i < num_active; i++) {
+    Int32 s = Mix(i) % num_states;
+    if (!toks.Find(s)) toks.Insert(s, 0);
+  }
+  Timer timer;
+  UInt64 sum = 0, num_last = num_active;
+  for (Int32 t = 0; t < num_frames; t++) {
+    Elem *last = toks.Clear();
+    UInt64 num_new = 0, range = num_last * num_finds;
+    for (Elem *e = last, *e_tail; e != NULL; e = e_tail) {
+      for (Int32 n = 0; n < num_finds; n++) {
+        Int32 next = Mix(e->key * num_finds + n) % num_states;
+        if (Mix(next + t) % range >= static_cast<UInt64>(num_active)) continue;
+        Elem *found = toks.Find(next);
+        if (found) {
+          found->val = std::min(found->val, e->val + n);
+        } else {
+          toks.Insert(next, e->val + n);
+          num_new++;
+        }
+      }
+      e_tail = e->tail;
+      toks.Delete(e);
+    }
+    for (const Elem *e = toks.GetList(); e != NULL; e = e->tail)
+      sum += e->key + e->val;
+    num_last = std::max<UInt64>(num_new, 1);
+  }
+  Float64 cost = timer.Elapsed();
+  ClearList(&toks);
+  *checksum = sum;
+  return cost;
+}
+
+int main(int argc, char const *argv[]) {
+  TestHashList<HashList>();
+  TestHashList<FlatHashList>();
+  const Int32 active_sizes[] = {1000, 5000, 10000, 20000, 50000};
+  for (Int32 num_active : active_sizes) {
+    UInt64 sum, flat_sum;
+    Float64 cost = Benchmark<HashList>(num_active, &sum);
+    Float64 flat_cost = Benchmark<FlatHashList>(num_active, &flat_sum);
+    ASSERT(sum == flat_sum);
+    LOG_INFO << "Active tokens " << num_active << ", " << num_frames
+             << " frames: HashList " << cost << "s, FlatHashList "
+             << flat_cost << "s";
+  }
+  return 0;
+}
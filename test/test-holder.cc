@@ -1,21 +1,116 @@
 // wujian@2018
 
+#include <random>
+#include <thread>
+
 #include "decoder/holder.h"
 
-int main(int argc, char const *argv[]) {
-  struct Token {
-    Int32 key;
-    Float32 cost;
-  };
+struct Token {
+  Int32 key;
+  Float32 cost;
+  Token *prev;
+
+  Token(Int32 key, Float32 cost, Token *prev)
+      : key(key), cost(cost), prev(prev) {}
+};
 
+const Int32 num_rounds = 200, num_objects = 20000;
+
+// Mimic decoder: each round allocates a batch of objects and frees most of
+// them in a shuffled order
+template <class NewFunc, class FreeFunc>
+Float64 Benchmark(NewFunc new_func, FreeFunc free_func) {
+  std::mt19937 rng(777);
+  std::vector<Token *> objects, survived;
+  Timer timer;
+  for (Int32 r = 0; r < num_rounds; r++) {
+    for (Int32 i = 0; i < num_objects; i++)
+      objects.push_back(new_func(i, r, objects.empty() ? NULL : objects[0]));
+    std::shuffle(objects.begin(), objects.end(), rng);
+    // keep 5% for next round
+    UInt64 num_keep = objects.size() / 20;
+    for (UInt64 i = num_keep; i < objects.size(); i++) free_func(objects[i]);
+    objects.resize(num_keep);
+  }
+  for (Token *tok : objects) free_func(tok);
+  return timer.Elapsed();
+}
+
+void TestHolder() {
   Holder<Token> token_holder;
   const Int32 num_object = 100;
   std::vector<Token *> to_free;
   for (Int32 i = 0; i < num_object; i++) {
-    Token *tok = token_holder.New();
-    tok->cost = -1;
+    Token *tok = token_holder.New(i, -1, nullptr);
     if (i % 2 == 0) to_free.push_back(tok);
   }
   for (Int32 i = 0; i < to_free.size(); i++) token_holder.Free(to_free[i]);
+  ASSERT(token_holder.NumActive() == num_object / 2);
+  token_holder.Release();
+  ASSERT(token_holder.NumActive() == 0);
+}
+
+// Objects from a cache freed by the holder and the other way round, stats are
+// the same as using the holder only
+void TestHolderCacheStats() {
+  Holder<Token> holder;
+  std::vector<Token *> from_cache, from_holder;
+  for (Int32 i = 0; i < 100; i++)
+    from_holder.push_back(holder.New(i, 0, nullptr));
+  {
+    HolderCache<Token> cache(&holder, 8);
+    for (Int32 i = 0; i < 100; i++)
+      from_cache.push_back(cache.New(i, 0, nullptr));
+    for (Token *tok : from_holder) cache.Free(tok);
+  }
+  AllocatorStats stats = holder.Stats();
+  ASSERT(stats.num_new == 200 && stats.num_free == 100);
+  ASSERT(stats.num_active == 100 && stats.max_active >= 100);
+  for (Token *tok : from_cache) holder.Free(tok);
+  stats = holder.Stats();
+  ASSERT(stats.num_new == 200 && stats.num_free == 200);
+  ASSERT(stats.num_active == 0);
+}
+
+int main(int argc, char const *argv[]) {
+  TestHolder();
+  TestHolderCacheStats();
+
+  Float64 system_cost = Benchmark(
+      [](Int32 k, Float32 c, Token *p) { return new Token(k, c, p); },
+      [](Token *tok) { delete tok; });
+
+  Holder<Token> holder;
+  Float64 holder_cost = Benchmark(
+      [&holder](Int32 k, Float32 c, Token *p) { return holder.New(k, c, p); },
+      [&holder](Token *tok) { holder.Free(tok); });
+  LOG_INFO << "Holder: " << holder.Stats().ToString();
+
+  const Int32 num_threads = 4;
+  Holder<Token> shared_holder;
+  std::vector<std::thread> workers;
+  Timer timer;
+  for (Int32 t = 0; t < num_threads; t++) {
+    workers.push_back(std::thread([&shared_holder]() {
+      HolderCache<Token> cache(&shared_holder);
+      Benchmark(
+          [&cache](Int32 k, Float32 c, Token *p) { return cache.New(k, c, p); },
+          [&cache](Token *tok) { cache.Free(tok); });
+    }));
+  }
+  for (std::thread &worker : workers) worker.join();
+  Float64 cache_cost = timer.Elapsed();
+  const AllocatorStats &stats = shared_holder.Stats();
+  ASSERT(stats.num_active == 0 && stats.num_new == stats.num_free);
+  ASSERT(stats.num_new == static_cast<UInt64>(num_threads) * num_rounds *
+                              num_objects);
+  LOG_INFO << "Shared holder: " << stats.ToString();
+
+  Float64 num_ops = 2.0 * num_rounds * num_objects;
+  LOG_INFO << "new/delete: " << num_ops / system_cost / 1e6 << " Mops/s";
+  LOG_INFO << "Holder:     " << num_ops / holder_cost / 1e6 << " Mops/s";
+  LOG_INFO << "HolderCache(" << num_threads
+           << " threads): " << num_ops * num_threads / cache_cost / 1e6
+           << " Mops/s";
   return 0;
 }
@@ -0,0 +1,111 @@
+// wujian@2018
+
+#include "decoder/lattice-decoder.h"
+
+// Two alignments of word 1 and one of word 2, followed by word 3:
+// 0 -1:1-> 1 -2:0-> 3 -5:3-> 4(final), word 1 through state 2 is better
+// 0 -1:0-> 2 -3:1-> 3
+// 0 -4:2-> 3
+void TestNBest() {
+  Lattice lat;
+  for (Int32 s = 0; s < 5; s++) lat.AddState();
+  lat.AddArc(0, LatticeArc(1, 1, 1.0, 2.5, 1));
+  lat.AddArc(1, LatticeArc(2, 0, 0.0, 1.0, 3));
+  lat.AddArc(0, LatticeArc(1, 0, 0.5, 1.0, 2));
+  lat.AddArc(2, LatticeArc(3, 1, 0.5, 1.0, 3));
+  lat.AddArc(0, LatticeArc(4, 2, 2.0, 3.0, 3));
+  lat.AddArc(3, LatticeArc(5, 3, 1.0, 1.0, 4));
+  lat.SetFinal(4, 0.5);
+  CompactLattice clat;
+  lat.Determinize(&clat);
+  // 0 -1-> 1 -3-> 3(final), 0 -2-> 2 -3-> 3
+  ASSERT(clat.NumStates() == 4 && clat.NumArcs() == 4);
+  std::vector<std::vector<Int32> > nbest;
+  std::vector<Float64> costs;
+  ASSERT(lat.GetNBest(3, &nbest, &costs));
+  ASSERT(nbest.size() == 2 && costs.size() == 2);
+  ASSERT(nbest[0] == std::vector<Int32>({1, 3}) && costs[0] == 5.5);
+  ASSERT(nbest[1] == std::vector<Int32>({2, 3}) && costs[1] == 7.5);
+  std::vector<Int32> best;
+  Float64 best_cost;
+  ASSERT(lat.GetBestPath(&best, &best_cost));
+  ASSERT(best == nbest[0] && best_cost == costs[0]);
+  // alignment of the best path of word 1 is kept
+  const CompactLatticeArc &arc = clat.Arcs(0)[0];
+  const CompactLatticeArc &next_arc = clat.Arcs(arc.nextstate)[0];
+  ASSERT(arc.word == 1 && arc.graph_cost == 1.0 && arc.acoustic_cost == 2.0);
+  std::vector<Int32> alignment = arc.alignment;
+  alignment.insert(alignment.end(), next_arc.alignment.begin(),
+                   next_arc.alignment.end());
+  ASSERT(alignment == std::vector<Int32>({1, 3, 5}));
+}
+
+// Compare best path of lattice with FasterDecoder, check N-best lists and
+// write lattices in text format(could be checked by lattice-copy
+// ark,t:lat.txt ark:- and lattice-copy ark,t:clat.txt ark:-)
+int main(int argc, char const *argv[]) {
+  TestNBest();
+  DecodeGraph graph("graph.fst", "trans.tab");
+  DecodeOpts decode_opts("decode.conf");
+  LatticeOpts lattice_opts("decode.conf");
+  std::cerr << "Lattice options: \n" << lattice_opts.Configure();
+  FasterDecoder decoder(graph, decode_opts);
+  LatticeDecoder lattice_decoder(graph, decode_opts, lattice_opts);
+
+  ArchiveReader reader("posts.ref.ark");
+  std::ofstream lat_os("lat.txt"), clat_os("clat.txt");
+  std::string utt_id;
+  Int32 num_frames, num_pdfs, num_utts = 0, num_mismatch = 0;
+  std::vector<Float32> loglikes;
+  std::vector<Int32> word_ids, lat_word_ids;
+  std::vector<std::vector<Int32> > nbest;
+  std::vector<Float64> nbest_costs;
+  Lattice lat;
+  CompactLattice clat;
+  for (Int32 u = 0; u < reader.NumItems(); u++) {
+    utt_id = reader.Key(u);
+    const MatrixView &matrix = reader.Value(u);
+    num_frames = matrix.num_rows, num_pdfs = matrix.num_cols;
+    loglikes.resize(num_frames * num_pdfs);
+    CopyMatrix(matrix, loglikes.data(), num_pdfs);
+    decoder.Reset();
+    decoder.Decode(loglikes.data(), num_frames, num_pdfs, num_pdfs);
+    word_ids.clear();
+    decoder.GetBestPath(&word_ids);
+
+    Timer timer;
+    UInt64 max_tokens = 0;
+    lattice_decoder.Reset();
+    for (Int32 t = 0; t < num_frames; t++) {
+      lattice_decoder.DecodeFrame(loglikes.data() + t * num_pdfs, num_pdfs);
+      max_tokens = std::max(max_tokens, lattice_decoder.NumTokens());
+    }
+    ASSERT(lattice_decoder.GetLattice(&lat));
+    ASSERT(lat.GetBestPath(&lat_word_ids));
+    LOG_INFO << "Decode utterance(lattice) " << utt_id << ": cost "
+             << timer.Elapsed() << "s, " << lat.NumStates() << " states and "
+             << lat.NumArcs() << " arcs, max " << max_tokens
+             << " tokens alive";
+    lat.Write(lat_os, utt_id);
+    lat.Determinize(&clat);
+    clat.Write(clat_os, utt_id);
+    ASSERT(clat.GetNBest(10, &nbest, &nbest_costs));
+    ASSERT(nbest[0] == lat_word_ids);
+    for (Int32 i = 1; i < nbest.size(); i++) {
+      ASSERT(nbest_costs[i] >= nbest_costs[i - 1]);
+      for (Int32 j = 0; j < i; j++) ASSERT(nbest[i] != nbest[j]);
+    }
+    LOG_INFO << "Compact lattice of " << utt_id << ": " << clat.NumStates()
+             << " states and " << clat.NumArcs() << " arcs, "
+             << nbest.size() << " best paths";
+    if (lat_word_ids != word_ids) {
+      LOG_WARN << "Best path of lattice mismatch with FasterDecoder on "
+               << utt_id;
+      num_mismatch++;
+    }
+    num_utts++;
+  }
+  LOG_INFO << num_mismatch << "/" << num_utts
+           << " utterances mismatch with FasterDecoder";
+  return 0;
+}
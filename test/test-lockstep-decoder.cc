@@ -0,0 +1,86 @@
+// wujian@2018
+
+#include "decoder/lockstep-decoder.h"
+
+// Decode all utterances in lockstep, cut to the shortest one, return words of
+// each utterance
+void LockstepDecode(const DecodeGraph &graph, const DecodeOpts &opts,
+                    const std::vector<std::vector<Float32> > &loglikes,
+                    Int32 num_frames, Int32 num_pdfs,
+                    std::vector<std::vector<Int32> > *word_ids) {
+  const Int32 chunk_frames = 20;
+  Int32 num_utts = loglikes.size();
+  LockstepDecoder decoder(graph, opts);
+  std::vector<Int32> streams(num_utts);
+  for (Int32 u = 0; u < num_utts; u++) streams[u] = decoder.NewStream();
+  ASSERT(decoder.NumActiveStreams() == num_utts);
+  std::vector<Float32> chunk(num_utts * chunk_frames * num_pdfs);
+  for (Int32 t = 0; t < num_frames; t += chunk_frames) {
+    Int32 n = std::min(chunk_frames, num_frames - t);
+    for (Int32 u = 0; u < num_utts; u++)
+      memcpy(chunk.data() + u * n * num_pdfs, loglikes[u].data() + t * num_pdfs,
+             sizeof(Float32) * n * num_pdfs);
+    decoder.DecodeFrames(chunk.data(), streams.data(), num_utts, n, num_pdfs,
+                         num_pdfs);
+  }
+  word_ids->resize(num_utts);
+  for (Int32 u = 0; u < num_utts; u++) {
+    ASSERT(decoder.NumDecodedFrames(streams[u]) == num_frames);
+    (*word_ids)[u].clear();
+    decoder.GetBestPath(streams[u], &(*word_ids)[u]);
+    decoder.FreeStream(streams[u]);
+  }
+  ASSERT(decoder.NumActiveStreams() == 0);
+  // freed streams are reused
+  ASSERT(decoder.NewStream() < num_utts);
+}
+
+// Compare with FasterDecoder, and check the result is the same for any number
+// of threads
+int main(int argc, char const *argv[]) {
+  DecodeGraph graph("graph.fst", "trans.tab");
+  DecodeOpts opts("decode.conf");
+
+  ArchiveReader reader("posts.ref.ark");
+  Int32 num_utts = reader.NumItems(), num_pdfs = 0,
+        min_frames = std::numeric_limits<Int32>::max();
+  std::vector<std::vector<Float32> > loglikes(num_utts);
+  for (Int32 u = 0; u < num_utts; u++) {
+    const MatrixView &matrix = reader.Value(u);
+    num_pdfs = matrix.num_cols;
+    loglikes[u].resize(matrix.num_rows * num_pdfs);
+    CopyMatrix(matrix, loglikes[u].data(), num_pdfs);
+    min_frames = std::min(min_frames, matrix.num_rows);
+  }
+
+  Timer timer;
+  std::vector<std::vector<Int32> > ref_words(num_utts);
+  FasterDecoder decoder(graph, opts);
+  for (Int32 u = 0; u < num_utts; u++) {
+    decoder.Reset();
+    decoder.Decode(loglikes[u].data(), min_frames, num_pdfs, num_pdfs);
+    decoder.GetBestPath(&ref_words[u]);
+  }
+  Float64 ref_time_cost = timer.Elapsed();
+
+  std::vector<std::vector<Int32> > word_ids, threaded_word_ids;
+  timer.Reset();
+  LockstepDecode(graph, opts, loglikes, min_frames, num_pdfs, &word_ids);
+  Float64 time_cost = timer.Elapsed();
+  DecodeOpts threaded_opts = opts;
+  threaded_opts.num_threads = 4;
+  timer.Reset();
+  LockstepDecode(graph, threaded_opts, loglikes, min_frames, num_pdfs,
+                 &threaded_word_ids);
+  Float64 threaded_time_cost = timer.Elapsed();
+  ASSERT(threaded_word_ids == word_ids);
+
+  Int32 num_diffs = 0;
+  for (Int32 u = 0; u < num_utts; u++) num_diffs += word_ids[u] != ref_words[u];
+  LOG_INFO << "Decode " << num_utts << " utterances (" << min_frames
+           << " frames) one by one, cost " << ref_time_cost
+           << "s, in lockstep, cost " << time_cost << "s (1 thread) and "
+           << threaded_time_cost << "s (" << threaded_opts.num_threads
+           << " threads), " << num_diffs << " utterances differ";
+  return 0;
+}
@@ -1,11 +1,48 @@
 // wujian@2018
 
+#include <thread>
+#include <vector>
+
 #include "decoder/logger.h"
 
+int num_formatted = 0;
+
+int Format(int value) {
+  num_formatted++;
+  return value;
+}
+
 int main(int argc, char const *argv[]) {
   LOG_INFO << "***TEST-INFO***\n";
   LOG_WARN << "***\nTEST-WARN***";
   LOG_INFO << "TEST-\nINFO";
   ASSERT(1 == 1);
+
+  // disabled levels do not format arguments
+  SetLogLevel(kWarn);
+  LOG_INFO << "TEST-INFO-SKIPPED " << Format(1);
+  LOG_DEBUG << "TEST-DEBUG-SKIPPED " << Format(2);
+  LOG_WARN << "TEST-WARN " << Format(3);
+  ASSERT(num_formatted == 1);
+  SetLogLevel(kDebug);
+  LOG_DEBUG << "TEST-DEBUG " << Format(4);
+  ASSERT(num_formatted == (kDebugLogging ? 2 : 1));
+  SetLogLevel(kInfo);
+
+  // if-else without braces
+  if (num_formatted)
+    LOG_INFO << "TEST-IF";
+  else
+    LOG_INFO << "TEST-ELSE";
+
+  SetLogAsync(true);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; i++)
+    threads.emplace_back([i] {
+      for (int n = 0; n < 3; n++)
+        LOG_INFO << "TEST-ASYNC thread " << i << ", line " << n;
+    });
+  for (std::thread &thread : threads) thread.join();
+  // pending lines are written before abort
   LOG_FAIL << "TEST-FAIL";
 }
@@ -1,6 +1,7 @@
 // wujian@2018
 
 #include <Eigen/Dense>
+#include <random>
 #include <sstream>
 
 #include "decoder/online.h"
@@ -53,9 +54,120 @@ void TestExtractor() {
   std::cout << mfcc << std::endl;
 }
 
+// Feed 10ms packets, should be same as offline. egs is taken as audio of
+// input_rate if it is not 0, so resampled by both extractors
+void TestStreamingExtractor(Int32 input_rate = 0,
+                            const std::string &conf = "mfcc.conf") {
+  FeatureExtractor extractor(conf, "mfcc"), offline_extractor(conf, "mfcc");
+  if (input_rate) {
+    extractor.SetInputRate(input_rate);
+    offline_extractor.SetInputRate(input_rate);
+  }
+
+  Wave egs;
+  ReadWave("egs.wav", &egs);
+  Int32 num_samples = egs.NumSamples();
+  Int32 num_frames = offline_extractor.NumFrames(num_samples),
+        dim = offline_extractor.FeatureDim();
+  Mat mfcc = Mat::Zero(num_frames, dim), online_mfcc = mfcc;
+  offline_extractor.Compute(egs.Data(), num_samples, mfcc.data(),
+                            mfcc.stride());
+
+  const Int32 packet_size = 160;
+  Int32 t = 0;
+  for (Int32 n = 0; n < num_samples; n += packet_size) {
+    extractor.AcceptWaveform(egs.Data() + n,
+                             std::min(packet_size, num_samples - n));
+    t += extractor.GetFrames(online_mfcc.data() + t * online_mfcc.stride(),
+                             online_mfcc.stride(), num_frames - t);
+  }
+  extractor.InputFinished();
+  t += extractor.GetFrames(online_mfcc.data() + t * online_mfcc.stride(),
+                           online_mfcc.stride(), num_frames - t);
+  ASSERT(t == num_frames && extractor.ReadyFrames() == 0);
+  Float32 diff = (mfcc - online_mfcc).cwiseAbs().maxCoeff();
+  LOG_INFO << "Streaming " << t << " frames(input rate "
+           << extractor.InputRate() << "), vs offline: " << diff;
+  ASSERT(diff == 0);
+}
+
+// Pad egs with one second of weak noise on both sides: padding should be
+// mostly silent, and features of active frames same as offline
+void TestOnlineVad() {
+  FeatureExtractor extractor("mfcc.conf", "mfcc"),
+      offline_extractor("mfcc.conf", "mfcc");
+  ConfigureParser parser("mfcc.conf");
+  VadOpts vad_opts;
+  vad_opts.ParseConfigure(&parser);
+
+  Wave egs;
+  ReadWave("egs.wav", &egs);
+  Int32 num_padding = 16000, num_samples = egs.NumSamples() + 2 * num_padding;
+  std::vector<Float32> samples(num_samples);
+  std::mt19937 generator(777);
+  std::normal_distribution<Float32> noise(0, 4);
+  for (Float32 &sample : samples) sample = noise(generator);
+  for (Int32 n = 0; n < egs.NumSamples(); n++)
+    samples[num_padding + n] += egs.Data()[n];
+
+  Int32 num_frames = offline_extractor.NumFrames(num_samples),
+        dim = offline_extractor.FeatureDim();
+  Mat mfcc = Mat::Zero(num_frames, dim), online_mfcc = mfcc;
+  offline_extractor.Compute(samples.data(), num_samples, mfcc.data(),
+                            mfcc.stride());
+  // energy only, then with spectral flatness
+  Float32 max_flatness[2] = {1.0, 0.5};
+  for (Float32 flatness : max_flatness) {
+    vad_opts.max_flatness = flatness;
+    Vad vad(vad_opts);
+    extractor.Reset();
+    online_mfcc.setZero();
+    std::vector<VadStatus> status(num_frames);
+    const Int32 packet_size = 160;
+    Int32 t = 0;
+    for (Int32 n = 0; n < num_samples; n += packet_size) {
+      extractor.AcceptWaveform(samples.data() + n,
+                               std::min(packet_size, num_samples - n));
+      t += extractor.GetFrames(online_mfcc.data() + t * online_mfcc.stride(),
+                               online_mfcc.stride(), num_frames - t, &vad,
+                               status.data() + t);
+    }
+    ASSERT(t == num_frames);
+    Int32 num_active = 0, num_padding_active = 0,
+          num_padding_frames = num_padding / 160 - 3;
+    for (Int32 i = 0; i < num_frames; i++) {
+      if (status[i] != kActive) continue;
+      num_active++;
+      if (i < num_padding_frames || i >= num_frames - num_padding_frames)
+        num_padding_active++;
+      ASSERT((mfcc.row(i) - online_mfcc.row(i)).cwiseAbs().maxCoeff() == 0);
+    }
+    LOG_INFO << "Max flatness " << flatness << ": " << num_active << "/"
+             << num_frames << " frames active, " << num_padding_active << "/"
+             << 2 * num_padding_frames << " in padding, noise floor "
+             << vad.NoiseFloor();
+    ASSERT(num_active > 0 && num_active < num_frames);
+    // trailing padding starts with hangover
+    ASSERT(num_padding_active <=
+           vad_opts.hangover_frames + num_padding_frames / 10);
+  }
+}
+
 int main(int argc, char const *argv[]) {
   // TestOnlineSplitter();
-  // TestOnlineVad();
   TestExtractor();
+  TestStreamingExtractor();
+  TestStreamingExtractor(8000);
+  TestStreamingExtractor(44100);
+  // with CMVN, deltas and splicing
+  {
+    std::ifstream is("mfcc.conf");
+    std::ofstream os("mfcc-stage.conf");
+    os << is.rdbuf() << "\n--CmvnOpts.norm_means=true\n"
+       << "--CmvnOpts.norm_vars=true\n--DeltaOpts.order=2\n"
+       << "--SpliceOpts.left_context=2\n--SpliceOpts.right_context=2\n";
+  }
+  TestStreamingExtractor(0, "mfcc-stage.conf");
+  TestOnlineVad();
   return 0;
 }
@@ -0,0 +1,163 @@
+// wujian@2018
+
+#include <random>
+
+#include "decoder/pipeline.h"
+#include "decoder/wave.h"
+
+// Splice features with context and project to log-softmax of num_pdfs
+class SpliceModel : public AcousticModel {
+ public:
+  SpliceModel(Int32 input_dim, Int32 num_pdfs, Int32 context)
+      : input_dim_(input_dim), num_pdfs_(num_pdfs), context_(context) {
+    std::mt19937 generator(777);
+    std::normal_distribution<Float32> normal(0, 0.1);
+    weights_.resize((2 * context + 1) * input_dim * num_pdfs);
+    for (Float32 &weight : weights_) weight = normal(generator);
+  }
+
+  Int32 InputDim() { return input_dim_; }
+
+  Int32 OutputDim() { return num_pdfs_; }
+
+  Int32 LeftContext() { return context_; }
+
+  Int32 RightContext() { return context_; }
+
+  void Compute(const Float32 *feats, Int32 feat_stride, Int32 num_frames,
+               Float32 *loglikes, Int32 loglike_stride) {
+    Int32 splice_dim = (2 * context_ + 1) * input_dim_;
+    for (Int32 t = 0; t < num_frames; t++) {
+      Float32 *loglike = loglikes + t * loglike_stride;
+      for (Int32 p = 0; p < num_pdfs_; p++) loglike[p] = 0;
+      // rows are contiguous if feat_stride == input_dim_
+      for (Int32 d = 0; d < splice_dim; d++) {
+        Int32 r = d / input_dim_, c = d % input_dim_;
+        Float32 value = feats[(t + r) * feat_stride + c];
+        const Float32 *weight = weights_.data() + d * num_pdfs_;
+        for (Int32 p = 0; p < num_pdfs_; p++) loglike[p] += value * weight[p];
+      }
+      Float32 max = *std::max_element(loglike, loglike + num_pdfs_), sum = 0;
+      for (Int32 p = 0; p < num_pdfs_; p++) sum += expf(loglike[p] - max);
+      for (Int32 p = 0; p < num_pdfs_; p++)
+        loglike[p] -= max + logf(sum);
+    }
+  }
+
+ private:
+  Int32 input_dim_, num_pdfs_, context_;
+  std::vector<Float32> weights_;
+};
+
+// Decode whole utterance with full matrices
+void DecodeOffline(FeatureExtractor *extractor, AcousticModel *model,
+                   FasterDecoder *decoder, Wave &egs,
+                   std::vector<Int32> *word_ids) {
+  Int32 num_samples = egs.NumSamples(), dim = extractor->FeatureDim();
+  Int32 num_frames = extractor->NumFrames(num_samples),
+        left = model->LeftContext(), right = model->RightContext();
+  std::vector<Float32> feats((left + num_frames + right) * dim),
+      loglikes(num_frames * model->OutputDim());
+  extractor->Reset();
+  extractor->Compute(egs.Data(), num_samples, feats.data() + left * dim, dim);
+  for (Int32 t = 0; t < left; t++)
+    std::copy(feats.begin() + left * dim, feats.begin() + (left + 1) * dim,
+              feats.begin() + t * dim);
+  for (Int32 t = left + num_frames; t < left + num_frames + right; t++)
+    std::copy(feats.begin() + (left + num_frames - 1) * dim,
+              feats.begin() + (left + num_frames) * dim,
+              feats.begin() + t * dim);
+  model->Compute(feats.data(), dim, num_frames, loglikes.data(),
+                 model->OutputDim());
+  decoder->Reset();
+  decoder->Decode(loglikes.data(), num_frames, model->OutputDim(),
+                  model->OutputDim());
+  decoder->GetBestPath(word_ids);
+}
+
+int main(int argc, char const *argv[]) {
+  DecodeGraph graph("graph.fst", "trans.tab");
+  DecodeOpts opts("decode.conf");
+  FasterDecoder decoder(graph, opts);
+  FeatureExtractor extractor("mfcc.conf", "mfcc");
+  SpliceModel model(extractor.FeatureDim(), graph.NumPdfs(), 2);
+
+  Wave egs;
+  ReadWave("egs.wav", &egs);
+  std::vector<Int32> word_ids, pipeline_word_ids;
+  DecodeOffline(&extractor, &model, &decoder, egs, &word_ids);
+  Int32 num_frames = decoder.NumDecodedFrames();
+
+  // different chunk sizes and packet sizes
+  Int32 chunk_sizes[3] = {1, 7, 50}, packet_sizes[3] = {160, 1000, 100000};
+  for (Int32 i = 0; i < 3; i++) {
+    DecodePipeline pipeline(&extractor, &model, &decoder, chunk_sizes[i]);
+    Profiler profiler(i);
+    pipeline.SetProfiler(&profiler);
+    for (Int32 n = 0; n < egs.NumSamples(); n += packet_sizes[i])
+      pipeline.AcceptWaveform(egs.Data() + n,
+                              std::min(packet_sizes[i], egs.NumSamples() - n));
+    pipeline.InputFinished();
+    pipeline_word_ids.clear();
+    pipeline.GetBestPath(&pipeline_word_ids);
+    LOG_INFO << "Chunk size " << chunk_sizes[i] << ": decode "
+             << pipeline.NumDecodedFrames() << " frames, "
+             << pipeline_word_ids.size() << " words";
+    ASSERT(pipeline.NumDecodedFrames() == num_frames);
+    ASSERT(pipeline_word_ids == word_ids);
+    // counted only if built with DECODER_PROFILE
+    ASSERT(profiler.NumFrames() == (kProfiling ? num_frames : 0));
+    std::ostringstream json;
+    profiler.WriteJson(json);
+    LOG_INFO << json.str();
+    // extractor and decoder are used later
+    pipeline.SetProfiler(NULL);
+  }
+
+  // decode one of every 3 frames, model computes these frames only
+  DecodeOpts subsampled_opts = opts;
+  subsampled_opts.frame_subsampling_factor = 3;
+  FasterDecoder subsampled_decoder(graph, subsampled_opts);
+  word_ids.clear();
+  DecodeOffline(&extractor, &model, &subsampled_decoder, egs, &word_ids);
+  num_frames = subsampled_decoder.NumDecodedFrames();
+  for (Int32 chunk_size : chunk_sizes) {
+    DecodePipeline pipeline(&extractor, &model, &subsampled_decoder,
+                            chunk_size);
+    for (Int32 n = 0; n < egs.NumSamples(); n += 1000)
+      pipeline.AcceptWaveform(egs.Data() + n,
+                              std::min(1000, egs.NumSamples() - n));
+    pipeline.InputFinished();
+    pipeline_word_ids.clear();
+    pipeline.GetBestPath(&pipeline_word_ids);
+    LOG_INFO << "Chunk size " << chunk_size << ", subsampled by 3: decode "
+             << pipeline.NumDecodedFrames() << " frames, "
+             << pipeline_word_ids.size() << " words";
+    ASSERT(pipeline.NumDecodedFrames() == num_frames);
+    ASSERT(pipeline_word_ids == word_ids);
+  }
+
+  // silence around egs is dropped by vad: fewer frames decoded
+  std::vector<Float32> samples(egs.NumSamples() + 32000, 0);
+  std::copy(egs.Data(), egs.Data() + egs.NumSamples(), samples.begin() + 16000);
+  Int32 num_samples = samples.size();
+  ConfigureParser parser("mfcc.conf");
+  VadOpts vad_opts;
+  vad_opts.ParseConfigure(&parser);
+  Vad vad(vad_opts);
+  DecodePipeline pipeline(&extractor, &model, &decoder, 7, &vad);
+  for (Int32 n = 0; n < num_samples; n += 1000)
+    pipeline.AcceptWaveform(samples.data() + n,
+                            std::min(1000, num_samples - n));
+  pipeline.InputFinished();
+  pipeline_word_ids.clear();
+  pipeline.GetBestPath(&pipeline_word_ids);
+  Int32 num_total_frames = extractor.NumFrames(num_samples);
+  LOG_INFO << "Vad: decode " << pipeline.NumDecodedFrames() << " frames, "
+           << pipeline.NumSilenceFrames() << "/" << num_total_frames
+           << " frames dropped, " << pipeline_word_ids.size() << " words";
+  ASSERT(pipeline.NumSilenceFrames() >= 150);
+  ASSERT(pipeline.NumDecodedFrames() + pipeline.NumSilenceFrames() ==
+         num_total_frames);
+  return 0;
+}
@@ -0,0 +1,64 @@
+// wujian@2018
+
+#include <random>
+
+#include "decoder/profiler.h"
+#include "decoder/signal.h"
+
+void TestProfiler() {
+  Profiler profiler(3, 4);
+  profiler.AddStage(kFftStage, 1000, 3000);
+  profiler.AddStage(kFftStage, 5000, 6000);
+  DecodeFrameStats stats;
+  stats.num_active_tokens = 100, stats.num_arcs = 400;
+  stats.num_epsilon_iters = 20, stats.num_new_tokens = 300, stats.beam = 12.5;
+  for (Int32 t = 0; t < 4; t++) profiler.AddFrame(stats, 7000 + t * 1000);
+  ASSERT(profiler.StageTime(kFftStage).count == 2);
+  ASSERT(profiler.StageTime(kFftStage).total == 3000);
+  ASSERT(profiler.StageTime(kFftStage).max == 2000);
+  ASSERT(profiler.NumFrames() == 4 && profiler.Arcs().total == 1600);
+  ASSERT(profiler.Beam().Mean() == 12.5);
+  // 6 events, 4 kept
+  ASSERT(profiler.NumDropped() == 2);
+  std::ostringstream json, trace;
+  profiler.WriteJson(json);
+  profiler.WriteChromeTrace(trace);
+  LOG_INFO << json.str();
+  LOG_INFO << trace.str();
+  ASSERT(json.str().find("\"fft\": {\"calls\": 2") != std::string::npos);
+  ASSERT(trace.str().find("\"ts\": 1.000, \"dur\": 2.000") !=
+         std::string::npos);
+  profiler.Reset();
+  ASSERT(profiler.NumFrames() == 0 && profiler.NumDropped() == 0);
+}
+
+// Stages are timed only if built with DECODER_PROFILE
+void TestComputer() {
+  Profiler profiler;
+  MfccOpts mfcc_opts;
+  MfccComputer computer(mfcc_opts);
+  computer.SetProfiler(&profiler);
+  const Int32 num_samps = 16000;
+  std::vector<Float32> signal(num_samps);
+  std::mt19937 generator(777);
+  std::normal_distribution<Float32> noise(0, 100);
+  for (Float32 &sample : signal) sample = noise(generator);
+  Int32 num_frames = computer.NumFrames(num_samps);
+  std::vector<Float32> mfcc(num_frames * computer.FeatureDim());
+  ComputeFeature(&computer, signal.data(), num_samps, mfcc.data(),
+                 computer.FeatureDim());
+  Int32 num_blocks = (num_frames + kFeatureBlockSize - 1) / kFeatureBlockSize;
+  ProfileStage stages[] = {kFramingStage, kFftStage, kMelStage, kDctStage};
+  for (ProfileStage stage : stages)
+    ASSERT(profiler.StageTime(stage).count == (kProfiling ? num_blocks : 0));
+  std::ostringstream json;
+  profiler.WriteJson(json);
+  LOG_INFO << "Profiling " << (kProfiling ? "on" : "off") << ": "
+           << json.str();
+}
+
+int main(int argc, char const *argv[]) {
+  TestProfiler();
+  TestComputer();
+  return 0;
+}
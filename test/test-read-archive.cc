@@ -1,33 +1,236 @@
 // wujian@2018
 
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <thread>
+
 #include "decoder/io.h"
+#include "decoder/timer.h"
+
+// Same as Kaldi's binary archive: "key \0BFM \4 num_rows \4 num_cols data",
+// return offset of the matrix header for scp
+UInt64 WriteMatrixInArchive(std::ostream &os, const std::string &key,
+                            const std::vector<Float32> &data,
+                            Int32 num_rows, Int32 num_cols) {
+  os << key << " ";
+  UInt64 offset = os.tellp();
+  os.put('\0');
+  os.put('B');
+  WriteToken(os, "FM");
+  WriteBinaryBasicType(os, num_rows);
+  WriteBinaryBasicType(os, num_cols);
+  WriteBinary(os, reinterpret_cast<const char *>(data.data()),
+              sizeof(Float32) * data.size());
+  return offset;
+}
+
+// Compressed matrix of random contents: global header (min_value, range,
+// num_rows, num_cols), then payload of format 1 (CM), 2 (CM2) or 3 (CM3)
+UInt64 WriteRandomCompressedMatrix(std::ostream &os, const std::string &key,
+                                   Int32 format, Int32 num_rows,
+                                   Int32 num_cols, std::mt19937 *generator) {
+  std::uniform_int_distribution<Int32> uint16(0, 65535);
+  os << key << " ";
+  UInt64 offset = os.tellp();
+  os.put('\0');
+  os.put('B');
+  WriteToken(os, format == 1 ? "CM" : (format == 2 ? "CM2" : "CM3"));
+  Float32 header[2] = {-20.5, 25};
+  Int32 shape[2] = {num_rows, num_cols};
+  WriteBinary(os, reinterpret_cast<const char *>(header), sizeof(header));
+  WriteBinary(os, reinterpret_cast<const char *>(shape), sizeof(shape));
+  if (format == 1) {
+    for (Int32 c = 0; c < num_cols; c++) {
+      UInt16 percentiles[4];
+      for (Int32 i = 0; i < 4; i++) percentiles[i] = uint16(*generator);
+      std::sort(percentiles, percentiles + 4);
+      WriteBinary(os, reinterpret_cast<const char *>(percentiles),
+                  sizeof(percentiles));
+    }
+  }
+  Int32 num_values = num_rows * num_cols;
+  for (Int32 i = 0; i < num_values; i++) {
+    UInt16 value = uint16(*generator);
+    if (format == 2)
+      WriteBinary(os, reinterpret_cast<const char *>(&value), sizeof(value));
+    else
+      os.put(static_cast<char>(value & 0xff));
+  }
+  return offset;
+}
+
+// Straight version of Kaldi's CompressedMatrix::CopyToMat()
+void DecompressMatrix(const MatrixView &view, std::vector<Float32> *mat) {
+  Int32 num_rows = view.num_rows, num_cols = view.num_cols;
+  mat->resize(num_rows * num_cols);
+  Float32 min_value, range;
+  memcpy(&min_value, view.data, 4);
+  memcpy(&range, view.data + 4, 4);
+  const UInt08 *data = reinterpret_cast<const UInt08 *>(view.data + 16);
+  if (view.compress_format == 1) {
+    const UInt08 *bytes = data + 8 * num_cols;
+    for (Int32 c = 0; c < num_cols; c++) {
+      UInt16 h[4];
+      memcpy(h, data + 8 * c, sizeof(h));
+      Float32 p[4];
+      for (Int32 i = 0; i < 4; i++)
+        p[i] = min_value + range * 1.52590218966964e-05F * h[i];
+      for (Int32 r = 0; r < num_rows; r++) {
+        Int32 v = bytes[c * num_rows + r];
+        Float32 value;
+        if (v <= 64)
+          value = p[0] + (p[1] - p[0]) * v * (1 / 64.0f);
+        else if (v <= 192)
+          value = p[1] + (p[2] - p[1]) * (v - 64) * (1 / 128.0f);
+        else
+          value = p[2] + (p[3] - p[2]) * (v - 192) * (1 / 63.0f);
+        (*mat)[r * num_cols + c] = value;
+      }
+    }
+  } else {
+    Float32 increment =
+        range * (view.compress_format == 2 ? 1.0 / 65535.0 : 1.0 / 255.0);
+    for (Int32 i = 0; i < num_rows * num_cols; i++) {
+      UInt16 value;
+      if (view.compress_format == 2)
+        memcpy(&value, data + 2 * i, 2);
+      else
+        value = data[i];
+      (*mat)[i] = min_value + increment * value;
+    }
+  }
+}
 
-Bool ReadMatrixInArchive(std::istream &is, Int32 *num_rows, Int32 *num_cols) {
-  std::string token;
-  is >> token;
-  if (is.eof()) return false;
-  ASSERT(isspace(is.peek()) && "Expect space after each token");
-  is.get();
-  ASSERT(is.get() == '\0' && is.get() == 'B' && "Expect binary header(\\0B)");
-  ExpectToken(is, "FM");
-  ReadBinaryBasicType(is, num_rows);
-  ReadBinaryBasicType(is, num_cols);
-  LOG_INFO << "Get matrix " << token << ": " << *num_rows << " x " << *num_cols;
-  return true;
+Float32 MaxRelativeDifference(const std::vector<Float32> &a,
+                              const std::vector<Float32> &b) {
+  ASSERT(a.size() == b.size());
+  Float32 diff = 0;
+  for (Int32 i = 0; i < a.size(); i++)
+    diff = std::max(diff, std::abs(a[i] - b[i]) / (1 + std::abs(b[i])));
+  return diff;
+}
+
+Bool SameMatrix(const MatrixView &view, const std::vector<Float32> &data,
+                Int32 num_rows, Int32 num_cols) {
+  if (view.compress_format != 0 || view.num_rows != num_rows ||
+      view.num_cols != num_cols)
+    return false;
+  return memcmp(view.FloatData(), data.data(),
+                sizeof(Float32) * data.size()) == 0;
 }
 
 int main(int argc, char const *argv[]) {
-  BinaryInput bo("50.ark");
-  Int32 count = 0, num_rows, num_cols;
-  while (true) {
-    Bool go = ReadMatrixInArchive(bo.Stream(), &num_rows, &num_cols);
-    if (!go) break;
-    LOG_INFO << "Read " << count << "-th...";
-    Float32 *loglikes = new Float32[num_cols * num_cols];
-    ReadBinary(bo.Stream(), reinterpret_cast<char *>(loglikes),
-               sizeof(Float32) * num_cols * num_rows);
-    count++;
-    delete[] loglikes;
+  const Int32 num_utts = 100, num_cols = 23;
+  std::mt19937 generator(777);
+  std::uniform_int_distribution<Int32> length(0, 300);
+  std::normal_distribution<Float32> normal(0, 1);
+  std::vector<std::string> keys;
+  std::vector<std::vector<Float32> > matrices;
+  std::vector<Int32> num_rows;
+  // CM, CM2, CM3, with odd number of columns for the non-SIMD tail
+  const Int32 cm_rows = 500, cm_cols = 3003;
+  {
+    BinaryOutput ark("egs.cm.ark");
+    for (Int32 format = 1; format <= 3; format++)
+      WriteRandomCompressedMatrix(ark.Stream(), "cm" + std::to_string(format),
+                                  format, cm_rows, cm_cols, &generator);
+  }
+  {
+    BinaryOutput ark("egs.ark");
+    std::ofstream scp("egs.scp");
+    for (Int32 u = 0; u < num_utts; u++) {
+      keys.push_back("utt-" + std::to_string(u));
+      num_rows.push_back(length(generator));
+      matrices.push_back(std::vector<Float32>(num_rows.back() * num_cols));
+      for (Float32 &value : matrices.back()) value = normal(generator);
+      UInt64 offset = WriteMatrixInArchive(ark.Stream(), keys.back(),
+                                           matrices.back(), num_rows.back(),
+                                           num_cols);
+      // scp of odd items
+      if (u % 2) scp << keys.back() << " egs.ark:" << offset << std::endl;
+    }
+  }
+
+  Timer timer;
+  ArchiveReader ark_reader("egs.ark");
+  LOG_INFO << "Index " << ark_reader.NumItems() << " matrices cost "
+           << timer.Elapsed() << "s";
+  ASSERT(ark_reader.NumItems() == num_utts);
+  for (Int32 u = 0; u < num_utts; u++) {
+    ASSERT(ark_reader.Key(u) == keys[u]);
+    ASSERT(SameMatrix(ark_reader.Value(u), matrices[u], num_rows[u],
+                      num_cols));
   }
+  // random access
+  MatrixView view;
+  ASSERT(ark_reader.Find("utt-42", &view) &&
+         SameMatrix(view, matrices[42], num_rows[42], num_cols));
+  ASSERT(!ark_reader.Find("utt-100", &view));
+
+  ArchiveReader scp_reader("egs.scp");
+  ASSERT(scp_reader.NumItems() == num_utts / 2);
+  for (Int32 i = 0; i < scp_reader.NumItems(); i++) {
+    Int32 u = 2 * i + 1;
+    ASSERT(scp_reader.Key(i) == keys[u]);
+    ASSERT(SameMatrix(scp_reader.Value(i), matrices[u], num_rows[u],
+                      num_cols));
+  }
+
+  ArchiveReader cm_reader("egs.cm.ark");
+  ASSERT(cm_reader.NumItems() == 3);
+  std::vector<Float32> mat, ref_mat, copy_mat(cm_rows * cm_cols);
+  for (Int32 i = 0; i < 3; i++) {
+    const MatrixView &cm = cm_reader.Value(i);
+    ASSERT(cm.compress_format == i + 1 && cm.num_rows == cm_rows &&
+           cm.num_cols == cm_cols);
+    DecompressMatrix(cm, &ref_mat);
+    // padded rows, best time of a few runs for both, so that neither one
+    // is charged for cache misses left by the other
+    mat.assign(cm_rows * (cm_cols + 5), 0);
+    Float64 time_cost = std::numeric_limits<Float64>::infinity(),
+            ref_time_cost = time_cost;
+    for (Int32 n = 0; n < 5; n++) {
+      timer.Reset();
+      CopyMatrix(cm, mat.data(), cm_cols + 5);
+      time_cost = std::min(time_cost, timer.Elapsed());
+      timer.Reset();
+      DecompressMatrix(cm, &ref_mat);
+      ref_time_cost = std::min(ref_time_cost, timer.Elapsed());
+    }
+    for (Int32 r = 0; r < cm_rows; r++)
+      std::copy(mat.begin() + r * (cm_cols + 5),
+                mat.begin() + r * (cm_cols + 5) + cm_cols,
+                copy_mat.begin() + r * cm_cols);
+    Float32 diff = MaxRelativeDifference(copy_mat, ref_mat);
+    LOG_INFO << "Decompress " << cm_reader.Key(i) << "(" << cm_rows << " x "
+             << cm_cols << ") cost " << time_cost << "s vs " << ref_time_cost
+             << "s (reference), max difference " << diff;
+    ASSERT(diff < 1e-6);
+  }
+  // FM copy
+  mat.resize(num_rows[42] * num_cols);
+  CopyMatrix(ark_reader.Value(42), mat.data(), num_cols);
+  ASSERT(mat == matrices[42]);
+
+  // workers share one reader
+  const Int32 num_workers = 4;
+  std::vector<Float64> sums(num_workers, 0);
+  std::vector<std::thread> workers;
+  for (Int32 w = 0; w < num_workers; w++)
+    workers.push_back(std::thread([&, w] {
+      for (Int32 i = w; i < ark_reader.NumItems(); i += num_workers) {
+        const MatrixView &value = ark_reader.Value(i);
+        const Float32 *data = value.FloatData();
+        for (Int32 j = 0; j < value.num_rows * value.num_cols; j++)
+          sums[w] += data[j];
+      }
+    }));
+  for (std::thread &worker : workers) worker.join();
+  Float64 sum = 0, ref_sum = 0;
+  for (Int32 w = 0; w < num_workers; w++) sum += sums[w];
+  for (Int32 u = 0; u < num_utts; u++)
+    for (Float32 value : matrices[u]) ref_sum += value;
+  ASSERT(std::abs(sum - ref_sum) < 1e-6 * (1 + std::abs(ref_sum)));
   return 0;
 }
@@ -0,0 +1,67 @@
+// wujian@2018
+
+#include <Eigen/Dense>
+#include "decoder/resample.h"
+
+using namespace Eigen;
+
+// Resample a sine of frequency (below both nyquists), compare with the sine
+// sampled at output rate, edges excluded
+Float32 ResampleSine(Int32 input_rate, Int32 output_rate, Float32 frequency) {
+  const Int32 N = input_rate;
+  VectorXf input(N);
+  for (Int32 n = 0; n < N; n++)
+    input[n] = sin(PI2 * frequency * n / input_rate);
+  ResampleOpts opts;
+  opts.num_zeros = 16;
+  Resampler resampler(input_rate, output_rate, opts);
+  VectorXf output(resampler.MaxOutputSamples(N));
+  Int32 num_output = resampler.Resample(input.data(), N, true, output.data());
+  ASSERT(num_output == resampler.NumOutputSamples(N));
+  Float32 max_diff = 0;
+  for (Int32 k = num_output / 10; k < num_output * 9 / 10; k++) {
+    Float32 ref = sin(PI2 * frequency * k / output_rate);
+    max_diff = std::max(max_diff, std::abs(output[k] - ref));
+  }
+  return max_diff;
+}
+
+// Feed packets of random size, outputs should be same as one call
+void TestStreaming(Int32 input_rate, Int32 output_rate) {
+  const Int32 N = 10000;
+  VectorXf input = VectorXf::Random(N);
+  ResampleOpts opts;
+  Resampler resampler(input_rate, output_rate, opts);
+  VectorXf output(resampler.MaxOutputSamples(N));
+  Int32 num_output = resampler.Resample(input.data(), N, true, output.data());
+  VectorXf online_output(num_output);
+  std::vector<Float32> packet(resampler.MaxOutputSamples(N));
+  Int32 t = 0;
+  for (Int32 n = 0; n < N;) {
+    Int32 num_samps = std::min(rand() % 500, N - n);
+    Int32 m = resampler.Resample(input.data() + n, num_samps, false,
+                                 packet.data());
+    ASSERT(m <= resampler.MaxOutputSamples(num_samps));
+    std::copy(packet.data(), packet.data() + m, online_output.data() + t);
+    n += num_samps;
+    t += m;
+  }
+  t += resampler.Resample(NULL, 0, true, online_output.data() + t);
+  ASSERT(t == num_output);
+  Float32 diff =
+      (online_output - output.head(num_output)).cwiseAbs().maxCoeff();
+  LOG_INFO << input_rate << " => " << output_rate << ": " << num_output
+           << " samples, max diff of streaming " << diff;
+  ASSERT(diff < 1e-5);
+}
+
+int main(int argc, char const *argv[]) {
+  Int32 rates[][2] = {{8000, 16000}, {44100, 16000}, {48000, 16000}};
+  for (auto &rate : rates) {
+    Float32 diff = ResampleSine(rate[0], rate[1], 1000);
+    LOG_INFO << rate[0] << " => " << rate[1] << ": max diff of sine " << diff;
+    ASSERT(diff < 1e-2);
+    TestStreaming(rate[0], rate[1]);
+  }
+  return 0;
+}
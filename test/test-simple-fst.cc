@@ -1,12 +1,41 @@
 // wujian@2018
 
 #include <fstream>
+#include "decoder/fst-reorder.h"
 #include "decoder/simple-fst.h"
 
+// Reordered graph is the same one with states renamed
+void TestReorderStates(const SimpleFst &fst) {
+  SimpleFst reordered(fst);
+  std::vector<StateId> order;
+  Timer timer;
+  BfsStateOrder(reordered, &order);
+  ReorderStates(order, &reordered);
+  LOG_INFO << "Reorder states cost " << timer.Elapsed() << " s";
+  std::vector<StateId> new_id(order.size());
+  for (UInt64 s = 0; s < order.size(); s++) new_id[order[s]] = s;
+  ASSERT(reordered.NumStates() == fst.NumStates());
+  ASSERT(reordered.Start() == new_id[fst.Start()]);
+  ASSERT(reordered.Start() == 0);
+  for (StateIterator siter(fst); !siter.Done(); siter.Next()) {
+    StateId state = siter.Value(), new_state = new_id[state];
+    ASSERT(reordered.Final(new_state) == fst.Final(state));
+    ASSERT(reordered.NumArcs(new_state) == fst.NumArcs(state));
+    for (ArcIterator aiter(fst, state), new_aiter(reordered, new_state);
+         !aiter.Done(); aiter.Next(), new_aiter.Next()) {
+      const Arc &arc = aiter.Value(), &new_arc = new_aiter.Value();
+      ASSERT(new_arc.ilabel == arc.ilabel && new_arc.olabel == arc.olabel &&
+             new_arc.weight == arc.weight &&
+             new_arc.nextstate == new_id[arc.nextstate]);
+    }
+  }
+}
+
 int main(int argc, char const *argv[]) {
   SimpleFst fst;
   Timer timer;
   ReadSimpleFst("graph.fst", &fst);
   LOG_INFO << "Cost " << timer.Elapsed() << " s";
+  TestReorderStates(fst);
   return 0;
 }
@@ -0,0 +1,48 @@
+// wujian@2018
+
+#include "decoder/symbol-table.h"
+
+// Check text and mapped symbol tables give the same symbols
+void CheckEqual(const SymbolTable &symbols, const SymbolTable &ref) {
+  ASSERT(symbols.NumSymbols() == ref.NumSymbols());
+  for (Int32 i = 0; i < ref.NumSymbols(); i++)
+    ASSERT(strcmp(symbols.Symbol(i), ref.Symbol(i)) == 0);
+}
+
+int main(int argc, char const *argv[]) {
+  const Int32 num_words = 200000;
+  {
+    BinaryOutput bo("words.test.txt");
+    bo.Stream() << "<eps> 0\n";
+    // leave id 2 undefined
+    bo.Stream() << "!SIL 1\n";
+    for (Int32 i = 3; i < num_words; i++)
+      bo.Stream() << "w" << i << " " << i << "\n";
+  }
+  Timer timer;
+  SymbolTable symbols("words.test.txt");
+  LOG_INFO << "Read text symbol table cost " << timer.Elapsed() << " s";
+  ASSERT(!symbols.IsMapped() && symbols.NumSymbols() == num_words);
+  ASSERT(strcmp(symbols.Symbol(1), "!SIL") == 0);
+  ASSERT(strcmp(symbols.Symbol(2), "") == 0);
+  ASSERT(strcmp(symbols.Symbol(num_words - 1), "w199999") == 0);
+
+  WriteSymbolTable("words.test.bin", symbols);
+  timer.Reset();
+  SymbolTable mapped_symbols("words.test.bin");
+  LOG_INFO << "Map symbol table cost " << timer.Elapsed() << " s";
+  ASSERT(mapped_symbols.IsMapped());
+  CheckEqual(mapped_symbols, symbols);
+
+  std::vector<Int32> ids = {1, 3, 4, 1};
+  ASSERT(mapped_symbols.Join(ids) == "!SIL w3 w4 !SIL");
+  std::string text = "prefix:";
+  mapped_symbols.Join(ids, &text, "|");
+  ASSERT(text == "prefix:!SIL|w3|w4|!SIL");
+
+  // mapped one could be loaded again in place
+  mapped_symbols.Load("words.test.txt");
+  ASSERT(!mapped_symbols.IsMapped());
+  CheckEqual(mapped_symbols, symbols);
+  return 0;
+}
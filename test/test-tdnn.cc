@@ -0,0 +1,218 @@
+// wujian@2018
+
+#include <random>
+
+#include "decoder/tdnn.h"
+
+const char *kContext = "-2,-1,0,1,2;0;-1,0,2;-3,0,3;0";
+const Int32 kFeatureDim = 13, kHiddenDim = 256, kNumPdfs = 100;
+
+std::mt19937 generator(777);
+
+// Parameters of a TDNN with 5 Linear layers, ReLU and BatchNorm between them
+struct Params {
+  std::vector<std::vector<Float32> > weight, bias, scale, offset;
+  std::vector<std::vector<Int32> > offsets;
+  std::vector<Int32> dims;
+};
+
+std::vector<Float32> RandomVector(Int32 dim, Float32 mean, Float32 stddev) {
+  std::normal_distribution<Float32> normal(mean, stddev);
+  std::vector<Float32> vec(dim);
+  for (Float32 &value : vec) value = normal(generator);
+  return vec;
+}
+
+void WriteVector(std::ostream &os, const std::vector<Float32> &vec) {
+  WriteToken(os, "FV");
+  WriteBinaryBasicType(os, static_cast<Int32>(vec.size()));
+  WriteBinary(os, reinterpret_cast<const char *>(vec.data()),
+              sizeof(Float32) * vec.size());
+}
+
+// Same layout as copy-nnet3-linear-params
+void WriteRandomParams(const std::string &param, Params *params) {
+  params->offsets = {{-2, -1, 0, 1, 2}, {0}, {-1, 0, 2}, {-3, 0, 3}, {0}};
+  params->dims = {kFeatureDim, kHiddenDim, kHiddenDim, kHiddenDim, kHiddenDim,
+                  kNumPdfs};
+  BinaryOutput bo(param);
+  std::ostream &os = bo.Stream();
+  for (Int32 l = 0; l < 5; l++) {
+    Int32 num_rows = params->dims[l + 1],
+          num_cols = params->dims[l] * params->offsets[l].size();
+    params->weight.push_back(
+        RandomVector(num_rows * num_cols, 0, std::sqrt(2.0 / num_cols)));
+    params->bias.push_back(RandomVector(num_rows, 0, 0.1));
+    WriteToken(os, "Linear");
+    WriteToken(os, "FM");
+    WriteBinaryBasicType(os, num_rows);
+    WriteBinaryBasicType(os, num_cols);
+    WriteBinary(os, reinterpret_cast<const char *>(params->weight[l].data()),
+                sizeof(Float32) * num_rows * num_cols);
+    WriteVector(os, params->bias[l]);
+    if (l == 4) break;
+    params->scale.push_back(RandomVector(num_rows, 1, 0.1));
+    params->offset.push_back(RandomVector(num_rows, 0, 0.1));
+    WriteToken(os, "ReLU");
+    WriteToken(os, "BatchNorm");
+    WriteVector(os, params->scale[l]);
+    WriteVector(os, params->offset[l]);
+  }
+  WriteToken(os, "LogSoftmax");
+}
+
+// Frame by frame forward, same as tdnn.py
+std::vector<Float32> Reference(const Params &params,
+                               const std::vector<Float32> &feats) {
+  std::vector<Float32> input = feats;
+  for (Int32 l = 0; l < 5; l++) {
+    const std::vector<Int32> &offsets = params.offsets[l];
+    Int32 input_dim = params.dims[l], output_dim = params.dims[l + 1],
+          num_input = input.size() / input_dim,
+          num_output = num_input - (offsets.back() - offsets.front()),
+          splice_dim = input_dim * offsets.size();
+    std::vector<Float32> output(num_output * output_dim);
+    for (Int32 t = 0; t < num_output; t++) {
+      for (Int32 o = 0; o < output_dim; o++) {
+        Float32 sum = params.bias[l][o];
+        for (Int32 i = 0; i < offsets.size(); i++)
+          for (Int32 d = 0; d < input_dim; d++)
+            sum += params.weight[l][o * splice_dim + i * input_dim + d] *
+                   input[(t + offsets[i] - offsets[0]) * input_dim + d];
+        if (l != 4)
+          sum = std::max(sum, 0.0f) * params.scale[l][o] + params.offset[l][o];
+        output[t * output_dim + o] = sum;
+      }
+      if (l == 4) {
+        Float32 *row = output.data() + t * output_dim, sum = 0;
+        for (Int32 o = 0; o < output_dim; o++) sum += expf(row[o]);
+        for (Int32 o = 0; o < output_dim; o++) row[o] -= logf(sum);
+      }
+    }
+    input.swap(output);
+  }
+  return input;
+}
+
+Float32 MaxDifference(const std::vector<Float32> &a,
+                      const std::vector<Float32> &b) {
+  ASSERT(a.size() == b.size());
+  Float32 diff = 0;
+  for (UInt64 i = 0; i < a.size(); i++)
+    diff = std::max(diff, std::abs(a[i] - b[i]));
+  return diff;
+}
+
+// Compare exp(loglikes)
+Float32 MaxPosteriorDifference(const std::vector<Float32> &a,
+                               const std::vector<Float32> &b) {
+  ASSERT(a.size() == b.size());
+  Float32 diff = 0;
+  for (UInt64 i = 0; i < a.size(); i++)
+    diff = std::max(diff, std::abs(expf(a[i]) - expf(b[i])));
+  return diff;
+}
+
+UInt64 FileSize(const std::string &filename) {
+  BinaryInput bi(filename);
+  bi.Stream().seekg(0, std::ios::end);
+  return bi.Stream().tellg();
+}
+
+int main(int argc, char const *argv[]) {
+  Params params;
+  WriteRandomParams("tdnn.param", &params);
+  Tdnn tdnn("tdnn.param", kContext);
+  ASSERT(tdnn.InputDim() == kFeatureDim && tdnn.OutputDim() == kNumPdfs);
+  ASSERT(tdnn.LeftContext() == 6 && tdnn.RightContext() == 7);
+
+  const Int32 num_frames = 200;
+  Int32 num_rows = tdnn.LeftContext() + num_frames + tdnn.RightContext();
+  std::vector<Float32> feats(num_rows * kFeatureDim),
+      loglikes(num_frames * kNumPdfs), stream_loglikes(num_frames * kNumPdfs);
+  feats = RandomVector(num_rows * kFeatureDim, 0, 1);
+  tdnn.Compute(feats.data(), kFeatureDim, num_frames, loglikes.data(),
+               kNumPdfs);
+  Float32 diff = MaxDifference(loglikes, Reference(params, feats));
+  LOG_INFO << "Max difference with reference: " << diff;
+  ASSERT(diff < 1e-3);
+
+  // feed chunks of different size, frames are never computed twice
+  Int32 chunk_sizes[4] = {1, 3, 17, 1000};
+  for (Int32 chunk_size : chunk_sizes) {
+    tdnn.Reset();
+    Int32 num_output = 0;
+    for (Int32 t = 0; t < num_rows; t += chunk_size)
+      num_output += tdnn.AcceptFrames(
+          feats.data() + t * kFeatureDim, kFeatureDim,
+          std::min(chunk_size, num_rows - t),
+          stream_loglikes.data() + num_output * kNumPdfs, kNumPdfs);
+    ASSERT(num_output == num_frames);
+    diff = MaxDifference(loglikes, stream_loglikes);
+    LOG_INFO << "Streaming with chunk size " << chunk_size
+             << ", max difference: " << diff;
+    ASSERT(diff < 1e-4);
+  }
+
+  // frame subsampling, rows of the full output
+  for (Int32 step = 2; step <= 3; step++) {
+    Int32 num_subsampled = (num_frames + step - 1) / step;
+    std::vector<Float32> subsampled(num_subsampled * kNumPdfs);
+    tdnn.ComputeSubsampled(feats.data(), kFeatureDim, num_frames, step,
+                           subsampled.data(), kNumPdfs);
+    for (Int32 t = 0; t < num_subsampled; t++)
+      std::copy(loglikes.begin() + t * step * kNumPdfs,
+                loglikes.begin() + (t * step + 1) * kNumPdfs,
+                stream_loglikes.begin() + t * kNumPdfs);
+    stream_loglikes.resize(num_subsampled * kNumPdfs);
+    diff = MaxDifference(subsampled, stream_loglikes);
+    LOG_INFO << "Subsampled by " << step << ", max difference: " << diff;
+    ASSERT(diff < 1e-4);
+    stream_loglikes.resize(num_frames * kNumPdfs);
+  }
+
+  // int8, input scales worked out on each call
+  Tdnn int8_tdnn("tdnn.param", kContext, true);
+  std::vector<Float32> int8_loglikes(num_frames * kNumPdfs);
+  int8_tdnn.Compute(feats.data(), kFeatureDim, num_frames,
+                    int8_loglikes.data(), kNumPdfs);
+  diff = MaxPosteriorDifference(loglikes, int8_loglikes);
+  LOG_INFO << "Int8 vs float, max difference of posteriors: " << diff;
+  ASSERT(diff < 0.05);
+
+  // int8, calibrated
+  Tdnn calibrated_tdnn("tdnn.param", kContext);
+  calibrated_tdnn.Calibrate(feats.data(), kFeatureDim, num_frames);
+  calibrated_tdnn.Quantize();
+  calibrated_tdnn.Write("tdnn.int8.param");
+  calibrated_tdnn.Compute(feats.data(), kFeatureDim, num_frames,
+                          int8_loglikes.data(), kNumPdfs);
+  diff = MaxPosteriorDifference(loglikes, int8_loglikes);
+  LOG_INFO << "Calibrated int8 vs float, max difference of posteriors: "
+           << diff;
+  ASSERT(diff < 0.05);
+  // reload and streaming, same results
+  Tdnn read_tdnn("tdnn.int8.param", kContext);
+  Int32 num_output = 0;
+  for (Int32 t = 0; t < num_rows; t += 17)
+    num_output += read_tdnn.AcceptFrames(
+        feats.data() + t * kFeatureDim, kFeatureDim, std::min(17, num_rows - t),
+        stream_loglikes.data() + num_output * kNumPdfs, kNumPdfs);
+  ASSERT(num_output == num_frames);
+  ASSERT(MaxDifference(int8_loglikes, stream_loglikes) == 0);
+  LOG_INFO << "Size of parameters: " << FileSize("tdnn.int8.param") << " vs "
+           << FileSize("tdnn.param") << " bytes";
+
+  Timer timer;
+  for (Int32 i = 0; i < 20; i++)
+    tdnn.Compute(feats.data(), kFeatureDim, num_frames, loglikes.data(),
+                 kNumPdfs);
+  Float64 time_cost = timer.Elapsed();
+  timer.Reset();
+  for (Int32 i = 0; i < 20; i++)
+    read_tdnn.Compute(feats.data(), kFeatureDim, num_frames,
+                      int8_loglikes.data(), kNumPdfs);
+  LOG_INFO << "Compute " << num_frames << " frames x 20 cost " << time_cost
+           << "s (float) vs " << timer.Elapsed() << "s (int8)";
+  return 0;
+}
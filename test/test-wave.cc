@@ -5,6 +5,49 @@
 
 using namespace Eigen;
 
+// Stereo Int24 and Float32 waves written by hand, read by blocks from stream
+// or mapping
+void TestWaveReader() {
+  const Int32 N = 5000;
+  VectorXf left = VectorXf::Random(N) * 30000, right = VectorXf::Random(N);
+  for (Int32 byte_per_sample : {3, 4}) {
+    WaveHeader header = GenWavHeader(N, 2, 16000, byte_per_sample);
+    if (byte_per_sample == 4) header.audio_format = 3;
+    UInt32 num_bytes = N * 2 * byte_per_sample;
+    {
+      BinaryOutput bo("egs.multi.wav");
+      std::ostream &os = bo.Stream();
+      WriteBinary(os, reinterpret_cast<char *>(&header), sizeof(header));
+      WriteBinary(os, "data", 4);
+      WriteBinary(os, reinterpret_cast<char *>(&num_bytes), sizeof(num_bytes));
+      for (Int32 n = 0; n < N; n++) {
+        for (Float32 sample : {left[n], right[n]}) {
+          if (byte_per_sample == 4) {
+            Float32 value = sample / 32768;
+            WriteBinary(os, reinterpret_cast<char *>(&value), 4);
+          } else {
+            Int32 value = static_cast<Int32>(sample * 256);
+            WriteBinary(os, reinterpret_cast<char *>(&value), 3);
+          }
+        }
+      }
+    }
+    for (Bool use_mmap : {false, true}) {
+      WaveReader reader("egs.multi.wav", use_mmap);
+      ASSERT(reader.NumChannels() == 2 && reader.NumSamples() == N);
+      MatrixXf samples(N, 2);
+      Int32 t = 0;
+      while (Int32 n = reader.Read(samples.data() + t, N, 999)) t += n;
+      ASSERT(t == N);
+      Float32 diff = std::max((samples.col(0) - left).cwiseAbs().maxCoeff(),
+                              (samples.col(1) - right).cwiseAbs().maxCoeff());
+      LOG_INFO << (byte_per_sample == 3 ? "Int24" : "Float32")
+               << ", mmap=" << use_mmap << ", max diff: " << diff;
+      ASSERT(diff < 1.0 / 128);
+    }
+  }
+}
+
 int main(int argc, char const *argv[]) {
   const Int32 N = 20000;
   VectorXf vector = VectorXf::Random(N);
@@ -17,5 +60,6 @@ int main(int argc, char const *argv[]) {
   LOG_INFO << "sample rate: " << egs.SampleRate();
   // Map<VectorXf> wav(egs.Data(), egs.NumSamples());
   // std::cout << wav;
+  TestWaveReader();
   return 0;
 }
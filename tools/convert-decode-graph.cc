@@ -0,0 +1,40 @@
+// wujian@2018
+
+#include "decoder/compact-fst.h"
+#include "decoder/const-fst.h"
+
+int main(int argc, char const *argv[]) {
+  const char *usage =
+      "Convert decode graph(output of copy-decode-graph) to mmap-able "
+      "ConstFst format, which could be loaded instantly and shared among "
+      "decoder processes. Arcs of each state are sorted with input epsilon "
+      "arcs first. If transition table is given, ilabels are rewritten to "
+      "pdf-id + 1 and the table is not needed when decoding. With --compact, "
+      "write bit-packed CompactFst instead (about 2~3x smaller, weights are "
+      "quantized to 16 bits)\n"
+      "\n"
+      "Usage: convert-decode-graph [--compact] <simple-graph> <const-graph> "
+      "[<transition-table>]\n";
+
+  Bool compact = argc > 1 && std::string(argv[1]) == "--compact";
+  if (compact) argc--, argv++;
+  if (argc != 3 && argc != 4) {
+    std::cerr << usage;
+    return 1;
+  }
+  Timer timer;
+  ConstFst fst;
+  ReadConstFst(argv[1], &fst);
+  if (argc == 4) {
+    TransitionTable table;
+    ReadTransitionTable(argv[3], &table);
+    fst.RelabelToPdfs(table);
+  }
+  if (compact)
+    WriteCompactFst(argv[2], CompactFst(fst));
+  else
+    WriteConstFst(argv[2], fst);
+  LOG_INFO << "Convert " << argv[1] << " => " << argv[2] << " done, cost "
+           << timer.Elapsed() << "s";
+  return 0;
+}
@@ -0,0 +1,24 @@
+// wujian@2018
+
+#include "decoder/symbol-table.h"
+
+int main(int argc, char const *argv[]) {
+  const char *usage =
+      "Convert word symbol table (words.txt, \"<word> <id>\" per line) to "
+      "mmap-able binary format, which could be loaded instantly and shared "
+      "among decoder processes\n"
+      "\n"
+      "Usage: convert-symbol-table <words-txt> <words-bin>\n";
+
+  if (argc != 3) {
+    std::cerr << usage;
+    return 1;
+  }
+  Timer timer;
+  SymbolTable symbols;
+  ReadSymbolTable(argv[1], &symbols);
+  WriteSymbolTable(argv[2], symbols);
+  LOG_INFO << "Convert " << argv[1] << " => " << argv[2] << " done, cost "
+           << timer.Elapsed() << "s";
+  return 0;
+}
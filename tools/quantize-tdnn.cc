@@ -0,0 +1,69 @@
+// wujian@2018
+
+#include "decoder/tdnn.h"
+
+// Read key and header of a binary float matrix in Kaldi's archive
+Bool ReadMatrixInArchive(std::istream &is, std::string *key, Int32 *num_rows,
+                         Int32 *num_cols) {
+  is >> *key;
+  if (is.eof()) return false;
+  ASSERT(isspace(is.peek()) && "Expect space after each token");
+  is.get();
+  ASSERT(is.get() == '\0' && is.get() == 'B' && "Expect binary header(\\0B)");
+  ExpectToken(is, "FM");
+  ReadBinaryBasicType(is, num_rows);
+  ReadBinaryBasicType(is, num_cols);
+  return true;
+}
+
+int main(int argc, char const *argv[]) {
+  const char *usage =
+      "Quantize Linear layers of TDNN parameters (output of "
+      "copy-nnet3-linear-params) to int8. Input scales are calibrated on "
+      "features in a binary archive (egs: copy-feats scp:feats.scp ark:-), "
+      "weights are quantized with one scale per output channel\n"
+      "\n"
+      "Usage: quantize-tdnn <tdnn-param> <tdnn-context> <feats-ark> "
+      "<quantized-param>\n"
+      "  egs: quantize-tdnn final.param \"-2,-1,0,1,2;0;-1,0,2;-3,0,3;0;0\" "
+      "feats.ark final.int8.param\n";
+
+  if (argc != 5) {
+    std::cerr << usage;
+    return 1;
+  }
+  Tdnn tdnn(argv[1], argv[2]);
+  BinaryInput bi(argv[3]);
+  std::string key;
+  Int32 num_rows, num_cols, num_utts = 0;
+  Int32 left = tdnn.LeftContext(), right = tdnn.RightContext();
+  std::vector<Float32> feats;
+  while (ReadMatrixInArchive(bi.Stream(), &key, &num_rows, &num_cols)) {
+    if (num_cols != tdnn.InputDim())
+      LOG_FAIL << "Dimention of features mismatch for " << key << ": "
+               << num_cols << " vs " << tdnn.InputDim();
+    // pad first/last frame as context
+    feats.resize((left + num_rows + right) * num_cols);
+    ReadBinary(bi.Stream(), reinterpret_cast<char *>(feats.data()) +
+                                sizeof(Float32) * left * num_cols,
+               sizeof(Float32) * num_rows * num_cols);
+    if (!num_rows) continue;
+    for (Int32 t = 0; t < left; t++)
+      std::copy(feats.begin() + left * num_cols,
+                feats.begin() + (left + 1) * num_cols,
+                feats.begin() + t * num_cols);
+    for (Int32 t = left + num_rows; t < left + num_rows + right; t++)
+      std::copy(feats.begin() + (left + num_rows - 1) * num_cols,
+                feats.begin() + (left + num_rows) * num_cols,
+                feats.begin() + t * num_cols);
+    tdnn.Calibrate(feats.data(), num_cols, num_rows);
+    num_utts++;
+  }
+  if (!num_utts) LOG_WARN << "No features in " << argv[3] << ", input scales "
+                          << "would be worked out on each call";
+  tdnn.Quantize();
+  tdnn.Write(argv[4]);
+  LOG_INFO << "Calibrate on " << num_utts << " utterances, write quantized "
+           << "parameters to " << argv[4];
+  return 0;
+}
@@ -0,0 +1,38 @@
+// wujian@2018
+
+#include "decoder/fst-reorder.h"
+
+int main(int argc, char const *argv[]) {
+  const char *usage =
+      "Renumber states of decode graph(output of copy-decode-graph) for "
+      "memory locality. States are ordered breadth first from the start "
+      "state, or by visit counts (\"state-id count\" per line, accumulated "
+      "by FasterDecoder::AccumulateActiveStates() on a dev set) if given. "
+      "Output is still in SimpleFst format, use convert-decode-graph to get "
+      "the mmap-able one\n"
+      "\n"
+      "Usage: reorder-decode-graph <simple-graph> <reordered-graph> "
+      "[<state-counts>]\n";
+
+  if (argc != 3 && argc != 4) {
+    std::cerr << usage;
+    return 1;
+  }
+  Timer timer;
+  SimpleFst fst;
+  ReadSimpleFst(argv[1], &fst);
+  std::vector<StateId> order;
+  if (argc == 4) {
+    std::vector<UInt64> counts;
+    ReadStateCounts(argv[3], fst.NumStates(), &counts);
+    FrequencyStateOrder(fst, counts, &order);
+  } else {
+    BfsStateOrder(fst, &order);
+  }
+  ReorderStates(order, &fst);
+  BinaryOutput bo(argv[2]);
+  fst.Write(bo.Stream());
+  LOG_INFO << "Reorder " << argv[1] << " => " << argv[2] << " done, cost "
+           << timer.Elapsed() << "s";
+  return 0;
+}